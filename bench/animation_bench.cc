@@ -0,0 +1,139 @@
+// Benchmarks of the animation system over a synthetic 64 joint skeleton. These report how many
+// joints per second AnimationClip::Sample decodes, and how many joints per second Animator::Update
+// poses for a crowd of characters blending two clips with 1, 2, 4, and so on up to one thread per
+// core, along with how much the clips were compressed. No OpenGL context is needed. Pass a
+// substring to only run the benchmarks whose names contain it.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "microbench.h"
+
+#include "gfx/animation_clip.h"
+#include "gfx/animator.h"
+#include "gfx/job_system.h"
+#include "gfx/skeleton.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const float kPi = 3.1415926535897932384626433832795f;
+
+// The joints of the skeleton, split into chains hanging off of the root.
+const unsigned int kJoints = 64;
+const unsigned int kChainLength = 9;
+// The frames and frame rate the clips are sampled at.
+const unsigned int kFrames = 121;
+const float kFrameRate = 30.0f;
+// The number of characters in the crowd.
+const unsigned int kCharacters = 512;
+
+// Builds a skeleton of chains of joints spreading out from a root.
+gfx::Skeleton CreateSkeleton() {
+  std::vector<unsigned int> parents;
+  gfx::Pose bind_pose(kJoints);
+  for (unsigned int joint = 0; joint < kJoints; joint++) {
+    bool is_chain_start = joint % kChainLength == 1;
+    parents.push_back(joint == 0 ? gfx::JOINT_NO_PARENT : (is_chain_start ? 0 : joint - 1));
+    float angle = 0.9f * (float)(joint / kChainLength);
+    glm::vec3 offset = is_chain_start ?
+        glm::vec3(0.2f * std::cos(angle), 0.1f, 0.2f * std::sin(angle)) :
+        glm::vec3(0.0f, 0.15f, 0.0f);
+    bind_pose.SetJoint(joint, joint == 0 ? glm::vec3(0.0f, 1.0f, 0.0f) : offset,
+        glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+  }
+  return gfx::Skeleton(parents, bind_pose);
+}
+
+// Samples an animation where the root bobs and every joint rotates on a few sine waves, with some
+// joints holding still like the fingers of a character mostly do, and compresses it.
+gfx::AnimationClip* CreateClip(gfx::Skeleton* skeleton, float frequency) {
+  std::vector<gfx::Pose> frames;
+  for (unsigned int frame = 0; frame < kFrames; frame++) {
+    float phase = 2.0f * kPi * frequency * (float)frame / (float)(kFrames - 1);
+    gfx::Pose pose = skeleton->GetBindPose();
+    pose.SetJoint(0, glm::vec3(0.0f, 1.0f + 0.05f * std::sin(2.0f * phase), 0.0f),
+        glm::angleAxis(0.1f * std::sin(phase), glm::vec3(0.0f, 1.0f, 0.0f)),
+        glm::vec3(1.0f, 1.0f, 1.0f));
+    for (unsigned int joint = 1; joint < kJoints; joint++) {
+      if (joint % 5 == 0) {
+        continue;
+      }
+      float angle = 0.5f * std::sin(phase + 0.3f * (float)joint) +
+          0.1f * std::sin(3.0f * phase + (float)joint);
+      glm::vec3 axis = glm::normalize(glm::vec3(1.0f, 0.3f * (float)(joint % 3), 0.5f));
+      pose.SetJoint(joint, pose.GetTranslation(joint), glm::angleAxis(angle, axis),
+          pose.GetScale(joint));
+    }
+    frames.push_back(pose);
+  }
+  return new gfx::AnimationClip(frames, kFrameRate);
+}
+
+void BenchmarkAnimation(microbench::Runner* runner) {
+  gfx::Skeleton skeleton = CreateSkeleton();
+  std::unique_ptr<gfx::AnimationClip> walk(CreateClip(&skeleton, 1.0f));
+  std::unique_ptr<gfx::AnimationClip> wave(CreateClip(&skeleton, 2.0f));
+  size_t raw_size = (size_t)kFrames * kJoints * 10 * sizeof(float);
+  std::cout << "Compressed " << kFrames << " frames of " << kJoints << " joints from " <<
+      raw_size / 1024 << " KB to " << walk->GetCompressedSize() / 1024 << " KB (" <<
+      walk->GetNumKeys() << " keys, " << (double)raw_size / (double)walk->GetCompressedSize() <<
+      "x)" << std::endl;
+
+  gfx::Pose pose(kJoints);
+  float time = 0.0f;
+  runner->Run("animation_sample/" + std::to_string(kJoints) + "_joints", (double)kJoints,
+      "joints", [&walk, &pose, &time]() {
+    walk->Sample(time, &pose);
+    time += 0.013f;
+    microbench::Consume(pose.blocks[0].translations[1][0]);
+  });
+
+  // The calling thread runs jobs too, so a job system with n - 1 workers poses on n threads.
+  gfx::Animator animator;
+  for (unsigned int i = 0; i < kCharacters; i++) {
+    animator.AddCharacter(&skeleton);
+  }
+  unsigned int max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  for (unsigned int threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+    gfx::JobSystem job_system(threads - 1);
+    float crowd_time = 0.0f;
+    auto update = [&animator, &walk, &wave, &job_system, &crowd_time]() {
+      for (unsigned int i = 0; i < kCharacters; i++) {
+        float time = crowd_time + 0.1f * (float)i;
+        animator.SetLayer(i, 0, walk.get(), time, 1.0f);
+        animator.SetLayer(i, 1, wave.get(), time, 0.5f + 0.5f * std::sin(time));
+      }
+      animator.Update(&job_system);
+      crowd_time += 1.0f / 60.0f;
+      microbench::Consume(animator.GetPalette(kCharacters - 1)[0].x);
+    };
+    runner->Run("animator_update/" + std::to_string(kCharacters) + "_characters_" +
+        std::to_string(threads) + "_threads", (double)kCharacters * kJoints, "joints", update);
+    if (threads == max_threads) {
+      break;
+    }
+  }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  microbench::Runner runner(argc > 1 ? argv[1] : "");
+  try {
+    BenchmarkAnimation(&runner);
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+// Benchmarks of the ambient occlusion baker, which report how many rays per second it traces, and
+// of building the Bvh it traces them through. The bakes are of the sculpture and the drawers from
+// the bundled assets, so run this from a directory with the assets. The sculpture was exported
+// with an older layout of the .eo format that has six map paths instead of five, so a copy of its
+// geometry in the current layout is written to the working directory (and removed afterwards). No
+// OpenGL context is needed. Pass a substring to only run the benchmarks whose names contain it.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "microbench.h"
+
+#include "gfx/ao_baker.h"
+#include "gfx/bvh.h"
+#include "gfx/job_system.h"
+#include "gfx/model_info.h"
+#include "gfx/texture_manager.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const std::string kSculpturePath = "assets/sculpture/sculpture.eo";
+const std::string kConvertedSculpturePath = "ao_bench_sculpture.eo";
+const std::string kDrawersPath = "assets/drawers/drawers.eo";
+
+// The number of map paths in the older layout of the .eo format.
+const int kLegacyMapPaths = 6;
+
+// The settings of the bakes.
+const gfx::AoBakeSettings kSettings[] = {{256, 256, 64, 0.0f, 4}, {1024, 1024, 16, 0.0f, 4}};
+
+// Reads a model in the older layout of the .eo format and writes its geometry without maps in the
+// current one. Returns false if it can't be read.
+bool ConvertLegacyModel(const std::string& legacy_path, const std::string& path) {
+  std::ifstream input_file(legacy_path, std::ios::binary);
+  char shader_type_value;
+  if (!input_file.read(&shader_type_value, 1)) {
+    return false;
+  }
+  for (int i = 0; i < kLegacyMapPaths; i++) {
+    char num_chars;
+    input_file.read(&num_chars, 1);
+    input_file.ignore(num_chars);
+  }
+  size_t num_vertices;
+  input_file.read((char*)(&num_vertices), sizeof(size_t));
+  if (!input_file || num_vertices > (1u << 26)) {
+    return false;
+  }
+  std::vector<gfx::Vertex> vertices(num_vertices);
+  input_file.read((char*)(vertices.data()), sizeof(gfx::Vertex) * num_vertices);
+  size_t num_indices;
+  input_file.read((char*)(&num_indices), sizeof(size_t));
+  if (!input_file || num_indices > (1u << 28)) {
+    return false;
+  }
+  std::vector<GLuint> indices(num_indices);
+  input_file.read((char*)(indices.data()), sizeof(GLuint) * num_indices);
+  if ((size_t)input_file.gcount() != sizeof(GLuint) * num_indices ||
+      input_file.get() != EOF || (size_t)shader_type_value >= gfx::shader_map.size()) {
+    return false;
+  }
+
+  gfx::ModelInfo::EOFileData data;
+  data.shader_type = gfx::shader_map[(size_t)shader_type_value];
+  data.vertices = &vertices;
+  data.indices = &indices;
+  gfx::ModelInfo::WriteEOFile(path, data);
+  return true;
+}
+
+// Benchmarks building the Bvh of a model and baking it at each of the settings.
+void BenchmarkModel(microbench::Runner* runner, gfx::JobSystem* job_system,
+    const std::string& name, const std::string& path) {
+  gfx::TextureManager texture_manager(false);
+  gfx::ModelInfo model_info(path, &texture_manager, false);
+  gfx::AoBaker baker(&model_info, job_system);
+  std::cout << "bvh/" << name << ": " << baker.GetBvh()->GetNumNodes() << " nodes over " <<
+      baker.GetBvh()->GetNumTriangles() << " triangles" << std::endl;
+  runner->Run("bvh/" + name, (double)baker.GetBvh()->GetNumTriangles(), "triangles",
+      [&model_info]() {
+    gfx::Bvh bvh(&model_info);
+    microbench::Consume(bvh.GetNumNodes());
+  });
+
+  for (const gfx::AoBakeSettings& settings : kSettings) {
+    auto bake = [&baker, &settings]() {
+      microbench::Consume(baker.Bake(settings)[0]);
+    };
+    bake();
+    std::string full_name = "ao_bake/" + name + "_" + std::to_string(settings.width) + "x" +
+        std::to_string(settings.height) + "_" + std::to_string(settings.rays_per_texel);
+    std::cout << full_name << ": " << baker.GetRaysTraced() << " rays on " <<
+        job_system->GetNumThreads() << " threads" << std::endl;
+    runner->Run(full_name, (double)baker.GetRaysTraced(), "rays", bake);
+  }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  microbench::Runner runner(argc > 1 ? argv[1] : "");
+  try {
+    gfx::JobSystem job_system(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    if (ConvertLegacyModel(kSculpturePath, kConvertedSculpturePath)) {
+      BenchmarkModel(&runner, &job_system, "sculpture", kConvertedSculpturePath);
+    } else {
+      std::cout << "Skipping unreadable model \'" << kSculpturePath << "\'." << std::endl;
+    }
+    BenchmarkModel(&runner, &job_system, "drawers", kDrawersPath);
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+  }
+  std::remove(kConvertedSculpturePath.c_str());
+  return 0;
+}
@@ -0,0 +1,174 @@
+// Checks that asset packs round trip and that packs with a corrupt table of contents are rejected
+// with an InvalidAssetPackException when they're opened, rather than crashing or failing to
+// allocate when their assets are read. Packs of synthetic assets are written to the working
+// directory (and removed afterwards), then copies of one with single fields of its table of
+// contents overwritten are opened.
+//
+// Usage: asset_pack_check
+//
+// The exit status is nonzero if any check fails, so this can run as a test.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "gfx/asset_pack.h"
+#include "gfx/exceptions.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::string kCompressiblePath = "asset_pack_check_compressible.bin";
+const std::string kIncompressiblePath = "asset_pack_check_incompressible.bin";
+const std::string kZeroPath = "asset_pack_check_zero.bin";
+const std::string kPackPath = "asset_pack_check.pack";
+const std::string kCorruptPackPath = "asset_pack_check_corrupt.pack";
+
+// The layout of the table of contents, as written by AssetPack::Write.
+const size_t kHeaderSize = 32;
+const size_t kNumEntriesOffset = 8;
+const size_t kNumSlotsOffset = 12;
+const size_t kEntrySize = 48;
+const size_t kEntryOffsetOffset = 8;
+const size_t kEntryStoredSizeOffset = 16;
+const size_t kEntrySizeOffset = 24;
+const size_t kEntryFlagsOffset = 40;
+
+int num_failures = 0;
+
+std::vector<unsigned char> ReadFile(const std::string& path) {
+  std::ifstream ifs(path, std::ios::binary);
+  return std::vector<unsigned char>(std::istreambuf_iterator<char>(ifs),
+      std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const std::string& path, const std::vector<unsigned char>& contents) {
+  std::ofstream ofs(path, std::ios::binary);
+  ofs.write((const char*)contents.data(), contents.size());
+}
+
+void Check(bool condition, const std::string& name) {
+  std::cout << (condition ? "PASS " : "FAIL ") << name << std::endl;
+  if (!condition) {
+    num_failures++;
+  }
+}
+
+// Gets the offset of the first entry whose flags have some value in a pack's contents.
+size_t FindEntry(const std::vector<unsigned char>& pack, uint32_t flags) {
+  uint32_t num_entries;
+  uint32_t num_slots;
+  std::memcpy(&num_entries, pack.data() + kNumEntriesOffset, sizeof(uint32_t));
+  std::memcpy(&num_slots, pack.data() + kNumSlotsOffset, sizeof(uint32_t));
+  size_t entries_offset = (kHeaderSize + sizeof(uint32_t) * num_slots + 7) / 8 * 8;
+  for (uint32_t i = 0; i < num_entries; i++) {
+    size_t entry_offset = entries_offset + i * kEntrySize;
+    uint32_t entry_flags;
+    std::memcpy(&entry_flags, pack.data() + entry_offset + kEntryFlagsOffset, sizeof(uint32_t));
+    if (entry_flags == flags) {
+      return entry_offset;
+    }
+  }
+  std::cerr << "ERROR: The pack has no entry with flags " << flags << "." << std::endl;
+  std::exit(EXIT_FAILURE);
+}
+
+// Writes a copy of the pack with a field overwritten, and checks that opening it and reading all
+// of its assets throws an InvalidAssetPackException and nothing else.
+template <typename T>
+void CheckCorruption(const std::vector<unsigned char>& pack, size_t offset, T value,
+    const std::string& name) {
+  std::vector<unsigned char> corrupt_pack = pack;
+  std::memcpy(corrupt_pack.data() + offset, &value, sizeof(T));
+  WriteFile(kCorruptPackPath, corrupt_pack);
+  bool is_rejected = false;
+  try {
+    gfx::AssetPack corrupt(kCorruptPackPath);
+    gfx::AssetData asset;
+    corrupt.Read(kCompressiblePath, &asset);
+    corrupt.Read(kIncompressiblePath, &asset);
+  } catch (const gfx::InvalidAssetPackException&) {
+    is_rejected = true;
+  } catch (const std::exception& e) {
+    std::cout << "  threw " << e.what() << std::endl;
+  }
+  Check(is_rejected, "rejects " + name);
+}
+
+}
+
+int main() {
+  std::vector<unsigned char> compressible;
+  for (int i = 0; i < 4096; i++) {
+    compressible.push_back((unsigned char)("asset pack "[i % 11]));
+  }
+  std::vector<unsigned char> incompressible;
+  uint32_t state = 1;
+  for (int i = 0; i < 4096; i++) {
+    state = state * 1664525 + 1013904223;
+    incompressible.push_back((unsigned char)(state >> 24));
+  }
+  WriteFile(kCompressiblePath, compressible);
+  WriteFile(kIncompressiblePath, incompressible);
+  std::vector<unsigned char> zero(1 << 20, 0);
+  WriteFile(kZeroPath, zero);
+
+  try {
+    gfx::AssetPackStats stats = gfx::AssetPack::Write(kPackPath,
+        {kCompressiblePath, kIncompressiblePath}, true);
+    Check(stats.num_entries == 2 && stats.num_compressed == 1, "compresses only when worth it");
+    {
+      gfx::AssetPack pack(kPackPath);
+      gfx::AssetData asset;
+      Check(pack.Read(kCompressiblePath, &asset) &&
+          std::vector<unsigned char>(asset.data, asset.data + asset.size) == compressible,
+          "round trips compressed assets");
+      Check(pack.Read(kIncompressiblePath, &asset) &&
+          std::vector<unsigned char>(asset.data, asset.data + asset.size) == incompressible,
+          "round trips stored assets");
+      Check(!pack.Read("missing.bin", &asset), "misses assets it doesn't contain");
+    }
+    {
+      // Runs of one byte compress about as far as LZ4 can, so they're within the bound on sizes.
+      gfx::AssetPack::Write(kPackPath, {kZeroPath}, true);
+      gfx::AssetPack pack(kPackPath);
+      gfx::AssetData asset;
+      Check(pack.Read(kZeroPath, &asset) &&
+          std::vector<unsigned char>(asset.data, asset.data + asset.size) == zero,
+          "round trips maximally compressed assets");
+    }
+
+    gfx::AssetPack::Write(kPackPath, {kCompressiblePath, kIncompressiblePath}, true);
+    std::vector<unsigned char> pack = ReadFile(kPackPath);
+    size_t compressed_entry = FindEntry(pack, 1);
+    size_t stored_entry = FindEntry(pack, 0);
+    CheckCorruption(pack, compressed_entry + kEntrySizeOffset, (uint64_t)1 << 60,
+        "compressed sizes beyond the maximum expansion");
+    CheckCorruption(pack, stored_entry + kEntrySizeOffset, (uint64_t)1 << 60,
+        "stored sizes that don't match");
+    CheckCorruption(pack, compressed_entry + kEntryOffsetOffset, (uint64_t)pack.size() + 1,
+        "offsets past the end");
+    CheckCorruption(pack, compressed_entry + kEntryStoredSizeOffset, (uint64_t)pack.size(),
+        "stored sizes past the end");
+    CheckCorruption(pack, kHeaderSize, (uint32_t)3, "slots past the entries");
+    CheckCorruption(pack, kNumSlotsOffset, (uint32_t)3, "slot counts that aren't powers of two");
+    CheckCorruption(pack, 0, (uint32_t)0, "bad magic");
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    num_failures++;
+  }
+
+  std::remove(kCompressiblePath.c_str());
+  std::remove(kIncompressiblePath.c_str());
+  std::remove(kZeroPath.c_str());
+  std::remove(kPackPath.c_str());
+  std::remove(kCorruptPackPath.c_str());
+  return num_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,302 @@
+// Microbenchmarks for the CPU paths that dominate load and update times: parsing .eo models
+// (loose and out of asset packs), decoding textures and HDR environments, updating ModelInstance
+// transforms, generating the Hammersley points, and culling, keying, and sorting the draw list.
+// None of them need an OpenGL context. They run over the bundled assets and over synthetic ones
+// written to the working directory (and removed afterwards), so run this from a directory with the
+// assets. Pass a substring to only run the benchmarks whose names contain it.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "microbench.h"
+
+#include "gfx/asset_pack.h"
+#include "gfx/constants.h"
+#include "gfx/draw_list.h"
+#include "gfx/environment.h"
+#include "gfx/mesh.h"
+#include "gfx/model_info.h"
+#include "gfx/model_instance.h"
+#include "gfx/texture_manager.h"
+#include "gfx/util.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::string kSyntheticModelPath = "cpu_bench_synthetic.eo";
+const std::string kSyntheticEnvironmentPath = "cpu_bench_synthetic.hdr";
+const std::string kSyntheticPackPath = "cpu_bench_synthetic.pack";
+const char* const kModelPaths[] = {"assets/primitives/box_no_maps.eo",
+    "assets/primitives/sphere_no_maps.eo", "assets/drawers/drawers.eo",
+    kSyntheticModelPath.c_str()};
+const char* const kTexturePaths[] = {"assets/box_albedo.png", "assets/drawers/drawers_albedo.png",
+    "assets/drawers/drawers_normal.png", "assets/sculpture/sculpture_albedo.tga"};
+const char* const kSpherePath = "assets/primitives/sphere_no_maps.eo";
+
+// The number of vertices along each side of the synthetic model's grid.
+const unsigned int kSyntheticGridSize = 512;
+// The size of the synthetic environment.
+const int kSyntheticEnvironmentWidth = 1024;
+const int kSyntheticEnvironmentHeight = 512;
+// The number of ModelInstances updated by the update benchmark.
+const unsigned int kInstances = 10000;
+// The number of draws culled, keyed, and sorted by the draw list benchmarks.
+const unsigned int kDraws = 100000;
+// The number of distinct models the draws are spread over.
+const unsigned int kModels = 64;
+
+// Mirrors the layout of the GameWindow's draw commands, so sorting moves as much memory.
+struct DrawCommand {
+  uint64_t sort_key;
+  void* model_instance;
+  void* environment;
+  size_t instance_offset;
+  bool visible;
+};
+
+// Gets the size of a file in bytes, or 0 if it can't be opened.
+size_t GetFileSize(const std::string& path) {
+  std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+  return ifs ? (size_t)ifs.tellg() : 0;
+}
+
+// Gets a deterministic pseudo-random number in [0, 1).
+float Random(uint32_t* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return (float)(*state >> 8) / 16777216.0f;
+}
+
+// Writes a Cook-Torrance model without maps holding a kSyntheticGridSize squared vertex grid.
+void WriteSyntheticModel() {
+  std::vector<gfx::Vertex> vertices;
+  std::vector<GLuint> indices;
+  for (unsigned int y = 0; y < kSyntheticGridSize; y++) {
+    for (unsigned int x = 0; x < kSyntheticGridSize; x++) {
+      glm::vec2 uv((float)x / (kSyntheticGridSize - 1), (float)y / (kSyntheticGridSize - 1));
+      vertices.push_back(gfx::Vertex{glm::vec3(uv.x, 0.1f * std::sin(10.0f * uv.x), uv.y),
+          glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), uv});
+      if (x + 1 < kSyntheticGridSize && y + 1 < kSyntheticGridSize) {
+        GLuint corner = y * kSyntheticGridSize + x;
+        GLuint quad[] = {corner, corner + kSyntheticGridSize, corner + 1, corner + 1,
+            corner + kSyntheticGridSize, corner + kSyntheticGridSize + 1};
+        indices.insert(indices.end(), quad, quad + 6);
+      }
+    }
+  }
+  std::ofstream ofs(kSyntheticModelPath, std::ios::binary);
+  const char header[] = {1, 0, 0, 0, 0, 0};
+  ofs.write(header, sizeof(header));
+  size_t num_vertices = vertices.size();
+  ofs.write((const char*)&num_vertices, sizeof(size_t));
+  ofs.write((const char*)vertices.data(), sizeof(gfx::Vertex) * num_vertices);
+  size_t num_indices = indices.size();
+  ofs.write((const char*)&num_indices, sizeof(size_t));
+  ofs.write((const char*)indices.data(), sizeof(GLuint) * num_indices);
+}
+
+// Writes a Radiance HDR environment with a sky gradient and a bright sun.
+void WriteSyntheticEnvironment() {
+  std::vector<float> pixels;
+  for (int y = 0; y < kSyntheticEnvironmentHeight; y++) {
+    for (int x = 0; x < kSyntheticEnvironmentWidth; x++) {
+      float t = 1.0f - (float)y / kSyntheticEnvironmentHeight;
+      float sun = std::abs(x - 256) < 12 && std::abs(y - 120) < 12 ? 50.0f : 0.0f;
+      pixels.push_back(0.2f + 0.6f * t + sun);
+      pixels.push_back(0.3f + 0.6f * t + sun);
+      pixels.push_back(0.5f + 0.8f * t + sun);
+    }
+  }
+  stbi_write_hdr(kSyntheticEnvironmentPath.c_str(), kSyntheticEnvironmentWidth,
+      kSyntheticEnvironmentHeight, 3, pixels.data());
+}
+
+void BenchmarkModelParsing(microbench::Runner* runner) {
+  for (const char* path : kModelPaths) {
+    size_t size = GetFileSize(path);
+    if (size == 0) {
+      std::cout << "Skipping missing model \'" << path << "\'." << std::endl;
+      continue;
+    }
+    runner->Run(std::string("eo_parse/") + path, (double)size, "B", [path]() {
+      gfx::ModelInfo::EOFileData data = gfx::ModelInfo::ReadEOFile(path);
+      microbench::Consume((double)data.vertices->size());
+      delete data.vertices;
+      delete data.indices;
+    });
+  }
+}
+
+void BenchmarkAssetPack(microbench::Runner* runner) {
+  std::vector<std::string> model_paths;
+  for (const char* path : kModelPaths) {
+    if (GetFileSize(path) != 0) {
+      model_paths.push_back(path);
+    }
+  }
+  for (bool should_compress : {false, true}) {
+    gfx::AssetPackStats stats = gfx::AssetPack::Write(kSyntheticPackPath, model_paths,
+        should_compress);
+    std::string mode = should_compress ? "compressed" : "stored";
+    runner->Run("pack_open/" + mode, (double)stats.num_entries, "assets", []() {
+      gfx::AssetPack pack(kSyntheticPackPath);
+      microbench::Consume((double)pack.GetNumEntries());
+    });
+    gfx::AssetPack pack(kSyntheticPackPath);
+    gfx::AssetPack::Mount(&pack);
+    for (const std::string& path : model_paths) {
+      runner->Run("eo_parse_" + mode + "/" + path, (double)GetFileSize(path), "B",
+          [&path]() {
+        gfx::ModelInfo::EOFileData data = gfx::ModelInfo::ReadEOFile(path);
+        microbench::Consume((double)data.vertices->size());
+        delete data.vertices;
+        delete data.indices;
+      });
+    }
+    gfx::AssetPack::Unmount(&pack);
+  }
+}
+
+void BenchmarkTextureDecoding(microbench::Runner* runner) {
+  for (const char* path : kTexturePaths) {
+    int width, height, num_components;
+    unsigned char* image_data = gfx::TextureManager::DecodeImage(path, &width, &height,
+        &num_components);
+    if (image_data == nullptr) {
+      std::cout << "Skipping undecodable texture \'" << path << "\'." << std::endl;
+      continue;
+    }
+    gfx::TextureManager::FreeImage(image_data);
+    runner->Run(std::string("texture_decode/") + path, (double)width * height, "pixels",
+        [path]() {
+      int width, height, num_components;
+      unsigned char* image_data = gfx::TextureManager::DecodeImage(path, &width, &height,
+          &num_components);
+      microbench::Consume(image_data[0]);
+      gfx::TextureManager::FreeImage(image_data);
+    });
+  }
+}
+
+void BenchmarkEnvironmentDecoding(microbench::Runner* runner) {
+  runner->Run("hdr_decode/synthetic_1024x512",
+      (double)kSyntheticEnvironmentWidth * kSyntheticEnvironmentHeight, "pixels", []() {
+    int width, height, num_components;
+    float* image_data = gfx::Environment::DecodeImage(kSyntheticEnvironmentPath, &width, &height,
+        &num_components);
+    microbench::Consume(image_data[0]);
+    gfx::Environment::FreeImage(image_data);
+  });
+}
+
+void BenchmarkModelInstanceUpdate(microbench::Runner* runner) {
+  gfx::TextureManager texture_manager;
+  gfx::ModelInfo sphere(kSpherePath, &texture_manager, false);
+  std::vector<gfx::ModelInstance> instances;
+  instances.reserve(kInstances);
+  uint32_t state = 1;
+  for (unsigned int i = 0; i < kInstances; i++) {
+    glm::vec3 position(Random(&state) * 100.0f, Random(&state) * 10.0f, Random(&state) * 100.0f);
+    glm::quat rotation = glm::angleAxis(Random(&state) * 6.283f,
+        glm::normalize(glm::vec3(Random(&state), 1.0f, Random(&state))));
+    instances.emplace_back(&sphere, position, glm::vec3(0.5f + Random(&state)), rotation,
+        gfx::Color(1.0f, 1.0f, 1.0f));
+  }
+  runner->Run("model_instance_update/10k", (double)kInstances, "instances", [&instances]() {
+    for (gfx::ModelInstance& instance : instances) {
+      instance.position.y += 0.001f;
+      instance.Update();
+    }
+    microbench::Consume(instances.back().GetBoundsRadius());
+  });
+}
+
+void BenchmarkHammersleyPoints(microbench::Runner* runner) {
+  runner->Run("hammersley_points/ibl_samples", (double)gfx::NUM_IBL_SAMPLES, "points", []() {
+    float sum = 0.0f;
+    for (unsigned int i = 0; i < gfx::NUM_IBL_SAMPLES; i++) {
+      glm::vec2 point = gfx::util::GetHammersleyPoint(i, gfx::NUM_IBL_SAMPLES);
+      sum += point.x + point.y;
+    }
+    microbench::Consume(sum);
+  });
+}
+
+void BenchmarkDrawList(microbench::Runner* runner) {
+  // Bounding spheres scattered around a camera looking down the -z axis, so about a fifth of them
+  // are visible.
+  std::vector<glm::vec4> spheres;
+  uint32_t state = 7;
+  for (unsigned int i = 0; i < kDraws; i++) {
+    spheres.push_back(glm::vec4(Random(&state) * 400.0f - 200.0f, Random(&state) * 100.0f - 50.0f,
+        Random(&state) * 400.0f - 200.0f, 0.5f + Random(&state) * 2.0f));
+  }
+  // The keys only hash the model pointers, so they don't need to point at real models.
+  std::vector<char> models(kModels);
+  glm::mat4 view_transform = glm::lookAt(glm::vec3(0.0f, 5.0f, 0.0f),
+      glm::vec3(0.0f, 5.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, gfx::NEAR_PLANE,
+      gfx::FAR_PLANE);
+
+  runner->Run("draw_list/frustum_cull_100k", (double)kDraws, "spheres", [&]() {
+    gfx::Frustum frustum(projection * view_transform);
+    unsigned int visible = 0;
+    for (const glm::vec4& sphere : spheres) {
+      visible += frustum.IntersectsSphere(glm::vec3(sphere), sphere.w);
+    }
+    microbench::Consume(visible);
+  });
+
+  std::vector<DrawCommand> commands(kDraws);
+  runner->Run("draw_list/sort_keys_100k", (double)kDraws, "keys", [&]() {
+    for (unsigned int i = 0; i < kDraws; i++) {
+      gfx::ModelInfo* model_info = (gfx::ModelInfo*)&models[i % kModels];
+      commands[i].sort_key = gfx::ComputeDrawSortKey(view_transform, glm::vec3(spheres[i]),
+          model_info, true);
+    }
+    microbench::Consume((double)commands.back().sort_key);
+  });
+
+  // Sorting copies the unsorted commands first, like each frame rebuilds the draw list.
+  std::vector<DrawCommand> draw_list;
+  runner->Run("draw_list/stable_sort_100k", (double)kDraws, "draws", [&]() {
+    draw_list = commands;
+    std::stable_sort(draw_list.begin(), draw_list.end(),
+        [](const DrawCommand& a, const DrawCommand& b) { return a.sort_key < b.sort_key; });
+    microbench::Consume((double)draw_list.front().sort_key);
+  });
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  WriteSyntheticModel();
+  WriteSyntheticEnvironment();
+  microbench::Runner runner(argc > 1 ? argv[1] : "");
+  try {
+    BenchmarkModelParsing(&runner);
+    BenchmarkAssetPack(&runner);
+    BenchmarkTextureDecoding(&runner);
+    BenchmarkEnvironmentDecoding(&runner);
+    BenchmarkModelInstanceUpdate(&runner);
+    BenchmarkHammersleyPoints(&runner);
+    BenchmarkDrawList(&runner);
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+  }
+  std::remove(kSyntheticModelPath.c_str());
+  std::remove(kSyntheticEnvironmentPath.c_str());
+  std::remove(kSyntheticPackPath.c_str());
+  return 0;
+}
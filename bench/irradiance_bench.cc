@@ -0,0 +1,98 @@
+// Benchmarks of baking an IrradianceVolume over the drawers, which report how many rays per second
+// the bake traces with 1, 2, 4, and so on up to one thread per core, so it can be checked that the
+// bake time scales with the cores. The environment is synthetic and written to the working
+// directory (and removed afterwards), and the drawers come from the bundled assets, so run this
+// from a directory with the assets. No OpenGL context is needed. Pass a substring to only run the
+// benchmarks whose names contain it.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "microbench.h"
+
+#include "gfx/environment.h"
+#include "gfx/irradiance_volume.h"
+#include "gfx/job_system.h"
+#include "gfx/model_info.h"
+#include "gfx/model_instance.h"
+#include "gfx/texture_manager.h"
+
+#include <glm/glm.hpp>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const std::string kSyntheticEnvironmentPath = "irradiance_bench_synthetic.hdr";
+const std::string kDrawersPath = "assets/drawers/drawers.eo";
+
+// The size of the synthetic environment.
+const int kSyntheticEnvironmentWidth = 1024;
+const int kSyntheticEnvironmentHeight = 512;
+// The probes along each axis of the volume and the rays traced per probe.
+const int kResolution = 8;
+const unsigned int kRaysPerProbe = 256;
+
+// Writes a Radiance HDR environment with a sky gradient and a bright sun.
+void WriteSyntheticEnvironment() {
+  std::vector<float> pixels;
+  for (int y = 0; y < kSyntheticEnvironmentHeight; y++) {
+    for (int x = 0; x < kSyntheticEnvironmentWidth; x++) {
+      float t = 1.0f - (float)y / kSyntheticEnvironmentHeight;
+      float sun = std::abs(x - 256) < 12 && std::abs(y - 120) < 12 ? 50.0f : 0.0f;
+      pixels.push_back(0.2f + 0.6f * t + sun);
+      pixels.push_back(0.3f + 0.6f * t + sun);
+      pixels.push_back(0.5f + 0.8f * t + sun);
+    }
+  }
+  stbi_write_hdr(kSyntheticEnvironmentPath.c_str(), kSyntheticEnvironmentWidth,
+      kSyntheticEnvironmentHeight, 3, pixels.data());
+}
+
+void BenchmarkDrawers(microbench::Runner* runner) {
+  gfx::TextureManager texture_manager(false);
+  gfx::ModelInfo drawers(kDrawersPath, &texture_manager, false);
+  gfx::ModelInstance instance(&drawers, glm::vec3(0.0f));
+  gfx::Environment environment(kSyntheticEnvironmentPath, 0.0f, false);
+  std::vector<gfx::ModelInstance*> instances = {&instance};
+  glm::vec3 radius(instance.GetBoundsRadius());
+  gfx::IrradianceVolume volume(instance.GetBoundsCenter() - radius,
+      instance.GetBoundsCenter() + radius, glm::ivec3(kResolution));
+
+  // The calling thread runs jobs too, so a job system with n - 1 workers bakes on n threads.
+  unsigned int max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  for (unsigned int threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+    gfx::JobSystem job_system(threads - 1);
+    auto bake = [&volume, &instances, &environment, &job_system]() {
+      volume.Bake(instances, &environment, kRaysPerProbe, &job_system);
+      microbench::Consume(volume.GetRaysTraced());
+    };
+    bake();
+    runner->Run("irradiance_bake/drawers_" + std::to_string(threads) + "_threads",
+        (double)volume.GetRaysTraced(), "rays", bake);
+    if (threads == max_threads) {
+      break;
+    }
+  }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  WriteSyntheticEnvironment();
+  microbench::Runner runner(argc > 1 ? argv[1] : "");
+  try {
+    BenchmarkDrawers(&runner);
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+  }
+  std::remove(kSyntheticEnvironmentPath.c_str());
+  return 0;
+}
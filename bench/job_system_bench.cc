@@ -0,0 +1,112 @@
+// Microbenchmarks for the job system. These measure the overhead of scheduling an empty job, of
+// scheduling a job behind a dependency, and how ParallelFor scales from one thread up to every
+// core on the machine.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "gfx/job_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// The number of jobs scheduled by the overhead benchmarks.
+const size_t kOverheadJobs = 100000;
+// The number of elements and the grain size of the scaling benchmark.
+const size_t kScalingElements = 1 << 22;
+const size_t kScalingGrainSize = 4096;
+// The number of runs each result is the best of.
+const unsigned int kRuns = 5;
+
+// Times a function in milliseconds, returning the best of kRuns runs.
+template <typename Function>
+double TimeBest(Function function) {
+  double best = 0.0;
+  for (unsigned int i = 0; i < kRuns; i++) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    best = i == 0 ? elapsed.count() : std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+// Measures the cost per job of running kOverheadJobs empty jobs and waiting for them.
+double MeasureRunOverhead(gfx::JobSystem* job_system) {
+  double time = TimeBest([job_system]() {
+    gfx::JobCounter counter;
+    for (size_t i = 0; i < kOverheadJobs; i++) {
+      job_system->Run([]() {}, &counter);
+    }
+    job_system->Wait(&counter);
+  });
+  return time * 1000000.0 / kOverheadJobs;
+}
+
+// Measures the cost per job of running kOverheadJobs empty jobs that each wait on a dependency.
+double MeasureDependencyOverhead(gfx::JobSystem* job_system) {
+  double time = TimeBest([job_system]() {
+    gfx::JobCounter dependency;
+    gfx::JobCounter counter;
+    job_system->Run([]() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); },
+        &dependency);
+    for (size_t i = 0; i < kOverheadJobs; i++) {
+      job_system->Run([]() {}, &counter, &dependency);
+    }
+    job_system->Wait(&counter);
+  });
+  // Don't count the dependency's own sleep.
+  return (time - 1.0) * 1000000.0 / kOverheadJobs;
+}
+
+// Measures the time of a ParallelFor doing a few transcendental functions per element.
+double MeasureParallelFor(gfx::JobSystem* job_system, std::vector<float>* values) {
+  return TimeBest([job_system, values]() {
+    job_system->ParallelFor(values->size(), kScalingGrainSize, [values](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        float x = (float)i * 0.001f;
+        (*values)[i] = std::sqrt(std::sin(x) * std::sin(x) + std::cos(x * 0.5f));
+      }
+    });
+  });
+}
+
+}
+
+int main() {
+  unsigned int max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "Job system microbenchmarks (" << max_threads << " hardware threads)" << std::endl;
+
+  std::cout << std::endl << "Scheduler overhead (ns per empty job)" << std::endl;
+  std::cout << "threads        run  dependent" << std::endl;
+  for (unsigned int threads : {1u, max_threads}) {
+    gfx::JobSystem job_system(threads - 1);
+    std::cout << std::setw(7) << threads << std::setw(11) << MeasureRunOverhead(&job_system) <<
+        std::setw(11) << MeasureDependencyOverhead(&job_system) << std::endl;
+    if (max_threads == 1) {
+      break;
+    }
+  }
+
+  std::cout << std::endl << "ParallelFor scaling (" << kScalingElements << " elements, grain " <<
+      kScalingGrainSize << ")" << std::endl;
+  std::cout << "threads         ms    speedup" << std::endl;
+  std::vector<float> values(kScalingElements);
+  double single_thread_time = 0.0;
+  for (unsigned int threads = 1; threads <= max_threads; threads++) {
+    gfx::JobSystem job_system(threads - 1);
+    double time = MeasureParallelFor(&job_system, &values);
+    single_thread_time = threads == 1 ? time : single_thread_time;
+    std::cout << std::setw(7) << threads << std::setw(11) << time << std::setw(10) <<
+        std::setprecision(2) << single_thread_time / time << "x" << std::setprecision(1) <<
+        std::endl;
+  }
+  return 0;
+}
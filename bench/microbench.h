@@ -0,0 +1,118 @@
+// A small timing harness for the microbenchmarks. Each benchmark is first calibrated to run
+// enough iterations per sample to take at least kMinSampleTime, then timed over kSamples samples.
+// The time per iteration is summarized as the min, median, mean, and standard deviation over the
+// samples, and the throughput is computed from the median in the benchmark's own units.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_BENCH_MICROBENCH_H
+#define GFX_BENCH_MICROBENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace microbench {
+
+// The number of timed samples of each benchmark.
+const unsigned int kSamples = 15;
+// The minimum time in milliseconds of each sample.
+const double kMinSampleTime = 20.0;
+
+// Keeps the compiler from optimizing away the computation of a value.
+inline void Consume(double value) {
+  static volatile double sink;
+  sink = value;
+  (void)sink;
+}
+
+// Formats a time in seconds with a readable unit.
+inline std::string FormatTime(double seconds) {
+  const char* units[] = {"ns", "us", "ms", "s"};
+  double value = seconds * 1e9;
+  int unit = 0;
+  while (value >= 1000.0 && unit < 3) {
+    value /= 1000.0;
+    unit++;
+  }
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.3g %s", value, units[unit]);
+  return buffer;
+}
+
+// Formats an amount of work per second with an SI prefix, e.g. "1.23 M<unit>/s".
+inline std::string FormatThroughput(double per_second, const std::string& unit) {
+  const char* prefixes[] = {"", "k", "M", "G", "T"};
+  int prefix = 0;
+  while (per_second >= 1000.0 && prefix < 4) {
+    per_second /= 1000.0;
+    prefix++;
+  }
+  char buffer[64];
+  std::snprintf(buffer, sizeof(buffer), "%.3g %s%s/s", per_second, prefixes[prefix],
+      unit.c_str());
+  return buffer;
+}
+
+class Runner {
+  public:
+    // Constructor given a filter. Only the benchmarks whose names contain it are run.
+    Runner(std::string filter) : filter{filter} {
+      std::printf("%-48s %10s %10s %10s %10s %10s  %s\n", "benchmark", "iterations", "min",
+          "median", "mean", "stddev", "throughput");
+    }
+
+    // Runs a benchmark whose body does work units of the named unit (e.g. 1e6 and "B" for a
+    // megabyte) per iteration, and prints its results.
+    void Run(const std::string& name, double work, const std::string& unit,
+        std::function<void()> body) {
+      if (name.find(filter) == std::string::npos) {
+        return;
+      }
+      // Double the iterations until a sample is long enough. This also warms up the caches.
+      unsigned long iterations = 1;
+      while (TimeSample(body, iterations) < kMinSampleTime / 1000.0 && iterations < (1ul << 30)) {
+        iterations *= 2;
+      }
+      std::vector<double> times;
+      for (unsigned int i = 0; i < kSamples; i++) {
+        times.push_back(TimeSample(body, iterations) / (double)iterations);
+      }
+      std::sort(times.begin(), times.end());
+      double mean = 0.0;
+      for (double time : times) {
+        mean += time / (double)times.size();
+      }
+      double variance = 0.0;
+      for (double time : times) {
+        variance += (time - mean) * (time - mean) / (double)times.size();
+      }
+      double median = times[times.size() / 2];
+      std::printf("%-48s %10lu %10s %10s %10s %10s  %s\n", name.c_str(), iterations,
+          FormatTime(times.front()).c_str(), FormatTime(median).c_str(),
+          FormatTime(mean).c_str(), FormatTime(std::sqrt(variance)).c_str(),
+          FormatThroughput(work / median, unit).c_str());
+      std::fflush(stdout);
+    }
+
+  private:
+    // Only the benchmarks whose names contain this are run.
+    std::string filter;
+
+    // Times iterations runs of a body in seconds.
+    double TimeSample(const std::function<void()>& body, unsigned long iterations) {
+      auto start = std::chrono::steady_clock::now();
+      for (unsigned long i = 0; i < iterations; i++) {
+        body();
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      return elapsed.count();
+    }
+};
+
+}
+#endif // GFX_BENCH_MICROBENCH_H
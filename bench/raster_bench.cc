@@ -0,0 +1,136 @@
+// Benchmarks of the CPU reference rasterizer, which report how many megapixels per second it
+// renders. The scenes match those of the scene benchmark: the drawers with all of their maps and a
+// grid of spheres ranging from dielectric to metallic, each lit by a point light and an HDR
+// environment. The environment is synthetic and written to the working directory (and removed
+// afterwards), and the models come from the bundled assets, so run this from a directory with the
+// assets. No OpenGL context is needed. Pass a substring to only run the benchmarks whose names
+// contain it.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "microbench.h"
+
+#include "gfx/camera.h"
+#include "gfx/color.h"
+#include "gfx/cpu_renderer.h"
+#include "gfx/environment.h"
+#include "gfx/model_info.h"
+#include "gfx/model_instance.h"
+#include "gfx/point_light.h"
+#include "gfx/texture_manager.h"
+
+#include <glm/glm.hpp>
+#include <stb_image_write.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::string kSyntheticEnvironmentPath = "raster_bench_synthetic.hdr";
+const std::string kDrawersPath = "assets/drawers/drawers.eo";
+const std::string kSpherePath = "assets/primitives/sphere_no_maps.eo";
+
+// The size of the synthetic environment.
+const int kSyntheticEnvironmentWidth = 1024;
+const int kSyntheticEnvironmentHeight = 512;
+// The number of spheres along each side of the sphere grid.
+const int kSphereGridSize = 10;
+
+// The image sizes each scene is rendered at.
+const int kSizes[][2] = {{320, 180}, {1280, 720}};
+
+// Writes a Radiance HDR environment with a sky gradient and a bright sun.
+void WriteSyntheticEnvironment() {
+  std::vector<float> pixels;
+  for (int y = 0; y < kSyntheticEnvironmentHeight; y++) {
+    for (int x = 0; x < kSyntheticEnvironmentWidth; x++) {
+      float t = 1.0f - (float)y / kSyntheticEnvironmentHeight;
+      float sun = std::abs(x - 256) < 12 && std::abs(y - 120) < 12 ? 50.0f : 0.0f;
+      pixels.push_back(0.2f + 0.6f * t + sun);
+      pixels.push_back(0.3f + 0.6f * t + sun);
+      pixels.push_back(0.5f + 0.8f * t + sun);
+    }
+  }
+  stbi_write_hdr(kSyntheticEnvironmentPath.c_str(), kSyntheticEnvironmentWidth,
+      kSyntheticEnvironmentHeight, 3, pixels.data());
+}
+
+// Renders the instances at each size, once untimed to decode the textures and report the
+// triangles, then as a benchmark.
+void BenchmarkScene(microbench::Runner* runner, const std::string& name, gfx::Camera* camera,
+    gfx::TextureManager* texture_manager, gfx::Environment* environment,
+    const std::vector<std::unique_ptr<gfx::ModelInstance>>& instances) {
+  gfx::PointLight point_light(glm::vec3(8.0f, 8.0f, 16.0f), 1.0f, 0.3f, 0.04f, glm::vec3(40.0f));
+  for (const int* size : kSizes) {
+    gfx::CpuRenderer renderer(size[0], size[1], camera, 45.0f, gfx::Color(0.0f, 0.0f, 0.0f),
+        texture_manager);
+    renderer.AddPointLight(&point_light);
+    auto render = [&renderer, environment, &instances]() {
+      renderer.PrepareRender(environment);
+      for (auto& instance : instances) {
+        renderer.RenderModel(instance.get(), environment);
+      }
+      renderer.FinishRender();
+      microbench::Consume(renderer.GetPixels()[0]);
+    };
+    render();
+    std::string full_name = "raster/" + name + "_" + std::to_string(size[0]) + "x" +
+        std::to_string(size[1]);
+    std::cout << full_name << ": " << renderer.GetTrianglesRasterized() << " triangles on " <<
+        renderer.GetJobSystem()->GetNumThreads() << " threads" << std::endl;
+    runner->Run(full_name, (double)size[0] * size[1], "pixels", render);
+  }
+}
+
+void BenchmarkDrawers(microbench::Runner* runner, gfx::Environment* environment) {
+  gfx::TextureManager texture_manager(false);
+  gfx::ModelInfo drawers(kDrawersPath, &texture_manager, false);
+  std::vector<std::unique_ptr<gfx::ModelInstance>> instances;
+  instances.emplace_back(new gfx::ModelInstance(&drawers, glm::vec3(0.0f)));
+  gfx::Camera camera(glm::vec3(5.0f, 6.0f, 5.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+      glm::vec3(0.0f, 1.0f, 0.0f));
+  BenchmarkScene(runner, "drawers", &camera, &texture_manager, environment, instances);
+}
+
+void BenchmarkSpheres(microbench::Runner* runner, gfx::Environment* environment) {
+  gfx::TextureManager texture_manager(false);
+  std::vector<std::unique_ptr<gfx::ModelInfo>> spheres;
+  std::vector<std::unique_ptr<gfx::ModelInstance>> instances;
+  for (int x = 0; x < kSphereGridSize; x++) {
+    for (int y = 0; y < kSphereGridSize; y++) {
+      gfx::ModelInfo* sphere = new gfx::ModelInfo(kSpherePath, &texture_manager, false);
+      sphere->GetMaterial()->albedo_info.value = glm::vec3(0.3f, 0.0f, 0.0f);
+      sphere->GetMaterial()->metallic_info.value = glm::vec3((float)x / 10.0f, 0.0f, 0.0f);
+      sphere->GetMaterial()->roughness_info.value = glm::vec3((float)y / 10.0f, 0.0f, 0.0f);
+      spheres.emplace_back(sphere);
+      instances.emplace_back(new gfx::ModelInstance(sphere,
+          glm::vec3((float)(x - 5) * 2.5f, 0.0f, (float)(y - 5) * 2.5f)));
+    }
+  }
+  gfx::Camera camera(glm::vec3(18.0f, 8.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f),
+      glm::vec3(0.0f, 1.0f, 0.0f));
+  BenchmarkScene(runner, "spheres", &camera, &texture_manager, environment, instances);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  WriteSyntheticEnvironment();
+  microbench::Runner runner(argc > 1 ? argv[1] : "");
+  try {
+    gfx::Environment environment(kSyntheticEnvironmentPath, 0.0f, false);
+    BenchmarkDrawers(&runner, &environment);
+    BenchmarkSpheres(&runner, &environment);
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+  }
+  std::remove(kSyntheticEnvironmentPath.c_str());
+  return 0;
+}
@@ -0,0 +1,275 @@
+// Compares the GameWindow's forward MSAA output against the CPU reference rasterizer. A scene is
+// rendered headless with OpenGL and read back, then rendered with a CpuRenderer from the same
+// camera and lights, and the two images are compared per channel. The mean and max error and the
+// percentage of pixels with a channel off by more than the tolerance are printed, and the
+// per-pixel error can be written as a PNG (scaled up so small errors are visible). The CPU
+// renderer doesn't render shadows, so the lights are set to not cast any. With
+// --irradiance-volume, an IrradianceVolume is baked over the scene from the environment and both
+// renderers light the scene with it. Mesa's software renderer is forced unless --hardware is
+// passed.
+//
+// Usage: raster_diff [--scene drawers|spheres] [--width W] [--height H] [--environment FILE]
+//     [--irradiance-volume] [--tolerance T] [--max-percent P] [--output FILE] [--hardware]
+//
+// The exit status is nonzero if more than P percent of the pixels are off by more than T (out of
+// 255), so this can gate changes to either renderer.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "gfx/camera.h"
+#include "gfx/color.h"
+#include "gfx/cpu_renderer.h"
+#include "gfx/directional_light.h"
+#include "gfx/environment.h"
+#include "gfx/game_window.h"
+#include "gfx/irradiance_volume.h"
+#include "gfx/model_info.h"
+#include "gfx/model_instance.h"
+#include "gfx/point_light.h"
+#include "gfx/texture_manager.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::string kMainVertexShaderPath = "shaders/main.vert";
+const std::string kMainFragmentShaderPath = "shaders/main.frag";
+const std::string kHdrVertexShaderPath = "shaders/hdr.vert";
+const std::string kHdrFragmentShaderPath = "shaders/hdr.frag";
+const std::string kSkyboxVertexShaderPath = "shaders/skybox.vert";
+const std::string kSkyboxFragmentShaderPath = "shaders/skybox.frag";
+const std::string kSpherePath = "assets/primitives/sphere_no_maps.eo";
+const std::string kDrawersPath = "assets/drawers/drawers.eo";
+
+// The defaults of the options.
+const int kDefaultWidth = 320;
+const int kDefaultHeight = 180;
+const int kDefaultTolerance = 8;
+const double kDefaultMaxPercent = 1.0;
+
+// The factor the per-pixel error is scaled by in the error image.
+const int kErrorImageScale = 16;
+
+// The probes along each axis of the irradiance volume and the rays traced per probe.
+const int kVolumeResolution = 8;
+const unsigned int kVolumeRays = 256;
+
+// The command line options.
+struct Options {
+  std::string scene;
+  int width;
+  int height;
+  std::string environment_path;
+  bool irradiance_volume;
+  int tolerance;
+  double max_percent;
+  std::string output_path;
+  bool hardware;
+};
+
+// The ModelInfos and ModelInstances of a scene.
+struct Scene {
+  std::vector<std::unique_ptr<gfx::ModelInfo>> model_infos;
+  std::vector<std::unique_ptr<gfx::ModelInstance>> model_instances;
+};
+
+// Parses the command line into options. Returns false if it's malformed.
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  options->scene = "drawers";
+  options->width = kDefaultWidth;
+  options->height = kDefaultHeight;
+  options->tolerance = kDefaultTolerance;
+  options->max_percent = kDefaultMaxPercent;
+  options->irradiance_volume = false;
+  options->hardware = false;
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    bool has_value = i + 1 < argc;
+    if (option == "--hardware") {
+      options->hardware = true;
+    } else if (option == "--irradiance-volume") {
+      options->irradiance_volume = true;
+    } else if (!has_value) {
+      return false;
+    } else if (option == "--scene") {
+      options->scene = argv[++i];
+    } else if (option == "--width") {
+      options->width = std::atoi(argv[++i]);
+    } else if (option == "--height") {
+      options->height = std::atoi(argv[++i]);
+    } else if (option == "--environment") {
+      options->environment_path = argv[++i];
+    } else if (option == "--tolerance") {
+      options->tolerance = std::atoi(argv[++i]);
+    } else if (option == "--max-percent") {
+      options->max_percent = std::atof(argv[++i]);
+    } else if (option == "--output") {
+      options->output_path = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  // The irradiance volume is baked from the environment.
+  return (options->scene == "drawers" || options->scene == "spheres") && options->width > 0 &&
+      options->height > 0 && (!options->irradiance_volume ||
+      !options->environment_path.empty());
+}
+
+// Loads the models of a scene through a TextureManager, mapping them if should_map is set.
+void LoadScene(const std::string& name, gfx::TextureManager* manager, bool should_map,
+    Scene* scene) {
+  if (name == "drawers") {
+    scene->model_infos.emplace_back(new gfx::ModelInfo(kDrawersPath, manager, should_map));
+    scene->model_instances.emplace_back(new gfx::ModelInstance(scene->model_infos[0].get(),
+        glm::vec3(0.0f)));
+    return;
+  }
+  // A grid of spheres ranging from dielectric to metallic and from smooth to rough.
+  for (int x = 0; x < 5; x++) {
+    for (int y = 0; y < 5; y++) {
+      gfx::ModelInfo* sphere = new gfx::ModelInfo(kSpherePath, manager, should_map);
+      sphere->GetMaterial()->albedo_info.value = glm::vec3(0.3f, 0.0f, 0.0f);
+      sphere->GetMaterial()->metallic_info.value = glm::vec3((float)x / 4.0f, 0.0f, 0.0f);
+      sphere->GetMaterial()->roughness_info.value = glm::vec3(0.1f + (float)y / 5.0f, 0.0f,
+          0.0f);
+      scene->model_infos.emplace_back(sphere);
+      scene->model_instances.emplace_back(new gfx::ModelInstance(sphere,
+          glm::vec3((float)(x - 2) * 2.5f, 0.0f, (float)(y - 2) * 2.5f)));
+    }
+  }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0] << " [--scene drawers|spheres] [--width W] [--height H] " <<
+        "[--environment FILE] [--irradiance-volume] [--tolerance T] [--max-percent P] " <<
+        "[--output FILE] [--hardware]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!options.hardware) {
+    // Mesa reads this when the context is created.
+#ifdef _WIN32
+    _putenv_s("LIBGL_ALWAYS_SOFTWARE", "1");
+#else
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+#endif
+  }
+
+  try {
+    bool is_drawers = options.scene == "drawers";
+    gfx::Camera camera(is_drawers ? glm::vec3(5.0f, 6.0f, 5.0f) : glm::vec3(9.0f, 7.0f, 9.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    gfx::Color clear_color(0.15f, 0.15f, 0.15f);
+    gfx::PointLight point_light(glm::vec3(8.0f, 8.0f, 16.0f), 1.0f, 0.3f, 0.04f,
+        glm::vec3(40.0f));
+    point_light.casts_shadows = false;
+    gfx::DirectionalLight directional_light(glm::vec3(-0.5f, -1.0f, -0.3f), glm::vec3(1.0f));
+    directional_light.casts_shadows = false;
+
+    // Render the scene with OpenGL and read back the default framebuffer.
+    gfx::GameWindow game_window{options.width, options.height, kMainVertexShaderPath,
+        kMainFragmentShaderPath, kHdrVertexShaderPath, kHdrFragmentShaderPath,
+        kSkyboxVertexShaderPath, kSkyboxFragmentShaderPath, &camera, 45.0f, clear_color,
+        gfx::MSAA, gfx::Headless};
+    game_window.AddPointLight(&point_light);
+    game_window.SetDirectionalLight(&directional_light);
+    gfx::TextureManager gl_manager;
+    std::unique_ptr<gfx::Environment> gl_environment;
+    if (!options.environment_path.empty()) {
+      gl_environment.reset(new gfx::Environment(options.environment_path, 0.0f));
+    }
+    Scene gl_scene;
+    LoadScene(options.scene, &gl_manager, true, &gl_scene);
+
+    // Bake the probes over a box bounding the scene's bounding spheres.
+    std::unique_ptr<gfx::IrradianceVolume> volume;
+    if (options.irradiance_volume) {
+      glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+      std::vector<gfx::ModelInstance*> instances;
+      for (auto& model_instance : gl_scene.model_instances) {
+        glm::vec3 radius(model_instance->GetBoundsRadius());
+        min = glm::min(min, model_instance->GetBoundsCenter() - radius);
+        max = glm::max(max, model_instance->GetBoundsCenter() + radius);
+        instances.push_back(model_instance.get());
+      }
+      volume.reset(new gfx::IrradianceVolume(min, max, glm::ivec3(kVolumeResolution)));
+      volume->Bake(instances, gl_environment.get(), kVolumeRays, game_window.GetJobSystem());
+      volume->Upload();
+      game_window.SetIrradianceVolume(volume.get());
+    }
+    game_window.PrepareRender(gl_environment.get());
+    for (auto& model_instance : gl_scene.model_instances) {
+      game_window.RenderModel(model_instance.get(), gl_environment.get());
+    }
+    game_window.FinishRender();
+    std::vector<unsigned char> gl_pixels(options.width * options.height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, options.width, options.height, GL_RGBA, GL_UNSIGNED_BYTE,
+        gl_pixels.data());
+
+    // Render the same scene on the CPU.
+    gfx::CpuRenderer renderer(options.width, options.height, &camera, 45.0f, clear_color,
+        &gl_manager);
+    renderer.AddPointLight(&point_light);
+    renderer.SetDirectionalLight(&directional_light);
+    renderer.SetIrradianceVolume(volume.get());
+    renderer.PrepareRender(gl_environment.get());
+    for (auto& model_instance : gl_scene.model_instances) {
+      renderer.RenderModel(model_instance.get(), gl_environment.get());
+    }
+    renderer.FinishRender();
+    const std::vector<unsigned char>& cpu_pixels = renderer.GetPixels();
+
+    // Compare the color channels of every pixel. The error image is written top row first.
+    int num_pixels = options.width * options.height;
+    double total_error = 0.0;
+    int max_error = 0;
+    int pixels_over_tolerance = 0;
+    std::vector<unsigned char> error_image(num_pixels * 3);
+    for (int i = 0; i < num_pixels; i++) {
+      int pixel_error = 0;
+      for (int c = 0; c < 3; c++) {
+        int error = std::abs((int)gl_pixels[i * 4 + c] - (int)cpu_pixels[i * 4 + c]);
+        total_error += error;
+        pixel_error = std::max(pixel_error, error);
+        int row = options.height - 1 - i / options.width;
+        error_image[(row * options.width + i % options.width) * 3 + c] =
+            (unsigned char)std::min(error * kErrorImageScale, 255);
+      }
+      max_error = std::max(max_error, pixel_error);
+      pixels_over_tolerance += pixel_error > options.tolerance;
+    }
+    double percent_over_tolerance = 100.0 * pixels_over_tolerance / num_pixels;
+    std::cout << "renderer: " << (const char*)glGetString(GL_RENDERER) << std::endl;
+    std::cout << "triangles: " << renderer.GetTrianglesRasterized() << std::endl;
+    std::cout << "mean error: " << total_error / (num_pixels * 3.0) << std::endl;
+    std::cout << "max error: " << max_error << std::endl;
+    std::cout << "pixels over tolerance " << options.tolerance << ": " <<
+        percent_over_tolerance << "%" << std::endl;
+
+    if (!options.output_path.empty() && !stbi_write_png(options.output_path.c_str(),
+        options.width, options.height, 3, error_image.data(), options.width * 3)) {
+      std::cerr << "Cannot write \'" << options.output_path << "\'." << std::endl;
+      return EXIT_FAILURE;
+    }
+    return percent_over_tolerance > options.max_percent ? EXIT_FAILURE : EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,536 @@
+// A deterministic benchmark of whole frames. Each scripted scene is loaded into a headless
+// GameWindow and rendered for a fixed number of frames along a recorded camera path, after some
+// warm-up frames that are left out of the results. Nothing depends on the wall clock, so every run
+// renders the same frames. The load times, the frame time percentiles, the CPU and GPU time of
+// each pass, and the draw calls per frame are written as JSON. The draw calls come from the
+// GameWindow's GL stats, so they're only written in builds that count them (debug builds, or any
+// build configured with -DENABLE_GL_STATS=ON). Mesa's software renderer is forced unless
+// --hardware is passed, so results can be compared across commits and machines.
+//
+// Usage: bench [--scene spheres|drawers|lights|instances|all] [--frames N] [--warmup N]
+//     [--width W] [--height H] [--deferred] [--taa] [--camera-path FILE] [--environment FILE]
+//     [--output FILE] [--hardware]
+//
+// A camera path file lists keyframes as whitespace separated "x y z target_x target_y target_z"
+// positions, which are looped through with a Catmull-Rom spline over the measured frames. The
+// per-pass statistics come from the profiler, so they cover at most the last
+// PROFILER_HISTORY_FRAMES measured frames.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "gfx/camera.h"
+#include "gfx/color.h"
+#include "gfx/constants.h"
+#include "gfx/directional_light.h"
+#include "gfx/environment.h"
+#include "gfx/game_window.h"
+#include "gfx/model_info.h"
+#include "gfx/model_instance.h"
+#include "gfx/point_light.h"
+#include "gfx/profiler.h"
+#include "gfx/texture_manager.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::string kMainVertexShaderPath = "shaders/main.vert";
+const std::string kMainFragmentShaderPath = "shaders/main.frag";
+const std::string kHdrVertexShaderPath = "shaders/hdr.vert";
+const std::string kHdrFragmentShaderPath = "shaders/hdr.frag";
+const std::string kSkyboxVertexShaderPath = "shaders/skybox.vert";
+const std::string kSkyboxFragmentShaderPath = "shaders/skybox.frag";
+const std::string kEnvironmentPath = "assets/hdr/pisa.hdr";
+const std::string kSpherePath = "assets/primitives/sphere_no_maps.eo";
+const std::string kBoxPath = "assets/primitives/box_no_maps.eo";
+const std::string kDrawersPath = "assets/drawers/drawers.eo";
+
+// The defaults of the options. These are small enough that a run over every scene finishes in a
+// few minutes on a software renderer.
+const int kDefaultWidth = 320;
+const int kDefaultHeight = 180;
+const unsigned int kDefaultFrames = 60;
+const unsigned int kDefaultWarmupFrames = 5;
+
+// The names of the scripted scenes.
+const char* const kSceneNames[] = {"spheres", "drawers", "lights", "instances"};
+
+// The number of spheres along each side of the sphere grid.
+const int kSphereGridSize = 10;
+// The number of boxes in the instances scene.
+const int kInstanceCount = 10000;
+
+// A keyframe of the camera path.
+struct CameraKeyframe {
+  glm::vec3 position;
+  glm::vec3 target;
+};
+
+// The default camera path: a loop around the origin that swings in and out and up and down. The
+// scenes scale it to fit their contents.
+const CameraKeyframe kDefaultCameraPath[] = {
+    {glm::vec3(9.0f, 4.0f, 0.0f), glm::vec3(0.0f, 1.5f, 0.0f)},
+    {glm::vec3(5.0f, 6.0f, 5.0f), glm::vec3(0.0f, 1.0f, 0.0f)},
+    {glm::vec3(0.0f, 3.0f, 8.0f), glm::vec3(0.5f, 2.0f, 0.0f)},
+    {glm::vec3(-7.0f, 5.0f, 7.0f), glm::vec3(0.0f, 1.5f, 0.0f)},
+    {glm::vec3(-10.0f, 7.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.5f)},
+    {glm::vec3(-5.0f, 2.5f, -6.0f), glm::vec3(0.0f, 2.0f, 0.0f)},
+    {glm::vec3(0.0f, 5.0f, -10.0f), glm::vec3(-0.5f, 1.5f, 0.0f)},
+    {glm::vec3(6.0f, 3.5f, -6.0f), glm::vec3(0.0f, 1.0f, 0.0f)}};
+
+// The command line options.
+struct Options {
+  std::string scene;
+  unsigned int frames;
+  unsigned int warmup_frames;
+  int width;
+  int height;
+  gfx::RenderMode render_mode;
+  gfx::AntiAliasingMode anti_aliasing_mode;
+  std::vector<CameraKeyframe> camera_path;
+  std::string environment_path;
+  std::string output_path;
+  bool hardware;
+};
+
+// A loaded scene. The camera path is scaled by camera_scale, and the point lights circle the
+// origin every frame if animate_lights is set.
+struct Scene {
+  std::string name;
+  std::unique_ptr<gfx::TextureManager> texture_manager;
+  std::unique_ptr<gfx::Environment> environment;
+  std::vector<std::unique_ptr<gfx::ModelInfo>> model_infos;
+  std::vector<std::unique_ptr<gfx::ModelInstance>> model_instances;
+  std::vector<std::unique_ptr<gfx::PointLight>> point_lights;
+  std::unique_ptr<gfx::DirectionalLight> directional_light;
+  float camera_scale;
+  bool animate_lights;
+  double model_load_time;
+  double environment_load_time;
+};
+
+// Statistics of the measured frames of a scene.
+struct SceneResult {
+  std::vector<double> frame_times;
+  std::vector<unsigned long> draw_calls;
+  std::vector<std::pair<std::string, gfx::ProfilerStatistics>> cpu_passes;
+  std::vector<std::pair<std::string, gfx::ProfilerStatistics>> gpu_passes;
+};
+
+// Gets the time in milliseconds since start.
+double GetMilliseconds(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Gets a percentile of sorted values by the nearest rank, like the profiler.
+double GetPercentile(const std::vector<double>& sorted, double percentile) {
+  size_t rank = (size_t)std::ceil(percentile * (double)sorted.size());
+  return sorted[std::max(rank, (size_t)1) - 1];
+}
+
+// Escapes a string for a JSON string literal.
+std::string EscapeJson(const std::string& value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += (unsigned char)c < 0x20 ? ' ' : c;
+  }
+  return escaped;
+}
+
+// Reads the keyframes of a camera path file. Returns an empty path if the file can't be read or
+// has fewer than two keyframes.
+std::vector<CameraKeyframe> ReadCameraPath(const std::string& path) {
+  std::ifstream ifs(path);
+  std::vector<CameraKeyframe> keyframes;
+  CameraKeyframe keyframe;
+  while (ifs >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >>
+      keyframe.target.x >> keyframe.target.y >> keyframe.target.z) {
+    keyframes.push_back(keyframe);
+  }
+  if (keyframes.size() < 2) {
+    keyframes.clear();
+  }
+  return keyframes;
+}
+
+// Parses the command line into options. Returns false if it's malformed.
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  options->scene = "all";
+  options->frames = kDefaultFrames;
+  options->warmup_frames = kDefaultWarmupFrames;
+  options->width = kDefaultWidth;
+  options->height = kDefaultHeight;
+  options->render_mode = gfx::Forward;
+  options->anti_aliasing_mode = gfx::MSAA;
+  options->camera_path.assign(std::begin(kDefaultCameraPath), std::end(kDefaultCameraPath));
+  options->environment_path = kEnvironmentPath;
+  options->hardware = false;
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    bool has_value = i + 1 < argc;
+    if (option == "--deferred") {
+      options->render_mode = gfx::Deferred;
+    } else if (option == "--taa") {
+      options->anti_aliasing_mode = gfx::TAA;
+    } else if (option == "--hardware") {
+      options->hardware = true;
+    } else if (!has_value) {
+      return false;
+    } else if (option == "--scene") {
+      options->scene = argv[++i];
+    } else if (option == "--frames") {
+      options->frames = std::strtoul(argv[++i], nullptr, 10);
+    } else if (option == "--warmup") {
+      options->warmup_frames = std::strtoul(argv[++i], nullptr, 10);
+    } else if (option == "--width") {
+      options->width = std::atoi(argv[++i]);
+    } else if (option == "--height") {
+      options->height = std::atoi(argv[++i]);
+    } else if (option == "--camera-path") {
+      options->camera_path = ReadCameraPath(argv[++i]);
+      if (options->camera_path.empty()) {
+        std::cerr << "Cannot read a camera path from \'" << argv[i] << "\'." << std::endl;
+        return false;
+      }
+    } else if (option == "--environment") {
+      options->environment_path = argv[++i];
+    } else if (option == "--output") {
+      options->output_path = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  return options->frames > 0 && options->width > 0 && options->height > 0;
+}
+
+// Loads a scene's models, timing how long the models and the environment take to load.
+void LoadScene(gfx::GameWindow* game_window, const Options& options, Scene* scene) {
+  scene->texture_manager.reset(new gfx::TextureManager());
+  scene->camera_scale = 1.0f;
+  scene->animate_lights = false;
+
+  auto start = std::chrono::steady_clock::now();
+  scene->environment.reset(new gfx::Environment(options.environment_path));
+  glFinish();
+  scene->environment_load_time = GetMilliseconds(start);
+
+  start = std::chrono::steady_clock::now();
+  std::vector<std::string> paths;
+  if (scene->name == "spheres") {
+    paths.assign(kSphereGridSize * kSphereGridSize, kSpherePath);
+  } else if (scene->name == "drawers") {
+    paths.push_back(kDrawersPath);
+  } else if (scene->name == "lights") {
+    paths = {kDrawersPath, kBoxPath, kSpherePath};
+  } else {
+    paths = {kBoxPath};
+  }
+  scene->model_infos = gfx::ModelInfo::LoadModels(paths, scene->texture_manager.get(),
+      game_window->GetJobSystem(), true);
+  glFinish();
+  scene->model_load_time = GetMilliseconds(start);
+
+  std::vector<std::unique_ptr<gfx::ModelInfo>>& models = scene->model_infos;
+  std::vector<std::unique_ptr<gfx::ModelInstance>>& instances = scene->model_instances;
+  if (scene->name == "spheres") {
+    // A grid of spheres ranging from dielectric to metallic and from smooth to rough.
+    for (int x = 0; x < kSphereGridSize; x++) {
+      for (int y = 0; y < kSphereGridSize; y++) {
+        gfx::ModelInfo* sphere = models[x * kSphereGridSize + y].get();
+        sphere->GetMaterial()->albedo_info.value = glm::vec3(0.3f, 0.0f, 0.0f);
+        sphere->GetMaterial()->metallic_info.value = glm::vec3((float)x / 10.0f, 0.0f, 0.0f);
+        sphere->GetMaterial()->roughness_info.value = glm::vec3((float)y / 10.0f, 0.0f, 0.0f);
+        instances.emplace_back(new gfx::ModelInstance(sphere,
+            glm::vec3((float)(x - 5) * 2.5f, 0.0f, (float)(y - 5) * 2.5f)));
+      }
+    }
+    scene->point_lights.emplace_back(new gfx::PointLight(glm::vec3(8.0f, 8.0f, 16.0f), 1.0f,
+        0.3f, 0.04f, glm::vec3(40.0f)));
+    scene->camera_scale = 2.0f;
+  } else if (scene->name == "drawers") {
+    // The demo scene.
+    instances.emplace_back(new gfx::ModelInstance(models[0].get(), glm::vec3(0.0f)));
+    scene->point_lights.emplace_back(new gfx::PointLight(glm::vec3(8.0f, 8.0f, 16.0f), 1.0f,
+        0.3f, 0.04f, glm::vec3(40.0f)));
+  } else if (scene->name == "lights") {
+    // The drawers and a ring of spheres on a floor, lit by the sun and every shadowed point light
+    // the engine supports. The point lights move every frame, so their shadows are re-rendered.
+    instances.emplace_back(new gfx::ModelInstance(models[0].get(), glm::vec3(0.0f)));
+    gfx::ModelInstance* floor = new gfx::ModelInstance(models[1].get(),
+        glm::vec3(0.0f, -0.1f, 0.0f));
+    floor->scale = glm::vec3(16.0f, 0.1f, 16.0f);
+    floor->Update();
+    instances.emplace_back(floor);
+    for (int i = 0; i < 12; i++) {
+      float angle = (float)i * 0.5236f;
+      instances.emplace_back(new gfx::ModelInstance(models[2].get(),
+          glm::vec3(6.0f * std::cos(angle), 1.0f, 6.0f * std::sin(angle))));
+    }
+    for (unsigned int i = 0; i < gfx::MAX_POINT_LIGHTS; i++) {
+      scene->point_lights.emplace_back(new gfx::PointLight(glm::vec3(0.0f, 4.0f, 0.0f), 1.0f,
+          0.3f, 0.04f, glm::vec3(15.0f)));
+    }
+    scene->directional_light.reset(new gfx::DirectionalLight(glm::vec3(-0.5f, -1.0f, -0.3f),
+        glm::vec3(2.0f)));
+    scene->camera_scale = 1.2f;
+    scene->animate_lights = true;
+  } else {
+    // Many small boxes in a ring, most of them outside the view at any time.
+    for (int i = 0; i < kInstanceCount; i++) {
+      float angle = (float)i * 0.37f;
+      float radius = 4.0f + (float)(i % 97) * 0.25f;
+      gfx::ModelInstance* box = new gfx::ModelInstance(models[0].get(), glm::vec3(
+          radius * std::sin(angle), -1.0f + (float)(i % 13) * 0.2f, radius * std::cos(angle)));
+      box->scale = glm::vec3(0.1f);
+      box->Update();
+      instances.emplace_back(box);
+    }
+    scene->point_lights.emplace_back(new gfx::PointLight(glm::vec3(8.0f, 8.0f, 16.0f), 1.0f,
+        0.3f, 0.04f, glm::vec3(40.0f)));
+    scene->camera_scale = 2.5f;
+  }
+}
+
+// Moves the camera to a point along the looped camera path, where t in [0, 1) covers the path.
+void UpdateCamera(const std::vector<CameraKeyframe>& path, float scale, float t,
+    gfx::Camera* camera) {
+  float position = t * (float)path.size();
+  size_t segment = (size_t)position % path.size();
+  float u = position - std::floor(position);
+  const CameraKeyframe& p0 = path[(segment + path.size() - 1) % path.size()];
+  const CameraKeyframe& p1 = path[segment];
+  const CameraKeyframe& p2 = path[(segment + 1) % path.size()];
+  const CameraKeyframe& p3 = path[(segment + 2) % path.size()];
+  // Uniform Catmull-Rom weights.
+  float w0 = 0.5f * (-u * u * u + 2.0f * u * u - u);
+  float w1 = 0.5f * (3.0f * u * u * u - 5.0f * u * u + 2.0f);
+  float w2 = 0.5f * (-3.0f * u * u * u + 4.0f * u * u + u);
+  float w3 = 0.5f * (u * u * u - u * u);
+  camera->camera_position = scale * (w0 * p0.position + w1 * p1.position + w2 * p2.position +
+      w3 * p3.position);
+  camera->camera_target = scale * (w0 * p0.target + w1 * p1.target + w2 * p2.target +
+      w3 * p3.target);
+  camera->camera_up = glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+// Renders the warm-up and measured frames of a scene.
+SceneResult RunScene(gfx::GameWindow* game_window, const Options& options, Scene* scene,
+    gfx::Camera* camera) {
+  for (auto& point_light : scene->point_lights) {
+    game_window->AddPointLight(point_light.get());
+  }
+  if (scene->directional_light != nullptr) {
+    game_window->SetDirectionalLight(scene->directional_light.get());
+  }
+
+  SceneResult result;
+  gfx::Profiler* profiler = game_window->GetProfiler();
+  unsigned int total_frames = options.warmup_frames + options.frames;
+  for (unsigned int frame = 0; frame < total_frames; frame++) {
+    bool measured = frame >= options.warmup_frames;
+    if (frame == options.warmup_frames) {
+      profiler->ResetStatistics();
+    }
+    // The warm-up frames look at the start of the path.
+    unsigned int path_frame = measured ? frame - options.warmup_frames : 0;
+    UpdateCamera(options.camera_path, scene->camera_scale,
+        (float)path_frame / (float)options.frames, camera);
+    if (scene->animate_lights) {
+      for (size_t i = 0; i < scene->point_lights.size(); i++) {
+        gfx::PointLight* point_light = scene->point_lights[i].get();
+        float angle = 0.05f * (float)frame + 2.0944f * (float)i;
+        point_light->position = glm::vec3(4.0f * std::cos(angle), 3.0f + (float)i,
+            4.0f * std::sin(angle));
+        game_window->UpdatePointLight(point_light);
+      }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    game_window->PollForEvents();
+    game_window->PrepareRender(scene->environment.get());
+    for (auto& model_instance : scene->model_instances) {
+      game_window->RenderModel(model_instance.get(), scene->environment.get());
+    }
+    game_window->FinishRender();
+    if (measured) {
+      result.frame_times.push_back(GetMilliseconds(start));
+      result.draw_calls.push_back(game_window->GetGlStats().total.draw_calls);
+    }
+  }
+
+  for (const std::string& name : profiler->GetCpuScopeNames()) {
+    result.cpu_passes.push_back(std::make_pair(name, profiler->GetCpuStatistics(name)));
+  }
+  for (const std::string& name : profiler->GetGpuScopeNames()) {
+    result.gpu_passes.push_back(std::make_pair(name, profiler->GetGpuStatistics(name)));
+  }
+
+  for (auto& point_light : scene->point_lights) {
+    game_window->RemovePointLight(point_light.get());
+  }
+  game_window->UnsetDirectionalLight();
+  return result;
+}
+
+// Writes the statistics of each pass as a JSON object.
+void WritePasses(std::ostream& out,
+    const std::vector<std::pair<std::string, gfx::ProfilerStatistics>>& passes) {
+  out << "{";
+  bool first = true;
+  for (const auto& pass : passes) {
+    if (pass.second.samples == 0) {
+      continue;
+    }
+    out << (first ? "" : ",") << "\n        \"" << EscapeJson(pass.first) << "\": {\"min\": " <<
+        pass.second.min << ", \"average\": " << pass.second.average << ", \"p99\": " <<
+        pass.second.p99 << ", \"samples\": " << pass.second.samples << "}";
+    first = false;
+  }
+  out << "\n      }";
+}
+
+// Writes the results of a scene as a JSON object.
+void WriteScene(std::ostream& out, const Scene& scene, const SceneResult& result) {
+  std::vector<double> sorted = result.frame_times;
+  std::sort(sorted.begin(), sorted.end());
+  double total_time = 0.0;
+  for (double time : sorted) {
+    total_time += time;
+  }
+  unsigned long total_draw_calls = 0;
+  unsigned long max_draw_calls = 0;
+  for (unsigned long count : result.draw_calls) {
+    total_draw_calls += count;
+    max_draw_calls = std::max(max_draw_calls, count);
+  }
+
+  out << "    {\n";
+  out << "      \"name\": \"" << scene.name << "\",\n";
+  out << "      \"instances\": " << scene.model_instances.size() << ",\n";
+  out << "      \"load_ms\": {\"environment\": " << scene.environment_load_time <<
+      ", \"models\": " << scene.model_load_time << "},\n";
+  out << "      \"frame_ms\": {\"mean\": " << total_time / (double)sorted.size() << ", \"min\": " <<
+      sorted.front() << ", \"p50\": " << GetPercentile(sorted, 0.5) << ", \"p90\": " <<
+      GetPercentile(sorted, 0.9) << ", \"p99\": " << GetPercentile(sorted, 0.99) <<
+      ", \"max\": " << sorted.back() << "},\n";
+#ifdef GFX_GL_STATS
+  out << "      \"draw_calls\": {\"mean\": " <<
+      (double)total_draw_calls / (double)result.draw_calls.size() << ", \"max\": " <<
+      max_draw_calls << "},\n";
+#endif
+  out << "      \"cpu_ms\": ";
+  WritePasses(out, result.cpu_passes);
+  out << ",\n      \"gpu_ms\": ";
+  WritePasses(out, result.gpu_passes);
+  out << "\n    }";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0] << " [--scene spheres|drawers|lights|instances|all] " <<
+        "[--frames N] [--warmup N] [--width W] [--height H] [--deferred] [--taa] " <<
+        "[--camera-path FILE] [--environment FILE] [--output FILE] [--hardware]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<std::string> scene_names;
+  for (const char* name : kSceneNames) {
+    if (options.scene == "all" || options.scene == name) {
+      scene_names.push_back(name);
+    }
+  }
+  if (scene_names.empty()) {
+    std::cerr << "Unknown scene \'" << options.scene << "\'." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!options.hardware) {
+    // Mesa reads this when the context is created.
+#ifdef _WIN32
+    _putenv_s("LIBGL_ALWAYS_SOFTWARE", "1");
+#else
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+#endif
+  }
+
+  try {
+    auto start = std::chrono::steady_clock::now();
+    gfx::Camera camera;
+    gfx::GameWindow game_window{options.width, options.height, kMainVertexShaderPath,
+        kMainFragmentShaderPath, kHdrVertexShaderPath, kHdrFragmentShaderPath,
+        kSkyboxVertexShaderPath, kSkyboxFragmentShaderPath, &camera, 45.0f,
+        gfx::Color(0.15f, 0.15f, 0.15f), options.anti_aliasing_mode, gfx::Headless};
+    game_window.SetRenderMode(options.render_mode);
+    glFinish();
+    double window_load_time = GetMilliseconds(start);
+
+    // Scenes are kept alive until the end, since the shadow caches remember their casters.
+    std::vector<std::unique_ptr<Scene>> scenes;
+    std::vector<SceneResult> results;
+    for (const std::string& name : scene_names) {
+      scenes.emplace_back(new Scene());
+      scenes.back()->name = name;
+      LoadScene(&game_window, options, scenes.back().get());
+      results.push_back(RunScene(&game_window, options, scenes.back().get(), &camera));
+    }
+
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\n";
+    json << "  \"renderer\": \"" << EscapeJson((const char*)glGetString(GL_RENDERER)) << "\",\n";
+    json << "  \"gl_version\": \"" << EscapeJson((const char*)glGetString(GL_VERSION)) << "\",\n";
+    json << "  \"width\": " << options.width << ",\n";
+    json << "  \"height\": " << options.height << ",\n";
+    json << "  \"render_mode\": \"" << (options.render_mode == gfx::Forward ? "forward" :
+        "deferred") << "\",\n";
+    json << "  \"anti_aliasing\": \"" << (options.anti_aliasing_mode == gfx::MSAA ? "msaa" :
+        "taa") << "\",\n";
+    json << "  \"frames\": " << options.frames << ",\n";
+    json << "  \"warmup_frames\": " << options.warmup_frames << ",\n";
+    json << "  \"window_load_ms\": " << window_load_time << ",\n";
+    gfx::RenderGraphMemory memory = game_window.GetRenderTargetMemory();
+    json << "  \"render_target_bytes\": {\"aliased\": " << memory.aliased_bytes <<
+        ", \"unaliased\": " << memory.unaliased_bytes << "},\n";
+    json << "  \"scenes\": [\n";
+    for (size_t i = 0; i < scenes.size(); i++) {
+      WriteScene(json, *scenes[i], results[i]);
+      json << (i + 1 < scenes.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+
+    if (options.output_path.empty()) {
+      std::cout << json.str();
+    } else {
+      std::ofstream ofs(options.output_path);
+      ofs << json.str();
+      if (!ofs) {
+        std::cerr << "Cannot write \'" << options.output_path << "\'." << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    return EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
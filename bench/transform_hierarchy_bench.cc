@@ -0,0 +1,76 @@
+// Microbenchmarks for the transform hierarchy. These time Update over 100k transforms laid out as
+// a flat list of roots, as small groups of children under a root, and as deep chains, with every
+// transform dirty and with only a few of them dirty.
+//
+// Brian Ho (brian@brkho.com)
+
+#include "gfx/transform_hierarchy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// The number of transforms in each hierarchy.
+const unsigned int kTransforms = 100000;
+// The number of runs each result is the best of.
+const unsigned int kRuns = 20;
+
+// Builds a hierarchy of kTransforms transforms where every group_size consecutive transforms form
+// a tree: either each one is a child of the group's first transform, or each one is a child of
+// the previous one if chain is set.
+void BuildHierarchy(gfx::TransformHierarchy* hierarchy, unsigned int group_size, bool chain) {
+  for (unsigned int i = 0; i < kTransforms; i++) {
+    unsigned int group_start = i - i % group_size;
+    unsigned int parent = i == group_start ? gfx::TRANSFORM_NO_PARENT :
+        (chain ? i - 1 : group_start);
+    unsigned int transform = hierarchy->AddTransform(parent);
+    hierarchy->SetPosition(transform, glm::vec3((float)(i % 100), 0.5f, (float)(i / 100)));
+    hierarchy->SetRotation(transform, glm::angleAxis(0.01f * i, glm::vec3(0.0f, 1.0f, 0.0f)));
+    hierarchy->SetScale(transform, glm::vec3(1.0f, 1.5f, 0.75f));
+  }
+  hierarchy->Update();
+}
+
+// Times an Update in milliseconds after moving every dirty_stride-th transform, returning the
+// best of kRuns runs.
+double TimeUpdate(gfx::TransformHierarchy* hierarchy, unsigned int dirty_stride) {
+  double best = 0.0;
+  for (unsigned int run = 0; run < kRuns; run++) {
+    for (unsigned int i = 0; i < kTransforms; i += dirty_stride) {
+      hierarchy->SetPosition(i, hierarchy->GetPosition(i) + glm::vec3(0.0f, 0.001f, 0.0f));
+    }
+    auto start = std::chrono::steady_clock::now();
+    hierarchy->Update();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    best = run == 0 ? elapsed.count() : std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+}
+
+int main() {
+  struct Layout {
+    std::string name;
+    unsigned int group_size;
+    bool chain;
+  };
+  const Layout layouts[] = {{"roots", 1, false}, {"groups of 8", 8, false},
+      {"chains of 8", 8, true}};
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "TransformHierarchy::Update over " << kTransforms << " transforms (ms)" <<
+      std::endl;
+  std::cout << "layout         all dirty   1% dirty" << std::endl;
+  for (const Layout& layout : layouts) {
+    gfx::TransformHierarchy hierarchy;
+    BuildHierarchy(&hierarchy, layout.group_size, layout.chain);
+    std::cout << std::left << std::setw(12) << layout.name << std::right << std::setw(12) <<
+        TimeUpdate(&hierarchy, 1) << std::setw(11) << TimeUpdate(&hierarchy, 100) << std::endl;
+  }
+  return 0;
+}
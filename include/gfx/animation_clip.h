@@ -0,0 +1,102 @@
+// This class stores an animation of a skeleton compressed for playback. The translation, rotation,
+// and scale of each joint are tracks of keys fitted to the frames the animation was sampled at:
+// a frame only becomes a key when interpolating linearly between the keys around it would stray
+// from it by more than a tolerance, so joints that move smoothly (or not at all) keep few keys.
+// The keys are quantized to 16 bits per component, with translations and scales spread over the
+// range of their track and rotations stored as the three smallest quaternion components. Sampling
+// decodes the keys around a time and interpolates them four joints at a time with SSE when it's
+// available.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_ANIMATION_CLIP_H
+#define GFX_ANIMATION_CLIP_H
+
+#include "gfx/constants.h"
+#include "gfx/skeleton.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gfx {
+
+class AnimationClip {
+  public:
+    // Constructor that compresses an animation given a pose per frame and the frames per second
+    // they were sampled at. Frames are kept as keys wherever interpolating would stray from them
+    // by more than the translation, rotation (per quaternion component), or scale tolerance. This
+    // throws if there are no frames, more than 65536 frames, frames with different numbers of
+    // joints, or a frame rate that isn't positive.
+    AnimationClip(const std::vector<gfx::Pose>& frames, float frame_rate,
+        float translation_tolerance, float rotation_tolerance, float scale_tolerance);
+
+    // Constructor that compresses an animation with the default ANIMATION_*_TOLERANCE values.
+    AnimationClip(const std::vector<gfx::Pose>& frames, float frame_rate);
+
+    // Constructor that loads a clip written by Write. This throws if the file can't be opened or
+    // parsed.
+    AnimationClip(std::string path);
+
+    // Writes the compressed clip to a path. This throws if the file can't be written.
+    void Write(std::string path);
+
+    // Samples the clip at a time in seconds into a pose with the clip's number of joints. The
+    // clip loops, so the time wraps around its duration.
+    void Sample(float time, gfx::Pose* pose);
+
+    // Gets the duration of the clip in seconds, from its first frame to its last.
+    float GetDuration();
+
+    // Gets the number of joints the clip animates.
+    size_t GetNumJoints();
+
+    // Gets the number of keys kept over all of the tracks.
+    size_t GetNumKeys();
+
+    // Gets the size in bytes of the compressed tracks and keys.
+    size_t GetCompressedSize();
+
+  private:
+    // The keys of a joint's translation, rotation, or scale.
+    struct Track {
+      // The range the translation or scale keys are quantized over. This is unused for rotations.
+      float minimum[3];
+      float extent[3];
+      // The index of the track's first key and its number of keys.
+      uint32_t first_key;
+      uint32_t num_keys;
+    };
+
+    // The frames per second the animation was sampled at.
+    float frame_rate;
+
+    // The number of frames the animation was sampled at.
+    uint32_t num_frames;
+
+    // The number of joints the clip animates.
+    uint32_t num_joints;
+
+    // The translation, rotation, and scale tracks of each joint. Joint i's are at 3 * i, 3 * i +
+    // 1, and 3 * i + 2.
+    std::vector<Track> tracks;
+
+    // The frame of each key, increasing within each track.
+    std::vector<uint16_t> key_frames;
+
+    // The three quantized components of each key. A rotation key stores the three smallest
+    // components of the quaternion in the top 15 bits of each value, and the index of the largest
+    // in the bottom bits of the first two.
+    std::vector<uint16_t> key_values;
+
+    // Fits and quantizes the keys of a track from the values of every frame, which have 3
+    // components (or 4 for rotations).
+    void CompressTrack(const std::vector<glm::vec4>& values, unsigned int num_components,
+        float tolerance, bool is_rotation);
+};
+
+}
+#endif // GFX_ANIMATION_CLIP_H
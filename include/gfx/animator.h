@@ -0,0 +1,110 @@
+// This class poses a batch of animated characters. Each character has a Skeleton and a few layers
+// that each play an AnimationClip at a time with a weight. Update samples the layers of every
+// character whose layers changed, blends them with SSE (filling any weight the layers leave
+// under 1 with the bind pose), and multiplies the blended joints down the skeleton into skinning
+// palettes. The characters are split over the threads of a job system, so hundreds of them can be
+// posed every frame. A skinning palette holds the first three rows of each joint's skinning
+// transform (the joint's model space transform times its inverse bind transform), which is what
+// the skinning.glsl shaders read.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_ANIMATOR_H
+#define GFX_ANIMATOR_H
+
+#include "gfx/animation_clip.h"
+#include "gfx/constants.h"
+#include "gfx/job_system.h"
+#include "gfx/skeleton.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace gfx {
+
+class Animator {
+  public:
+    // Default constructor for an Animator with no characters.
+    Animator();
+
+    // Adds a character posed by a skeleton (which must outlive the Animator) and returns its
+    // index. The character starts in the bind pose with no layers.
+    unsigned int AddCharacter(gfx::Skeleton* skeleton);
+
+    // Sets a layer of a character to play a clip at a time in seconds with a weight. The layers
+    // are blended by their weights, and a nullptr clip or a weight of 0 turns the layer off. This
+    // throws if the layer is ANIMATION_MAX_LAYERS or above, or the clip animates a different
+    // number of joints than the character's skeleton has.
+    void SetLayer(unsigned int character, unsigned int layer, gfx::AnimationClip* clip, float time,
+        float weight);
+
+    // Poses the characters whose layers changed since the last Update in parallel on the job
+    // system, and updates their skinning palettes. This should be called once per frame, since
+    // the palettes of the previous Update are kept for motion vectors.
+    void Update(gfx::JobSystem* job_system);
+
+    // Gets the skinning palette of a character as of the last Update, with three rows per joint.
+    const glm::vec4* GetPalette(unsigned int character);
+
+    // Gets the skinning palette of a character as of the Update before the last.
+    const glm::vec4* GetPreviousPalette(unsigned int character);
+
+    // Gets the model space transform of a joint of a character as of the last Update, e.g. to
+    // attach a prop to a hand.
+    glm::mat4 GetJointTransform(unsigned int character, unsigned int joint);
+
+    // Gets the model space box bounding the skinned mesh of a character as of the last Update.
+    void GetBounds(unsigned int character, glm::vec3* bounds_min, glm::vec3* bounds_max);
+
+    // Gets the skeleton of a character.
+    gfx::Skeleton* GetSkeleton(unsigned int character);
+
+    // Returns a counter that is incremented every time Update changes the pose of a character.
+    unsigned int GetRevision(unsigned int character);
+
+    // Gets the number of characters.
+    size_t GetNumCharacters();
+
+    // Disable copy constructor and copy assignment.
+    Animator(Animator const&) = delete;
+    void operator=(Animator const&) = delete;
+
+  private:
+    // A clip played by a character.
+    struct Layer {
+      gfx::AnimationClip* clip;
+      float time;
+      float weight;
+    };
+
+    // The state of a character.
+    struct Character {
+      gfx::Skeleton* skeleton;
+      Layer layers[gfx::ANIMATION_MAX_LAYERS];
+      // Whether the layers changed since the last Update.
+      bool dirty;
+      // Whether the last Update changed the pose, so the previous palette differs.
+      bool moved;
+      // The model space transform of each joint.
+      std::vector<glm::mat4> joint_transforms;
+      // The skinning palettes of the last Update and the one before it.
+      std::vector<glm::vec4> palette;
+      std::vector<glm::vec4> previous_palette;
+      // The model space box bounding the skinned mesh.
+      glm::vec3 bounds_min;
+      glm::vec3 bounds_max;
+      // The number of times Update changed the pose.
+      unsigned int revision;
+    };
+
+    // The characters.
+    std::vector<Character> characters;
+
+    // Poses a character if its layers changed, using the given poses as scratch space.
+    void PoseCharacter(Character* character, gfx::Pose* sampled, gfx::Pose* blended);
+};
+
+}
+#endif // GFX_ANIMATOR_H
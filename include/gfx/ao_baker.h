@@ -0,0 +1,97 @@
+// This class bakes ambient occlusion maps for models that ship without one. Every texel of the
+// map that a triangle covers in UV space is mapped back to its point on the model, and
+// cosine-weighted rays over the hemisphere around the normal there are traced through a Bvh of
+// the model's triangles. The fraction of rays that escape within a maximum distance is the
+// texel's ambient occlusion. Texels are traced in parallel on a job system, with the rays of a
+// texel traced in packets of 4. The result is dilated past the UV seams so filtering doesn't
+// pull in the empty texels around them, and can be written as a PNG that the TextureManager
+// loads like any other map.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_AO_BAKER_H
+#define GFX_AO_BAKER_H
+
+#include "gfx/bvh.h"
+#include "gfx/job_system.h"
+#include "gfx/model_info.h"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+namespace gfx {
+
+// The settings of a bake.
+struct AoBakeSettings {
+  // The dimensions of the map.
+  int width;
+  int height;
+  // The number of rays traced per texel, which is rounded up to a multiple of 4.
+  unsigned int rays_per_texel;
+  // The distance in model space past which hits don't occlude, or 0 for a quarter of the
+  // diagonal of the model's bounds.
+  float max_distance;
+  // The number of texels the map is extended by past the edges of the UV islands.
+  unsigned int dilation;
+};
+
+class AoBaker {
+  public:
+    // Constructor given the model to bake, which must stay alive while baking, and the job system
+    // to trace on. This builds the Bvh of the model.
+    AoBaker(gfx::ModelInfo* model_info, gfx::JobSystem* job_system);
+
+    // Bakes the map and returns its texels as 8-bit RGB rows, with the first row at a v
+    // coordinate of 0 like the engine's textures. The values are encoded so that the shaders,
+    // which raise AO to the power of the display gamma, end up with the occlusion that was traced.
+    std::vector<unsigned char> Bake(const gfx::AoBakeSettings& settings);
+
+    // Bakes the map and writes it as a PNG. This throws if the file can't be written.
+    void BakeToFile(const gfx::AoBakeSettings& settings, std::string path);
+
+    // Gets the Bvh the rays are traced through.
+    gfx::Bvh* GetBvh();
+
+    // Gets the number of rays traced by the last bake.
+    size_t GetRaysTraced();
+
+    // Disable copy constructor and copy assignment.
+    AoBaker(AoBaker const&) = delete;
+    void operator=(AoBaker const&) = delete;
+
+  private:
+    // A texel of the map and the point of the model it covers.
+    struct Texel {
+      // Whether a triangle covers the texel.
+      bool covered;
+      // The position, the interpolated normal, and the normal of the covering triangle's plane.
+      glm::vec3 position;
+      glm::vec3 normal;
+      glm::vec3 face_normal;
+    };
+
+    // The model to bake.
+    gfx::ModelInfo* model_info;
+
+    // The job system the texels are traced on.
+    gfx::JobSystem* job_system;
+
+    // The hierarchy over the model's triangles.
+    gfx::Bvh bvh;
+
+    // The number of rays traced by the last bake.
+    size_t rays_traced;
+
+    // Finds the point of the model covered by each texel of a width by height map.
+    std::vector<Texel> RasterizeTexels(int width, int height);
+
+    // Extends the traced occlusion into the uncovered texels next to covered ones, one texel per
+    // pass, marking them as covered.
+    static void Dilate(int width, int height, unsigned int passes, std::vector<Texel>* texels,
+        std::vector<float>* occlusion);
+};
+
+}
+#endif // GFX_AO_BAKER_H
@@ -0,0 +1,45 @@
+// This class defines a one or two sided area light in the shape of a rectangle or an ellipse
+// (e.g. a disk), represented by its center, the vectors from its center to the middle of its
+// right and top edges, and the radiance leaving its surface. The light shines towards the cross
+// product of the right and up vectors, and from both sides if it's two sided. Area lights are
+// shaded analytically with LTCs (see LtcTable) and don't cast shadows.
+
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_AREA_LIGHT_H
+#define GFX_AREA_LIGHT_H
+
+#include "gfx/light.h"
+
+#include <glm/glm.hpp>
+
+namespace gfx {
+
+// The shape of an area light. A disk light is the ellipse inscribed in the rectangle of the same
+// vectors.
+enum AreaLightShape { RectangleLight, DiskLight };
+
+class AreaLight : public gfx::Light {
+  public:
+    // The shape of the light.
+    gfx::AreaLightShape shape;
+
+    // The center of the light.
+    glm::vec3 position;
+
+    // The vectors from the center of the light to the middle of its right and top edges, which
+    // are half of its width and height. These don't need to be perpendicular.
+    glm::vec3 right;
+    glm::vec3 up;
+
+    // Whether the light also shines from its back side. This defaults to false.
+    bool two_sided;
+
+    // Constructor for an AreaLight that specifies its shape, center, right and up vectors, and
+    // radiance, which is stored as the irradiance of the Light.
+    AreaLight(gfx::AreaLightShape shape, glm::vec3 position, glm::vec3 right, glm::vec3 up,
+        glm::vec3 radiance);
+};
+
+}
+#endif // GFX_AREA_LIGHT_H
@@ -0,0 +1,148 @@
+// This class reads a pack of assets, so that a scene's models, textures, and environments load out
+// of one file instead of hundreds of loose ones. A pack starts with a table of contents: a header,
+// an open addressing hash table from the hash of each asset's path to its entry, the entries, and
+// their paths. The contents of the assets follow, each aligned to ASSET_PACK_ALIGNMENT bytes and
+// either stored as is or compressed in the LZ4 block format when that makes them smaller (which
+// already compressed images usually aren't). Packs are memory mapped where the engine is built with
+// mmap (GFX_MMAP) and read whole otherwise, so opening one costs a few large sequential reads and
+// stored assets are read in place. Packs are built from loose files by build_pack.
+//
+// Mounted packs are searched by ModelInfo, TextureManager, and Environment before the loose files,
+// using the same paths the assets would be loaded from (e.g. "assets/drawers/drawers.eo").
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_ASSET_PACK_H
+#define GFX_ASSET_PACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace gfx {
+
+// Where the demo looks for a pack of its assets.
+const std::string asset_pack_path = "assets.pack";
+
+// The contents of an asset read out of a pack. Stored assets point into the pack, while compressed
+// assets are decompressed into the storage.
+struct AssetData {
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+  std::vector<unsigned char> storage;
+};
+
+// A stream buffer over the contents of an asset, so parsers of std::istreams can read assets out of
+// packs without copying them.
+class AssetStreamBuffer : public std::streambuf {
+  public:
+    // Constructor given the contents of an asset, which must outlive the buffer.
+    AssetStreamBuffer(const unsigned char* data, size_t size);
+};
+
+// The sizes of a newly written pack.
+struct AssetPackStats {
+  size_t num_entries;
+  size_t num_compressed;
+  uint64_t asset_size;
+  uint64_t pack_size;
+};
+
+class AssetPack {
+  public:
+    // Constructor that opens and maps a pack. This throws if the file can't be opened or its table
+    // of contents is malformed.
+    AssetPack(std::string path);
+
+    // Destructor which unmounts and unmaps the pack.
+    ~AssetPack();
+
+    // Reads an asset out of the pack by its path. This returns false if the pack doesn't contain
+    // the asset, and throws if its contents are corrupt. It can be called from any thread.
+    bool Read(std::string path, gfx::AssetData* asset);
+
+    // Gets the number of assets in the pack.
+    size_t GetNumEntries();
+
+    // Gets the size of the pack in bytes.
+    size_t GetSize();
+
+    // Writes a pack of the loose files at some paths, in their order so assets loaded together can
+    // be read sequentially. Each asset is compressed if should_compress is set and that saves at
+    // least ASSET_PACK_MIN_SAVINGS of its size. Repeated paths are only written once. This throws
+    // if a file can't be read or the pack can't be written.
+    static gfx::AssetPackStats Write(std::string path, const std::vector<std::string>& asset_paths,
+        bool should_compress);
+
+    // Mounts a pack so that ReadMounted finds its assets, searching it before the packs mounted
+    // earlier. Since mounted assets shadow the loose files, hot reloading only picks up changes to
+    // assets that aren't in a mounted pack. Packs must not be mounted or unmounted while assets
+    // are loading on other threads.
+    static void Mount(gfx::AssetPack* pack);
+
+    // Unmounts a pack if it's mounted.
+    static void Unmount(gfx::AssetPack* pack);
+
+    // Reads an asset out of the mounted packs by its path. This returns false if none of them
+    // contain the asset, and throws if its contents are corrupt.
+    static bool ReadMounted(std::string path, gfx::AssetData* asset);
+
+    // Gets a path in the form packs index assets by, with forward slashes and without leading
+    // "./" components.
+    static std::string NormalizePath(std::string path);
+
+    // Disable copy constructor and copy assignment.
+    AssetPack(AssetPack const&) = delete;
+    void operator=(AssetPack const&) = delete;
+
+  private:
+    // An entry of the table of contents, as stored in the pack.
+    struct Entry {
+      // The FNV-1a hash of the normalized path.
+      uint64_t hash;
+      // Where the contents start in the pack, and how many bytes they take there.
+      uint64_t offset;
+      uint64_t stored_size;
+      // The size of the asset once decompressed.
+      uint64_t size;
+      // Where the path starts in the paths of the table of contents, and its length.
+      uint32_t path_offset;
+      uint32_t path_length;
+      // Flags, which only mark whether the contents are compressed.
+      uint32_t flags;
+      uint32_t padding;
+    };
+
+    // The contents of the pack, either mapped or read into storage.
+    const unsigned char* data;
+    size_t size;
+    std::vector<unsigned char> storage;
+
+    // Whether data is mapped.
+    bool is_mapped;
+
+    // The hash table of one plus the entry index of each path, or 0 for empty slots. Its number of
+    // slots is a power of two.
+    const uint32_t* slots;
+    uint32_t num_slots;
+
+    // The entries and their paths.
+    const Entry* entries;
+    uint32_t num_entries;
+    const char* paths;
+
+    // Unmaps the pack if it's mapped.
+    void Unmap();
+
+    // Finds the entry of a normalized path, or returns nullptr if the pack doesn't contain it.
+    const Entry* Find(const std::string& path);
+
+    // Checks that the table of contents and the entries lie within the pack, and that compressed
+    // entries don't claim to decompress to more than LZ4 can expand them to. This throws if not.
+    void Validate(uint64_t paths_size);
+};
+
+}
+#endif // GFX_ASSET_PACK_H
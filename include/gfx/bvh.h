@@ -0,0 +1,84 @@
+// This class defines a bounding volume hierarchy over a set of triangles for tracing rays on the
+// CPU, e.g. to bake ambient occlusion. The hierarchy is built top down by splitting each node
+// where the surface area heuristic is lowest among BVH_SAH_BINS bins of the triangle centroids,
+// and is stored as a flat array of nodes with both children of a node next to each other. Rays are
+// traced in packets of 4 that walk the hierarchy together, with the box and triangle tests of the
+// whole packet done at once in SSE registers. Only occlusion queries are supported, which stop as
+// soon as every ray in the packet hits something.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_BVH_H
+#define GFX_BVH_H
+
+#include "gfx/model_info.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gfx {
+
+class Bvh {
+  public:
+    // Constructor that builds the hierarchy over the triangles given by the indices into the
+    // positions.
+    Bvh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices);
+
+    // Constructor that builds the hierarchy over the triangles of every mesh of a ModelInfo in
+    // model space.
+    Bvh(gfx::ModelInfo* model_info);
+
+    // Traces a packet of 4 rays and returns a mask with bit i set if ray i hits a triangle at a
+    // distance in (0, max_distance). The directions don't need to be normalized, in which case
+    // distances are in multiples of their lengths.
+    unsigned int GetOccludedRays(const glm::vec3 origins[4], const glm::vec3 directions[4],
+        float max_distance);
+
+    // Traces a single ray and returns whether it hits a triangle at a distance in
+    // (0, max_distance).
+    bool IsOccluded(glm::vec3 origin, glm::vec3 direction, float max_distance);
+
+    // Gets the corners of the box bounding every triangle.
+    glm::vec3 GetMin();
+    glm::vec3 GetMax();
+
+    // Gets the number of nodes and the number of triangles in the hierarchy.
+    size_t GetNumNodes();
+    size_t GetNumTriangles();
+
+    // Disable copy constructor and copy assignment.
+    Bvh(Bvh const&) = delete;
+    void operator=(Bvh const&) = delete;
+
+  private:
+    // A node of the hierarchy. A leaf holds count triangles starting at offset, and an interior
+    // node (with a count of 0) has its children at offset and offset + 1.
+    struct Node {
+      glm::vec3 min;
+      unsigned int offset;
+      glm::vec3 max;
+      unsigned int count;
+    };
+
+    // A triangle stored as a vertex and the two edges from it, which is what the intersection
+    // test needs.
+    struct Triangle {
+      glm::vec3 vertex;
+      glm::vec3 edge_1;
+      glm::vec3 edge_2;
+    };
+
+    // The nodes, with the root first.
+    std::vector<Node> nodes;
+
+    // The triangles in the order the leaves reference them.
+    std::vector<Triangle> triangles;
+
+    // Builds the hierarchy over the triangles given by the indices into the positions.
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices);
+};
+
+}
+#endif // GFX_BVH_H
@@ -0,0 +1,110 @@
+// This class manages the cascaded shadow maps of a directional light. The view frustum is split
+// with the practical split scheme and each slice is covered by a padded, texel-snapped orthographic
+// cascade so shadows don't shimmer as the camera moves. Static casters are cached per cascade and
+// only re-rendered when the light, the cascade, or a static caster changes. Dynamic casters are
+// drawn on top of a copy of the cache each frame.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_CASCADED_SHADOW_MAP_H
+#define GFX_CASCADED_SHADOW_MAP_H
+
+#include "gfx/constants.h"
+#include "gfx/model_instance.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gfx {
+
+class CascadedShadowMap {
+  public:
+    // Handle to the OpenGL managed depth texture array (one layer per cascade) that is sampled
+    // when shading. This is 0 until the first call to Render.
+    GLuint shadow_map_handle;
+
+    // Constructor given the depth-only shader program used to render the casters. This program
+    // must take model_transform, view_transform, and projection_transform uniforms.
+    CascadedShadowMap(GLuint depth_program);
+
+    // Updates the cascades for the given camera view transform, field of view (in degrees),
+    // aspect ratio, light direction, and casters, re-rendering only the cascades that changed.
+    // This leaves the shadow framebuffer bound and the viewport set to the shadow map size.
+    // Returns true if any of the shadow transforms changed.
+    bool Render(glm::mat4 view_transform, float fov, float aspect_ratio, glm::vec3 light_direction,
+        const std::vector<gfx::ModelInstance*>& casters);
+
+    // Gets the transform from world space into the [0, 1] shadow map space of a cascade.
+    glm::mat4 GetShadowTransform(unsigned int cascade);
+
+    // Gets the world space size of a texel of a cascade (used for normal offset biasing).
+    float GetTexelSize(unsigned int cascade);
+
+    // Gets the number of cascades whose static casters were re-rendered in the last Render.
+    unsigned int GetCascadesRendered();
+
+    // Replaces the depth-only shader program used to render the casters (e.g. after it was
+    // reloaded). The old program is not deleted.
+    void SetDepthProgram(GLuint depth_program);
+
+    // Disable copy constructor and copy assignment.
+    CascadedShadowMap(CascadedShadowMap const&) = delete;
+    void operator=(CascadedShadowMap const&) = delete;
+
+  private:
+    // Describes the cached state of a single cascade.
+    struct Cascade {
+      // The world space center of the cascade.
+      glm::vec3 center;
+      // The radius of the cascade in world units (half the width of the orthographic projection).
+      float radius;
+      // The light view-projection transform of the cascade.
+      glm::mat4 view_projection;
+      // Whether the static cache of the cascade has ever been rendered.
+      bool valid;
+      // Signature of the static casters rendered into the static cache.
+      size_t static_signature;
+    };
+
+    // The depth-only shader program used to render the casters.
+    GLuint depth_program;
+
+    // Handle to the depth texture array holding only the static casters.
+    GLuint static_map_handle;
+
+    // Framebuffer used to render into and copy between the cascade layers.
+    GLuint fbo;
+
+    // Framebuffer used as the read target when copying the static cache.
+    GLuint read_fbo;
+
+    // The cached state of the cascades.
+    Cascade cascades[gfx::NUM_SHADOW_CASCADES];
+
+    // The light direction the cascades were rendered with.
+    glm::vec3 cached_light_direction;
+
+    // Whether dynamic casters were drawn over the cache in the last frame.
+    bool had_dynamic_casters;
+
+    // The number of cascades whose static casters were re-rendered in the last Render.
+    unsigned int cascades_rendered;
+
+    // Allocates the depth texture arrays and framebuffers.
+    void Initialize();
+
+    // Computes the view distances of the cascade split planes using the practical split scheme.
+    void ComputeSplits(float splits[gfx::NUM_SHADOW_CASCADES + 1]);
+
+    // Draws the casters matching is_static into the given layer of the given texture array.
+    void DrawCasters(GLuint texture, unsigned int cascade,
+        const std::vector<gfx::ModelInstance*>& casters, bool is_static, bool clear);
+
+    // Copies a cascade layer of the static cache into the sampled shadow map.
+    void CopyStaticCache(unsigned int cascade);
+};
+
+}
+#endif // GFX_CASCADED_SHADOW_MAP_H
@@ -7,17 +7,169 @@
 
 #include "gfx/light.h"
 
+#include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <cstddef>
+
 namespace gfx {
 
 // The maximum number of point lights in a scene.
 const unsigned int MAX_POINT_LIGHTS = 3;
 // The number of samples for MSAA.
 const unsigned int MSAA_SAMPLES = 4;
+// The number of sub-pixel jitter positions TAA cycles through.
+const unsigned int TAA_JITTER_PHASES = 8;
+// How much of the reprojected history TAA keeps each frame.
+const float TAA_HISTORY_WEIGHT = 0.9f;
 // The number of samples to take for IBL. Note that this must match the number in main.frag and
 // must be in base 2.
 const unsigned int NUM_IBL_SAMPLES = 32;
+// The distance to the near plane of the perspective projection.
+const float NEAR_PLANE = 0.1f;
+// The distance to the far plane of the perspective projection.
+const float FAR_PLANE = 1000.0f;
+// The number of shadow cascades for the directional light. Note that this must match the number
+// in common.glsl.
+const unsigned int NUM_SHADOW_CASCADES = 4;
+// The width and height in texels of each shadow cascade.
+const unsigned int SHADOW_MAP_SIZE = 1024;
+// The distance from the camera covered by the shadow cascades.
+const float SHADOW_DISTANCE = 60.0f;
+// Blend between logarithmic (1.0) and uniform (0.0) cascade splits for the practical split scheme.
+const float SHADOW_SPLIT_LAMBDA = 0.75f;
+// How much larger than its frustum slice each cascade is. The slack lets the camera move without
+// re-rendering the cascade until the slice leaves the cached region.
+const float SHADOW_CASCADE_PADDING = 1.3f;
+// The largest and smallest width and height in texels of a point light shadow cube face. Each
+// light gets a power of two size in this range depending on its screen coverage.
+const unsigned int MAX_POINT_SHADOW_SIZE = 512;
+const unsigned int MIN_POINT_SHADOW_SIZE = 128;
+// The maximum number of point light shadow cube faces rendered per frame. Dirty faces over the
+// budget are deferred to later frames.
+const unsigned int POINT_SHADOW_FACE_BUDGET = 6;
+// The irradiance below which a point light is considered too dim to need shadows. This bounds
+// the range of the shadow cube.
+const float POINT_SHADOW_IRRADIANCE_CUTOFF = 0.05f;
+// The distance to the near plane of the point light shadow cube faces.
+const float POINT_SHADOW_NEAR_PLANE = 0.05f;
+// The bounds of the dynamic resolution scale, as a fraction of the viewport width and height.
+const float MIN_RESOLUTION_SCALE = 0.5f;
+const float MAX_RESOLUTION_SCALE = 1.0f;
+// How far the dynamic resolution scale moves towards the scale that would hit the target frame
+// time each frame. Smaller values react slower but don't chase noise in the GPU timings.
+const float RESOLUTION_SCALE_SMOOTHING = 0.1f;
+// The number of half resolution levels in the downsample chain shared by bloom and auto exposure.
+// The first level is half the viewport resolution. Note that this must match the number of names
+// in game_window.cc.
+const unsigned int DOWNSAMPLE_LEVELS = 6;
+// How much of the bloom is blended into the HDR color before tone mapping.
+const float BLOOM_STRENGTH = 0.04f;
+// The exposure maps the log average scene luminance to this middle grey.
+const float EXPOSURE_KEY = 0.18f;
+// The bounds of the auto exposure, which keep a black or blown out frame from picking an extreme
+// exposure.
+const float MIN_EXPOSURE = 1.0f / 16.0f;
+const float MAX_EXPOSURE = 16.0f;
+// How fast in 1 / seconds the exposure adapts towards the one measured each frame. The exposure
+// covers 1 - e^-1 of the remaining distance in log space every 1 / rate seconds.
+const float EXPOSURE_ADAPTATION_RATE = 1.5f;
+// The number of frames the profiler waits before reading back the GPU timings of a frame. Frames
+// whose timings still aren't ready are dropped rather than stalling.
+const unsigned int PROFILER_QUERY_LATENCY = 4;
+// The maximum number of GPU scopes timed per frame.
+const unsigned int PROFILER_MAX_GPU_SCOPES = 32;
+// The number of frames in the profiler's rolling statistics.
+const unsigned int PROFILER_HISTORY_FRAMES = 240;
+// The number of frames of streamed data that can be in flight at once. The CPU can get this many
+// frames ahead of the GPU before it waits.
+const unsigned int STREAM_BUFFER_FRAMES = 3;
+// The size in bytes of each frame's region of the streamed uniform buffer. This fits the
+// constants of about 16k ModelInstances, or of several hundred skinned ModelInstances with their
+// skinning palettes.
+const size_t STREAM_BUFFER_REGION_SIZE = 8 << 20;
+// How long in nanoseconds to block on a stream buffer fence before checking it again.
+const GLuint64 STREAM_BUFFER_WAIT_TIMEOUT = 1000000;
+// The uniform block binding points of the streamed per-frame and per-instance constants. Note
+// that these are bound by the GameWindow to the blocks in main.vert.
+const GLuint FRAME_CONSTANTS_BINDING = 0;
+const GLuint INSTANCE_CONSTANTS_BINDING = 1;
+// The uniform block binding point of the streamed skinning palettes. Note that this is bound by
+// the GameWindow to the block in skinning.glsl.
+const GLuint SKINNING_PALETTE_BINDING = 2;
+// The number of queued ModelInstances each worker thread processes at a time when building the
+// draw list.
+const size_t DRAW_LIST_GRAIN_SIZE = 256;
+// The number of view depth buckets the draw list is sorted into front to back.
+const unsigned int DRAW_LIST_DEPTH_BUCKETS = 1024;
+// The width and height in pixels of the screen tiles the CpuRenderer rasterizes in parallel.
+const unsigned int CPU_TILE_SIZE = 32;
+// The number of vertices or triangles each worker thread of the CpuRenderer transforms or sets up
+// at a time.
+const size_t CPU_GRAIN_SIZE = 1024;
+// The number of bins the centroids are sorted into when choosing a BVH split with the surface area
+// heuristic.
+const unsigned int BVH_SAH_BINS = 16;
+// The most triangles a BVH leaf holds.
+const unsigned int BVH_MAX_LEAF_TRIANGLES = 4;
+// The number of texels the AoBaker traces rays for at a time on each worker thread.
+const size_t AO_BAKE_GRAIN_SIZE = 64;
+// The number of L2 spherical harmonics coefficients an IrradianceVolume stores per probe. This must
+// match the value defined in common.glsl.
+const unsigned int IRRADIANCE_SH_COEFFICIENTS = 9;
+// The width the environment is box filtered down to before an IrradianceVolume bake samples it,
+// so the few rays per probe don't alias small bright features.
+const int IRRADIANCE_ENVIRONMENT_WIDTH = 128;
+// The number of probes an IrradianceVolume bake traces at a time on each worker thread.
+const size_t IRRADIANCE_BAKE_GRAIN_SIZE = 1;
+// The texture unit the lit shaders sample the IrradianceVolume from.
+const GLuint IRRADIANCE_VOLUME_TEXTURE_UNIT = 8;
+// The maximum number of area lights. Make sure this matches the MAX_AREA_LIGHTS in common.glsl!
+const unsigned int MAX_AREA_LIGHTS = 4;
+// The number of entries along each axis of the LTC tables that fit_ltc fits by default.
+const unsigned int LTC_TABLE_SIZE = 64;
+// The most entries along each axis of LTC tables that can be fitted or loaded.
+const unsigned int LTC_MAX_TABLE_SIZE = 256;
+// The number of samples along each axis of the grids of directions that the error of each LTC
+// fit is measured over by default.
+const unsigned int LTC_FIT_SAMPLES = 32;
+// The number of Newton steps taken to find the cone of a disk area light. This must match the
+// value defined in common.glsl.
+const int LTC_DISK_ITERATIONS = 8;
+// The texture units the LTC matrix and amplitude tables are bound to.
+const GLuint LTC_MATRIX_TEXTURE_UNIT = 9;
+const GLuint LTC_AMPLITUDE_TEXTURE_UNIT = 10;
+// The parent of the root transforms in a TransformHierarchy.
+const unsigned int TRANSFORM_NO_PARENT = 0xFFFFFFFF;
+// The most joints a Skeleton can have. This must match the value defined in skinning.glsl.
+const unsigned int MAX_SKIN_JOINTS = 128;
+// The parent of the root joints of a Skeleton.
+const unsigned int JOINT_NO_PARENT = 0xFFFFFFFF;
+// The most AnimationClips an Animator blends into the pose of each character.
+const unsigned int ANIMATION_MAX_LAYERS = 4;
+// The number of characters an Animator poses at a time on each worker thread.
+const size_t ANIMATION_GRAIN_SIZE = 8;
+// How far (in model units, quaternion components, and scale factors) the keys an AnimationClip
+// keeps may interpolate away from the translation, rotation, and scale samples of the dropped
+// keys by default.
+const float ANIMATION_TRANSLATION_TOLERANCE = 0.001f;
+const float ANIMATION_ROTATION_TOLERANCE = 0.0005f;
+const float ANIMATION_SCALE_TOLERANCE = 0.001f;
+// The number of frame captures that can be read back at once. A capture is mapped up to this many
+// frames after it was rendered, so the GPU has long finished writing it.
+const unsigned int CAPTURE_READBACK_FRAMES = 3;
+// The number of mapped frame captures that can wait for the encoder thread before capturing
+// blocks the render loop.
+const size_t CAPTURE_MAX_QUEUED_FRAMES = 8;
+// The number of digits the frame numbers of captured image sequences are zero padded to.
+const int CAPTURE_FRAME_DIGITS = 5;
+// How long in nanoseconds to block on a frame capture fence before checking it again.
+const GLuint64 CAPTURE_WAIT_TIMEOUT = 1000000;
+// The alignment in bytes of the contents of each asset in an AssetPack.
+const size_t ASSET_PACK_ALIGNMENT = 64;
+// The fraction of its size compressing an asset must save for an AssetPack to store it compressed,
+// since compressed assets have to be decompressed instead of read in place.
+const double ASSET_PACK_MIN_SAVINGS = 0.05;
 
 }
 #endif // GFX_CONSTANTS_H
@@ -0,0 +1,296 @@
+// This class renders scenes on the CPU with the same results as the GameWindow's forward MSAA path,
+// as a reference to validate the OpenGL output against and as a fallback where no usable OpenGL
+// driver is available. It takes the same Camera, lights, Environments, and ModelInstances, queued
+// between PrepareRender and FinishRender. FinishRender transforms the vertices, clips the
+// triangles against the near plane, and bins them into screen tiles, each step split across the
+// threads of a job system. The tiles are then rasterized in parallel into tile-local buffers with
+// MSAA_SAMPLES samples per pixel. Edge functions are evaluated exactly in double precision on
+// vertices snapped to the sub-pixel grid, so edges shared by two triangles never crack. Coverage
+// and depth are tested with SIMD across all samples of a pixel at once (SSE2, or AVX when built
+// with ENABLE_AVX), while triangle setup stays scalar. Once a tile is rasterized, every triangle
+// covering a pixel is shaded once at the pixel center with the Cook-Torrance BRDF and IBL of
+// lighting.glsl. The barycentrics at the pixel and at its quad (for texture derivatives) are
+// interpolated together with SIMD. The samples are then tone mapped, resolved, gamma corrected,
+// and dithered like in hdr.frag.
+// Shadows aren't rendered, so lights are treated as if they didn't cast any.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_CPU_RENDERER_H
+#define GFX_CPU_RENDERER_H
+
+#include "gfx/area_light.h"
+#include "gfx/camera.h"
+#include "gfx/color.h"
+#include "gfx/constants.h"
+#include "gfx/directional_light.h"
+#include "gfx/environment.h"
+#include "gfx/irradiance_volume.h"
+#include "gfx/job_system.h"
+#include "gfx/ltc_table.h"
+#include "gfx/mesh.h"
+#include "gfx/model_instance.h"
+#include "gfx/point_light.h"
+#include "gfx/texture_manager.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace gfx {
+
+// A mipmapped image decoded for sampling on the CPU. Each level holds 3 components per texel, with
+// the first row at a v coordinate of 0 like an OpenGL texture.
+template <typename T>
+struct CpuTexture {
+  // The dimensions of each level.
+  std::vector<int> widths;
+  std::vector<int> heights;
+  // The texels of each level.
+  std::vector<std::vector<T>> levels;
+  // Whether the texels are sRGB and converted to linear space when sampled.
+  bool convert_to_linear;
+};
+
+class CpuRenderer {
+  public:
+    // A reference to the camera used to render the scene.
+    gfx::Camera* camera;
+
+    // Constructor given the dimensions of the image, the camera, the vertical field of view in
+    // degrees, the clear color, and the TextureManager the materials' maps were loaded through,
+    // which is used to find their images. The renderer runs on its own job system with a thread
+    // per core. No OpenGL context is needed.
+    CpuRenderer(int width, int height, gfx::Camera* camera, float fov, gfx::Color color,
+        gfx::TextureManager* manager);
+
+    // Destructor which stops the job system.
+    ~CpuRenderer();
+
+    // Sets the directional light, or removes it if directional_light is nullptr.
+    void SetDirectionalLight(gfx::DirectionalLight* directional_light);
+
+    // Adds a point light to the scene. This throws if the light was already added or if there are
+    // already MAX_POINT_LIGHTS lights. Unlike with the GameWindow, changes to a light are picked up
+    // by the next FinishRender without having to update it.
+    void AddPointLight(gfx::PointLight* point_light);
+
+    // Removes a point light from the scene. This throws if the light wasn't added.
+    void RemovePointLight(gfx::PointLight* point_light);
+
+    // Adds an area light to the scene, loading the LTC tables it's shaded with from
+    // ltc_table_path the first time. This throws if the light was already added, if there are
+    // already MAX_AREA_LIGHTS lights, or if the tables can't be loaded.
+    void AddAreaLight(gfx::AreaLight* area_light);
+
+    // Removes an area light from the scene. This throws if the light wasn't added.
+    void RemoveAreaLight(gfx::AreaLight* area_light);
+
+    // Sets the irradiance volume used for indirect diffuse lighting, or removes it if
+    // irradiance_volume is nullptr. The volume is read on the CPU, so it doesn't need to be
+    // uploaded.
+    void SetIrradianceVolume(gfx::IrradianceVolume* irradiance_volume);
+
+    // Starts a new frame with an environment for the skybox, or nullptr to clear the background to
+    // the clear color.
+    void PrepareRender(gfx::Environment* environment);
+
+    // Starts a new frame without a skybox.
+    void PrepareRender() { PrepareRender(nullptr); }
+
+    // Queues a ModelInstance to be rendered by FinishRender with an environment for ambient
+    // lighting, or nullptr for a constant ambient term.
+    void RenderModel(gfx::ModelInstance* model_instance, gfx::Environment* environment);
+
+    // Queues a ModelInstance to be rendered without an environment.
+    void RenderModel(gfx::ModelInstance* model_instance) { RenderModel(model_instance, nullptr); }
+
+    // Renders the queued ModelInstances. Textures and environments are decoded the first time
+    // they're rendered. This throws if one can't be loaded.
+    void FinishRender();
+
+    // Gets the pixels of the last frame as 8-bit RGBA rows from the bottom up, which is how
+    // glReadPixels returns the GameWindow's default framebuffer.
+    const std::vector<unsigned char>& GetPixels();
+
+    // Gets the dimensions of the image.
+    int GetWidth();
+    int GetHeight();
+
+    // Gets the number of triangles rasterized by the last FinishRender, after clipping.
+    size_t GetTrianglesRasterized();
+
+    // Gets the job system the renderer runs on.
+    gfx::JobSystem* GetJobSystem();
+
+    // Disable copy constructor and copy assignment.
+    CpuRenderer(CpuRenderer const&) = delete;
+    void operator=(CpuRenderer const&) = delete;
+
+  private:
+    // A vertex after the vertex stage, with the outputs of main.vert.
+    struct ShadedVertex {
+      // The clip space position.
+      glm::vec4 position;
+      // The world space position, tangent frame, and UV coordinates.
+      glm::vec3 world_position;
+      glm::vec3 tangent;
+      glm::vec3 bitangent;
+      glm::vec3 normal;
+      glm::vec2 uv;
+    };
+
+    // A mesh of a queued ModelInstance and what it's shaded with.
+    struct Draw {
+      // The mesh.
+      gfx::Mesh* mesh;
+      // The model and normal transforms.
+      glm::mat4 model_transform;
+      glm::mat4 normal_transform;
+      // The skinning palette of a skinned mesh of an animated ModelInstance, or nullptr.
+      const glm::vec4* skinning_palette;
+      // The albedo, metallic, roughness, normal, and AO maps, or nullptr for the map's value.
+      const gfx::CpuTexture<unsigned char>* maps[5];
+      // The values used for missing maps.
+      glm::vec3 map_values[5];
+      // The environment for ambient lighting, or nullptr.
+      const gfx::CpuTexture<float>* environment;
+      // The index of the draw's first vertex and first triangle across all draws.
+      size_t first_vertex;
+      size_t first_triangle;
+    };
+
+    // A triangle set up for rasterization.
+    struct Triangle {
+      // The draw the triangle belongs to.
+      const Draw* draw;
+      // The window space positions of the vertices, snapped to the sub-pixel grid, and the
+      // reciprocals of their clip space w.
+      double x[3];
+      double y[3];
+      float inverse_w[3];
+      // The window space depth at the first vertex and its derivatives in x and y.
+      double depth;
+      double depth_dx;
+      double depth_dy;
+      // Twice the (positive) area of the triangle in window space.
+      double area;
+      // Whether each edge (opposite its vertex) is a top or left edge, which own the samples
+      // exactly on them.
+      bool top_left[3];
+      // The bounding box of the covered pixels.
+      int min_x;
+      int min_y;
+      int max_x;
+      int max_y;
+      // The vertices, whose attributes are interpolated when shading.
+      ShadedVertex vertices[3];
+    };
+
+    // The triangles and per-tile bins set up by one chunk of the input triangles.
+    struct TriangleChunk {
+      // The triangles, which may be fewer or more than the input triangles after clipping.
+      std::vector<Triangle> triangles;
+      // The indices into triangles of those overlapping each tile.
+      std::vector<std::vector<unsigned int>> bins;
+    };
+
+    // The dimensions of the image and its tiles.
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+
+    // The vertical field of view in degrees.
+    float field_of_view;
+
+    // The clear color.
+    gfx::Color clear_color;
+
+    // The TextureManager the materials' maps were loaded through.
+    gfx::TextureManager* manager;
+
+    // Runs the vertex, setup, and tile jobs.
+    gfx::JobSystem* job_system;
+
+    // The directional light, or nullptr.
+    gfx::DirectionalLight* directional_light;
+
+    // The point light in each slot, or nullptr.
+    gfx::PointLight* point_lights[gfx::MAX_POINT_LIGHTS];
+
+    // The area light in each slot, or nullptr.
+    gfx::AreaLight* area_lights[gfx::MAX_AREA_LIGHTS];
+
+    // The LTC tables area lights are shaded with, or nullptr until an area light is added.
+    std::unique_ptr<gfx::LtcTable> ltc_table;
+
+    // The irradiance volume, or nullptr.
+    gfx::IrradianceVolume* irradiance_volume;
+
+    // The Hammersley points used to sample the environments.
+    glm::vec2 hammersley_points[gfx::NUM_IBL_SAMPLES];
+
+    // The skybox environment of the current frame.
+    gfx::Environment* skybox_environment;
+
+    // The ModelInstances (and their environments) queued for the current frame.
+    std::vector<std::pair<gfx::ModelInstance*, gfx::Environment*>> queued_models;
+
+    // The decoded maps by OpenGL handle and the decoded environments by path.
+    std::unordered_map<GLuint, std::unique_ptr<gfx::CpuTexture<unsigned char>>> maps;
+    std::unordered_map<std::string, std::unique_ptr<gfx::CpuTexture<float>>> environments;
+
+    // The draws, vertices, and triangle chunks of the current frame. These are kept between
+    // frames to reuse their memory.
+    std::vector<Draw> draws;
+    std::vector<ShadedVertex> vertices;
+    std::vector<TriangleChunk> chunks;
+
+    // The number of triangles rasterized by the last FinishRender.
+    size_t triangles_rasterized;
+
+    // The output image.
+    std::vector<unsigned char> pixels;
+
+    // Gets the decoded texture of a map, decoding it if it isn't cached yet. This returns nullptr
+    // for a handle of 0.
+    const gfx::CpuTexture<unsigned char>* GetMap(GLuint handle);
+
+    // Gets the decoded image of an environment, decoding it if it isn't cached yet. This returns
+    // nullptr for a nullptr environment.
+    const gfx::CpuTexture<float>* GetEnvironment(gfx::Environment* environment);
+
+    // Creates the draws of the queued ModelInstances.
+    void CreateDraws();
+
+    // Runs the vertex stage over the vertices of every draw.
+    void ShadeVertices(const glm::mat4& view_projection);
+
+    // Clips, sets up, and bins the triangles of every draw.
+    void SetUpTriangles();
+
+    // Clips a triangle against the near plane and sets up what's left of it.
+    void ClipTriangle(const Draw* draw, const ShadedVertex* triangle_vertices[3],
+        TriangleChunk* chunk);
+
+    // Sets up a triangle in clip space, appending it to a chunk and its bins unless it's
+    // degenerate or covers no pixels.
+    void AddTriangle(const Draw* draw, const ShadedVertex& a, const ShadedVertex& b,
+        const ShadedVertex& c, TriangleChunk* chunk);
+
+    // Rasterizes, shades, and resolves a tile. The inverse sky transform maps normalized device
+    // coordinates to view directions of the skybox.
+    void RenderTile(int tile_x, int tile_y, const glm::mat4& inverse_sky_transform);
+
+    // Shades a triangle at the center of a pixel as main.frag would.
+    glm::vec3 ShadePixel(const Triangle& triangle, int x, int y);
+};
+
+}
+#endif // GFX_CPU_RENDERER_H
@@ -16,6 +16,9 @@ class DirectionalLight : public gfx::Light {
     // The direction the light is coming from. This is not inverted!
     glm::vec3 direction;
 
+    // Whether the light casts shadows with cascaded shadow maps. This defaults to true.
+    bool casts_shadows;
+
     // Constructor for a DirectionalLight that specifies a color irradiance and direction.
     DirectionalLight(glm::vec3 direction, glm::vec3 irradiance);
 };
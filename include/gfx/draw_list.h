@@ -0,0 +1,61 @@
+// This header defines the view frustum culling and sort keys used to build the draw list. They
+// don't touch OpenGL, so the draw list can be built on worker threads. The per-instance tests are
+// defined here so the draw list loop can inline them.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_DRAW_LIST_H
+#define GFX_DRAW_LIST_H
+
+#include "gfx/constants.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+namespace gfx {
+
+class ModelInfo;
+
+class Frustum {
+  public:
+    // Constructor given a view projection transform. This extracts the normalized planes of the
+    // view frustum (Gribb and Hartmann).
+    Frustum(glm::mat4 view_projection);
+
+    // Returns whether a bounding sphere is at least partly inside the frustum.
+    bool IntersectsSphere(glm::vec3 center, float radius) const {
+      for (int i = 0; i < 6; i++) {
+        if (!(glm::dot(glm::vec3(planes[i]), center) + planes[i].w >= -radius)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+  private:
+    // The left, right, bottom, top, near, and far planes with unit length normals pointing in.
+    glm::vec4 planes[6];
+};
+
+// Computes the key the draw list is sorted by. With depth_sorted set, the draws are sorted front
+// to back in coarse depth buckets so hidden samples fail the depth test early. Within a bucket
+// (or always, without depth_sorted) the instances of a model are grouped so consecutive draws
+// share vertex arrays and materials.
+inline uint64_t ComputeDrawSortKey(const glm::mat4& view_transform, glm::vec3 center,
+    gfx::ModelInfo* model_info, bool depth_sorted) {
+  uint64_t bucket = 0;
+  if (depth_sorted) {
+    float depth = -(view_transform * glm::vec4(center, 1.0f)).z / gfx::FAR_PLANE;
+    depth = std::min(std::max(depth, 0.0f), 1.0f);
+    bucket = (uint64_t)(std::sqrt(depth) * (gfx::DRAW_LIST_DEPTH_BUCKETS - 1));
+  }
+  uint64_t model_key = std::hash<gfx::ModelInfo*>()(model_info);
+  return (bucket << 54) | (model_key & ((1ull << 54) - 1));
+}
+
+}
+#endif // GFX_DRAW_LIST_H
@@ -16,8 +16,11 @@ namespace gfx {
 // TODO(brkho): Implement more types of supported textures other than parabolic.
 class Environment {
   public:
-    // Handle to the OpenGL managed texture for the environment. This is an HDR texture.
+    // Handle to the OpenGL managed texture for the environment. This is an HDR texture, or 0 if
+    // the environment wasn't uploaded.
     GLuint environment_handle;
+    // The path to the HDR image.
+    std::string path;
     // How much to blur the skybox (essentially what mipmap level to sample from).
     GLfloat skybox_blur;
 
@@ -25,8 +28,21 @@ class Environment {
     // texture uploades that go through TextureManager, this does not prevent duplicates.
     Environment(std::string skybox_path, GLfloat skybox_blur);
 
+    // Constructor that also specifies whether to upload the image to OpenGL. Without uploading, no
+    // OpenGL context is needed and the image isn't loaded until it's rendered (e.g. by the
+    // CpuRenderer).
+    Environment(std::string skybox_path, GLfloat skybox_blur, bool should_upload);
+
     // Constructor for an environment without a skybox blur.
     Environment(std::string skybox_path) : Environment(skybox_path, 0.0f) {}
+
+    // Decodes an HDR image into 32-bit float pixels without touching OpenGL. This returns nullptr
+    // if the image can't be loaded or doesn't have 3 or 4 components. The pixels must be freed
+    // with FreeImage.
+    static float* DecodeImage(std::string path, int* width, int* height, int* num_components);
+
+    // Frees the pixels returned by DecodeImage.
+    static void FreeImage(float* image_data);
 };
 
 }
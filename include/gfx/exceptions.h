@@ -79,5 +79,200 @@ class InvalidEOFileFormatException : public std::exception {
     }
 };
 
+// When a frame writes more data than fits in its region of a stream buffer.
+class StreamBufferFullException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Stream buffer region is full.";
+    }
+};
+
+// When the profiler cannot write a trace file.
+class CannotWriteTraceException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Trace file cannot be written.";
+    }
+};
+
+// When a headless OpenGL context cannot be created.
+class CannotCreateHeadlessContextException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Headless OpenGL context cannot be created.";
+    }
+};
+
+// When a transform is parented to a transform added after it (or to itself).
+class InvalidTransformParentException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Transform parent must be added before the transform.";
+    }
+};
+
+// When a render graph references a missing pass or render target, or one of its framebuffers is
+// incomplete.
+class InvalidRenderGraphException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Render graph is invalid.";
+    }
+};
+
+// When a directory cannot be watched for changed files.
+class CannotWatchFilesException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Files cannot be watched for changes.";
+    }
+};
+
+// When a changed shader fails to compile or link into one of the programs that use it.
+class CannotReloadShaderException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Shader cannot be reloaded.";
+    }
+};
+
+// When a baked image cannot be written.
+class CannotWriteImageException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Image cannot be written.";
+    }
+};
+
+// When an EO file cannot be written.
+class CannotWriteEOFileException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "EO file cannot be written.";
+    }
+};
+
+// When a skeleton's joints are out of order or too many, or a skeleton doesn't match the model or
+// animation it's used with.
+class InvalidSkeletonException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Skeleton is invalid.";
+    }
+};
+
+// When an animation clip is compressed from no frames, too many frames, or frames with different
+// numbers of joints.
+class InvalidAnimationClipException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Animation clip is invalid.";
+    }
+};
+
+// When an animation file cannot be opened.
+class CannotOpenAnimationFileException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Animation file cannot be opened.";
+    }
+};
+
+// When an animation file is malformed.
+class InvalidAnimationFileFormatException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Animation file is malformed.";
+    }
+};
+
+// When an animation file cannot be written.
+class CannotWriteAnimationFileException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Animation file cannot be written.";
+    }
+};
+
+// When LTC tables are fitted with too few or too many entries, or a file of them is malformed.
+class InvalidLtcTableException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "LTC table is invalid.";
+    }
+};
+
+// When an LTC table file cannot be opened.
+class CannotOpenLtcTableException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "LTC table file cannot be opened.";
+    }
+};
+
+// When an LTC table file cannot be written.
+class CannotWriteLtcTableException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "LTC table file cannot be written.";
+    }
+};
+
+// When an irradiance volume file is malformed.
+class InvalidIrradianceVolumeException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Irradiance volume file is malformed.";
+    }
+};
+
+// When an irradiance volume file cannot be opened.
+class CannotOpenIrradianceVolumeException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Irradiance volume file cannot be opened.";
+    }
+};
+
+// When an irradiance volume file cannot be written.
+class CannotWriteIrradianceVolumeException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Irradiance volume file cannot be written.";
+    }
+};
+
+// When an asset pack is malformed or an asset in it is corrupt.
+class InvalidAssetPackException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Asset pack is malformed.";
+    }
+};
+
+// When an asset pack cannot be opened.
+class CannotOpenAssetPackException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Asset pack cannot be opened.";
+    }
+};
+
+// When an asset pack cannot be written, or an asset to pack cannot be read.
+class CannotWriteAssetPackException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Asset pack cannot be written.";
+    }
+};
+
+// When dynamic resolution is enabled without a positive target frame time.
+class InvalidTargetFrameTimeException : public std::exception {
+  public:
+    const char * what () const throw () {
+      return "Target frame time must be positive.";
+    }
+};
+
 }
 #endif // GFX_EXCEPTIONS_H
@@ -0,0 +1,51 @@
+// This class watches directories for changed files so assets can be reloaded while the engine
+// runs. It's backed by inotify, watching each directory along with its subdirectories (including
+// ones created later). A file counts as changed once it's closed after being written or moved into
+// a watched directory, which covers editors that save through a temporary file. Polling never
+// blocks. This is only available when the engine is built with inotify (GFX_INOTIFY), and never
+// reports changes otherwise.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_FILE_WATCHER_H
+#define GFX_FILE_WATCHER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gfx {
+
+class FileWatcher {
+  public:
+    // Default constructor. This throws if inotify can't be initialized.
+    FileWatcher();
+
+    // Destructor which stops watching every directory.
+    ~FileWatcher();
+
+    // Watches a directory and its subdirectories. This throws if the directory can't be watched.
+    void WatchDirectory(std::string path);
+
+    // Gets the files that changed since the last poll, each once, in the order they first changed.
+    // The paths start with the path of the watched directory, e.g. "shaders/hdr.frag". New
+    // subdirectories that can't be watched are skipped rather than thrown for.
+    std::vector<std::string> Poll();
+
+    // Disable copy constructor and copy assignment.
+    FileWatcher(FileWatcher const&) = delete;
+    void operator=(FileWatcher const&) = delete;
+
+  private:
+    // The inotify file descriptor, or -1 without inotify.
+    int inotify_fd;
+
+    // Maps each inotify watch descriptor to the path of its directory.
+    std::unordered_map<int, std::string> watch_paths;
+
+    // Watches a single directory and then recurses into its subdirectories.
+    void AddWatch(const std::string& path);
+};
+
+}
+#endif // GFX_FILE_WATCHER_H
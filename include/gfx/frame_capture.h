@@ -0,0 +1,129 @@
+// This class captures rendered frames to an image sequence without stalling the render loop.
+// Each capture is read back into one of a ring of pixel pack buffers, so glReadPixels only queues
+// a copy on the GPU. The buffer is mapped a few frames later once its fence has signaled, and the
+// pixels are handed to a background thread that encodes and writes the image. The render loop
+// only waits when the GPU falls a whole ring behind or the encoder falls CAPTURE_MAX_QUEUED_FRAMES
+// behind, so frames are never dropped.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_FRAME_CAPTURE_H
+#define GFX_FRAME_CAPTURE_H
+
+#include "gfx/constants.h"
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gfx {
+
+// The format of captured frames. Png captures the tone mapped 8-bit image that is displayed. Pfm
+// captures the linear HDR image before tone mapping as raw 32-bit floats in a Portable Float Map.
+enum CaptureFormat { CapturePng, CapturePfm };
+
+class FrameCapture {
+  public:
+    // Constructor given the path prefix of the image sequence and the format. Frame i is written
+    // to the prefix followed by i zero padded to CAPTURE_FRAME_DIGITS digits and the extension.
+    // This must be called with a current OpenGL context.
+    FrameCapture(std::string path_prefix, gfx::CaptureFormat format);
+
+    // Waits for the outstanding captures to be read back and written before freeing the buffers.
+    // This must be called with the OpenGL context still current.
+    ~FrameCapture();
+
+    // Captures a width by height region at the origin of a framebuffer's read buffer. If
+    // tone_mapped is set, the framebuffer holds Reinhard tone mapped colors that Pfm captures
+    // convert back to linear.
+    void Capture(GLuint framebuffer, GLuint width, GLuint height, bool tone_mapped);
+
+    // Gets the format of the captured frames.
+    gfx::CaptureFormat GetFormat();
+
+    // Gets the number of frames captured so far.
+    unsigned int GetFramesCaptured();
+
+    // Gets the time in milliseconds the last Capture spent waiting on the GPU or the encoder.
+    double GetWaitTime();
+
+    // Disable copy constructor and copy assignment.
+    FrameCapture(FrameCapture const&) = delete;
+    void operator=(FrameCapture const&) = delete;
+
+  private:
+    // A capture being read back into a pixel pack buffer.
+    struct Readback {
+      // The pixel pack buffer and the number of bytes allocated for it.
+      GLuint buffer;
+      size_t buffer_size;
+      // The fence placed after the read, or nullptr if the buffer isn't in use.
+      GLsync fence;
+      // The frame number and size of the capture, and whether it's tone mapped.
+      unsigned int frame;
+      GLuint width;
+      GLuint height;
+      bool tone_mapped;
+    };
+
+    // A mapped capture waiting to be encoded. The pixels are RGBA with the rows bottom to top, as
+    // read by glReadPixels.
+    struct EncodeJob {
+      unsigned int frame;
+      GLuint width;
+      GLuint height;
+      bool tone_mapped;
+      std::vector<unsigned char> pixels;
+    };
+
+    // The path prefix of the image sequence and the format.
+    std::string path_prefix;
+    gfx::CaptureFormat format;
+
+    // The ring of readbacks. Captures are issued into next_readback, which also holds the oldest
+    // outstanding readback once the ring is full.
+    Readback readbacks[gfx::CAPTURE_READBACK_FRAMES];
+    unsigned int next_readback;
+
+    // The number of frames captured so far.
+    unsigned int frames_captured;
+
+    // The time the last Capture spent waiting.
+    double wait_time;
+
+    // The mapped captures waiting for the encoder thread, guarded by queue_mutex. The encoder is
+    // woken with job_queued, and the render loop waits on job_taken when the queue is full.
+    std::deque<EncodeJob> encode_queue;
+    std::mutex queue_mutex;
+    std::condition_variable job_queued;
+    std::condition_variable job_taken;
+
+    // Whether the encoder thread should exit once the queue is empty.
+    bool stopping;
+
+    // The thread encoding and writing the captures.
+    std::thread encoder;
+
+    // Waits for a readback's fence (if wait is set and it hasn't signaled yet), then maps its
+    // buffer and queues the pixels for encoding. Returns false without doing anything if wait isn't
+    // set and the GPU hasn't finished the read.
+    bool Retrieve(Readback* readback, bool wait);
+
+    // Queues a mapped capture for the encoder thread, waiting for room in the queue.
+    void Enqueue(EncodeJob job);
+
+    // The loop run by the encoder thread.
+    void EncodeFrames();
+
+    // Encodes and writes a capture to its file in the sequence.
+    void Encode(const EncodeJob& job);
+};
+
+}
+#endif // GFX_FRAME_CAPTURE_H
@@ -1,31 +1,77 @@
 // This class defines a game window backed by GLFW that abstracts away much of the OpenGL
 // operations. In addition, it will also manage the camera, shaders, and program(s). The GameWindow
 // will hold references to the Camera and Lights and will require an input of ModelInstances to
-// draw. The full feature set of the GLFW can be accessed via the window property.
+// draw. The full feature set of the GLFW can be accessed via the window property. A GameWindow can
+// also run headless, rendering offscreen without a window or display.
 //
 // Brian Ho (brian@brkho.com)
 
 #ifndef GFX_GAME_WINDOW_H
 #define GFX_GAME_WINDOW_H
 
+#include "gfx/area_light.h"
 #include "gfx/camera.h"
+#include "gfx/cascaded_shadow_map.h"
 #include "gfx/color.h"
 #include "gfx/constants.h"
 #include "gfx/directional_light.h"
 #include "gfx/environment.h"
+#include "gfx/frame_capture.h"
+#include "gfx/gl_stats.h"
+#include "gfx/headless_context.h"
+#include "gfx/irradiance_volume.h"
+#include "gfx/job_system.h"
+#include "gfx/ltc_table.h"
 #include "gfx/mesh.h"
 #include "gfx/model_instance.h"
 #include "gfx/point_light.h"
+#include "gfx/point_shadow_atlas.h"
+#include "gfx/profiler.h"
+#include "gfx/render_graph.h"
+#include "gfx/stream_buffer.h"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace gfx {
 
+// The base path for the shaders used internally by the engine's additional render passes.
+const std::string shaders_path = "shaders";
+
+// The renderer used to shade ModelInstances. Forward shading runs the full BRDF and IBL for every
+// covered sample of every rasterized fragment. Deferred shading writes a thin G-buffer and then
+// lights each pixel once, only shading per-sample on MSAA edges.
+enum RenderMode { Forward, Deferred };
+
+// How edges are anti-aliased. MSAA renders into 4x multisampled targets and resolves them after
+// tone mapping. TAA renders into single-sampled targets with a sub-pixel jitter that changes every
+// frame and accumulates the frames into a history buffer using motion vectors.
+enum AntiAliasingMode { MSAA, TAA };
+
+// Where frames are presented. Windowed opens a visible GLFW window. Headless creates an offscreen
+// EGL context instead, so frames can be rendered on servers and in CI containers without a
+// display (or a GPU, with llvmpipe). Headless GameWindows have no GLFW window and never get input.
+enum ContextMode { Windowed, Headless };
+
+// The per-frame constants read by main.vert. This matches the std140 layout of the FrameConstants
+// uniform block.
+struct FrameConstants {
+  // The camera view transform.
+  glm::mat4 view_transform;
+  // The (jittered) projection transform.
+  glm::mat4 projection_transform;
+  // The view-projection transforms of this and the previous frame without jitter.
+  glm::mat4 unjittered_view_projection;
+  glm::mat4 previous_view_projection;
+};
+
 // Bayer Matrix for ordered dithing used to combat banding in low light scenes.
 // From: http://www.anisopteragames.com/how-to-fix-color-banding-with-dithering/
 const char bayer_matrix[] = {
@@ -55,14 +101,29 @@ class GameWindow {
     // A reference to the camera used to render the scene.
     gfx::Camera* camera;
 
-    // A reference to the underlying GLFW window.
+    // A reference to the underlying GLFW window. This is nullptr for headless GameWindows.
     GLFWwindow* window;
 
     // The field of view for the window.
     GLfloat field_of_view;
 
     // Constructor with a width, height, paths to the shaders, the reference to the camera, field
-    // of view, and the buffer clear color.
+    // of view, the buffer clear color, the anti-aliasing mode, and the context mode.
+    GameWindow(int width, int height, std::string main_vertex_path, std::string main_fragment_path,
+        std::string hdr_vertex_path, std::string hdr_fragment_path, std::string skybox_vertex_path,
+        std::string skybox_fragment_path, gfx::Camera* camera, float fov, gfx::Color color,
+        gfx::AntiAliasingMode anti_aliasing_mode, gfx::ContextMode context_mode);
+
+    // Constructor with a width, height, paths to the shaders, the reference to the camera, field
+    // of view, the buffer clear color, and the anti-aliasing mode. This defaults the context mode
+    // to Windowed.
+    GameWindow(int width, int height, std::string main_vertex_path, std::string main_fragment_path,
+        std::string hdr_vertex_path, std::string hdr_fragment_path, std::string skybox_vertex_path,
+        std::string skybox_fragment_path, gfx::Camera* camera, float fov, gfx::Color color,
+        gfx::AntiAliasingMode anti_aliasing_mode);
+
+    // Constructor with a width, height, paths to the shaders, the reference to the camera, field
+    // of view, and the buffer clear color. This defaults the anti-aliasing mode to MSAA.
     GameWindow(int width, int height, std::string main_vertex_path, std::string main_fragment_path,
         std::string hdr_vertex_path, std::string hdr_fragment_path, std::string skybox_vertex_path,
         std::string skybox_fragment_path, gfx::Camera* camera, float fov, gfx::Color color);
@@ -80,6 +141,12 @@ class GameWindow {
     // game loop).
     bool IsRunning();
 
+    // Makes IsRunning return false, e.g. once a headless GameWindow has rendered enough frames.
+    void Close();
+
+    // Gets the context mode chosen at construction.
+    gfx::ContextMode GetContextMode();
+
     // Updates the dimensions of the window and recalculates the perspective projection.
     void UpdateDimensions(int width, int height);
 
@@ -108,40 +175,185 @@ class GameWindow {
     // it to be reflected for rendering in the engine.
     void UpdatePointLight(gfx::PointLight* point_light);
 
-    // Polls the GLFW window for events and invokes the proper callbacks.
+    // Adds an area light to the scene. The LTC tables it's shaded with are loaded from
+    // ltc_table_path the first time an area light is added.
+    void AddAreaLight(gfx::AreaLight* area_light);
+
+    // Removes an area light from the scene.
+    void RemoveAreaLight(gfx::AreaLight* area_light);
+
+    // Updates an area light. This must be called after any changes to the area light's fields for
+    // it to be reflected for rendering in the engine.
+    void UpdateAreaLight(gfx::AreaLight* area_light);
+
+    // Sets the irradiance volume used for indirect diffuse lighting, or removes it if
+    // irradiance_volume is nullptr. The volume must have been uploaded, and must be set again
+    // after it's moved or re-uploaded for the changes to be reflected.
+    void SetIrradianceVolume(gfx::IrradianceVolume* irradiance_volume);
+
+    // Sets the renderer used for subsequent frames. This must not be called in between a
+    // PrepareRender and a FinishRender. The G-buffer is allocated the first time deferred shading
+    // is selected.
+    void SetRenderMode(gfx::RenderMode mode);
+
+    // Gets the renderer currently used for rendering frames.
+    gfx::RenderMode GetRenderMode();
+
+    // Enables or disables the depth pre-pass. When enabled, the queued ModelInstances are first
+    // drawn depth-only from their position streams, then shaded with an equal depth test so each
+    // visible sample is only shaded once. This must not be called in between a PrepareRender and
+    // a FinishRender.
+    void SetDepthPrepass(bool enabled);
+
+    // Returns whether the depth pre-pass is enabled.
+    bool IsDepthPrepassEnabled();
+
+    // Gets the number of samples that passed the depth test in the shaded geometry pass of a
+    // recently completed frame. This lags a couple of frames behind so reading it never stalls.
+    GLuint64 GetShadedSampleCount();
+
+    // Gets the number of directional light shadow cascades whose static casters were re-rendered
+    // in the last frame. This stays at 0 for static scenes viewed from a still camera.
+    unsigned int GetShadowCascadesRendered();
+
+    // Gets the number of point light shadow cube faces re-rendered in the last frame.
+    unsigned int GetPointShadowFacesRendered();
+
+    // Enables or disables dynamic resolution. When enabled, the scene is rendered into a scaled
+    // down region of the HDR buffer that is picked each frame from the measured GPU frame time to
+    // hit the target frame time (in milliseconds), and upscaled when resolved. Disabling it
+    // returns to rendering at the full viewport resolution. This throws if dynamic resolution is
+    // enabled with a target frame time that isn't positive.
+    void SetDynamicResolution(bool enabled, double target_frame_time);
+
+    // Returns whether dynamic resolution is enabled.
+    bool IsDynamicResolutionEnabled();
+
+    // Gets the fraction of the viewport width and height the scene is currently rendered at.
+    float GetResolutionScale();
+
+    // Enables or disables auto exposure. When enabled, the frame is reduced to its log average
+    // luminance through the downsample chain on the GPU, and the exposure adapts over time towards
+    // the one that maps it to middle grey. The exposure stays in a texture read by the tone
+    // mapping, so it never stalls on a readback. This must not be called in between a
+    // PrepareRender and a FinishRender.
+    void SetAutoExposure(bool enabled);
+
+    // Returns whether auto exposure is enabled.
+    bool IsAutoExposureEnabled();
+
+    // Enables or disables bloom. When enabled, a dual filter blur upsamples back up the downsample
+    // chain and is blended into the HDR color before tone mapping. This must not be called in
+    // between a PrepareRender and a FinishRender.
+    void SetBloom(bool enabled);
+
+    // Returns whether bloom is enabled.
+    bool IsBloomEnabled();
+
+    // Gets the GPU time in milliseconds of a recently completed frame. Like the shaded sample
+    // count, this lags a few frames behind so reading it never stalls.
+    double GetGpuFrameTime();
+
+    // Gets the profiler timing the passes of each frame. Callers can add their own scopes to it in
+    // between a PrepareRender and a FinishRender.
+    gfx::Profiler* GetProfiler();
+
+    // Gets the memory of the render targets of the current render graph, with and without
+    // aliasing the ones whose lifetimes don't overlap.
+    gfx::RenderGraphMemory GetRenderTargetMemory();
+
+    // Gets the draw calls, triangles, program switches, texture binds, uniform uploads, and buffer
+    // uploads of the last rendered frame and of each of its passes. These are only counted in
+    // builds with GFX_GL_STATS defined, and are zero otherwise.
+    const gfx::FrameGlStats& GetGlStats();
+
+    // Gets the job system, which can be used to load assets in the background. The thread that
+    // created the GameWindow is its main thread.
+    gfx::JobSystem* GetJobSystem();
+
+    // Relinks the shader programs that use the shader at a path, directly or through an #include,
+    // e.g. after it changed on disk. The uniform values and uniform block bindings of each old
+    // program are copied to its replacement, so none of them have to be set again. This returns
+    // false if no program uses the shader, and throws if any of them fails to compile or link, in
+    // which case those keep their old version. This must not be called in between a PrepareRender
+    // and a FinishRender.
+    bool ReloadShader(std::string path);
+
+    // Starts capturing every frame rendered by FinishRender to an image sequence, replacing any
+    // capture in progress. Frame i is written to the path prefix followed by i and the format's
+    // extension. Png captures the displayed image. Pfm captures the linear HDR image, resolved
+    // from the MSAA samples (at the dynamic resolution, if enabled) or taken from the TAA history.
+    // The frames are read back asynchronously and written on a background thread.
+    void StartCapture(std::string path_prefix, gfx::CaptureFormat format);
+
+    // Stops capturing, waiting for the captured frames to be written.
+    void StopCapture();
+
+    // Returns whether frames are being captured.
+    bool IsCapturing();
+
+    // Polls the GLFW window for events and invokes the proper callbacks (headless GameWindows have
+    // no events). This also runs the jobs posted to the job system's main thread.
     void PollForEvents();
 
     // Gets the time in seconds since the window was created.
     double GetElapsedTime();
 
-    // This must be called every frame before drawing any ModelInstances to the screen. This sets
-    // the state of the OpenGL context so that we can begin drawing the next frame. After this is
-    // called, the caller shouldn't change the game state and should only call RenderModel until
-    // the render is completed with FinishRender. This is passed an environment which is usde to
-    // render the skybox. A nullptr means that no skybox is rendered.
+    // This must be called every frame before drawing any ModelInstances to the screen. This begins
+    // a new frame. After this is called, the caller shouldn't change the game state and should
+    // only call RenderModel until the render is completed with FinishRender. This is passed an
+    // environment which is usde to render the skybox. A nullptr means that no skybox is rendered.
     void PrepareRender(gfx::Environment* environment);
 
     // Prepares the render without a skybox.
     void PrepareRender() { PrepareRender(nullptr); }
 
-    // Draws a given ModelInstance. Note that this must be called in between a PrepareRender and a
-    // a FinishRender. An environment is passed for use in ambient lighting. A nullptr for the
-    // environment means that no environment is used in ambient lighting.
+    // Queues a given ModelInstance to be drawn. Note that this must be called in between a
+    // PrepareRender and a FinishRender. An environment is passed for use in ambient lighting. A
+    // nullptr for the environment means that no environment is used in ambient lighting.
+    // FinishRender culls and sorts the queued ModelInstances on worker threads, so a ModelInstance
+    // should only be queued once per frame.
     void RenderModel(gfx::ModelInstance* model_instance, gfx::Environment* environment);
 
     // Renders a model without an environment.
     void RenderModel(gfx::ModelInstance* model_instance) { RenderModel(model_instance, nullptr); }
 
-    // Compeletes the rendering started by PrepareRender. This takes the accumulated render on the
-    // HDR buffer and tone maps it onto the display buffer. It then swaps the buffer so the
-    // rendered image can actually be seen.
+    // Compeletes the rendering started by PrepareRender. This renders the shadows and then the
+    // queued ModelInstances into the HDR buffer and tone maps it onto the display buffer. It then
+    // swaps the buffer so the rendered image can actually be seen. Each pass is timed with the
+    // profiler. While capturing, the frame is also read back before the swap.
     void FinishRender();
 
   private:
+    // A shader program that is relinked when one of its shaders changes.
+    struct ShaderProgram {
+      // The member holding the program.
+      GLuint* program;
+      // The paths of the vertex and fragment shaders.
+      std::string vertex_path;
+      std::string fragment_path;
+    };
+
+    // A ModelInstance to be drawn by the geometry pass.
+    struct DrawCommand {
+      // Orders the draws to reduce overdraw and state changes.
+      uint64_t sort_key;
+      // The ModelInstance and the environment it was queued with.
+      gfx::ModelInstance* model_instance;
+      gfx::Environment* environment;
+      // The offset into stream_buffer of the instance constants.
+      size_t instance_offset;
+      // Whether the ModelInstance is inside the view frustum.
+      bool visible;
+    };
+
     // The main shader program used by the GameWindow. This outputs to a HDR framebuffer which is
     // in turn rendered with the hdr_program.
     GLuint program;
 
+    // The buffer clear color.
+    gfx::Color clear_color;
+
     // The width of the viewport.
     GLuint vp_width;
 
@@ -155,13 +367,178 @@ class GameWindow {
     // The skybox shader program that renders the skybox given panoramic HDR texture.
     GLuint skybox_program;
 
-    // The Framebuffer Object (with greater floating point precision) that is written to by the
-    // main shader and then subsequently used for rendering by the HDR program. This is
-    // multisampled for MSAA.
-    GLuint multisampled_hdr_fbo;
+    // The renderer currently used for rendering frames.
+    gfx::RenderMode render_mode;
+
+    // The anti-aliasing mode chosen at construction.
+    gfx::AntiAliasingMode anti_aliasing_mode;
+
+    // The context mode chosen at construction.
+    gfx::ContextMode context_mode;
+
+    // The offscreen context of a headless GameWindow, or nullptr if it's windowed.
+    gfx::HeadlessContext* headless_context;
+
+    // Whether Close was called on a headless GameWindow.
+    bool headless_closed;
+
+    // The number of samples per pixel of the HDR buffer and G-buffer. This is 1 with TAA.
+    unsigned int num_samples;
+
+    // The shader program that writes material properties into the G-buffer in deferred mode.
+    GLuint gbuffer_program;
+
+    // The shader program that lights the G-buffer into the HDR buffer in deferred mode.
+    GLuint deferred_program;
+
+    // The shader program that marks MSAA edge pixels in the stencil buffer in deferred mode.
+    GLuint deferred_edges_program;
+
+    // The render graph's G-buffer attachments, storing the albedo and metallic, the world space
+    // normal and roughness, the AO and whether to use the environment map, and the depth and
+    // stencil. The depth and stencil is shared with the deferred lighting pass so the stencil can
+    // flag MSAA edges. These are only declared in deferred mode.
+    unsigned int gbuffer_targets[4];
+
+    // The skybox environment of the current frame. The skybox is rendered in FinishRender after
+    // all opaque geometry so it is only shaded where no geometry covers it.
+    gfx::Environment* skybox_environment;
+
+    // The shader program used for the depth pre-pass.
+    GLuint depth_program;
+
+    // Whether the depth pre-pass is enabled.
+    bool depth_prepass_enabled;
+
+    // The cascaded shadow maps of the directional light.
+    gfx::CascadedShadowMap* shadow_map;
+
+    // The shared shadow atlas of the point lights.
+    gfx::PointShadowAtlas* point_shadow_atlas;
+
+    // The irradiance volume used for indirect diffuse lighting, or nullptr.
+    gfx::IrradianceVolume* irradiance_volume;
+
+    // The LTC tables area lights are shaded with, or nullptr until an area light is added.
+    gfx::LtcTable* ltc_table;
+
+    // The ModelInstances (and their environments) queued by RenderModel for drawing in
+    // FinishRender.
+    std::vector<std::pair<gfx::ModelInstance*, gfx::Environment*>> queued_models;
+
+    // Double buffered occlusion queries counting the samples shaded in the geometry pass.
+    GLuint shaded_samples_queries[2];
+
+    // The index of the query in shaded_samples_queries used for the current frame.
+    unsigned int current_query;
+
+    // The most recently read back result of the shaded samples query.
+    GLuint64 shaded_sample_count;
+
+    // The environment used for ambient lighting in the current deferred frame. This is the last
+    // non-null environment passed to RenderModel.
+    gfx::Environment* deferred_environment;
+
+    // The render graph scheduling the passes of each frame and allocating their render targets.
+    // It is rebuilt whenever the render mode or post-processing changes or a capture starts or
+    // stops.
+    gfx::RenderGraph* render_graph;
+
+    // The render graph's HDR color buffer (with greater floating point precision), which is
+    // written by the geometry or deferred lighting pass and tone mapped by the HDR program. This
+    // is multisampled for MSAA.
+    unsigned int hdr_color_target;
+
+    // The render graph's buffer storing the per-sample motion in UV space since the previous
+    // frame. This is only declared with TAA.
+    unsigned int motion_target;
+
+    // The pass whose framebuffer has the HDR color buffer attached: the geometry pass in forward
+    // mode and the deferred lighting pass in deferred mode.
+    unsigned int hdr_pass;
+
+    // The shader program that blends the current frame into the TAA history.
+    GLuint taa_program;
+
+    // The ping-ponged, tone mapped TAA history buffers and their Framebuffer Objects.
+    GLuint taa_history_buffers[2];
+    GLuint taa_history_fbos[2];
+
+    // The index of the TAA history buffer written by the current frame.
+    unsigned int taa_history_index;
+
+    // Whether the TAA history holds a previous frame.
+    bool taa_history_valid;
+
+    // The number of frames rendered, used to pick the sub-pixel jitter.
+    unsigned int frame_index;
+
+    // Whether dynamic resolution is enabled.
+    bool dynamic_resolution_enabled;
 
-    // Color buffer used with the multisampled FBO.
-    GLuint multisampled_hdr_color_buffer;
+    // The GPU frame time in milliseconds that dynamic resolution aims for.
+    double target_frame_time;
+
+    // The fraction of the viewport width and height the scene is rendered at.
+    float resolution_scale;
+
+    // The width and height of the region of the HDR buffer (and G-buffer) the scene is rendered
+    // into. These are the viewport dimensions without dynamic resolution.
+    GLuint render_width;
+    GLuint render_height;
+
+    // Whether auto exposure and bloom are enabled.
+    bool auto_exposure_enabled;
+    bool bloom_enabled;
+
+    // The shader programs of the post-processing chain: the first downsample, which resolves the
+    // HDR buffer or TAA history at half resolution, the dual filter downsample and upsample, and
+    // the exposure reduction.
+    GLuint downsample_resolve_program;
+    GLuint downsample_program;
+    GLuint upsample_program;
+    GLuint exposure_program;
+
+    // The render graph's levels of the downsample chain, each half the size of the last, and the
+    // levels the bloom is upsampled into. The last level is never upsampled into. These are only
+    // declared with auto exposure or bloom enabled.
+    unsigned int downsample_targets[gfx::DOWNSAMPLE_LEVELS];
+    unsigned int upsample_targets[gfx::DOWNSAMPLE_LEVELS];
+
+    // The ping-ponged 1x1 textures holding the auto exposure and their Framebuffer Objects.
+    GLuint exposure_buffers[2];
+    GLuint exposure_fbos[2];
+
+    // The index of the exposure buffer written by the current frame.
+    unsigned int exposure_index;
+
+    // Whether the exposure buffers hold the exposure of a previous frame.
+    bool exposure_valid;
+
+    // The elapsed time at the end of the previous frame, used to adapt the exposure.
+    double previous_frame_time;
+
+    // The profiler timing the CPU and GPU passes of each frame.
+    gfx::Profiler* profiler;
+
+    // The ring buffer streaming the per-frame and per-instance constants to the GPU.
+    gfx::StreamBuffer* stream_buffer;
+
+    // The job system used to build the draw list. Its main thread jobs run in PollForEvents.
+    gfx::JobSystem* job_system;
+
+    // The capture of the rendered frames, or nullptr if frames aren't being captured.
+    gfx::FrameCapture* frame_capture;
+
+    // The capture pass. Its framebuffer holds the render graph's resolved HDR buffer for Pfm
+    // captures with MSAA.
+    unsigned int capture_pass;
+
+    // The draw commands of the queued ModelInstances, in queue order.
+    std::vector<DrawCommand> draw_commands;
+
+    // The visible draw commands sorted by their keys. This is what the geometry pass submits.
+    std::vector<DrawCommand> draw_list;
 
     // The handle to the texture storing the Bayer matrix used for dithering.
     GLuint matrix_handle;
@@ -187,6 +564,13 @@ class GameWindow {
     // The matrix used for the perspective projection.
     glm::mat4 perspective_projection;
 
+    // The perspective projection offset by the current frame's sub-pixel jitter. This is the same
+    // as perspective_projection without TAA.
+    glm::mat4 jittered_projection;
+
+    // The camera view transform of the previous frame, used for motion vectors.
+    glm::mat4 previous_view_transform;
+
     // The directional light of the scene. This will be nullptr if there is no directional light.
     gfx::DirectionalLight* directional_light;
 
@@ -196,16 +580,114 @@ class GameWindow {
     // An associative array mapping pointers to point lights back to an index into point_lights.
     std::unordered_map<gfx::PointLight*, unsigned int> point_lights_reverse;
 
-    // Initializes the HDR program.
+    // The array of pointers to area lights.
+    gfx::AreaLight* area_lights[gfx::MAX_AREA_LIGHTS];
+
+    // An associative array mapping pointers to area lights back to an index into area_lights.
+    std::unordered_map<gfx::AreaLight*, unsigned int> area_lights_reverse;
+
+    // The shader programs that ReloadShader can relink.
+    std::vector<ShaderProgram> shader_programs;
+
+    // Initializes the HDR program and the quad it draws.
     void InitializeHdrProgram();
 
     // Initializes the skybox program.
     void InitializeSkyboxProgram();
 
+    // Binds the samplers of the deferred programs to their G-buffer texture units.
+    void InitializeDeferredProgram();
+
+    // Allocates the TAA history buffers and links the TAA program with the fullscreen vertex
+    // shader at a path.
+    void InitializeTemporalAntiAliasing(std::string hdr_vertex_path);
+
+    // Links the post-processing programs with the fullscreen vertex shader at a path and allocates
+    // the exposure buffers.
+    void InitializePostProcessing(std::string hdr_vertex_path);
+
+    // Gets the width and height of a level of the downsample chain.
+    void GetDownsampleSize(unsigned int level, GLuint* width, GLuint* height);
+
+    // Renders a level of the downsample chain from the previous level, or from the HDR buffer (or
+    // the TAA history) for the first level.
+    void RenderDownsample(unsigned int level);
+
+    // Upsamples the bloom into a level of the upsample chain from the next level.
+    void RenderUpsample(unsigned int level);
+
+    // Reduces the last level of the downsample chain into the current exposure buffer.
+    void RenderExposure();
+
+    // Declares the passes of a frame and their render targets for the current render mode,
+    // anti-aliasing mode, post-processing, and capture, and compiles the render graph.
+    void BuildRenderGraph();
+
+    // Blends the current frame in the HDR buffer into the TAA history.
+    void RenderTemporalResolve();
+
+    // Reads back the current frame for the frame capture.
+    void CaptureFrame();
+
+    // Gets the shader program that draws ModelInstances for the current render mode.
+    GLuint GetGeometryProgram();
+
+    // Draws a ModelInstance with the geometry program, binding the environment for ambient
+    // lighting.
+    void DrawModel(gfx::ModelInstance* model_instance, gfx::Environment* environment);
+
+    // Updates the directional light's shadow cascades and the point light shadow atlas with the
+    // queued ModelInstances as casters.
+    void RenderShadows();
+
+    // Builds the draw list from the queued ModelInstances. Worker threads cull the ModelInstances
+    // against the view frustum, build their sort keys, and write their instance constants (and the
+    // skinning palettes of animated ones) into the stream buffer. This also writes and binds the
+    // frame constants, and runs before the render graph so every pass can draw the ModelInstances.
+    void BuildDrawList();
+
+    // Draws the queued ModelInstances into the HDR buffer (or G-buffer in deferred mode). With the
+    // depth pre-pass enabled, they are first drawn depth-only and then shaded with an equal depth
+    // test.
+    void RenderQueuedModels();
+
+    // Starts counting the samples shaded by the geometry pass, reading back the result of the
+    // query issued two frames ago.
+    void BeginShadedSamplesQuery();
+
+    // Picks the resolution scale from the GPU time of the most recently read back frame when
+    // dynamic resolution is enabled.
+    void UpdateResolutionScale();
+
+    // Sets the size of the region of the HDR buffer the scene is rendered into, updating the
+    // programs that read it.
+    void SetRenderDimensions(GLuint width, GLuint height);
+
+    // Draws the skybox into the currently bound framebuffer with the given environment. It's
+    // projected onto the far plane and drawn with an inclusive depth test, so the depth test must
+    // be enabled with the scene's depth attached for it to only shade the uncovered pixels.
+    void RenderSkybox(gfx::Environment* environment);
+
+    // Lights the G-buffer into the HDR color buffer. Pixels whose samples agree are shaded once
+    // and MSAA edge pixels are shaded once per sample.
+    void RenderDeferredLighting();
+
+    // Exposes, composites the bloom into, and tone maps the HDR color buffer (or the TAA history)
+    // onto the default framebuffer.
+    void RenderTonemap();
+
+    // Gets the shader programs that consume the light and IBL uniforms.
+    std::vector<GLuint> GetLitPrograms();
+
     // Computes the N Hammersley points where N is defined in constants.h and passes them to the
     // main shader via a uniform array.
     void InitializeHammersleyPoints();
 
+    // Reads the shader at the given path, recursively expanding any #include "file" directives
+    // relative to the directory of the including shader. If source_paths isn't nullptr, the path
+    // of every file read is appended to it.
+    std::string ReadShaderSource(std::string path, std::vector<std::string>* source_paths);
+
     // Given a path to the shader and a shader type, compile the shader.
     GLuint CompileShader(std::string path, GLenum shader_type);
 
@@ -213,16 +695,32 @@ class GameWindow {
     // into a shader program.
     GLuint LinkProgram(std::string vertex_path, std::string fragment_path);
 
+    // Registers a linked shader program so ReloadShader relinks it when one of its shaders
+    // changes.
+    void AddShaderProgram(GLuint* program, std::string vertex_path, std::string fragment_path);
+
+    // Gets the size of the default framebuffer.
+    void GetFramebufferSize(int* width, int* height);
+
     // Initializes the game window.
     void InitializeGameWindow(int width, int height, gfx::Color color);
 
-    // Updates the perspective projection with the width, height, and field of view.
+    // Sets up the OpenGL state of a newly created context.
+    void InitializeContextState(int width, int height, gfx::Color color);
+
+    // Updates the perspective projection with the width, height, and field of view. With TAA, this
+    // also offsets the jittered projection by a sub-pixel amount picked by the frame index from a
+    // Halton sequence.
     void UpdatePerspectiveProjection(int width, int height);
 
     // Helper function to find the index of a point light using the reverse map. This throws if the
     // point light is not yet added.
     unsigned int GetAndValidatePointLightIndex(gfx::PointLight* point_light);
 
+    // Helper function to find the index of an area light using the reverse map. This throws if the
+    // area light is not yet added.
+    unsigned int GetAndValidateAreaLightIndex(gfx::AreaLight* area_light);
+
     // Helper function to turn a vec3 position into a Vertex to be consumed by the Mesh class with
     // non-important values for normal, tangent, and UV.
     gfx::Vertex PositionToVertex(glm::vec3 position);
@@ -0,0 +1,78 @@
+// This header defines counters of the GL commands the engine issues: draw calls, triangles,
+// program switches, texture binds, uniform uploads, and buffer uploads. In builds with
+// GFX_GL_STATS defined (debug builds, or any build configured with -DENABLE_GL_STATS=ON), Install
+// wraps glad's function pointers with versions that count each call before forwarding it, so none
+// of the GL calls in the engine change. Otherwise the counting compiles away entirely and the
+// stats stay zero. The Profiler splits the counts into frames and passes.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_GL_STATS_H
+#define GFX_GL_STATS_H
+
+#include <string>
+#include <vector>
+
+namespace gfx {
+
+// Counts of the GL commands issued over a frame or a pass.
+struct GlStats {
+  // The number of draw calls.
+  unsigned long draw_calls;
+  // The number of triangles drawn, counting each instance.
+  unsigned long triangles;
+  // The number of glUseProgram calls that changed the bound program.
+  unsigned long program_switches;
+  // The number of glBindTexture calls.
+  unsigned long texture_binds;
+  // The number of glUniform calls.
+  unsigned long uniform_uploads;
+  // The number of buffer uploads (glBufferData with data, glBufferSubData, and flushes of mapped
+  // ranges) and the bytes they uploaded.
+  unsigned long buffer_uploads;
+  unsigned long buffer_upload_bytes;
+};
+
+// Gets the counts of the commands issued between two snapshots of the counters.
+inline gfx::GlStats operator-(const gfx::GlStats& end, const gfx::GlStats& start) {
+  return gfx::GlStats{end.draw_calls - start.draw_calls, end.triangles - start.triangles,
+      end.program_switches - start.program_switches, end.texture_binds - start.texture_binds,
+      end.uniform_uploads - start.uniform_uploads, end.buffer_uploads - start.buffer_uploads,
+      end.buffer_upload_bytes - start.buffer_upload_bytes};
+}
+
+// The GL commands issued by a pass, i.e. a CPU scope of the Profiler.
+struct GlPassStats {
+  // The name of the scope.
+  std::string name;
+  // The nesting depth of the scope, starting at 1. A pass's counts include its nested passes.
+  unsigned int depth;
+  // The commands issued inside the scope.
+  gfx::GlStats stats;
+};
+
+// The GL commands issued by a frame.
+struct FrameGlStats {
+  // The commands issued between the start and end of the frame.
+  gfx::GlStats total;
+  // The passes of the frame in the order they started.
+  std::vector<gfx::GlPassStats> passes;
+};
+
+namespace gl_stats {
+
+#ifdef GFX_GL_STATS
+// Wraps glad's function pointers with the counting versions. This must be called after glad is
+// loaded, and again whenever it's reloaded. Calling it twice without reloading does nothing.
+void Install();
+
+// Gets the counts of the commands issued since the program started.
+gfx::GlStats GetCounters();
+#endif
+
+// Formats a compact summary of a frame's stats, with a line for the frame and one per pass.
+std::string Format(const gfx::FrameGlStats& stats);
+
+}
+}
+#endif // GFX_GL_STATS_H
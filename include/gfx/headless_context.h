@@ -0,0 +1,59 @@
+// This class creates an OpenGL context without a window or display through EGL. It prefers Mesa's
+// surfaceless platform, which works on render nodes and (with llvmpipe) on machines without a GPU,
+// and falls back to the default EGL display. The context renders into a pbuffer surface that acts
+// as the default framebuffer, so the renderer runs unchanged. This is only available when the
+// engine is built with EGL (GFX_HEADLESS_EGL).
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_HEADLESS_CONTEXT_H
+#define GFX_HEADLESS_CONTEXT_H
+
+#include <chrono>
+
+namespace gfx {
+
+class HeadlessContext {
+  public:
+    // Creates an OpenGL 3.3 core context with a width by height pbuffer and makes it current.
+    // This throws if EGL is unavailable or can't create the context.
+    HeadlessContext(int width, int height);
+
+    // Destroys the context and its surface.
+    ~HeadlessContext();
+
+    // Finishes the frame. Nothing is presented, but this lets the driver flush the frame like a
+    // swap would.
+    void SwapBuffers();
+
+    // Gets the size of the pbuffer.
+    int GetWidth();
+    int GetHeight();
+
+    // Gets the time in seconds since the context was created.
+    double GetElapsedTime();
+
+    // Looks up an OpenGL function for the loader.
+    static void* GetProcAddress(const char* name);
+
+    // Disable copy constructor and copy assignment.
+    HeadlessContext(HeadlessContext const&) = delete;
+    void operator=(HeadlessContext const&) = delete;
+
+  private:
+    // The EGL display, surface, and context. These are stored untyped so the header doesn't need
+    // EGL.
+    void* display;
+    void* surface;
+    void* context;
+
+    // The size of the pbuffer.
+    int width;
+    int height;
+
+    // When the context was created.
+    std::chrono::steady_clock::time_point start_time;
+};
+
+}
+#endif // GFX_HEADLESS_CONTEXT_H
@@ -0,0 +1,87 @@
+// This class reloads the shaders, textures, and models the engine uses when they change on disk,
+// so they can be edited while the engine runs. It watches the shaders and assets directories with
+// a FileWatcher and only reloads what changed: a shader relinks just the programs that include it,
+// a texture is re-uploaded into its existing handle, and a model re-reads its EO file into its
+// existing meshes. Everything else keeps its GPU state, so a reload never rebuilds the renderer. A
+// change that fails to load (e.g. a shader with a syntax error) keeps the old version and is
+// reported instead of thrown, so it can be fixed and saved again.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_HOT_RELOADER_H
+#define GFX_HOT_RELOADER_H
+
+#include "gfx/file_watcher.h"
+#include "gfx/game_window.h"
+#include "gfx/model_info.h"
+#include "gfx/texture_manager.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gfx {
+
+// The kinds of files that can be reloaded.
+enum ReloadKind { ShaderReload, TextureReload, ModelReload };
+
+// A file that was reloaded.
+struct ReloadEvent {
+  // The path of the file, e.g. "shaders/hdr.frag".
+  std::string path;
+  // The kind of file.
+  gfx::ReloadKind kind;
+  // Whether the reload succeeded. If not, the old version is still in use.
+  bool succeeded;
+  // The reason the reload failed, or an empty string.
+  std::string error;
+  // The time spent reloading the file in milliseconds.
+  double reload_time;
+  // The time from when the file was last modified to when the reload finished in milliseconds.
+  double latency;
+};
+
+class HotReloader {
+  public:
+    // Constructor given the GameWindow whose shaders are reloaded and the TextureManager whose
+    // textures are reloaded. This throws if the directories can't be watched.
+    HotReloader(gfx::GameWindow* window, gfx::TextureManager* manager);
+
+    // Registers a ModelInfo to be reloaded when the EO file at a path changes. The ModelInfo must
+    // outlive the HotReloader.
+    void AddModel(std::string model_path, gfx::ModelInfo* model_info);
+
+    // Reloads the files that changed since the last call and returns what was reloaded. Changed
+    // files that nothing uses are skipped. This must be called with the GameWindow's context
+    // current and not in between a PrepareRender and a FinishRender.
+    std::vector<gfx::ReloadEvent> Update();
+
+    // Disable copy constructor and copy assignment.
+    HotReloader(HotReloader const&) = delete;
+    void operator=(HotReloader const&) = delete;
+
+  private:
+    // The GameWindow whose shaders are reloaded.
+    gfx::GameWindow* window;
+
+    // The TextureManager whose textures are reloaded.
+    gfx::TextureManager* manager;
+
+    // Watches the shaders and assets directories.
+    gfx::FileWatcher watcher;
+
+    // Hash map from the path of an EO file to the ModelInfo loaded from it.
+    std::unordered_map<std::string, gfx::ModelInfo*> models;
+
+    // Gets the kind of a file from its extension.
+    static gfx::ReloadKind GetKind(const std::string& path);
+
+    // Gets the milliseconds since the file at a path was last modified, or 0 if it can't be read.
+    static double GetTimeSinceModified(const std::string& path);
+
+    // Reloads a single file. Returns false if nothing uses it.
+    bool Reload(const std::string& path, gfx::ReloadKind kind);
+};
+
+}
+#endif // GFX_HOT_RELOADER_H
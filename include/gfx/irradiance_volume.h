@@ -0,0 +1,94 @@
+// This class defines a grid of light probes over a box of the scene that stores the irradiance
+// reaching each probe as L2 spherical harmonics, for indirect diffuse lighting. The probes are
+// baked on the CPU by tracing rays in every direction through a Bvh of the scene's triangles on a
+// job system. Rays that escape sample the Environment, and rays that hit the scene are treated as
+// black, so the probes capture how much of the sky each part of the scene sees. The baked
+// coefficients are uploaded to a 3D texture with the 9 coefficients stacked along its depth, so
+// the shaders interpolate them trilinearly with 9 texture fetches. Baking takes a while, so a baked
+// volume can be written to a file and loaded from it instead.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_IRRADIANCE_VOLUME_H
+#define GFX_IRRADIANCE_VOLUME_H
+
+#include "gfx/constants.h"
+#include "gfx/environment.h"
+#include "gfx/job_system.h"
+#include "gfx/model_instance.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+namespace gfx {
+
+class IrradianceVolume {
+  public:
+    // The OpenGL handle of the coefficient texture, or 0 if it hasn't been uploaded.
+    GLuint volume_handle;
+
+    // Constructor given the corners of the box and the number of probes along each of its axes.
+    // The probes sit on the corners of the cells, so the outermost ones are on the faces of the
+    // box. The volume is black until it's baked.
+    IrradianceVolume(glm::vec3 min, glm::vec3 max, glm::ivec3 resolution);
+
+    // Constructor that loads a volume written by Write. This throws if the file can't be opened or
+    // parsed.
+    IrradianceVolume(std::string path);
+
+    // Destructor which deletes the coefficient texture.
+    ~IrradianceVolume();
+
+    // Bakes the probes by tracing rays_per_probe rays (rounded up to a multiple of 4) from each
+    // of them through the ModelInstances, sampling the environment for the rays that escape. This
+    // throws if the environment can't be decoded. No OpenGL context is needed.
+    void Bake(const std::vector<gfx::ModelInstance*>& instances, gfx::Environment* environment,
+        unsigned int rays_per_probe, gfx::JobSystem* job_system);
+
+    // Writes the box, the number of probes, and the baked coefficients to a path. This throws if
+    // the file can't be written.
+    void Write(std::string path);
+
+    // Uploads the baked coefficients to the coefficient texture, creating it if needed.
+    void Upload();
+
+    // Gets the irradiance reaching a surface at a position with a normal, interpolated between the
+    // probes as the shaders do.
+    glm::vec3 GetIrradiance(glm::vec3 position, glm::vec3 normal);
+
+    // Gets the corners of the box and the number of probes along each of its axes.
+    glm::vec3 GetMin();
+    glm::vec3 GetMax();
+    glm::ivec3 GetResolution();
+
+    // Gets the distance between neighboring probes along each axis.
+    glm::vec3 GetCellSize();
+
+    // Gets the number of rays traced by the last bake.
+    size_t GetRaysTraced();
+
+    // Disable copy constructor and copy assignment.
+    IrradianceVolume(IrradianceVolume const&) = delete;
+    void operator=(IrradianceVolume const&) = delete;
+
+  private:
+    // The corners of the box.
+    glm::vec3 min;
+    glm::vec3 max;
+
+    // The number of probes along each axis.
+    glm::ivec3 resolution;
+
+    // The irradiance coefficients in the layout of the coefficient texture: a resolution sized
+    // block of probes for each of the IRRADIANCE_SH_COEFFICIENTS coefficients.
+    std::vector<glm::vec3> coefficients;
+
+    // The number of rays traced by the last bake.
+    size_t rays_traced;
+};
+
+}
+#endif // GFX_IRRADIANCE_VOLUME_H
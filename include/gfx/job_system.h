@@ -0,0 +1,161 @@
+// This class implements a work-stealing job system. Every thread has its own deque of jobs: it
+// pushes and pops its own jobs at the back (so recently spawned, cache-warm work runs first) and
+// idle threads steal from the front of the others' deques. Jobs signal completion through
+// counters, which other jobs can depend on and which any thread can wait on while helping to run
+// jobs. The thread that creates the JobSystem is the main thread. It owns the OpenGL context, so
+// jobs that issue GL calls are posted to a separate queue that only the main thread runs. An
+// exception thrown by a job is caught and handed to whoever waits on the job's counter.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_JOB_SYSTEM_H
+#define GFX_JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace gfx {
+
+// Counts the unfinished jobs of a group. A counter is done once every job run with it has
+// finished, at which point the jobs that depend on it are scheduled.
+class JobCounter {
+  public:
+    // Default constructor for a counter with no jobs.
+    JobCounter();
+
+    // Returns whether all of the jobs run with the counter have finished.
+    bool IsDone();
+
+    // Disable copy constructor and copy assignment.
+    JobCounter(JobCounter const&) = delete;
+    void operator=(JobCounter const&) = delete;
+
+  private:
+    friend class JobSystem;
+
+    // The number of unfinished jobs.
+    std::atomic<unsigned int> count;
+
+    // Guards the continuations against the counter reaching zero.
+    std::mutex mutex;
+
+    // The jobs (and their counters) waiting for the counter to reach zero.
+    std::vector<std::pair<std::function<void()>, gfx::JobCounter*>> continuations;
+
+    // The first exception thrown by a job run with the counter, or nullptr if none have thrown.
+    std::exception_ptr error;
+};
+
+class JobSystem {
+  public:
+    // Constructor given the number of worker threads to start in addition to the main thread.
+    JobSystem(unsigned int num_workers);
+
+    // Stops and joins the worker threads. Jobs that haven't started are discarded.
+    ~JobSystem();
+
+    // Schedules a job on any thread. If a counter is given (it can be nullptr), it is incremented
+    // now and decremented when the job finishes, even if it throws. Jobs run without a counter
+    // must not throw, since there's nobody to hand the exception to, and terminate if they do.
+    void Run(std::function<void()> job, gfx::JobCounter* counter);
+
+    // Schedules a job once the dependency counter is done. It runs even if a job of the
+    // dependency threw.
+    void Run(std::function<void()> job, gfx::JobCounter* counter, gfx::JobCounter* dependency);
+
+    // Schedules a job that will only run on the main thread, such as one issuing GL calls.
+    void RunOnMainThread(std::function<void()> job, gfx::JobCounter* counter);
+
+    // Runs the jobs posted with RunOnMainThread. This must be called from the main thread, and is
+    // called by GameWindow::PollForEvents every frame.
+    void RunMainThreadJobs();
+
+    // Waits for a counter to be done, running jobs (including main thread jobs when called on the
+    // main thread) in the meantime. If any of its jobs threw, this rethrows the first exception
+    // once all of them have finished and clears it from the counter.
+    void Wait(gfx::JobCounter* counter);
+
+    // Calls body(begin, end) over chunks of at most grain_size indices covering [0, count) in
+    // parallel, returning once all of them are done. The body must be safe to run concurrently on
+    // disjoint ranges. If it throws, this rethrows the first exception once every chunk is done.
+    void ParallelFor(size_t count, size_t grain_size,
+        const std::function<void(size_t, size_t)>& body);
+
+    // Gets the number of threads (including the main thread) that run jobs.
+    unsigned int GetNumThreads();
+
+    // Disable copy constructor and copy assignment.
+    JobSystem(JobSystem const&) = delete;
+    void operator=(JobSystem const&) = delete;
+
+  private:
+    // A scheduled job and the counter to decrement when it finishes.
+    struct Job {
+      std::function<void()> function;
+      gfx::JobCounter* counter;
+    };
+
+    // The jobs of a thread. The owner works at the back and thieves take from the front.
+    struct JobQueue {
+      std::mutex mutex;
+      std::deque<Job> jobs;
+    };
+
+    // The worker threads.
+    std::vector<std::thread> workers;
+
+    // The job queues. Queue 0 belongs to the main thread (and any other thread that isn't a
+    // worker) and queue i + 1 to worker i.
+    std::vector<std::unique_ptr<JobQueue>> queues;
+
+    // The jobs that must run on the main thread.
+    JobQueue main_thread_jobs;
+
+    // The ID of the main thread.
+    std::thread::id main_thread_id;
+
+    // The number of jobs waiting in the queues, used to put idle workers to sleep.
+    std::atomic<size_t> queued_jobs;
+
+    // The number of workers asleep waiting for jobs.
+    std::atomic<unsigned int> sleeping_workers;
+
+    // Wakes idle workers when jobs are queued or the system stops.
+    std::mutex sleep_mutex;
+    std::condition_variable wake_up;
+
+    // Whether the workers should exit.
+    std::atomic<bool> stopping;
+
+    // Gets the index of the calling thread's queue.
+    unsigned int GetQueueIndex();
+
+    // Pushes a job onto the calling thread's queue and wakes a worker.
+    void Push(Job job);
+
+    // Takes a job from the calling thread's queue, or steals one from another queue. Returns
+    // false if there were none.
+    bool TryTakeJob(unsigned int queue_index, Job* job);
+
+    // Runs a job and finishes it on its counter, keeping the exception on the counter if it
+    // throws.
+    void Execute(Job& job);
+
+    // Decrements a counter, scheduling its continuations if it reaches zero.
+    void Finish(gfx::JobCounter* counter);
+
+    // The main loop of a worker thread.
+    void RunWorker(unsigned int queue_index);
+};
+
+}
+#endif // GFX_JOB_SYSTEM_H
@@ -0,0 +1,99 @@
+// This class holds the lookup tables that area lights are shaded with, using linearly transformed
+// cosines (LTCs, see "Real-Time Polygonal-Light Shading with Linearly Transformed Cosines" by
+// Heitz et al.). For each roughness and view angle, a linear transform of the clamped cosine
+// distribution is fitted to the Cook-Torrance lobe of lighting.glsl. Integrating the lobe over a
+// light then becomes integrating a cosine over the light's transformed shape, which has a closed
+// form. Fitting takes a while, so the tables are fitted offline by fit_ltc and loaded from a
+// file. They're uploaded to two textures indexed by the roughness and sqrt(1 - cos(theta)):
+//  - The matrix texture holds the four entries of each inverse transform that aren't 0 or 1.
+//  - The amplitude texture holds the integral of the lobe and the integral of the lobe times the
+//    Fresnel factor in its first two channels. Its third channel is indexed by the cosine of the
+//    elevation and the form factor of a sphere instead, and holds the sphere's form factor once
+//    the horizon clips it, divided by its unclipped form factor. The shaders clip the shapes of
+//    the lights against the horizon by looking up the sphere with the same vector form factor.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_LTC_TABLE_H
+#define GFX_LTC_TABLE_H
+
+#include "gfx/constants.h"
+#include "gfx/job_system.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+namespace gfx {
+
+// Where the GameWindow and CpuRenderer load the tables from.
+const std::string ltc_table_path = "assets/ltc/ggx.ltc";
+
+class LtcTable {
+  public:
+    // The OpenGL handles of the matrix and amplitude textures, or 0 if they haven't been uploaded.
+    GLuint matrix_handle;
+    GLuint amplitude_handle;
+
+    // Constructor that fits tables of size by size entries on the job system, measuring the error
+    // of each fit over a grid of samples by samples directions. The roughnesses are fitted in
+    // parallel. This throws if the size is below 2 or above LTC_MAX_TABLE_SIZE, or samples is 0.
+    // No OpenGL context is needed.
+    LtcTable(unsigned int size, unsigned int samples, gfx::JobSystem* job_system);
+
+    // Constructor that loads tables written by Write. This throws if the file can't be opened or
+    // parsed.
+    LtcTable(std::string path);
+
+    // Destructor which deletes the textures.
+    ~LtcTable();
+
+    // Writes the tables to a path. This throws if the file can't be written.
+    void Write(std::string path);
+
+    // Uploads the tables to the matrix and amplitude textures, creating them if needed.
+    void Upload();
+
+    // Gets the inverse transform and the two amplitudes for a roughness and the cosine of the
+    // angle between the normal and the view, filtered bilinearly like the shaders' lookups. The
+    // transform maps directions in a frame with the normal along z and the view in the xz plane.
+    void Sample(float roughness, float cos_theta, glm::mat3* inverse_transform,
+        glm::vec2* amplitudes);
+
+    // Gets the horizon clipping factor of a sphere given the cosine of its center's elevation and
+    // its unclipped form factor, filtered bilinearly like the shaders' lookups.
+    float GetHorizonScale(float cos_elevation, float form_factor);
+
+    // Gets the number of entries along each axis of the tables.
+    unsigned int GetSize();
+
+    // Gets the average error of the fits, if the tables were fitted rather than loaded.
+    double GetAverageError();
+
+    // Disable copy constructor and copy assignment.
+    LtcTable(LtcTable const&) = delete;
+    void operator=(LtcTable const&) = delete;
+
+  private:
+    // The number of entries along each axis of the tables.
+    unsigned int size;
+
+    // The entries of the matrix and amplitude tables, in rows of increasing sqrt(1 - cos(theta))
+    // (or form factor for the third amplitude) of increasing roughness (or cosine of the
+    // elevation) each.
+    std::vector<glm::vec4> matrices;
+    std::vector<glm::vec3> amplitudes;
+
+    // The average error of the fits.
+    double average_error;
+
+    // Bilinearly filters entries of a table at coordinates in [0, 1] that map the ends of each
+    // axis to the centers of the first and last entries.
+    template <typename T>
+    T Filter(const std::vector<T>& table, glm::vec2 coordinates);
+};
+
+}
+#endif // GFX_LTC_TABLE_H
@@ -1,6 +1,7 @@
 // This class provides a representation of a mesh. A mesh stores a set of vertices, indicies on
-// those verticies forming the model, the VAO, the VBO, the EBO, and the material. The class
-// implements the Mappable interface which maps the mesh data to OpenGL managed buffers.
+// those verticies forming the model, the VAO, the VBO, the EBO, and the material. Skinned meshes
+// also store the joints influencing each vertex in a separate stream. The class implements the
+// Mappable interface which maps the mesh data to OpenGL managed buffers.
 
 // Brian Ho (brian@dropbox.com)
 
@@ -13,6 +14,7 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -30,6 +32,14 @@ struct Vertex {
   glm::vec2 uv;
 };
 
+// Abstraction that describes the joints influencing a vertex of a skinned mesh.
+struct SkinVertex {
+  // Indices of up to four joints of the skeleton.
+  uint8_t joints[4];
+  // Weights of the joints in units of 1/255, which sum to 255.
+  uint8_t weights[4];
+};
+
 class Mesh : public gfx::Mappable {
   public:
     // TODO: Pull from a global pool of managed buffers instead of having a buffer per model.
@@ -39,14 +49,32 @@ class Mesh : public gfx::Mappable {
     GLuint vbo;
     // Stores the integer handle to an OpenGL managed EBO and is 0 if unmapped.
     GLuint ebo;
+    // Stores the integer handle to an OpenGL managed VAO that only sources positions (for
+    // depth-only passes) and is 0 if unmapped. This shares the EBO with the full VAO.
+    GLuint position_vao;
+    // Stores the integer handle to an OpenGL managed VBO of tightly packed positions and is 0 if
+    // unmapped.
+    GLuint position_vbo;
+    // Stores the integer handle to an OpenGL managed VBO of the skin and is 0 if unmapped or if
+    // the mesh isn't skinned. Both VAOs source the joints and weights from it.
+    GLuint skin_vbo;
     // The material of the mesh.
     std::shared_ptr<gfx::Material> material;
+    // The minimum corner of the object space bounding box of the vertices.
+    glm::vec3 bounds_min;
+    // The maximum corner of the object space bounding box of the vertices.
+    glm::vec3 bounds_max;
 
     // Create a Mesh with a list of verticies and indices. The should_map param specifies whether
     // Map() should be called immediately by the constructor.
     Mesh(std::vector<Vertex>* vertices, std::vector<GLuint>* indices,
         std::shared_ptr<gfx::Material> material, bool should_map);
 
+    // Create a skinned Mesh with a list of vertices, indices, and the joints influencing each
+    // vertex. A nullptr skin creates an unskinned Mesh.
+    Mesh(std::vector<Vertex>* vertices, std::vector<GLuint>* indices,
+        std::vector<SkinVertex>* skin, std::shared_ptr<gfx::Material> material, bool should_map);
+
     // Destroys the Mesh by unmapping and freeing the vertex and index vectors.
     ~Mesh();
 
@@ -54,7 +82,7 @@ class Mesh : public gfx::Mappable {
     bool IsMapped();
 
     // If the model is unmapped, set up the VAO, EBO, and EBO by mapping the vertex data to the
-    // buffers.
+    // buffers. This also sets up the position-only VAO and VBO, and the skin VBO of skinned meshes.
     void Map();
 
     // If the model is mapped, delete the VAO, EBO, and EBO.
@@ -65,11 +93,33 @@ class Mesh : public gfx::Mappable {
 
     // Gets the number of indices for drawing purposes.
     GLuint GetNumberOfIndices();
+
+    // Gets the vertices and indices, e.g. for rendering the mesh without OpenGL.
+    const std::vector<Vertex>& GetVertices();
+    const std::vector<GLuint>& GetIndices();
+
+    // Returns whether the Mesh has a skin.
+    bool IsSkinned();
+
+    // Gets the joints influencing each vertex. This must only be called on skinned meshes.
+    const std::vector<SkinVertex>& GetSkin();
+
+    // Swaps the vertices, indices, and skin with new ones (e.g. reloaded from disk) and remaps the
+    // mesh if it's mapped. Copies of the Mesh share its vertices, indices, and skin, so they see
+    // the new geometry as well. The given vectors hold the old geometry afterwards and are still
+    // owned by the caller. The new skin must be nullptr exactly when the Mesh isn't skinned.
+    void SwapGeometry(std::vector<Vertex>* new_vertices, std::vector<GLuint>* new_indices,
+        std::vector<SkinVertex>* new_skin);
   private:
     // List of vertices.
     std::vector<Vertex>* vertices;
     // List of indices.
     std::vector<GLuint>* indices;
+    // List of the joints influencing each vertex, or nullptr if the mesh isn't skinned.
+    std::vector<SkinVertex>* skin;
+
+    // Computes the bounding box of the vertices.
+    void UpdateBounds();
 };
 
 }
@@ -1,19 +1,22 @@
 // This class defines a loaded model made up of one or many meshes with materials. The ModelInfo
-// implements the Mappable interface, so it can map its meshes to OpenGL managed buffers.
+// implements the Mappable interface, so it can map its meshes to OpenGL managed buffers. Skinned
+// models also have the Skeleton their meshes are bound to.
 //
 // Brian Ho (brian@brkho.com)
 
 #ifndef GFX_MODEL_INFO_H
 #define GFX_MODEL_INFO_H
 
+#include "gfx/job_system.h"
 #include "gfx/mappable.h"
 #include "gfx/material.h"
 #include "gfx/mesh.h"
+#include "gfx/skeleton.h"
 #include "gfx/texture_manager.h"
 
 #include <glad/glad.h>
 
-#include <fstream>
+#include <istream>
 #include <memory>
 #include <string>
 #include <vector>
@@ -35,6 +38,33 @@ class ModelInfo : public gfx::Mappable {
     // should_map argument specifies whether the constructor should map its individual meshes.
     ModelInfo(std::string model_path, gfx::TextureManager* manager, bool should_map);
 
+    // The contents of an EO file. Reading these doesn't touch OpenGL, so it can be done on any
+    // thread.
+    struct EOFileData {
+      gfx::ShaderType shader_type;
+      // The paths of the albedo, metallic, roughness, normal, and AO maps. A path is empty if the
+      // model doesn't have that map.
+      std::string map_paths[5];
+      // The vertices and indices, which are owned by the caller until they're passed to a Mesh.
+      std::vector<gfx::Vertex>* vertices = nullptr;
+      std::vector<GLuint>* indices = nullptr;
+      // The joints influencing each vertex and the skeleton of a skinned model, or nullptr if the
+      // model isn't skinned. The skin is owned like the vertices.
+      std::vector<gfx::SkinVertex>* skin = nullptr;
+      std::shared_ptr<gfx::Skeleton> skeleton;
+    };
+
+    // Creates a ModelInfo from the contents of an EO file (which may also be generated in code),
+    // loading its maps through the TextureManager and mapping its meshes if should_map is set.
+    ModelInfo(const EOFileData& data, gfx::TextureManager* manager, bool should_map);
+
+    // Loads a batch of EO format models. The files are read and their textures decoded in
+    // parallel on the job system, while the OpenGL work runs on the main thread. This must be
+    // called from the job system's main thread, and throws the first error of any of the models.
+    static std::vector<std::unique_ptr<gfx::ModelInfo>> LoadModels(
+        const std::vector<std::string>& model_paths, gfx::TextureManager* manager,
+        gfx::JobSystem* job_system, bool should_map);
+
     // Copy constructor for ModelInfo that performs a deep copy of the meshes.
     ModelInfo(const ModelInfo& that);
 
@@ -59,14 +89,47 @@ class ModelInfo : public gfx::Mappable {
     // Remaps all of the ModelInfo's meshes.
     void Remap();
 
+    // Reloads the model from an EO file, e.g. after it changed on disk. The meshes are remapped
+    // with the new geometry and the material's maps are pointed at the new map paths, loading them
+    // through the TextureManager, and the geometry revision is incremented so ModelInstances of
+    // the model pick up its new bounds on their next Update. This throws (keeping the old model)
+    // if the file can't be read, or if it adds, removes, or changes the number of joints of the
+    // skeleton, since Animators hold on to the skeleton.
+    void Reload(std::string model_path, gfx::TextureManager* manager);
+
+    // Returns a counter that is incremented every time Reload changes the geometry. This lets
+    // ModelInstances detect when their bounds and cached shadows are stale.
+    unsigned int GetGeometryRevision();
+
     // Returns a shared_ptr to the material.
     std::shared_ptr<gfx::Material> GetMaterial();
+
+    // Gets the skeleton the meshes are bound to, or nullptr if the model isn't skinned.
+    gfx::Skeleton* GetSkeleton();
+
+    // Reads an EO format model from its path, out of a mounted AssetPack if one has it. This throws
+    // if the file can't be opened or parsed.
+    // A skinned model stores its skeleton and the joints influencing each vertex after the indices.
+    static EOFileData ReadEOFile(std::string model_path);
+
+    // Writes an EO format model to a path, e.g. to point a model at a newly baked map. This throws
+    // if the file can't be written or a map path is too long for the format.
+    static void WriteEOFile(std::string model_path, const EOFileData& data);
+
   private:
-    // Loads the next material map path in the EO model stream given a TextureManager. This loads
-    // the map from file into OpenGL managed memory and returns a handle to the texture. This also
-    // takes a boolean specifying whether we should gamma correct the sRGB texture into linear
-    // space when loading into OpenGL.
-    GLuint LoadMap(std::ifstream* input_file, gfx::TextureManager* manager, bool convert_to_linear);
+    // The skeleton the meshes are bound to, or nullptr if the model isn't skinned.
+    std::shared_ptr<gfx::Skeleton> skeleton;
+
+    // The number of times Reload has changed the geometry.
+    unsigned int geometry_revision;
+
+    // Reads the skeleton and the joints influencing each of a number of vertices from the EO model
+    // stream into the data. This throws if they're malformed.
+    static void ReadSkin(std::istream* input_file, size_t num_vertices, EOFileData* data);
+
+    // Reads the next material map path in the EO model stream. This returns an empty string if the
+    // model doesn't have the map.
+    static std::string ReadMapPath(std::istream* input_file);
 };
 
 }
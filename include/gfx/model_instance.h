@@ -1,15 +1,19 @@
 // This class represents a physical instantiation of a ModelInfo. In other words, a ModelInfo
 // describes a model, but we must use that ModelInfo to create a ModelInstance which represents
 // the model in physical space. The ModelInstance allows the developer to specify position, scale,
-// and rotation.
+// and rotation. A ModelInstance of a skinned model can be attached to a character of an Animator,
+// which deforms its skinned meshes.
 //
 // Brian Ho (brian@brkho.com)
 
 #ifndef GFX_MODEL_INSTANCE_H
 #define GFX_MODEL_INSTANCE_H
 
+#include "gfx/animator.h"
 #include "gfx/color.h"
+#include "gfx/constants.h"
 #include "gfx/model_info.h"
+#include "gfx/transform_hierarchy.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -17,6 +21,26 @@
 
 namespace gfx {
 
+// The per-instance constants read by main.vert. This matches the std140 layout of the
+// InstanceConstants uniform block.
+struct InstanceConstants {
+  // The model transform.
+  glm::mat4 model_transform;
+  // The normal transform.
+  glm::mat4 normal_transform;
+  // The model transform of the previous frame, used to compute motion vectors.
+  glm::mat4 previous_model_transform;
+};
+
+// The skinning palettes read by skinning.glsl. This matches the std140 layout of the
+// SkinningPalette uniform block, and only the rows of the skeleton's joints are written.
+struct SkinningPalette {
+  // The first three rows of each joint's skinning transform.
+  glm::vec4 rows[3 * gfx::MAX_SKIN_JOINTS];
+  // The rows of the previous frame, used to compute motion vectors.
+  glm::vec4 previous_rows[3 * gfx::MAX_SKIN_JOINTS];
+};
+
 class ModelInstance {
   public:
     // Position of the model in 3D scene space.
@@ -27,6 +51,10 @@ class ModelInstance {
     glm::quat rotation;
     // Color of the model.
     gfx::Color color;
+    // Whether the model is expected to stay still. Static models are cached in the shadow maps and
+    // only re-rendered when they change. Models that move every frame should set this to false so
+    // they are drawn over the cached shadows instead of invalidating them. This defaults to true.
+    bool is_static;
 
     // Default constructor which initializes the position to origin, the scale to (1.0, 1.0, 1.0),
     // the rotation to no rotation, and the color to white.
@@ -41,11 +69,62 @@ class ModelInstance {
         glm::quat rotation, gfx::Color color);
 
     // Updates the model and normal transforms from the position, scale, and rotation. This must be
-    // called after any changes to the ModelInstance properties.
+    // called after any changes to the ModelInstance properties. If the ModelInstance is attached
+    // to a transform, this instead takes the transforms computed by the hierarchy's last Update.
+    // The bounds are recomputed if the ModelInfo was reloaded since the last Update.
     void Update();
 
-    // Draws the ModelInstance to the current OpenGL context given a shader program.
+    // Attaches the ModelInstance to a transform in a hierarchy, so it moves with the transform and
+    // its ancestors instead of by its position, scale, and rotation.
+    void AttachTransform(gfx::TransformHierarchy* hierarchy, unsigned int transform);
+
+    // Attaches the ModelInstance to a character of an Animator, so its skinned meshes are drawn in
+    // the character's pose and its bounds follow the pose. The character's skeleton must have the
+    // same joints as the model's, or this throws. Since the shadows of an animated ModelInstance
+    // change every frame, this also makes it non-static.
+    void AttachAnimator(gfx::Animator* animator, unsigned int character);
+
+    // Gets the skinning palette of the attached character as of the Animator's last Update, with
+    // three rows per joint, or nullptr if the ModelInstance isn't attached to an Animator.
+    const glm::vec4* GetSkinningPalette();
+
+    // Returns a counter that is incremented every time Update is called. This lets caches detect
+    // when the ModelInstance has moved.
+    unsigned int GetRevision();
+
+    // Gets the world space center of a sphere bounding the ModelInstance as of the last Update.
+    glm::vec3 GetBoundsCenter();
+
+    // Gets the world space radius of a sphere bounding the ModelInstance as of the last Update.
+    float GetBoundsRadius();
+
+    // Gets the ModelInfo the ModelInstance is an instance of.
+    gfx::ModelInfo* GetModelInfo();
+
+    // Gets the model and normal transforms as of the last Update.
+    glm::mat4 GetModelTransform();
+    glm::mat4 GetNormalTransform();
+
+    // Writes the transforms of the ModelInstance into the given constants (usually in mapped
+    // buffer memory). The model transform of the previous call is written as well so the program
+    // can compute motion vectors. This should be called once per frame, and can be called for
+    // different ModelInstances from different threads.
+    void WriteInstanceConstants(gfx::InstanceConstants* constants);
+
+    // Writes the current and previous skinning palettes of the attached character into the given
+    // palette (usually in mapped buffer memory) and remembers where it is in the buffer, so Draw
+    // and DrawDepth can bind it. This should be called once per frame for ModelInstances attached
+    // to an Animator, and can be called for different ModelInstances from different threads.
+    void WriteSkinningPalette(gfx::SkinningPalette* palette, GLuint buffer, size_t offset);
+
+    // Draws the ModelInstance to the current OpenGL context given a shader program. The constants
+    // written by WriteInstanceConstants must be bound to INSTANCE_CONSTANTS_BINDING. Skinned
+    // meshes are skinned with the palette written by WriteSkinningPalette, if any.
     void Draw(GLuint program);
+
+    // Draws only the positions of the ModelInstance (without binding any materials) given a depth
+    // shader program. This is used for depth-only passes, and skins like Draw.
+    void DrawDepth(GLuint program);
   private:
     // The underlying ModelInfo that ther object is an instance of.
     gfx::ModelInfo* model_info;
@@ -55,6 +134,47 @@ class ModelInstance {
 
     // The normal transform.
     glm::mat4 normal_transform;
+
+    // The number of times Update has been called.
+    unsigned int revision;
+
+    // The world space center of the bounding sphere.
+    glm::vec3 bounds_center;
+
+    // The world space radius of the bounding sphere.
+    float bounds_radius;
+
+    // The model transform written by the last call to WriteInstanceConstants.
+    glm::mat4 drawn_model_transform;
+
+    // The hierarchy and transform the ModelInstance is attached to, or nullptr if it isn't.
+    gfx::TransformHierarchy* hierarchy;
+    unsigned int transform;
+
+    // The revision of the attached transform the model transform was taken from.
+    unsigned int transform_revision;
+
+    // The Animator and character the ModelInstance is attached to, or nullptr if it isn't.
+    gfx::Animator* animator;
+    unsigned int character;
+
+    // The revision of the attached character the bounds were taken from.
+    unsigned int character_revision;
+
+    // The geometry revision of the ModelInfo the bounds were taken from.
+    unsigned int geometry_revision;
+
+    // The buffer and offset of the skinning palette written by the last WriteSkinningPalette. The
+    // buffer is 0 if no palette has been written.
+    GLuint palette_buffer;
+    size_t palette_offset;
+
+    // Sets whether the program skins the next draws and binds the skinning palette if it does.
+    void BindSkinningPalette(GLuint program, gfx::Mesh* mesh);
+
+    // Sets the model and normal transforms, incrementing the revision and moving the bounding
+    // sphere with them.
+    void SetTransforms(glm::mat4 model_transform, glm::mat4 normal_transform);
 };
 
 }
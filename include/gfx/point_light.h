@@ -27,6 +27,12 @@ class PointLight : public gfx::Light {
     // The quadratic attenuation coefficient of the light.
     GLfloat quad_atten;
 
+    // The distance at which the light's falloff reaches zero. This defaults to 100.0.
+    GLfloat radius;
+
+    // Whether the light casts shadows with cube shadow maps. This defaults to true.
+    bool casts_shadows;
+
     // Constructor for a PointLight that specifies a color irradiance, position, constant
     // attenuation, linear attenuation, and quadratic attenuation.
     PointLight(glm::vec3 position, GLfloat const_atten, GLfloat linear_atten, GLfloat quad_atten,
@@ -0,0 +1,127 @@
+// This class manages the omnidirectional shadows of the point lights. Every light gets a fixed slot
+// in one shared depth atlas that holds its six cube faces side by side. The face size of a light
+// is chosen from its screen coverage, and each face is only re-rendered when the light or a caster
+// overlapping that face changes. A per-frame face budget spreads the updates of many shadowed
+// lights over several frames.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_POINT_SHADOW_ATLAS_H
+#define GFX_POINT_SHADOW_ATLAS_H
+
+#include "gfx/constants.h"
+#include "gfx/model_instance.h"
+#include "gfx/point_light.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gfx {
+
+// The number of faces of a shadow cube.
+const unsigned int NUM_CUBE_FACES = 6;
+
+class PointShadowAtlas {
+  public:
+    // Handle to the OpenGL managed depth atlas that is sampled when shading. This is 0 until the
+    // first call to Render.
+    GLuint atlas_handle;
+
+    // Constructor given the depth-only shader program used to render the casters. This program
+    // must take model_transform, view_transform, and projection_transform uniforms.
+    PointShadowAtlas(GLuint depth_program);
+
+    // Updates the shadows of the given point lights (indexed by their slot, with nullptr for empty
+    // slots) for the given camera position and field of view (in degrees) and casters. This leaves
+    // the atlas framebuffer bound and the viewport set to the last rendered face. Returns true if
+    // any of the shadow transforms or shadow availability changed.
+    bool Render(gfx::PointLight* const lights[gfx::MAX_POINT_LIGHTS], glm::vec3 camera_position,
+        float fov, const std::vector<gfx::ModelInstance*>& casters);
+
+    // Returns whether the light in a slot has a shadow in the atlas that can be sampled.
+    bool HasShadow(unsigned int light);
+
+    // Gets the transform from world space into the [0, 1] atlas space of a face of a light.
+    glm::mat4 GetFaceTransform(unsigned int light, unsigned int face);
+
+    // Gets the world space size of a texel of a light's faces per unit of distance from the light
+    // (used for normal offset biasing).
+    float GetTexelScale(unsigned int light);
+
+    // Gets the number of cube faces rendered in the last Render.
+    unsigned int GetFacesRendered();
+
+    // Replaces the depth-only shader program used to render the casters (e.g. after it was
+    // reloaded). The old program is not deleted.
+    void SetDepthProgram(GLuint depth_program);
+
+    // Disable copy constructor and copy assignment.
+    PointShadowAtlas(PointShadowAtlas const&) = delete;
+    void operator=(PointShadowAtlas const&) = delete;
+
+  private:
+    // Describes the state of a light's slot as it was last rendered into the atlas.
+    struct Slot {
+      // The light the slot was rendered for.
+      gfx::PointLight* light;
+      // Whether all six faces have been rendered for the current position, range, and size.
+      bool valid;
+      // The position of the light.
+      glm::vec3 position;
+      // The distance to the far plane of the faces.
+      float range;
+      // The width and height in texels of each face.
+      unsigned int face_size;
+      // Signatures of the casters overlapping each face.
+      size_t face_signatures[gfx::NUM_CUBE_FACES];
+      // The number of frames the slot has waited on the budget with dirty faces.
+      unsigned int frames_waiting;
+    };
+
+    // The depth-only shader program used to render the casters.
+    GLuint depth_program;
+
+    // Framebuffer used to render into the atlas.
+    GLuint fbo;
+
+    // The state of each light's slot.
+    Slot slots[gfx::MAX_POINT_LIGHTS];
+
+    // The number of cube faces rendered in the last Render.
+    unsigned int faces_rendered;
+
+    // Allocates the depth atlas and framebuffer.
+    void Initialize();
+
+    // Gets the distance past which the light is too dim to need shadows.
+    float GetShadowRange(gfx::PointLight* light);
+
+    // Picks the face size for a light from how much of the screen its shadow range covers. The
+    // previous size adds hysteresis so lights near a threshold don't flip sizes every frame.
+    unsigned int ChooseFaceSize(glm::vec3 position, float range, glm::vec3 camera_position,
+        float fov, unsigned int previous_size);
+
+    // Returns whether the bounding sphere of a caster overlaps a face of a shadow cube.
+    bool CasterOverlapsFace(glm::vec3 position, float range, unsigned int face_size,
+        unsigned int face, gfx::ModelInstance* caster);
+
+    // Computes the signature of the casters overlapping a face of a shadow cube.
+    size_t ComputeFaceSignature(glm::vec3 position, float range, unsigned int face_size,
+        unsigned int face, const std::vector<gfx::ModelInstance*>& casters);
+
+    // Gets the view-projection transform of a face of a shadow cube.
+    glm::mat4 GetFaceViewProjection(glm::vec3 position, float range, unsigned int face_size,
+        unsigned int face);
+
+    // Gets the texel rectangle (x, y, width, height) of a face of a light's slot in the atlas.
+    glm::ivec4 GetFaceRect(unsigned int light, unsigned int face_size, unsigned int face);
+
+    // Draws the casters into a face of a light's slot.
+    void DrawFace(unsigned int light, unsigned int face,
+        const std::vector<gfx::ModelInstance*>& casters);
+};
+
+}
+#endif // GFX_POINT_SHADOW_ATLAS_H
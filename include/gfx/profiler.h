@@ -0,0 +1,235 @@
+// This class profiles the CPU and GPU time of the passes of each frame. CPU scopes are timed with
+// a steady clock and GPU scopes with GL_TIME_ELAPSED queries from a ring of per-frame query sets.
+// The GPU timings are read back a few frames late so reading them never stalls the pipeline. Each
+// scope keeps rolling min, average, and 99th percentile statistics, and frames can be captured and
+// exported as a Chrome trace (viewable in chrome://tracing).
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_PROFILER_H
+#define GFX_PROFILER_H
+
+#include "gfx/constants.h"
+#include "gfx/gl_stats.h"
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gfx {
+
+// Rolling statistics of the time in milliseconds spent in a scope.
+struct ProfilerStatistics {
+  // The shortest time in the window.
+  double min;
+  // The mean time in the window.
+  double average;
+  // The 99th percentile time in the window.
+  double p99;
+  // The number of frames in the window.
+  unsigned int samples;
+};
+
+class Profiler {
+  public:
+    // Default constructor. This must be called with a current OpenGL context.
+    Profiler();
+
+    // Starts a new frame, reading back the GPU timings of the frame issued
+    // PROFILER_QUERY_LATENCY frames ago. Returns true if they were available.
+    bool BeginFrame();
+
+    // Ends the current frame.
+    void EndFrame();
+
+    // Starts timing a CPU scope with the given name. Scopes can nest, but must be ended in the
+    // reverse order they were started. The name must outlive the frame.
+    void BeginCpuScope(const char* name);
+
+    // Ends the most recently started CPU scope.
+    void EndCpuScope();
+
+    // Starts timing the GPU commands issued until the matching EndGpuScope. GL_TIME_ELAPSED
+    // queries can't nest, so only the outermost GPU scope is timed. The name must outlive the
+    // frame.
+    void BeginGpuScope(const char* name);
+
+    // Ends the most recently started GPU scope.
+    void EndGpuScope();
+
+    // Gets the rolling statistics of a CPU scope. The scope "Frame" covers each whole frame.
+    gfx::ProfilerStatistics GetCpuStatistics(std::string name);
+
+    // Gets the rolling statistics of a GPU scope. The scope "Frame" is the sum of the GPU scopes
+    // of each frame.
+    gfx::ProfilerStatistics GetGpuStatistics(std::string name);
+
+    // Gets the names of the CPU and GPU scopes in the order they were first seen.
+    std::vector<std::string> GetCpuScopeNames();
+    std::vector<std::string> GetGpuScopeNames();
+
+    // Gets the total GPU time in milliseconds of the most recently read back frame.
+    double GetGpuFrameTime();
+
+    // Gets the GL commands issued by the last completed frame and by each of its CPU scopes. The
+    // counts are only collected in builds with GFX_GL_STATS defined and are zero otherwise.
+    const gfx::FrameGlStats& GetGlStats();
+
+    // Clears the rolling statistics of every scope and drops the GPU timings that haven't been
+    // read back yet, e.g. to exclude warm-up frames from a benchmark.
+    void ResetStatistics();
+
+    // Captures the scopes of the next frame_count frames for exporting with WriteChromeTrace.
+    // This discards any previous capture.
+    void CaptureFrames(unsigned int frame_count);
+
+    // Returns whether the captured frames have all completed and their GPU timings have been read
+    // back (or dropped because they weren't ready in time).
+    bool IsCaptureComplete();
+
+    // Writes the captured frames to a Chrome trace JSON file. CPU scopes are on one track and GPU
+    // scopes on another. GPU scopes only have durations, so they are laid out back to back from
+    // the start of the frame that issued them. This throws if the file can't be written.
+    void WriteChromeTrace(std::string path);
+
+    // Disable copy constructor and copy assignment.
+    Profiler(Profiler const&) = delete;
+    void operator=(Profiler const&) = delete;
+
+  private:
+    // A scope that was timed in a frame.
+    struct Event {
+      // The name of the scope.
+      const char* name;
+      // The start time in microseconds since the profiler was created. For GPU events, this is
+      // the CPU time the scope was issued.
+      double start;
+      // The duration in microseconds.
+      double duration;
+      // The nesting depth of the scope.
+      unsigned int depth;
+    };
+
+    // The GPU scopes issued in a frame, waiting to be read back.
+    struct GpuFrame {
+      // The queries of the frame. Only the first scopes.size() are in use.
+      GLuint queries[gfx::PROFILER_MAX_GPU_SCOPES];
+      // The scopes of the frame, with durations filled in when they are read back.
+      std::vector<Event> scopes;
+      // Whether the frame is waiting to be read back.
+      bool pending;
+      // Whether the frame is part of the capture.
+      bool captured;
+    };
+
+    // A rolling window of the times in milliseconds of a scope.
+    struct History {
+      // The times, used as a ring buffer once full.
+      std::vector<double> times;
+      // The index of the oldest time once the ring buffer is full.
+      unsigned int next;
+    };
+
+    // The time the profiler was created.
+    std::chrono::steady_clock::time_point epoch;
+
+    // The ring of GPU query sets, one per frame in flight.
+    GpuFrame gpu_frames[gfx::PROFILER_QUERY_LATENCY];
+
+    // The index of the current frame's GPU query set.
+    unsigned int gpu_frame_index;
+
+    // The nesting depth of the GPU scopes. Only depth 0 scopes are timed.
+    unsigned int gpu_depth;
+
+    // Whether the open outermost GPU scope has a query running. This is false once the frame runs
+    // out of queries.
+    bool gpu_scope_timed;
+
+    // The start time of the current frame.
+    double frame_start;
+
+    // The CPU scopes currently open.
+    std::vector<Event> open_cpu_scopes;
+
+    // The rolling statistics of the CPU and GPU scopes.
+    std::unordered_map<std::string, History> cpu_histories;
+    std::unordered_map<std::string, History> gpu_histories;
+
+    // The scope names in the order they were first seen.
+    std::vector<std::string> cpu_scope_names;
+    std::vector<std::string> gpu_scope_names;
+
+    // The total GPU time of the most recently read back frame.
+    double gpu_frame_time;
+
+    // The number of frames left to capture.
+    unsigned int frames_to_capture;
+
+    // Whether the current frame is being captured.
+    bool capturing_frame;
+
+    // The captured CPU and GPU events.
+    std::vector<Event> captured_cpu_events;
+    std::vector<Event> captured_gpu_events;
+
+    // The GL commands issued by the last completed frame.
+    gfx::FrameGlStats gl_stats;
+
+#ifdef GFX_GL_STATS
+    // The GL commands issued by the current frame so far.
+    gfx::FrameGlStats current_gl_stats;
+
+    // The GL counters at the start of the current frame and of each open CPU scope.
+    gfx::GlStats frame_gl_start;
+    std::vector<gfx::GlStats> open_gl_scopes;
+
+    // The indices into current_gl_stats.passes of the open CPU scopes.
+    std::vector<size_t> open_gl_passes;
+#endif
+
+    // Gets the time in microseconds since the profiler was created.
+    double GetTime();
+
+    // Reads back the GPU timings of a frame if they're available. Returns true if they were.
+    bool ReadGpuFrame(GpuFrame& frame);
+
+    // Adds a time to the rolling statistics of a scope.
+    void Record(std::unordered_map<std::string, History>& histories,
+        std::vector<std::string>& names, std::string name, double time);
+
+    // Computes the statistics of a rolling window.
+    gfx::ProfilerStatistics ComputeStatistics(
+        std::unordered_map<std::string, History>& histories, std::string name);
+};
+
+// Times a CPU scope for the lifetime of the object. If is_gpu is set, the GPU commands issued
+// during its lifetime are timed as well.
+class ProfileScope {
+  public:
+    // Constructor given the profiler, the name of the scope, and whether to also time the GPU.
+    ProfileScope(gfx::Profiler* profiler, const char* name, bool is_gpu);
+
+    // Constructor for a CPU-only scope.
+    ProfileScope(gfx::Profiler* profiler, const char* name) : ProfileScope(profiler, name, false) {}
+
+    // Ends the scope.
+    ~ProfileScope();
+
+    // Disable copy constructor and copy assignment.
+    ProfileScope(ProfileScope const&) = delete;
+    void operator=(ProfileScope const&) = delete;
+
+  private:
+    // The profiler the scope is timed with.
+    gfx::Profiler* profiler;
+
+    // Whether the GPU is timed as well.
+    bool is_gpu;
+};
+
+}
+#endif // GFX_PROFILER_H
@@ -0,0 +1,201 @@
+// This class schedules the passes of a frame and allocates the render targets they share. Each pass
+// declares the render targets it reads and the ones it writes, along with where they're attached
+// to its framebuffer. Compile then culls the passes whose writes nothing reads and works out the
+// lifetime of each transient render target. Transient render targets whose lifetimes don't
+// overlap and whose descriptions match are aliased onto one texture or renderbuffer. Execute runs
+// the live passes in order, each inside a profiler scope with its framebuffer and draw buffers
+// bound. OpenGL already orders framebuffer writes before later reads of the same texture, so
+// there are no explicit barriers to issue.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_RENDER_GRAPH_H
+#define GFX_RENDER_GRAPH_H
+
+#include "gfx/profiler.h"
+
+#include <glad/glad.h>
+
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace gfx {
+
+// Describes a transient render target.
+struct RenderTargetDescription {
+  // GL_TEXTURE_2D, GL_TEXTURE_2D_MULTISAMPLE, or GL_RENDERBUFFER.
+  GLenum target;
+  // The sized internal format, e.g. GL_RGBA16F.
+  GLenum internal_format;
+  // The dimensions in pixels.
+  GLuint width;
+  GLuint height;
+  // The number of samples per pixel. This is ignored for GL_TEXTURE_2D.
+  GLuint samples;
+};
+
+// The render target memory of a compiled render graph.
+struct RenderGraphMemory {
+  // The bytes of the textures and renderbuffers allocated, with aliasing.
+  size_t aliased_bytes;
+  // The bytes the transient render targets of the live passes would take without aliasing.
+  size_t unaliased_bytes;
+  // The number of textures and renderbuffers allocated and the number of transient render
+  // targets they back.
+  unsigned int physical_targets;
+  unsigned int transient_targets;
+};
+
+class RenderGraph {
+  public:
+    // Default constructor. This must be called with a current OpenGL context.
+    RenderGraph();
+
+    // Destructor which deletes the textures, renderbuffers, and framebuffers of the graph.
+    ~RenderGraph();
+
+    // Removes every pass and render target so the graph can be declared again. The allocated
+    // textures and renderbuffers are kept until the next Compile, which reuses the ones that still
+    // match a render target and deletes the rest.
+    void Reset();
+
+    // Declares a transient render target and returns its index. Its contents are undefined at the
+    // start of each frame, since its memory may be aliased, so the first pass writing it must
+    // clear it. The name must outlive the graph.
+    unsigned int CreateRenderTarget(const char* name, gfx::RenderTargetDescription description);
+
+    // Declares a render target owned outside the graph (e.g. the TAA history) and returns its
+    // index. Passes bind it themselves, so it can only be written with an attachment of GL_NONE.
+    // A pass writing it is never culled since it's read outside the graph.
+    unsigned int ImportRenderTarget(const char* name);
+
+    // Adds a pass that runs execute and returns its index. Passes run in the order they are added.
+    // The name is also the name of the pass's profiler scope, so it must outlive the graph.
+    unsigned int AddPass(const char* name, std::function<void()> execute);
+
+    // Declares that a pass reads a render target. Rendering into an attachment without clearing it
+    // first (e.g. depth testing against it) counts as a read as well.
+    void Read(unsigned int pass, unsigned int render_target);
+
+    // Declares that a pass writes a render target at an attachment of its framebuffer (e.g.
+    // GL_COLOR_ATTACHMENT0 or GL_DEPTH_ATTACHMENT), or GL_NONE if it writes it some other way.
+    void Write(unsigned int pass, unsigned int render_target, GLenum attachment);
+
+    // Marks a pass as having effects outside the graph (e.g. rendering shadow maps or to the
+    // default framebuffer), so it's never culled.
+    void SetSideEffects(unsigned int pass);
+
+    // Culls the unused passes, allocates the transient render targets, and creates the
+    // framebuffers of the live passes. This throws if a framebuffer is incomplete.
+    void Compile();
+
+    // Runs the live passes, timing each on the CPU and GPU with the profiler. Passes whose
+    // framebuffer has no attachments leave the bound framebuffer alone.
+    void Execute(gfx::Profiler* profiler);
+
+    // Gets the texture or renderbuffer handle of a transient render target.
+    GLuint GetHandle(unsigned int render_target);
+
+    // Gets the framebuffer of a pass, or 0 if it has no attachments.
+    GLuint GetFramebuffer(unsigned int pass);
+
+    // Returns whether Compile culled a pass.
+    bool IsPassCulled(unsigned int pass);
+
+    // Gets the render target memory of the compiled graph.
+    gfx::RenderGraphMemory GetMemory();
+
+    // Disable copy constructor and copy assignment.
+    RenderGraph(RenderGraph const&) = delete;
+    void operator=(RenderGraph const&) = delete;
+
+  private:
+    // A render target declared by the passes.
+    struct RenderTarget {
+      // The name of the render target.
+      const char* name;
+      // The description of a transient render target.
+      gfx::RenderTargetDescription description;
+      // Whether the render target is owned outside the graph.
+      bool imported;
+      // The index into physical_targets backing a transient render target.
+      unsigned int physical_target;
+      // The first and last live passes using the render target. first_pass is greater than
+      // last_pass if no live pass uses it.
+      unsigned int first_pass;
+      unsigned int last_pass;
+    };
+
+    // A pass of the frame.
+    struct Pass {
+      // The name of the pass.
+      const char* name;
+      // Runs the pass.
+      std::function<void()> execute;
+      // The render targets the pass reads.
+      std::vector<unsigned int> reads;
+      // The render targets the pass writes and their attachments.
+      std::vector<std::pair<GLenum, unsigned int>> writes;
+      // Whether the pass has effects outside the graph.
+      bool side_effects;
+      // Whether Compile culled the pass.
+      bool culled;
+      // The framebuffer of the pass, or 0 if it has no attachments.
+      GLuint framebuffer;
+      // The draw buffers of the framebuffer, mapping each fragment output to its color attachment.
+      std::vector<GLenum> draw_buffers;
+    };
+
+    // A texture or renderbuffer backing one or more transient render targets.
+    struct PhysicalTarget {
+      // The description shared by the render targets it backs.
+      gfx::RenderTargetDescription description;
+      // The texture or renderbuffer handle.
+      GLuint handle;
+      // Whether a render target of the current compile was assigned to it.
+      bool assigned;
+      // The last pass using it in the current compile.
+      unsigned int last_pass;
+    };
+
+    // The render targets and passes declared since the last Reset.
+    std::vector<RenderTarget> render_targets;
+    std::vector<Pass> passes;
+
+    // The allocated textures and renderbuffers.
+    std::vector<PhysicalTarget> physical_targets;
+
+    // The framebuffers of the live passes, keyed by their sorted attachments so passes rendering
+    // into the same targets share one.
+    std::map<std::vector<std::pair<GLenum, GLuint>>, GLuint> framebuffers;
+
+    // The render target memory of the compiled graph.
+    gfx::RenderGraphMemory memory;
+
+    // Gets the size in bytes of a render target with a description.
+    static size_t GetSize(const gfx::RenderTargetDescription& description);
+
+    // Returns whether two descriptions can share a texture or renderbuffer.
+    static bool IsAliasable(const gfx::RenderTargetDescription& a,
+        const gfx::RenderTargetDescription& b);
+
+    // Allocates a texture or renderbuffer with a description.
+    static GLuint Allocate(const gfx::RenderTargetDescription& description);
+
+    // Deletes a texture or renderbuffer with a description.
+    static void Free(const gfx::RenderTargetDescription& description, GLuint handle);
+
+    // Culls the passes whose writes are never read.
+    void CullPasses();
+
+    // Assigns each transient render target used by a live pass to a physical target.
+    void AssignPhysicalTargets();
+
+    // Creates the framebuffer of each live pass.
+    void CreateFramebuffers();
+};
+
+}
+#endif // GFX_RENDER_GRAPH_H
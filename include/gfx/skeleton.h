@@ -0,0 +1,106 @@
+// This header defines the skeletons that skinned meshes are deformed by and the poses they are
+// animated with. A skeleton is a list of joints, each parented to a joint before it (or to none),
+// so one pass over the joints visits every parent before its children. Poses store the local
+// translation, rotation, and scale (applied as translate * rotate * scale) of every joint as
+// structure of arrays blocks of four joints, so the animation code can sample, blend, and convert
+// them four joints at a time with SSE.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_SKELETON_H
+#define GFX_SKELETON_H
+
+#include "gfx/constants.h"
+#include "gfx/mesh.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace gfx {
+
+// The local transforms of four joints in structure of arrays form. Each component holds the values
+// of the four joints in a row, so it can be loaded straight into an SSE register.
+struct JointBlock {
+  // The translations (x, y, z), rotations (w, x, y, z), and scales (x, y, z).
+  float translations[3][4];
+  float rotations[4][4];
+  float scales[3][4];
+};
+
+class Pose {
+  public:
+    // The blocks of joints. Joint i is lane i % 4 of block i / 4, and the unused lanes of the last
+    // block hold identity transforms.
+    std::vector<JointBlock> blocks;
+
+    // Default constructor for a pose of no joints.
+    Pose();
+
+    // Constructor for a pose of a number of joints, each with no translation, rotation, or scale.
+    Pose(size_t num_joints);
+
+    // Gets the number of joints in the pose.
+    size_t GetNumJoints() const;
+
+    // Sets the local translation, rotation, and scale of a joint.
+    void SetJoint(unsigned int joint, glm::vec3 translation, glm::quat rotation, glm::vec3 scale);
+
+    // Gets the local translation, rotation, or scale of a joint.
+    glm::vec3 GetTranslation(unsigned int joint) const;
+    glm::quat GetRotation(unsigned int joint) const;
+    glm::vec3 GetScale(unsigned int joint) const;
+
+  private:
+    // The number of joints in the pose.
+    size_t num_joints;
+};
+
+class Skeleton {
+  public:
+    // Constructor given the parent of each joint (or JOINT_NO_PARENT for a root) and the pose the
+    // skinned mesh was modeled in. This throws if a joint is parented to itself or a joint after
+    // it, or if there are more than MAX_SKIN_JOINTS joints.
+    Skeleton(std::vector<unsigned int> parents, gfx::Pose bind_pose);
+
+    // Gets the number of joints in the skeleton.
+    size_t GetNumJoints();
+
+    // Gets the parent of a joint, or JOINT_NO_PARENT for a root.
+    unsigned int GetParent(unsigned int joint);
+
+    // Gets the pose the skinned mesh was modeled in.
+    const gfx::Pose& GetBindPose();
+
+    // Gets the inverse of a joint's model space transform in the bind pose, which takes the
+    // vertices of the skinned mesh into the joint's space.
+    glm::mat4 GetInverseBindTransform(unsigned int joint);
+
+    // Fits the bounds padding to a skinned mesh, making it the farthest any vertex is from the
+    // joints influencing it in the bind pose. This throws if a vertex is influenced by a joint the
+    // skeleton doesn't have.
+    void FitBoundsPadding(const std::vector<gfx::Vertex>& vertices,
+        const std::vector<gfx::SkinVertex>& skin);
+
+    // Gets the bounds padding. As long as a pose doesn't scale the joints up, the posed mesh stays
+    // inside the box bounding its joints grown by the padding on every side.
+    float GetBoundsPadding();
+
+  private:
+    // The parent of each joint.
+    std::vector<unsigned int> parents;
+
+    // The pose the skinned mesh was modeled in.
+    gfx::Pose bind_pose;
+
+    // The inverse of each joint's model space transform in the bind pose.
+    std::vector<glm::mat4> inverse_bind_transforms;
+
+    // How far the vertices of the skinned mesh reach past the joints.
+    float bounds_padding;
+};
+
+}
+#endif // GFX_SKELETON_H
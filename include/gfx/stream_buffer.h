@@ -0,0 +1,88 @@
+// This class streams per-frame data to the GPU through a ring of buffer regions. Each frame writes
+// into its own region, which is mapped without synchronization so the driver never waits for the
+// GPU. Instead, every region is guarded by a fence placed after the frame's last draw, and the CPU
+// only waits on it when it wraps around to a region the GPU may still be reading. This lets the
+// CPU prepare the next frames while the GPU renders the current one.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_STREAM_BUFFER_H
+#define GFX_STREAM_BUFFER_H
+
+#include "gfx/constants.h"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+namespace gfx {
+
+class StreamBuffer {
+  public:
+    // Handle to the OpenGL managed buffer.
+    GLuint buffer_handle;
+
+    // Constructor given the buffer target (e.g. GL_UNIFORM_BUFFER) and the size in bytes of each
+    // frame's region. This must be called with a current OpenGL context.
+    StreamBuffer(GLenum target, size_t region_size);
+
+    // Starts writing the next frame's region, waiting for the GPU to finish reading it if needed.
+    void BeginFrame();
+
+    // Reserves size bytes of the current region and returns their offset into the buffer. The
+    // offset is aligned so it can be bound with glBindBufferRange. This must be called in between
+    // a BeginFrame and an Unmap, and throws if the region is full.
+    size_t Allocate(size_t size);
+
+    // Gets a pointer to the mapped memory at an offset returned by Allocate. Different threads can
+    // fill disjoint parts of the allocations until Unmap.
+    void* GetPointer(size_t offset);
+
+    // Copies data into a new allocation and returns its offset into the buffer.
+    size_t Write(const void* data, size_t size);
+
+    // Gets the alignment of the offsets returned by Allocate. Sizes rounded up to this can be
+    // packed back to back in a single allocation.
+    size_t GetAlignment();
+
+    // Finishes writing the current region so it can be read by draws.
+    void Unmap();
+
+    // Fences the current region after the last draw that reads it has been issued.
+    void EndFrame();
+
+    // Gets the time in milliseconds the last BeginFrame spent waiting on the GPU.
+    double GetWaitTime();
+
+    // Disable copy constructor and copy assignment.
+    StreamBuffer(StreamBuffer const&) = delete;
+    void operator=(StreamBuffer const&) = delete;
+
+  private:
+    // The buffer target.
+    GLenum target;
+
+    // The size in bytes of each frame's region.
+    size_t region_size;
+
+    // The alignment of the offsets returned by Write.
+    size_t alignment;
+
+    // The index of the current frame's region.
+    unsigned int region;
+
+    // The fences guarding the regions. These are nullptr for regions the GPU isn't reading.
+    GLsync fences[gfx::STREAM_BUFFER_FRAMES];
+
+    // The mapped current region, or nullptr if it isn't mapped.
+    char* mapped;
+
+    // The number of bytes written to the current region.
+    size_t written;
+
+    // The time the last BeginFrame spent waiting on the GPU.
+    double wait_time;
+};
+
+}
+#endif // GFX_STREAM_BUFFER_H
@@ -8,11 +8,14 @@
 #ifndef GFX_TEXTURE_MANAGER_H
 #define GFX_TEXTURE_MANAGER_H
 
+#include "gfx/job_system.h"
+
 #include <glad/glad.h>
 
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace gfx {
@@ -22,11 +25,42 @@ class TextureManager {
     // Default constructor that initializes its members.
     TextureManager();
 
+    // Constructor specifying whether textures are uploaded to OpenGL. Without uploading, no OpenGL
+    // context is needed and the handles only identify the textures (e.g. for the CpuRenderer to
+    // look up their images with GetTextureSource).
+    TextureManager(bool should_upload);
+
     // Load the image given by the path argument and set it up as a texture in OpenGL. This also
     // specifies a boolean to convert the sRGB texture into linear space when loading into OpenGL.
     // This returns the OpenGL texture handle associated with the texture.
     GLuint GetTextureHandle(std::string path, bool convert_to_linear);
 
+    // Loads a batch of (path, convert_to_linear) textures so later calls to GetTextureHandle return
+    // them from the cache. The images are decoded in parallel on the job system and each one is
+    // transferred to OpenGL by a main thread job as soon as it is decoded. This waits for the
+    // whole batch and must be called from the job system's main thread.
+    void LoadTextures(const std::vector<std::pair<std::string, bool>>& textures,
+        gfx::JobSystem* job_system);
+
+    // Decodes the image at a path into 8-bit pixels without touching OpenGL, so it can run on any
+    // thread. This returns nullptr if the image can't be loaded or doesn't have 3 or 4 components.
+    // The pixels must be freed with FreeImage.
+    static unsigned char* DecodeImage(std::string path, int* width, int* height,
+        int* num_components);
+
+    // Frees the pixels returned by DecodeImage.
+    static void FreeImage(unsigned char* image_data);
+
+    // Reloads a texture that was loaded from a path, e.g. after the file changed on disk. The image
+    // is uploaded into the existing texture, so the Materials using its handle pick it up. This
+    // returns false if no texture was loaded from the path, and throws (keeping the old image) if
+    // the image can't be decoded.
+    bool ReloadTexture(std::string path);
+
+    // Gets the path and the convert_to_linear flag a texture was loaded with given its handle. This
+    // returns false if the handle isn't a texture loaded by the TextureManager.
+    bool GetTextureSource(GLuint id, std::string* path, bool* convert_to_linear);
+
     // Frees the OpenGL texture data for a given integer handle and updates all Materials that
     // depend on it to point to the null texture instead.
     void FreeTexture(GLuint id);
@@ -37,6 +71,26 @@ class TextureManager {
   private:
     // Hash map from the path to the OpenGL managed texture ID.
     std::unordered_map<std::string, GLuint> path_to_id_map;
+
+    // Hash map from the path to whether the texture was converted to linear space, so it's
+    // converted the same way when reloaded.
+    std::unordered_map<std::string, bool> path_to_linear_map;
+
+    // Whether textures are uploaded to OpenGL.
+    bool should_upload;
+
+    // The handle given to the next texture when textures aren't uploaded.
+    GLuint next_handle;
+
+    // Transfers a decoded image to OpenGL, caches it under its path, and frees the image data.
+    // This returns the OpenGL texture handle.
+    GLuint UploadTexture(std::string path, unsigned char* image_data, int width, int height,
+        int num_components, bool convert_to_linear);
+
+    // Transfers a decoded image into the texture bound to GL_TEXTURE_2D, generates its mipmaps,
+    // and frees the image data.
+    static void TransferImage(unsigned char* image_data, int width, int height,
+        int num_components, bool convert_to_linear);
 };
 
 }
@@ -0,0 +1,123 @@
+// This class stores a hierarchy of transforms in structure of arrays form so they can be updated
+// in batches. Each transform has a local position, rotation, and scale (applied as translate *
+// rotate * scale) relative to its parent. Update recomputes the world and normal transforms of
+// every transform that changed, or whose ancestors changed, four at a time with SSE when it's
+// available. A parent must be added before its children. Transforms are stored sorted by their
+// depth in the hierarchy, with each depth starting a new block of four, so one pass over the
+// blocks finishes every parent before its children and no block holds both.
+//
+// Brian Ho (brian@brkho.com)
+
+#ifndef GFX_TRANSFORM_HIERARCHY_H
+#define GFX_TRANSFORM_HIERARCHY_H
+
+#include "gfx/constants.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gfx {
+
+class TransformHierarchy {
+  public:
+    // Default constructor for an empty hierarchy.
+    TransformHierarchy();
+
+    // Adds a transform with no translation, rotation, or scale under a parent (or
+    // TRANSFORM_NO_PARENT for a root) and returns its index.
+    unsigned int AddTransform(unsigned int parent);
+
+    // Moves a transform under a new parent (or TRANSFORM_NO_PARENT). The parent must have been
+    // added before the transform, or this throws.
+    void SetParent(unsigned int transform, unsigned int parent);
+
+    // Gets the parent of a transform, or TRANSFORM_NO_PARENT for a root.
+    unsigned int GetParent(unsigned int transform);
+
+    // Sets the local position, rotation, or scale of a transform and marks it dirty.
+    void SetPosition(unsigned int transform, glm::vec3 position);
+    void SetRotation(unsigned int transform, glm::quat rotation);
+    void SetScale(unsigned int transform, glm::vec3 scale);
+
+    // Gets the local position, rotation, or scale of a transform.
+    glm::vec3 GetPosition(unsigned int transform);
+    glm::quat GetRotation(unsigned int transform);
+    glm::vec3 GetScale(unsigned int transform);
+
+    // Recomputes the world and normal transforms of the dirty transforms and their descendants.
+    void Update();
+
+    // Gets the world transform of a transform as of the last Update.
+    glm::mat4 GetWorldTransform(unsigned int transform);
+
+    // Gets the normal transform (the inverse transpose of the world transform's upper 3x3) as of
+    // the last Update.
+    glm::mat4 GetNormalTransform(unsigned int transform);
+
+    // Returns a counter that is incremented every time Update changes the world transform of a
+    // transform.
+    unsigned int GetRevision(unsigned int transform);
+
+    // Gets the number of transforms in the hierarchy.
+    size_t GetSize();
+
+    // Disable copy constructor and copy assignment.
+    TransformHierarchy(TransformHierarchy const&) = delete;
+    void operator=(TransformHierarchy const&) = delete;
+
+  private:
+    // Four transforms stored as structure of arrays: each component holds the values of the four
+    // transforms in a row, so it can be loaded straight into an SSE register. Keeping the block's
+    // components together means Update streams through one array instead of dozens.
+    struct TransformBlock {
+      // The local positions (x, y, z), rotations (w, x, y, z), and scales (x, y, z).
+      float positions[3][4];
+      float rotations[4][4];
+      float scales[3][4];
+      // The first three rows of the world transforms. Element column * 3 + row holds column 0-3
+      // (the last one being the translation) of row 0-2.
+      float world_transforms[12][4];
+      // The upper 3x3 of the normal transforms, laid out like the world transforms.
+      float normal_transforms[9][4];
+    };
+
+    // The parent of each transform.
+    std::vector<unsigned int> parents;
+
+    // The transform blocks. The transform in slot i is lane i % 4 of block i / 4.
+    std::vector<TransformBlock> blocks;
+
+    // The slot each transform is stored in.
+    std::vector<unsigned int> slots;
+
+    // The transform stored in each slot, or EMPTY_SLOT for the padding at the end of a depth.
+    std::vector<unsigned int> slot_transforms;
+
+    // Whether the slots are sorted by depth. Adding or reparenting a transform clears this, and the
+    // next Update sorts them again.
+    bool is_sorted;
+
+    // Whether each transform needs to be updated. Update sets this for the descendants of dirty
+    // transforms before clearing it.
+    std::vector<uint8_t> dirty;
+
+    // The number of times Update has changed each world transform.
+    std::vector<unsigned int> revisions;
+
+    // Creates a block whose four lanes are identity transforms, so unused lanes stay finite.
+    static TransformBlock CreateIdentityBlock();
+
+    // Moves the transforms into slots sorted by depth, starting each depth at a new block.
+    void SortByDepth();
+
+    // Updates the world and normal transforms of a block. The blocks of its parents must have
+    // been updated already.
+    void UpdateBlock(size_t block);
+};
+
+}
+#endif // GFX_TRANSFORM_HIERARCHY_H
@@ -6,6 +6,9 @@
 #define GFX_UTIL_H
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
 
 namespace gfx {
 namespace util {
@@ -20,6 +23,14 @@ void GetBufferContents(GLenum target, GLuint* buffer);
 // Pretty prints the contents of a buffer bound to target.
 void PrettyPrintBuffer(GLenum target);
 
+// Gets point i of the count point Hammersley set used to sample the environment for IBL. This
+// doesn't touch OpenGL.
+glm::vec2 GetHammersleyPoint(unsigned int i, unsigned int count);
+
+// Hashes an integer into another with its bits well mixed, e.g. to decorrelate the sample patterns
+// of neighboring texels or probes.
+uint32_t Hash(uint32_t value);
+
 // Checks the current errors queued up in OpenGL and prints it to standard output.
 void _CheckGlError(const char *file, int line);
 #define CheckGlError() _CheckGlError(__FILE__, __LINE__)
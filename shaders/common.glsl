@@ -0,0 +1,35 @@
+// Definitions shared by the main, G-buffer, and deferred lighting shaders. This is pulled in with
+// the #include directive handled by GameWindow::CompileShader.
+
+#ifndef COMMON_GLSL
+#define COMMON_GLSL
+
+// A fairly granular value for Pi.
+#define PI 3.1415926535897932384626433832795
+// Make sure this matches the MAX_POINT_LIGHTS in gfx/constants.h!
+#define MAX_POINT_LIGHTS 3
+// Make sure this matches the MAX_AREA_LIGHTS in gfx/constants.h!
+#define MAX_AREA_LIGHTS 4
+// The number of Newton steps taken to shade disk area lights. This must match the value defined
+// in gfx/constants.h.
+#define LTC_DISK_ITERATIONS 8
+// The maximum gloss to apply as a power.
+#define MAX_GLOSS 64.0
+// The gamma for converting between linear and sRGB.
+#define GAMMA 2.2
+// The number of samples to take for IBL. This must match the value defined in gfx/constants.h.
+#define NUM_IBL_SAMPLES 32
+// The number of directional light shadow cascades. This must match the value defined in
+// gfx/constants.h.
+#define NUM_SHADOW_CASCADES 4
+// The number of spherical harmonics coefficients of each irradiance probe. This must match the
+// value defined in gfx/constants.h.
+#define IRRADIANCE_SH_COEFFICIENTS 9
+
+struct MapInfo {
+  bool enabled;
+  vec3 default_value;
+  sampler2D map;
+};
+
+#endif // COMMON_GLSL
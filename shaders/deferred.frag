@@ -0,0 +1,38 @@
+#version 330 core
+
+// Shades the G-buffer with the same BRDF and IBL as main.frag. This is run once for pixels whose
+// samples all agree and once per sample (with glSampleMaski) for pixels flagged as MSAA edges.
+
+uniform sampler2DMS albedo_metallic_buffer;
+uniform sampler2DMS normal_roughness_buffer;
+uniform sampler2DMS ao_environment_buffer;
+uniform sampler2DMS depth_buffer;
+uniform mat4 inverse_view_projection;
+uniform uvec2 dimensions;
+uniform int sample_index;
+
+out vec4 out_color;
+
+// Reconstructed from the depth buffer in main() before any lighting is computed.
+vec3 WorldPosition;
+
+#include "lighting.glsl"
+
+void main() {
+  ivec2 coords = ivec2(gl_FragCoord.xy);
+  float depth = texelFetch(depth_buffer, coords, sample_index).r;
+  // Nothing was drawn to this sample, so leave the skybox (or clear color) untouched.
+  if (depth == 1.0) {
+    discard;
+  }
+  vec4 ndc = vec4((gl_FragCoord.xy / vec2(dimensions)) * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+  vec4 world = inverse_view_projection * ndc;
+  WorldPosition = world.xyz / world.w;
+
+  vec4 albedo_metallic = texelFetch(albedo_metallic_buffer, coords, sample_index);
+  vec4 normal_roughness = texelFetch(normal_roughness_buffer, coords, sample_index);
+  vec4 ao_environment = texelFetch(ao_environment_buffer, coords, sample_index);
+  out_color = vec4(shade_surface(albedo_metallic.rgb, albedo_metallic.a,
+      normal_roughness.a, normalize(normal_roughness.xyz), ao_environment.rgb,
+      ao_environment.a > 0.5), 1.0);
+}
@@ -0,0 +1,31 @@
+#version 330 core
+
+// Classifies MSAA edge pixels for deferred shading. Pixels whose samples all hit the same surface
+// are discarded, so only edge pixels survive to mark the stencil buffer for per-sample shading.
+
+// The depth difference between samples past which the pixel is considered an edge.
+#define DEPTH_THRESHOLD 0.0005
+// The cosine between sample normals below which the pixel is considered an edge.
+#define NORMAL_THRESHOLD 0.99
+
+uniform sampler2DMS normal_roughness_buffer;
+uniform sampler2DMS depth_buffer;
+uniform int num_samples;
+
+out vec4 out_color;
+
+void main() {
+  ivec2 coords = ivec2(gl_FragCoord.xy);
+  float first_depth = texelFetch(depth_buffer, coords, 0).r;
+  vec3 first_normal = texelFetch(normal_roughness_buffer, coords, 0).xyz;
+  for (int i = 1; i < num_samples; i++) {
+    float depth = texelFetch(depth_buffer, coords, i).r;
+    vec3 normal = texelFetch(normal_roughness_buffer, coords, i).xyz;
+    if (abs(depth - first_depth) > DEPTH_THRESHOLD ||
+        dot(normal, first_normal) < NORMAL_THRESHOLD) {
+      out_color = vec4(0.0);
+      return;
+    }
+  }
+  discard;
+}
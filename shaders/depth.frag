@@ -0,0 +1,6 @@
+#version 330 core
+
+// Depth-only pass. Nothing is written besides depth.
+
+void main() {
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+// Depth-only pass. This must compute gl_Position exactly like main.vert so the main pass can shade
+// with an equal depth test.
+
+layout (location = 0) in vec3 position;
+
+#include "skinning.glsl"
+
+uniform mat4 model_transform;
+uniform mat4 view_transform;
+uniform mat4 projection_transform;
+
+invariant gl_Position;
+
+void main() {
+  vec3 object_position = position;
+  if (skinned) {
+    object_position = vec4(position, 1.0) * get_skinning_transform();
+  }
+  gl_Position = projection_transform * view_transform * model_transform *
+      vec4(object_position, 1.0);
+}
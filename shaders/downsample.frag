@@ -0,0 +1,22 @@
+#version 330 core
+
+// Dual filter (Kawase) downsample to the next level of the chain. Five bilinear taps cover a 4x4
+// block of the source, the center one weighted by half. The log luminance in the alpha channel is
+// averaged along with the color.
+
+in vec2 UV;
+
+out vec4 out_color;
+
+uniform sampler2D source;
+// The size of a source texel in UV space.
+uniform vec2 texel_size;
+
+void main() {
+  vec4 color = texture(source, UV) * 4.0;
+  color += texture(source, UV - texel_size);
+  color += texture(source, UV + texel_size);
+  color += texture(source, UV + vec2(texel_size.x, -texel_size.y));
+  color += texture(source, UV - vec2(texel_size.x, -texel_size.y));
+  out_color = color / 8.0;
+}
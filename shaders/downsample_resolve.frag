@@ -0,0 +1,58 @@
+#version 330 core
+
+// Resolves the HDR buffer (or the TAA history) into the first level of the downsample chain, at
+// half the viewport resolution. Each texel averages the 2x2 block of source texels it covers,
+// weighted by their inverse luminance so a single bright sample can't make the bloom flicker.
+// The alpha channel holds the average log luminance, which the rest of the chain keeps averaging
+// for auto exposure.
+
+in vec2 UV;
+
+out vec4 out_color;
+
+uniform sampler2DMS hdr_buffer;
+uniform int num_samples;
+// With TAA, the history replaces the HDR buffer.
+uniform sampler2D taa_history;
+uniform bool taa_enabled;
+// The size of the rendered region of the source.
+uniform uvec2 source_dimensions;
+
+const vec3 LUMINANCE = vec3(0.2126, 0.7152, 0.0722);
+
+// Gets the linear HDR color of a source texel.
+vec3 fetch_texel(ivec2 coords) {
+  vec3 hdr_color = vec3(0.0);
+  if (taa_enabled) {
+    // The history is tone mapped, so undo the Reinhard curve.
+    vec3 mapped = min(vec3(texelFetch(taa_history, coords, 0)), vec3(0.999));
+    hdr_color = mapped / (vec3(1.0) - mapped);
+  } else {
+    for (int i = 0; i < num_samples; i++) {
+      hdr_color += vec3(texelFetch(hdr_buffer, coords, i));
+    }
+    hdr_color /= float(num_samples);
+  }
+  // A single NaN would spread through every level of the chain, and negative colors would blow up
+  // the luminance weights, so drop them.
+  return any(isnan(hdr_color)) ? vec3(0.0) : max(hdr_color, vec3(0.0));
+}
+
+void main() {
+  ivec2 base = ivec2(floor(UV * vec2(source_dimensions) - 0.5));
+  ivec2 max_coords = ivec2(source_dimensions) - 1;
+  vec3 color = vec3(0.0);
+  float total_weight = 0.0;
+  float log_luminance = 0.0;
+  for (int y = 0; y <= 1; y++) {
+    for (int x = 0; x <= 1; x++) {
+      vec3 texel = fetch_texel(clamp(base + ivec2(x, y), ivec2(0), max_coords));
+      float luminance = dot(texel, LUMINANCE);
+      float weight = 1.0 / (1.0 + luminance);
+      color += texel * weight;
+      total_weight += weight;
+      log_luminance += log(max(luminance, 1e-4));
+    }
+  }
+  out_color = vec4(color / total_weight, log_luminance / 4.0);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+
+// Reduces the last level of the downsample chain to the log average luminance of the frame and
+// adapts the previous exposure towards the one that maps it to middle grey. The result is written
+// to a 1x1 texture that hdr.frag reads, so the exposure never goes through the CPU.
+
+out vec4 out_color;
+
+// The last level of the downsample chain, with the log luminance in the alpha channel.
+uniform sampler2D luminance_buffer;
+uniform sampler2D previous_exposure;
+uniform bool history_valid;
+// How far to move towards the measured exposure in log space.
+uniform float adaptation;
+uniform float key;
+uniform float min_exposure;
+uniform float max_exposure;
+
+void main() {
+  ivec2 size = textureSize(luminance_buffer, 0);
+  float log_luminance = 0.0;
+  for (int y = 0; y < size.y; y++) {
+    for (int x = 0; x < size.x; x++) {
+      log_luminance += texelFetch(luminance_buffer, ivec2(x, y), 0).a;
+    }
+  }
+  float average_luminance = exp(log_luminance / float(size.x * size.y));
+  float exposure = clamp(key / average_luminance, min_exposure, max_exposure);
+  if (history_valid) {
+    float previous = texelFetch(previous_exposure, ivec2(0), 0).r;
+    exposure = exp2(mix(log2(previous), log2(exposure), adaptation));
+  }
+  out_color = vec4(exposure, 0.0, 0.0, 1.0);
+}
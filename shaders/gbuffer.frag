@@ -0,0 +1,29 @@
+#version 330 core
+
+// Writes the material properties of the closest surface into the G-buffer for deferred shading.
+
+in vec2 UV;
+in vec3 WorldPosition;
+in mat3 TBN;
+
+layout (location = 0) out vec4 albedo_metallic;
+layout (location = 1) out vec4 normal_roughness;
+layout (location = 2) out vec4 ao_environment;
+layout (location = 3) out vec2 motion;
+
+#include "material.glsl"
+#include "motion.glsl"
+
+// Only the enabled flag is read here; the map itself is sampled in the lighting pass.
+uniform MapInfo environment_map;
+
+void main() {
+  vec3 albedo, normal, ao;
+  float metallic, roughness;
+  sample_material(albedo, metallic, roughness, normal, ao);
+  albedo_metallic = vec4(albedo, metallic);
+  normal_roughness = vec4(normal, roughness);
+  // The alpha channel flags whether the surface should integrate the environment map.
+  ao_environment = vec4(ao, environment_map.enabled ? 1.0 : 0.0);
+  motion = get_motion();
+}
@@ -9,21 +9,77 @@ out vec4 out_color;
 uniform usampler2D bayer_matrix;
 uniform sampler2DMS hdrBuffer;
 uniform uvec2 dimensions;
+// The size of the region of hdrBuffer that was rendered to. This is smaller than dimensions with
+// dynamic resolution, in which case the region is upscaled.
+uniform uvec2 render_dimensions;
+// With TAA, the resolved history is already tone mapped and replaces the MSAA resolve.
+uniform sampler2D taa_history;
+uniform bool taa_enabled;
+// The half resolution bloom from the downsample chain, blended into each sample before tone
+// mapping.
+uniform sampler2D bloom_buffer;
+uniform bool bloom_enabled;
+uniform float bloom_strength;
+// The 1x1 texture holding the auto exposure, which is 1 when it's disabled.
+uniform sampler2D exposure_buffer;
+uniform bool auto_exposure_enabled;
 
 vec3 reinhard_map(vec3 hdr_color) {
   vec3 mapped = hdr_color / (hdr_color + vec3(1.0));
   return mapped;
 }
 
+// Composites the bloom into a HDR color and exposes it.
+vec3 expose(vec3 hdr_color, vec3 bloom, float exposure) {
+  if (bloom_enabled) {
+    hdr_color = mix(hdr_color, bloom, bloom_strength);
+  }
+  return hdr_color * exposure;
+}
+
+// Exposes, tone maps, and resolves the MSAA samples of a texel.
+vec3 resolve_texel(ivec2 coords, vec3 bloom, float exposure) {
+  vec3 hdr_color = vec3(0.0);
+  hdr_color += reinhard_map(expose(vec3(texelFetch(hdrBuffer, coords, 0)), bloom, exposure));
+  hdr_color += reinhard_map(expose(vec3(texelFetch(hdrBuffer, coords, 1)), bloom, exposure));
+  hdr_color += reinhard_map(expose(vec3(texelFetch(hdrBuffer, coords, 2)), bloom, exposure));
+  hdr_color += reinhard_map(expose(vec3(texelFetch(hdrBuffer, coords, 3)), bloom, exposure));
+  return hdr_color / 4.0;
+}
+
 void main() {
-  // We do a custom MSAA resolve in order to do tone mapping before the resolve.
+  // We do a custom MSAA resolve in order to do tone mapping before the resolve. The bloom and
+  // exposure are applied per sample in the same pass, so the post chain only adds passes at half
+  // resolution and below.
   ivec2 coords = ivec2(int(UV.s * dimensions.x), int(UV.t * dimensions.y));
+  vec3 bloom = bloom_enabled ? vec3(texture(bloom_buffer, UV)) : vec3(0.0);
+  float exposure = auto_exposure_enabled ? texelFetch(exposure_buffer, ivec2(0), 0).r : 1.0;
   vec3 hdr_color = vec3(0.0);
-  hdr_color += reinhard_map(vec3(texelFetch(hdrBuffer, coords, 0)));
-  hdr_color += reinhard_map(vec3(texelFetch(hdrBuffer, coords, 1)));
-  hdr_color += reinhard_map(vec3(texelFetch(hdrBuffer, coords, 2)));
-  hdr_color += reinhard_map(vec3(texelFetch(hdrBuffer, coords, 3)));
-  hdr_color /= 4.0;
+  if (taa_enabled) {
+    hdr_color = vec3(texelFetch(taa_history, coords, 0));
+    if (bloom_enabled || auto_exposure_enabled) {
+      // The history was tone mapped without exposure, so undo the Reinhard curve first. Keep NaNs,
+      // which min may turn into 0.999, so they show up the same as without the post chain.
+      hdr_color = any(isnan(hdr_color)) ? hdr_color : min(hdr_color, vec3(0.999));
+      hdr_color = reinhard_map(expose(hdr_color / (vec3(1.0) - hdr_color), bloom, exposure));
+    }
+  } else if (render_dimensions == dimensions) {
+    hdr_color = resolve_texel(coords, bloom, exposure);
+  } else {
+    // Multisampled textures can't be filtered, so bilinearly upscale the resolved texels by hand.
+    vec2 position = UV * vec2(render_dimensions) - 0.5;
+    ivec2 max_coords = ivec2(render_dimensions) - 1;
+    ivec2 base = ivec2(floor(position));
+    vec2 weight = position - vec2(base);
+    vec3 texels[4];
+    for (int i = 0; i < 4; i++) {
+      ivec2 neighbor_coords = clamp(base + ivec2(i % 2, i / 2), ivec2(0), max_coords);
+      texels[i] = resolve_texel(neighbor_coords, bloom, exposure);
+    }
+    vec3 bottom = mix(texels[0], texels[1], weight.x);
+    vec3 top = mix(texels[2], texels[3], weight.x);
+    hdr_color = mix(bottom, top, weight.y);
+  }
 
   // Gamma correction.
   out_color = vec4(pow(hdr_color, vec3(1.0 / GAMMA)), 1.0);
@@ -0,0 +1,460 @@
+// Lighting shared by the forward and deferred shaders. This holds the light uniforms, the
+// Cook-Torrance BRDF, and the IBL integration. The including shader must provide WorldPosition
+// (either as an input or as a global it fills in) before including this file.
+
+#ifndef LIGHTING_GLSL
+#define LIGHTING_GLSL
+
+#include "common.glsl"
+
+struct DirectionalLight {
+  bool enabled;
+  bool casts_shadows;
+  vec3 direction;
+  vec3 irradiance;
+};
+
+struct PointLight {
+  bool enabled;
+  bool casts_shadows;
+  vec3 position;
+  vec3 irradiance;
+  float const_atten;
+  float linear_atten;
+  float quad_atten;
+  float radius;
+};
+
+// A rectangle or disk shaped area light, with the vectors from its center to the middle of its
+// right and top edges. It shines towards cross(right, up), and from both sides if two_sided is set.
+struct AreaLight {
+  bool enabled;
+  bool is_disk;
+  bool two_sided;
+  vec3 position;
+  vec3 right;
+  vec3 up;
+  vec3 radiance;
+};
+
+// A grid of irradiance probes. The coefficients of the probes are stacked along the depth of the
+// texture, one block of resolution.z slices per coefficient.
+struct IrradianceVolume {
+  bool enabled;
+  vec3 min_position;
+  vec3 cell_size;
+  ivec3 resolution;
+  sampler3D coefficients;
+};
+
+uniform DirectionalLight directional_light;
+uniform PointLight point_lights[MAX_POINT_LIGHTS];
+uniform MapInfo environment_map;
+uniform vec2 hammersley_points[NUM_IBL_SAMPLES];
+uniform vec3 camera_position;
+uniform sampler2DArrayShadow shadow_map;
+uniform mat4 shadow_transforms[NUM_SHADOW_CASCADES];
+uniform float shadow_texel_sizes[NUM_SHADOW_CASCADES];
+uniform sampler2DShadow point_shadow_atlas;
+uniform mat4 point_shadow_transforms[MAX_POINT_LIGHTS * 6];
+uniform float point_shadow_texel_scales[MAX_POINT_LIGHTS];
+uniform IrradianceVolume irradiance_volume;
+uniform AreaLight area_lights[MAX_AREA_LIGHTS];
+uniform sampler2D ltc_matrices;
+uniform sampler2D ltc_amplitudes;
+
+float clamped_cosine(vec3 a, vec3 b) {
+  return min(max(dot(a, b), 0.0), 1.0);
+}
+
+float normal_distribution_function(vec3 normal, vec3 halfway, float roughness) {
+  float alpha_2 = pow(roughness, 4);
+  return alpha_2 / (PI * pow((pow(dot(normal, halfway), 2) * (alpha_2 - 1) + 1), 2));
+}
+
+float get_geometric_attenuation(vec3 direction, vec3 view, vec3 normal, vec3 halfway,
+    float roughness) {
+  float k = pow(roughness + 1, 2) / 8;
+  float g1l = dot(normal, direction) / (dot(normal, direction) * (1 - k) + k);
+  float g1v = dot(normal, view) / (dot(normal, view) * (1 - k) + k);
+  return g1l * g1v;
+}
+
+vec3 get_fresnel(vec3 view, vec3 halfway, vec3 f0) {
+  float dot_vh = dot(view, halfway);
+  return f0 + (1 - f0) * pow(2.0, (-5.55473 * dot_vh - 6.98316) * dot_vh);
+}
+
+vec3 get_light_contribution_helper(vec3 albedo, vec3 f0, float roughness, vec3 normal,
+    vec3 incoming_irradiance, vec3 reversed_direction) {
+  vec3 view = normalize(camera_position - WorldPosition);
+  vec3 halfway = normalize(reversed_direction + view);
+
+  vec3 albedo_contribution = albedo / PI;
+  float d = normal_distribution_function(normal, halfway, roughness);
+  vec3 f = get_fresnel(view, halfway, f0);
+  float g = get_geometric_attenuation(reversed_direction, view, normal, halfway, roughness);
+  vec3 specular_contribution = (d * f * g) / (dot(normal, reversed_direction) * dot(normal, view));
+
+  return (albedo_contribution + specular_contribution) * incoming_irradiance;
+}
+
+vec3 get_light_contribution(vec3 albedo, float metallic, float roughness, vec3 normal,
+    vec3 incoming_irradiance, vec3 reversed_direction) {
+  vec3 dielectric_contribution = get_light_contribution_helper(albedo, vec3(0.04, 0.04, 0.04),
+      roughness, normal, incoming_irradiance, reversed_direction);
+  vec3 metallic_contribution = get_light_contribution_helper(vec3(0.0, 0.0, 0.0), albedo,
+      roughness, normal, incoming_irradiance, reversed_direction);
+  return mix(dielectric_contribution, metallic_contribution, metallic);
+}
+
+// Gets the fraction of the directional light reaching WorldPosition from the shadow cascades. The
+// first cascade containing the (normal offset) position is filtered with a 3x3 grid of hardware
+// 2x2 PCF taps.
+float get_directional_light_visibility(vec3 normal) {
+  for (int i = 0; i < NUM_SHADOW_CASCADES; i++) {
+    // Offset along the normal by a texel or two to avoid acne on surfaces facing away from the
+    // light.
+    vec3 offset_position = WorldPosition + normal * shadow_texel_sizes[i] * 1.5;
+    vec3 coords = vec3(shadow_transforms[i] * vec4(offset_position, 1.0));
+    float texel = 1.0 / float(textureSize(shadow_map, 0).x);
+    if (all(greaterThan(coords.xy, vec2(texel * 2.0))) &&
+        all(lessThan(coords.xy, vec2(1.0 - texel * 2.0))) && coords.z < 1.0) {
+      float visibility = 0.0;
+      for (int x = -1; x <= 1; x++) {
+        for (int y = -1; y <= 1; y++) {
+          visibility += texture(shadow_map, vec4(coords.xy + vec2(x, y) * texel, float(i),
+              coords.z));
+        }
+      }
+      return visibility / 9.0;
+    }
+  }
+  return 1.0;
+}
+
+vec3 get_directional_light_contribution(vec3 albedo, float metallic, float roughness,
+    vec3 normal) {
+  vec3 reversed_direction = -directional_light.direction;
+  vec3 incoming_irradiance = directional_light.irradiance *
+      clamped_cosine(normal, reversed_direction);
+  if (directional_light.casts_shadows) {
+    incoming_irradiance *= get_directional_light_visibility(normal);
+  }
+  return get_light_contribution(albedo, metallic, roughness, normal, incoming_irradiance,
+      reversed_direction);
+}
+
+// Returns how much of a point light reaches WorldPosition by looking up the cube face of its slot
+// in the shadow atlas. The lookup is offset along the normal by a texel at that distance.
+float get_point_light_visibility(int light_index, vec3 normal) {
+  vec3 light_position = point_lights[light_index].position;
+  float texel_size = point_shadow_texel_scales[light_index] * distance(WorldPosition,
+      light_position);
+  vec3 offset_position = WorldPosition + normal * texel_size * 1.5;
+  vec3 to_surface = offset_position - light_position;
+  vec3 abs_to_surface = abs(to_surface);
+  int face;
+  if (abs_to_surface.x >= abs_to_surface.y && abs_to_surface.x >= abs_to_surface.z) {
+    face = to_surface.x > 0.0 ? 0 : 1;
+  } else if (abs_to_surface.y >= abs_to_surface.z) {
+    face = to_surface.y > 0.0 ? 2 : 3;
+  } else {
+    face = to_surface.z > 0.0 ? 4 : 5;
+  }
+  vec4 shadow_position = point_shadow_transforms[light_index * 6 + face] *
+      vec4(offset_position, 1.0);
+  shadow_position.xyz /= shadow_position.w;
+  if (shadow_position.z >= 1.0) {
+    return 1.0;
+  }
+  return texture(point_shadow_atlas, shadow_position.xyz);
+}
+
+vec3 get_point_light_contribution(int light_index, vec3 albedo, float metallic, float roughness,
+    vec3 normal) {
+  PointLight light = point_lights[light_index];
+  vec3 reversed_direction = normalize(light.position - WorldPosition);
+  float dist = distance(WorldPosition, light.position);
+  float falloff = 1.0 / (dist * dist + 1);
+  falloff = pow(clamp(1 - pow(dist / light.radius, 4), 0.0, 1.0), 2) / (pow(dist, 2) + 1);
+
+  vec3 incoming_irradiance = (light.irradiance * falloff) * clamped_cosine(normal,
+      reversed_direction);
+  if (light.casts_shadows) {
+    incoming_irradiance *= get_point_light_visibility(light_index, normal);
+  }
+  return get_light_contribution(albedo, metallic, roughness, normal, incoming_irradiance,
+      reversed_direction);
+}
+
+// Looks up an LTC table (see gfx/ltc_table.h) at coordinates in [0, 1] that map the ends of each
+// axis to the centers of the first and last entries.
+vec4 get_ltc_entry(sampler2D table, vec2 coordinates) {
+  vec2 size = vec2(textureSize(table, 0));
+  return texture(table, (coordinates * (size - 1.0) + 0.5) / size);
+}
+
+// Integrates the clamped cosine over the edge of a spherical polygon between two unit vectors,
+// returning the edge's part of the polygon's vector form factor. The rational fit of
+// theta / sin(theta) from Heitz's LTC code stays accurate for short edges.
+vec3 integrate_ltc_edge(vec3 v1, vec3 v2) {
+  float x = dot(v1, v2);
+  float y = abs(x);
+  float a = 0.8543985 + (0.4965155 + 0.0145206 * y) * y;
+  float b = 3.4175940 + (4.1616724 + y) * y;
+  float v = a / b;
+  float theta_sin_theta = x > 0.0 ? v : 0.5 * inversesqrt(max(1.0 - x * x, 1e-7)) - v;
+  return cross(v1, v2) * theta_sin_theta;
+}
+
+// Integrates the clamped cosine over an area light centered at center (relative to WorldPosition)
+// after transforming it by a matrix, clipped against the horizon by looking up the sphere with the
+// same vector form factor. A rectangle's form factor points away from the light behind it, so it's
+// flipped there. A disk is integrated through the cone from the origin over its ellipse (see
+// "Real-Time Line- and Disk-Light Shading with Linearly Transformed Cosines" by Heitz and Hill).
+// The cone's negative eigenvalue lies in [-1, -1 / k], so it's found with a safeguarded Newton
+// method rather than a general cubic solver, which loses it to cancellation for distant lights.
+float integrate_ltc(mat3 transform, AreaLight light, vec3 center, bool front) {
+  if (!light.is_disk) {
+    vec3 corners[4] = vec3[4](center - light.right - light.up, center - light.right + light.up,
+        center + light.right + light.up, center + light.right - light.up);
+    for (int i = 0; i < 4; i++) {
+      corners[i] = normalize(transform * corners[i]);
+    }
+    vec3 form_factor = integrate_ltc_edge(corners[0], corners[1]) +
+        integrate_ltc_edge(corners[1], corners[2]) + integrate_ltc_edge(corners[2], corners[3]) +
+        integrate_ltc_edge(corners[3], corners[0]);
+    float len = length(form_factor);
+    if (!(len > 0.0)) {
+      return 0.0;
+    }
+    float z = form_factor.z / len;
+    return len * get_ltc_entry(ltc_amplitudes, vec2((front ? z : -z) * 0.5 + 0.5, len)).z;
+  }
+
+  // Find the axes of the ellipse, then the ellipse's center in the frame of its axes, scaled by
+  // its distance.
+  vec3 c = transform * center;
+  vec3 v1 = transform * light.right;
+  vec3 v2 = transform * light.up;
+  float d11 = dot(v1, v1);
+  float d22 = dot(v2, v2);
+  float d12 = dot(v1, v2);
+  float a, b;
+  if (abs(d12) > 0.0001 * sqrt(d11 * d22)) {
+    float trace = d11 + d22;
+    float determinant = sqrt(max(d11 * d22 - d12 * d12, 0.0));
+    float u = 0.5 * sqrt(max(trace - 2.0 * determinant, 0.0));
+    float v = 0.5 * sqrt(trace + 2.0 * determinant);
+    float e_max = (u + v) * (u + v);
+    float e_min = (u - v) * (u - v);
+    vec3 axis_1, axis_2;
+    if (d11 > d22) {
+      axis_1 = v1 * d12 + v2 * (e_max - d11);
+      axis_2 = v1 * d12 + v2 * (e_min - d11);
+    } else {
+      axis_1 = v2 * d12 + v1 * (e_max - d22);
+      axis_2 = v2 * d12 + v1 * (e_min - d22);
+    }
+    a = 1.0 / e_max;
+    b = 1.0 / e_min;
+    v1 = normalize(axis_1);
+    v2 = normalize(axis_2);
+  } else {
+    a = 1.0 / d11;
+    b = 1.0 / d22;
+    v1 *= sqrt(a);
+    v2 *= sqrt(b);
+  }
+  vec3 v3 = cross(v1, v2);
+  if (dot(c, v3) < 0.0) {
+    v3 = -v3;
+  }
+  float dist = dot(v3, c);
+  if (!(dist > 0.0)) {
+    return 0.0;
+  }
+  float x0 = dot(v1, c) / dist;
+  float y0 = dot(v2, c) / dist;
+  a *= dist * dist;
+  b *= dist * dist;
+
+  // The cubic's constant and linear terms nearly cancel for distant lights, so they're grouped to
+  // keep the precision of the root.
+  float k = 1.0 + x0 * x0 + y0 * y0;
+  float trace = a * (1.0 + x0 * x0) + b * (1.0 + y0 * y0) - 1.0;
+  float low = -1.0;
+  float high = -1.0 / k;
+  float e = high;
+  for (int i = 0; i < LTC_DISK_ITERATIONS; i++) {
+    float f = a * b * (1.0 + k * e) - (a + b) * e - (trace - e) * e * e;
+    float slope = a * b * k - (a + b) - (2.0 * trace - 3.0 * e) * e;
+    if (f > 0.0) {
+      high = e;
+    } else {
+      low = e;
+    }
+    float next = e - f / slope;
+    e = next > low && next < high ? next : 0.5 * (low + high);
+  }
+  // The form factor only depends on the product and sum of the two positive eigenvalues.
+  float product = -a * b / e;
+  float sum = trace - e;
+  float form_factor = -e * inversesqrt(product - e * sum + e * e);
+  vec3 direction = normalize(v1 * (a * x0 / (a - e)) + v2 * (b * y0 / (b - e)) + v3);
+  return form_factor * get_ltc_entry(ltc_amplitudes,
+      vec2(direction.z * 0.5 + 0.5, form_factor)).z;
+}
+
+// Gets the light reflected towards the camera from an area light. The clamped cosine is integrated
+// over the light once for the diffuse term, and once transformed by the LTC fitted to the
+// Cook-Torrance lobe for the specular term, which is scaled by the lobe's Fresnel weighted
+// integrals. These are mixed between dielectric and metallic like in get_light_contribution.
+vec3 get_area_light_contribution(int light_index, vec3 albedo, float metallic, float roughness,
+    vec3 normal) {
+  AreaLight light = area_lights[light_index];
+  vec3 center = light.position - WorldPosition;
+  bool front = dot(center, cross(light.right, light.up)) < 0.0;
+  if (!front && !light.two_sided) {
+    return vec3(0.0, 0.0, 0.0);
+  }
+
+  // Build a frame with the normal along z and the view in the xz plane.
+  vec3 view = normalize(camera_position - WorldPosition);
+  vec3 tangent = view - normal * dot(view, normal);
+  if (dot(tangent, tangent) < 1e-8) {
+    vec3 up = abs(normal.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    tangent = cross(up, normal);
+  }
+  tangent = normalize(tangent);
+  mat3 frame = transpose(mat3(tangent, cross(normal, tangent), normal));
+
+  vec2 coordinates = vec2(roughness, sqrt(1.0 - clamp(dot(normal, view), 0.0, 1.0)));
+  vec4 entry = get_ltc_entry(ltc_matrices, coordinates);
+  mat3 inverse_transform = mat3(vec3(entry.x, 0.0, entry.y), vec3(0.0, 1.0, 0.0),
+      vec3(entry.z, 0.0, entry.w));
+  vec2 amplitudes = get_ltc_entry(ltc_amplitudes, coordinates).xy;
+
+  float diffuse = integrate_ltc(frame, light, center, front);
+  float specular = integrate_ltc(inverse_transform * frame, light, center, front);
+  vec3 dielectric = albedo * diffuse + specular * (0.04 * amplitudes.x + 0.96 * amplitudes.y);
+  vec3 metal = specular * (albedo * amplitudes.x + (1.0 - albedo) * amplitudes.y);
+  return mix(dielectric, metal, metallic) * light.radiance;
+}
+
+vec3 get_ibl_sample_contribution(vec2 hammersley, float roughness, vec3 normal, vec3 albedo,
+    float metallic) {
+  // Get the sample direction from the Hammersley point. See GGX paper for derivation of closed
+  // solutions for theta and phi.
+  float alpha = pow(roughness, 2.0);
+  float theta = atan((alpha * sqrt(hammersley.x)) / sqrt(1.0 - hammersley.x));
+  float phi = 2.0 * PI * hammersley.y;
+  vec3 h_tangent = vec3(cos(phi) * sin(theta), sin(phi) * sin(theta), cos(theta));
+
+  // This direction is in tangent space, so we need to transform it to world space.
+  vec3 up = abs(normal.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+  vec3 tangent_x = normalize(cross(up, normal));
+  vec3 tangent_y = cross(normal, tangent_x);
+  vec3 h = normalize(tangent_x * h_tangent.x + tangent_y * h_tangent.y + normal * h_tangent.z);
+
+  vec3 v = normalize(camera_position - WorldPosition);
+  vec3 l = normalize(2 * abs(dot(h, v)) * h - v);
+  vec3 n = normal;
+
+  // Calculate the light contribution from the sample and the environment map.
+  if (clamped_cosine(n, l) > 0) {
+    vec2 uv1 = vec2((1.0 + atan(l.x, l.z) / PI) / 2.0, acos(l.y) / PI);
+
+    // Hacky, but fast computation of LOD. Perhaps I should opt for the more traditional and
+    // analytic solid angle approach here...
+    float lod = mix(6.0, 0.0, metallic);
+    vec3 sample_color = vec3(textureLod(environment_map.map, uv1, lod));
+
+    vec3 f0 = mix(vec3(0.04, 0.04, 0.04), albedo, metallic);
+    vec3 f = get_fresnel(v, h, f0);
+    float g = get_geometric_attenuation(l, v, n, h, roughness);
+    return (f * g * sample_color * clamped_cosine(v, h)) /
+        (clamped_cosine(n, h) * clamped_cosine(n, v));
+  }
+  return vec3(0.0, 0.0, 0.0);
+}
+
+// Evaluates the L2 spherical harmonics basis functions in a direction. This must match GetShBasis
+// in irradiance_volume.cc.
+void get_sh_basis(vec3 d, out float basis[IRRADIANCE_SH_COEFFICIENTS]) {
+  basis[0] = 0.282095;
+  basis[1] = 0.488603 * d.y;
+  basis[2] = 0.488603 * d.z;
+  basis[3] = 0.488603 * d.x;
+  basis[4] = 1.092548 * d.x * d.y;
+  basis[5] = 1.092548 * d.y * d.z;
+  basis[6] = 0.315392 * (3.0 * d.z * d.z - 1.0);
+  basis[7] = 1.092548 * d.x * d.z;
+  basis[8] = 0.546274 * (d.x * d.x - d.y * d.y);
+}
+
+// Gets the irradiance reaching WorldPosition from the probes around it. The position is offset
+// along the normal by half a cell so the surface doesn't pick up the probes behind it, and
+// clamped to the grid so each coefficient's fetch stays within its own block of slices.
+vec3 get_volume_irradiance(vec3 normal) {
+  vec3 cell_size = irradiance_volume.cell_size;
+  vec3 position = WorldPosition + normal * 0.5 * min(min(cell_size.x, cell_size.y), cell_size.z);
+  vec3 resolution = vec3(irradiance_volume.resolution);
+  vec3 grid = clamp((position - irradiance_volume.min_position) / cell_size, vec3(0.0),
+      resolution - 1.0);
+  vec3 coords = (grid + 0.5) / vec3(resolution.xy, resolution.z * IRRADIANCE_SH_COEFFICIENTS);
+  float basis[IRRADIANCE_SH_COEFFICIENTS];
+  get_sh_basis(normal, basis);
+  vec3 irradiance = vec3(0.0);
+  for (int i = 0; i < IRRADIANCE_SH_COEFFICIENTS; i++) {
+    vec3 block_offset = vec3(0.0, 0.0, float(i) / float(IRRADIANCE_SH_COEFFICIENTS));
+    irradiance += texture(irradiance_volume.coefficients, coords + block_offset).rgb * basis[i];
+  }
+  // L2 irradiance can ring below zero opposite bright lights.
+  return max(irradiance, vec3(0.0));
+}
+
+// Shades a surface point at WorldPosition with every enabled light. The environment map is only
+// integrated if use_environment is set. The irradiance volume, when enabled, adds indirect diffuse
+// light in place of the constant ambient term.
+vec3 shade_surface(vec3 albedo, float metallic, float roughness, vec3 normal, vec3 ao,
+    bool use_environment) {
+  vec3 total_color = vec3(0.0, 0.0, 0.0);
+  if (use_environment) {
+    // TODO(brkho): Investigate unrolling this loop for better performance.
+    for (int i = 0; i < NUM_IBL_SAMPLES; i++) {
+      total_color += get_ibl_sample_contribution(hammersley_points[i], roughness, normal, albedo,
+          metallic);
+    }
+    total_color /= float(NUM_IBL_SAMPLES);
+  } else if (!irradiance_volume.enabled) {
+    total_color = mix(albedo * 0.05, vec3(0.0), metallic);
+  }
+  if (irradiance_volume.enabled) {
+    total_color += mix(albedo / PI * get_volume_irradiance(normal), vec3(0.0), metallic);
+  }
+
+  if (directional_light.enabled) {
+    total_color += get_directional_light_contribution(albedo, metallic, roughness, normal);
+  }
+  if (point_lights[0].enabled) {
+    total_color += get_point_light_contribution(0, albedo, metallic, roughness, normal);
+  }
+  if (point_lights[1].enabled) {
+    total_color += get_point_light_contribution(1, albedo, metallic, roughness, normal);
+  }
+  if (point_lights[2].enabled) {
+    total_color += get_point_light_contribution(2, albedo, metallic, roughness, normal);
+  }
+  for (int i = 0; i < MAX_AREA_LIGHTS; i++) {
+    if (area_lights[i].enabled) {
+      total_color += get_area_light_contribution(i, albedo, metallic, roughness, normal);
+    }
+  }
+
+  // Bias AO because it will eventually be gamma corrected.
+  return total_color * pow(ao, vec3(GAMMA));
+}
+
+#endif // LIGHTING_GLSL
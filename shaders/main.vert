@@ -5,24 +5,60 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec3 tangent;
 layout (location = 3) in vec2 uv;
 
-uniform mat4 model_transform;
-uniform mat4 normal_transform;
-uniform mat4 view_transform;
-uniform mat4 projection_transform;
+#include "skinning.glsl"
+
+// Constants streamed once per frame by the GameWindow.
+layout (std140) uniform FrameConstants {
+  mat4 view_transform;
+  mat4 projection_transform;
+  // Transforms used to compute motion vectors for TAA. These exclude the sub-pixel jitter.
+  mat4 unjittered_view_projection;
+  mat4 previous_view_projection;
+};
+
+// Constants streamed once per frame for each ModelInstance (see gfx::InstanceConstants).
+layout (std140) uniform InstanceConstants {
+  mat4 model_transform;
+  mat4 normal_transform;
+  mat4 previous_model_transform;
+};
 
 out vec3 Normal;
 out vec2 UV;
 out vec3 WorldPosition;
 out mat3 TBN;
+out vec4 CurrentPosition;
+out vec4 PreviousPosition;
+
+// The depth pre-pass in depth.vert must produce bit-identical depths.
+invariant gl_Position;
 
 void main() {
-  gl_Position = projection_transform * view_transform * model_transform * vec4(position, 1.0);
-  WorldPosition = vec3(model_transform * vec4(position, 1.0));
-  Normal = normalize(mat3(normal_transform) * normal);
+  // Skin the vertex in object space. The joints are assumed to scale uniformly, so the normal and
+  // tangent are skinned like directions.
+  vec3 object_position = position;
+  vec3 object_normal = normal;
+  vec3 object_tangent = tangent;
+  vec3 previous_position = position;
+  if (skinned) {
+    mat3x4 skinning_transform = get_skinning_transform();
+    object_position = vec4(position, 1.0) * skinning_transform;
+    object_normal = vec4(normal, 0.0) * skinning_transform;
+    object_tangent = vec4(tangent, 0.0) * skinning_transform;
+    previous_position = vec4(position, 1.0) * get_previous_skinning_transform();
+  }
+
+  gl_Position = projection_transform * view_transform * model_transform *
+      vec4(object_position, 1.0);
+  WorldPosition = vec3(model_transform * vec4(object_position, 1.0));
+  Normal = normalize(mat3(normal_transform) * object_normal);
   UV = uv;
+  CurrentPosition = unjittered_view_projection * vec4(WorldPosition, 1.0);
+  PreviousPosition = previous_view_projection * previous_model_transform *
+      vec4(previous_position, 1.0);
 
-  vec3 normalized_tangent = normalize(mat3(normal_transform) * tangent);
-  vec3 normalized_normal = normalize(mat3(normal_transform) * normal);
+  vec3 normalized_tangent = normalize(mat3(normal_transform) * object_tangent);
+  vec3 normalized_normal = normalize(mat3(normal_transform) * object_normal);
   vec3 normalized_bitangent = normalize(cross(normalized_tangent, normalized_normal));
   TBN = mat3(normalized_tangent, normalized_bitangent, normalized_normal);
 }
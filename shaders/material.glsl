@@ -0,0 +1,31 @@
+// Material sampling shared by the forward and G-buffer shaders. The including shader must declare
+// the UV and TBN inputs before including this file.
+
+#ifndef MATERIAL_GLSL
+#define MATERIAL_GLSL
+
+#include "common.glsl"
+
+uniform MapInfo albedo_map;
+uniform MapInfo metallic_map;
+uniform MapInfo roughness_map;
+uniform MapInfo normal_map;
+uniform MapInfo ao_map;
+
+void sample_material(out vec3 albedo, out float metallic, out float roughness, out vec3 normal,
+    out vec3 ao) {
+  // TODO(brkho): Have a separate shader compilation step to avoid this branching.
+  albedo = albedo_map.enabled ? vec3(texture(albedo_map.map, UV)) : albedo_map.default_value;
+  metallic = metallic_map.enabled ? texture(metallic_map.map, UV).x :
+      metallic_map.default_value.x;
+  roughness = roughness_map.enabled ? texture(roughness_map.map, UV).x :
+      roughness_map.default_value.x;
+  vec3 tangent_space_normal = normal_map.enabled ? vec3(texture(normal_map.map, UV)) :
+      normal_map.default_value;
+  ao = ao_map.enabled ? vec3(texture(ao_map.map, UV)) : ao_map.default_value;
+
+  tangent_space_normal = normalize((tangent_space_normal * 2.0) - 1.0) * vec3(1.0, -1.0, 1.0);
+  normal = normalize(TBN * tangent_space_normal);
+}
+
+#endif // MATERIAL_GLSL
@@ -0,0 +1,17 @@
+// Motion vectors for temporal anti-aliasing. The including shader's vertex stage must output the
+// unjittered clip space positions of the current and previous frames.
+
+#ifndef MOTION_GLSL
+#define MOTION_GLSL
+
+in vec4 CurrentPosition;
+in vec4 PreviousPosition;
+
+// Gets how far the surface moved in UV space since the previous frame.
+vec2 get_motion() {
+  vec2 current = CurrentPosition.xy / CurrentPosition.w;
+  vec2 previous = PreviousPosition.xy / PreviousPosition.w;
+  return (current - previous) * 0.5;
+}
+
+#endif // MOTION_GLSL
@@ -0,0 +1,45 @@
+// Linear blend skinning with the palettes streamed by the GameWindow (see gfx::SkinningPalette).
+// Each joint's skinning transform is stored as its first three rows, so a point is skinned with
+// vec4(point, 1.0) * get_skinning_transform(). The including vertex shader must only use the
+// transforms when skinned is set, since unskinned meshes have no joints or weights.
+
+#ifndef SKINNING_GLSL
+#define SKINNING_GLSL
+
+// This must match gfx::MAX_SKIN_JOINTS.
+#define MAX_SKIN_JOINTS 128
+
+layout (location = 4) in uvec4 joints;
+layout (location = 5) in vec4 weights;
+
+// Whether the mesh being drawn is skinned.
+uniform bool skinned;
+
+layout (std140) uniform SkinningPalette {
+  vec4 skinning_rows[3 * MAX_SKIN_JOINTS];
+  vec4 previous_skinning_rows[3 * MAX_SKIN_JOINTS];
+};
+
+// Gets the weighted sum of the skinning transforms of the joints influencing the vertex.
+mat3x4 get_skinning_transform() {
+  mat3x4 transform = mat3x4(0.0);
+  for (int i = 0; i < 4; i++) {
+    uint row = joints[i] * 3u;
+    transform += weights[i] * mat3x4(skinning_rows[row], skinning_rows[row + 1u],
+        skinning_rows[row + 2u]);
+  }
+  return transform;
+}
+
+// Gets the skinning transform of the previous frame, used to compute motion vectors.
+mat3x4 get_previous_skinning_transform() {
+  mat3x4 transform = mat3x4(0.0);
+  for (int i = 0; i < 4; i++) {
+    uint row = joints[i] * 3u;
+    transform += weights[i] * mat3x4(previous_skinning_rows[row],
+        previous_skinning_rows[row + 1u], previous_skinning_rows[row + 2u]);
+  }
+  return transform;
+}
+
+#endif // SKINNING_GLSL
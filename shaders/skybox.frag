@@ -5,7 +5,10 @@
 
 in vec3 Position;
 
-out vec4 out_color;
+layout (location = 0) out vec4 out_color;
+layout (location = 1) out vec2 out_motion;
+
+#include "motion.glsl"
 
 uniform float skybox_blur;
 uniform sampler2D environment_map;
@@ -15,4 +18,5 @@ void main() {
   vec2 uv = vec2((1.0 + atan(direction.x, direction.z) / PI) / 2.0, acos(direction.y) / PI);
   vec3 environment_color = vec3(textureLod(environment_map, uv, skybox_blur));
   out_color = vec4(environment_color, 1.0);
+  out_motion = get_motion();
 }
\ No newline at end of file
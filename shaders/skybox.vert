@@ -3,11 +3,19 @@
 layout (location = 0) in vec3 position;
 
 out vec3 Position;
+out vec4 CurrentPosition;
+out vec4 PreviousPosition;
 
 uniform mat4 view_transform;
 uniform mat4 projection_transform;
+// Transforms used to compute motion vectors for TAA. These exclude the sub-pixel jitter.
+uniform mat4 unjittered_view_projection;
+uniform mat4 previous_view_projection;
 
 void main() {
   Position = position;
-  gl_Position = projection_transform * view_transform * vec4(position, 1.0);
+  // Force the skybox onto the far plane so it is only drawn where no geometry was rendered.
+  gl_Position = (projection_transform * view_transform * vec4(position, 1.0)).xyww;
+  CurrentPosition = unjittered_view_projection * vec4(position, 1.0);
+  PreviousPosition = previous_view_projection * vec4(position, 1.0);
 }
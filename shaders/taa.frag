@@ -0,0 +1,51 @@
+#version 330 core
+
+// Temporal anti-aliasing resolve. The jittered single-sample frame is blended with the history
+// reprojected by the motion vectors. The history is clamped to the current frame's 3x3
+// neighborhood so stale or disoccluded colors don't ghost. Blending happens after tone mapping so
+// bright samples don't dominate the average. With dynamic resolution, the current frame covers a
+// smaller region of its buffers and is upscaled into the full resolution history.
+
+in vec2 UV;
+
+out vec4 out_color;
+
+uniform sampler2DMS current_buffer;
+uniform sampler2DMS motion_buffer;
+uniform sampler2D history_buffer;
+uniform uvec2 dimensions;
+uniform uvec2 render_dimensions;
+uniform bool history_valid;
+uniform float history_weight;
+
+vec3 reinhard_map(vec3 hdr_color) {
+  return hdr_color / (hdr_color + vec3(1.0));
+}
+
+void main() {
+  ivec2 coords = ivec2(int(UV.s * dimensions.x), int(UV.t * dimensions.y));
+  ivec2 render_coords = ivec2(UV * vec2(render_dimensions));
+  ivec2 max_coords = ivec2(render_dimensions) - 1;
+  vec3 current = reinhard_map(vec3(texelFetch(current_buffer, render_coords, 0)));
+  vec3 neighborhood_min = current;
+  vec3 neighborhood_max = current;
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      ivec2 neighbor_coords = clamp(render_coords + ivec2(x, y), ivec2(0), max_coords);
+      vec3 neighbor = reinhard_map(vec3(texelFetch(current_buffer, neighbor_coords, 0)));
+      neighborhood_min = min(neighborhood_min, neighbor);
+      neighborhood_max = max(neighborhood_max, neighbor);
+    }
+  }
+
+  vec2 motion = texelFetch(motion_buffer, render_coords, 0).xy;
+  vec2 previous_uv = (vec2(coords) + 0.5) / vec2(dimensions) - motion;
+  if (!history_valid || any(lessThan(previous_uv, vec2(0.0))) ||
+      any(greaterThan(previous_uv, vec2(1.0)))) {
+    out_color = vec4(current, 1.0);
+    return;
+  }
+  vec3 history = clamp(vec3(texture(history_buffer, previous_uv)), neighborhood_min,
+      neighborhood_max);
+  out_color = vec4(mix(current, history, history_weight), 1.0);
+}
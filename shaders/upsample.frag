@@ -0,0 +1,25 @@
+#version 330 core
+
+// Dual filter (Kawase) upsample to the previous level of the chain. Eight bilinear taps in a
+// diamond around the texel form a tent filter, so the bloom widens smoothly at each level.
+
+in vec2 UV;
+
+out vec4 out_color;
+
+uniform sampler2D source;
+// Half the size of a source texel in UV space.
+uniform vec2 half_texel_size;
+
+void main() {
+  vec2 offset = half_texel_size;
+  vec3 color = vec3(texture(source, UV + vec2(-2.0 * offset.x, 0.0)));
+  color += vec3(texture(source, UV + vec2(2.0 * offset.x, 0.0)));
+  color += vec3(texture(source, UV + vec2(0.0, -2.0 * offset.y)));
+  color += vec3(texture(source, UV + vec2(0.0, 2.0 * offset.y)));
+  color += vec3(texture(source, UV + vec2(-offset.x, offset.y))) * 2.0;
+  color += vec3(texture(source, UV + vec2(offset.x, offset.y))) * 2.0;
+  color += vec3(texture(source, UV + vec2(offset.x, -offset.y))) * 2.0;
+  color += vec3(texture(source, UV + vec2(-offset.x, -offset.y))) * 2.0;
+  out_color = vec4(color / 12.0, 1.0);
+}
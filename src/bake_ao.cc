@@ -0,0 +1,120 @@
+// Bakes an ambient occlusion map for an EO model and writes it as a PNG. If an output model path
+// is given, a copy of the model pointing its AO map at the PNG is written there too, so the map
+// is loaded along with the model's other maps. The AO map path is stored as given, so pass it
+// relative to where the engine runs (e.g. "assets/sculpture/sculpture_ao.png"). No OpenGL context
+// is needed.
+//
+// Usage: bake_ao MODEL OUTPUT [--size N] [--rays N] [--distance D] [--dilation N]
+//     [--model-output FILE]
+//
+// Brian Ho (brian@brkho.com)
+
+#include "gfx/ao_baker.h"
+#include "gfx/job_system.h"
+#include "gfx/model_info.h"
+#include "gfx/texture_manager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+// The defaults of the options.
+const int kDefaultSize = 1024;
+const unsigned int kDefaultRays = 128;
+const unsigned int kDefaultDilation = 4;
+
+// The command line options.
+struct Options {
+  std::string model_path;
+  std::string output_path;
+  std::string model_output_path;
+  gfx::AoBakeSettings settings;
+};
+
+// Parses the command line into options. Returns false if it's malformed.
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  if (argc < 3) {
+    return false;
+  }
+  options->model_path = argv[1];
+  options->output_path = argv[2];
+  options->settings = gfx::AoBakeSettings{kDefaultSize, kDefaultSize, kDefaultRays, 0.0f,
+      kDefaultDilation};
+  for (int i = 3; i + 1 < argc; i += 2) {
+    std::string option = argv[i];
+    if (option == "--size") {
+      options->settings.width = options->settings.height = std::atoi(argv[i + 1]);
+    } else if (option == "--rays") {
+      options->settings.rays_per_texel = std::strtoul(argv[i + 1], nullptr, 10);
+    } else if (option == "--distance") {
+      options->settings.max_distance = std::atof(argv[i + 1]);
+    } else if (option == "--dilation") {
+      options->settings.dilation = std::strtoul(argv[i + 1], nullptr, 10);
+    } else if (option == "--model-output") {
+      options->model_output_path = argv[i + 1];
+    } else {
+      return false;
+    }
+  }
+  return argc % 2 == 1 && options->settings.width > 0 && options->settings.rays_per_texel > 0;
+}
+
+// Gets the time in milliseconds since start.
+double GetMilliseconds(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0] << " MODEL OUTPUT [--size N] [--rays N] [--distance D] " <<
+        "[--dilation N] [--model-output FILE]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    gfx::JobSystem job_system(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    gfx::TextureManager texture_manager(false);
+    gfx::ModelInfo model_info(options.model_path, &texture_manager, false);
+
+    auto start = std::chrono::steady_clock::now();
+    gfx::AoBaker baker(&model_info, &job_system);
+    double build_time = GetMilliseconds(start);
+    start = std::chrono::steady_clock::now();
+    baker.BakeToFile(options.settings, options.output_path);
+    double bake_time = GetMilliseconds(start);
+
+    std::cout << "Built a BVH of " << baker.GetBvh()->GetNumNodes() << " nodes over " <<
+        baker.GetBvh()->GetNumTriangles() << " triangles in " << build_time << " ms." << std::endl;
+    std::cout << "Traced " << baker.GetRaysTraced() << " rays on " <<
+        job_system.GetNumThreads() << " threads in " << bake_time << " ms (" <<
+        (double)baker.GetRaysTraced() / bake_time / 1000.0 << " Mrays/s)." << std::endl;
+
+    if (!options.model_output_path.empty()) {
+      gfx::ModelInfo::EOFileData data = gfx::ModelInfo::ReadEOFile(options.model_path);
+      data.map_paths[4] = options.output_path;
+      try {
+        gfx::ModelInfo::WriteEOFile(options.model_output_path, data);
+      } catch (...) {
+        delete data.vertices;
+        delete data.indices;
+        throw;
+      }
+      delete data.vertices;
+      delete data.indices;
+    }
+    return EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
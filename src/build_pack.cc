@@ -0,0 +1,90 @@
+// Builds an asset pack out of loose files. The assets are stored under their paths as given, so
+// pass them relative to where the engine runs (e.g. "assets/drawers/drawers.eo"). The maps of each
+// EO model are packed right after it, so a model and its textures are read sequentially. The
+// assets are compressed when it's worth it unless --store is given. No OpenGL context is needed.
+//
+// Usage: build_pack OUTPUT ASSET... [--store]
+//
+// Brian Ho (brian@brkho.com)
+
+#include "gfx/asset_pack.h"
+#include "gfx/model_info.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The command line options.
+struct Options {
+  std::string output_path;
+  std::vector<std::string> asset_paths;
+  bool should_compress;
+};
+
+// Parses the command line into options. Returns false if it's malformed.
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  options->should_compress = true;
+  for (int i = 1; i < argc; i++) {
+    std::string argument = argv[i];
+    if (argument == "--store") {
+      options->should_compress = false;
+    } else if (argument.compare(0, 2, "--") == 0) {
+      return false;
+    } else if (options->output_path.empty()) {
+      options->output_path = argument;
+    } else {
+      options->asset_paths.push_back(argument);
+    }
+  }
+  return !options->asset_paths.empty();
+}
+
+// Gets the paths of the assets with the maps of each EO model added after it.
+std::vector<std::string> AddModelMaps(const std::vector<std::string>& asset_paths) {
+  std::vector<std::string> paths;
+  for (const std::string& asset_path : asset_paths) {
+    paths.push_back(asset_path);
+    if (asset_path.size() < 3 || asset_path.compare(asset_path.size() - 3, 3, ".eo") != 0) {
+      continue;
+    }
+    gfx::ModelInfo::EOFileData data = gfx::ModelInfo::ReadEOFile(asset_path);
+    delete data.vertices;
+    delete data.indices;
+    delete data.skin;
+    for (const std::string& map_path : data.map_paths) {
+      if (!map_path.empty()) {
+        paths.push_back(map_path);
+      }
+    }
+  }
+  return paths;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0] << " OUTPUT ASSET... [--store]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    auto start = std::chrono::steady_clock::now();
+    gfx::AssetPackStats stats = gfx::AssetPack::Write(options.output_path,
+        AddModelMaps(options.asset_paths), options.should_compress);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Packed " << stats.num_entries << " assets (" << stats.num_compressed <<
+        " compressed) from " << stats.asset_size / 1024 << " KB into " <<
+        stats.pack_size / 1024 << " KB in " << elapsed.count() << " s." << std::endl;
+    return EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -1,11 +1,18 @@
 // This is the main entry point of the demo program.
 // Brian Ho (brian@brkho.com)
 
+#include "gfx/animation_clip.h"
+#include "gfx/animator.h"
+#include "gfx/area_light.h"
+#include "gfx/asset_pack.h"
 #include "gfx/camera.h"
 #include "gfx/color.h"
 #include "gfx/directional_light.h"
 #include "gfx/environment.h"
+#include "gfx/exceptions.h"
 #include "gfx/game_window.h"
+#include "gfx/hot_reloader.h"
+#include "gfx/irradiance_volume.h"
 #include "gfx/model_info.h"
 #include "gfx/model_instance.h"
 #include "gfx/point_light.h"
@@ -14,8 +21,14 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <exception>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
 
 const int kWindowWidth = 1280;
@@ -33,6 +46,22 @@ const std::string kHdrVertexShaderPath = "shaders/hdr.vert";
 const std::string kHdrFragmentShaderPath = "shaders/hdr.frag";
 const std::string kSkyboxVertexShaderPath = "shaders/skybox.vert";
 const std::string kSkyboxFragmentShaderPath = "shaders/skybox.frag";
+const std::string kTracePath = "trace.json";
+const unsigned int kTraceFrames = 120;
+const int kVolumeResolution = 8;
+const std::string kVolumePath = "assets/drawers/drawers.irr";
+const unsigned int kVolumeRaysPerProbe = 256;
+const float kPi = 3.1415926535897932384626433832795f;
+const unsigned int kTentacleJoints = 8;
+const unsigned int kTentacleRings = 33;
+const unsigned int kTentacleSides = 12;
+const float kTentacleLength = 2.0f;
+const float kTentacleRadius = 0.12f;
+const unsigned int kClipFrames = 61;
+const float kClipFrameRate = 30.0f;
+const int kCrowdWidth = 16;
+const float kCrowdSpacing = 0.6f;
+const glm::vec3 kCrowdOrigin = glm::vec3(-4.5f, 0.0f, 3.0f);
 
 struct Position {
   double x;
@@ -46,6 +75,12 @@ double current_pitch;
 double distance;
 bool keys[1024];
 bool clicking = false;
+bool capturing_trace = false;
+gfx::IrradianceVolume* irradiance_volume = nullptr;
+bool irradiance_volume_enabled = false;
+bool crowd_enabled = false;
+gfx::AreaLight* area_light = nullptr;
+bool area_light_enabled = false;
 glm::vec3 pan_offset;
 
 void update_camera() {
@@ -97,11 +132,144 @@ void scroll_callback(GLFWwindow* /* window */, double /* x */, double y) {
   distance = std::max(0.1, distance - y * kZoomSensitivity);
 }
 
-void handle_input(GLFWwindow* window) {
+// Creates a skinned tentacle standing on the origin, made of rings of vertices bound to a chain of
+// joints.
+gfx::ModelInfo* create_tentacle_info(gfx::TextureManager* texture_manager) {
+  gfx::ModelInfo::EOFileData data;
+  data.shader_type = gfx::CookTorrance;
+  data.vertices = new std::vector<gfx::Vertex>();
+  data.indices = new std::vector<GLuint>();
+  data.skin = new std::vector<gfx::SkinVertex>();
+  float segment_length = kTentacleLength / (float)kTentacleJoints;
+  for (unsigned int ring = 0; ring < kTentacleRings; ring++) {
+    float height = kTentacleLength * (float)ring / (float)(kTentacleRings - 1);
+    float radius = kTentacleRadius * (1.0f - height / kTentacleLength);
+    // Blend each ring between the joints below and above it.
+    float joint_position = height / segment_length;
+    unsigned int joint = std::min((unsigned int)joint_position, kTentacleJoints - 1);
+    unsigned int next_joint = std::min(joint + 1, kTentacleJoints - 1);
+    uint8_t next_weight = (uint8_t)std::round(
+        std::min(joint_position - (float)joint, 1.0f) * 255.0f);
+    for (unsigned int side = 0; side <= kTentacleSides; side++) {
+      float angle = 2.0f * kPi * (float)side / (float)kTentacleSides;
+      glm::vec3 normal(std::cos(angle), 0.0f, std::sin(angle));
+      data.vertices->push_back(gfx::Vertex{radius * normal + glm::vec3(0.0f, height, 0.0f),
+          normal, glm::vec3(-normal.z, 0.0f, normal.x),
+          glm::vec2((float)side / (float)kTentacleSides, height / kTentacleLength)});
+      data.skin->push_back(gfx::SkinVertex{{(uint8_t)joint, (uint8_t)next_joint, 0, 0},
+          {(uint8_t)(255 - next_weight), next_weight, 0, 0}});
+    }
+  }
+  for (unsigned int ring = 0; ring + 1 < kTentacleRings; ring++) {
+    for (unsigned int side = 0; side < kTentacleSides; side++) {
+      GLuint corner = ring * (kTentacleSides + 1) + side;
+      GLuint above = corner + kTentacleSides + 1;
+      data.indices->insert(data.indices->end(), {corner, above, corner + 1, corner + 1, above,
+          above + 1});
+    }
+  }
+
+  std::vector<unsigned int> parents;
+  gfx::Pose bind_pose(kTentacleJoints);
+  for (unsigned int joint = 0; joint < kTentacleJoints; joint++) {
+    parents.push_back(joint == 0 ? gfx::JOINT_NO_PARENT : joint - 1);
+    bind_pose.SetJoint(joint, glm::vec3(0.0f, joint == 0 ? 0.0f : segment_length, 0.0f),
+        glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+  }
+  data.skeleton = std::make_shared<gfx::Skeleton>(parents, bind_pose);
+  data.skeleton->FitBoundsPadding(*data.vertices, *data.skin);
+
+  gfx::ModelInfo* tentacle_info = new gfx::ModelInfo(data, texture_manager, true);
+  tentacle_info->GetMaterial()->albedo_info.value = glm::vec3(0.8f, 0.3f, 0.3f);
+  return tentacle_info;
+}
+
+// Samples a looping animation of the tentacle that bends each joint about an axis, with the bend
+// travelling up the tentacle as a wave, and compresses it into a clip.
+gfx::AnimationClip* create_tentacle_clip(gfx::Skeleton* skeleton, glm::vec3 axis,
+    float amplitude) {
+  std::vector<gfx::Pose> frames;
+  for (unsigned int frame = 0; frame < kClipFrames; frame++) {
+    float phase = 2.0f * kPi * (float)frame / (float)(kClipFrames - 1);
+    gfx::Pose pose = skeleton->GetBindPose();
+    for (unsigned int joint = 1; joint < kTentacleJoints; joint++) {
+      float angle = amplitude * std::sin(phase - 0.6f * (float)joint);
+      pose.SetJoint(joint, pose.GetTranslation(joint), glm::angleAxis(angle, axis),
+          pose.GetScale(joint));
+    }
+    frames.push_back(pose);
+  }
+  return new gfx::AnimationClip(frames, kClipFrameRate);
+}
+
+// Prints the rolling CPU and GPU statistics of each profiled pass, and the GL commands of the last
+// frame in builds that count them.
+void print_profile(gfx::Profiler* profiler) {
+  for (int is_gpu = 0; is_gpu < 2; is_gpu++) {
+    std::vector<std::string> names = is_gpu ? profiler->GetGpuScopeNames() :
+        profiler->GetCpuScopeNames();
+    for (std::string& name : names) {
+      gfx::ProfilerStatistics statistics = is_gpu ? profiler->GetGpuStatistics(name) :
+          profiler->GetCpuStatistics(name);
+      std::cout << "  " << (is_gpu ? "GPU " : "CPU ") << name << ": min " << statistics.min <<
+          " ms, avg " << statistics.average << " ms, p99 " << statistics.p99 << " ms" << std::endl;
+    }
+  }
+#ifdef GFX_GL_STATS
+  std::cout << gfx::gl_stats::Format(profiler->GetGlStats());
+#endif
+}
+
+void handle_input(gfx::GameWindow* game_window) {
+  GLFWwindow* window = game_window->window;
   if (keys[GLFW_KEY_ESCAPE]) {
     glfwSetWindowShouldClose(window, GL_TRUE);
   } else if (keys[GLFW_KEY_F]){
     initialize_camera();
+  } else if (keys[GLFW_KEY_R]) {
+    // Toggle between the forward and deferred renderers to compare frame times.
+    keys[GLFW_KEY_R] = false;
+    game_window->SetRenderMode(game_window->GetRenderMode() == gfx::Forward ? gfx::Deferred :
+        gfx::Forward);
+  } else if (keys[GLFW_KEY_P]) {
+    // Toggle the depth pre-pass to compare the number of shaded samples.
+    keys[GLFW_KEY_P] = false;
+    game_window->SetDepthPrepass(!game_window->IsDepthPrepassEnabled());
+  } else if (keys[GLFW_KEY_D]) {
+    // Toggle dynamic resolution, aiming for 60 FPS.
+    keys[GLFW_KEY_D] = false;
+    game_window->SetDynamicResolution(!game_window->IsDynamicResolutionEnabled(), 1000.0 / 60.0);
+  } else if (keys[GLFW_KEY_E]) {
+    // Toggle auto exposure.
+    keys[GLFW_KEY_E] = false;
+    game_window->SetAutoExposure(!game_window->IsAutoExposureEnabled());
+  } else if (keys[GLFW_KEY_B]) {
+    // Toggle bloom.
+    keys[GLFW_KEY_B] = false;
+    game_window->SetBloom(!game_window->IsBloomEnabled());
+  } else if (keys[GLFW_KEY_T]) {
+    // Capture a few seconds of frames to a Chrome trace.
+    keys[GLFW_KEY_T] = false;
+    game_window->GetProfiler()->CaptureFrames(kTraceFrames);
+    capturing_trace = true;
+  } else if (keys[GLFW_KEY_I]) {
+    // Toggle the baked irradiance volume.
+    keys[GLFW_KEY_I] = false;
+    irradiance_volume_enabled = !irradiance_volume_enabled;
+    game_window->SetIrradianceVolume(irradiance_volume_enabled ? irradiance_volume : nullptr);
+  } else if (keys[GLFW_KEY_A]) {
+    // Toggle the crowd of animated tentacles.
+    keys[GLFW_KEY_A] = false;
+    crowd_enabled = !crowd_enabled;
+  } else if (keys[GLFW_KEY_L]) {
+    // Toggle the area light over the drawers.
+    keys[GLFW_KEY_L] = false;
+    area_light_enabled = !area_light_enabled;
+    if (area_light_enabled) {
+      game_window->AddAreaLight(area_light);
+    } else {
+      game_window->RemoveAreaLight(area_light);
+    }
   }
   if (clicking) {
     double x, y;
@@ -118,16 +286,27 @@ void handle_input(GLFWwindow* window) {
   }
 }
 
-// Main point of entry for the code.
-int main(int /* argc */, char* /* argv */[]) {
+// Main point of entry for the code. Running with --headless <frames> renders that many frames
+// offscreen without a window and prints the profile. Adding a path prefix after the frame count
+// also captures the frames to a PNG sequence.
+int main(int argc, char* argv[]) {
+  bool headless = (argc == 3 || argc == 4) && std::string(argv[1]) == "--headless";
+  int headless_frames = headless ? std::atoi(argv[2]) : 0;
   // TODO(brkho): Remove this big try-catch and do actual error handling on a per-line basis.
   try {
+    // Load the assets out of a pack if one was built with build_pack.
+    std::unique_ptr<gfx::AssetPack> asset_pack;
+    if (std::ifstream(gfx::asset_pack_path)) {
+      asset_pack.reset(new gfx::AssetPack(gfx::asset_pack_path));
+      gfx::AssetPack::Mount(asset_pack.get());
+    }
+
     camera = gfx::Camera();
     initialize_camera();
     gfx::GameWindow game_window{kWindowWidth, kWindowHeight, kMainVertexShaderPath,
         kMainFragmentShaderPath, kHdrVertexShaderPath, kHdrFragmentShaderPath,
         kSkyboxVertexShaderPath, kSkyboxFragmentShaderPath, &camera, 45.0f,
-        gfx::Color(0.15f, 0.15f, 0.15f)};
+        gfx::Color(0.15f, 0.15f, 0.15f), gfx::MSAA, headless ? gfx::Headless : gfx::Windowed};
     gfx::Environment environment{"assets/hdr/pisa.hdr"};
 
     // gfx::DirectionalLight directional_light = gfx::DirectionalLight(glm::vec3(-1.0f, -1.0f, -1.0f),
@@ -152,12 +331,73 @@ int main(int /* argc */, char* /* argv */[]) {
     //     glm::vec3(0.0f, 0.0f, 0.0f));
     // model_instances.push_back(sculpture_instance);
 
-    gfx::ModelInfo drawers_info = gfx::ModelInfo("assets/drawers/drawers.eo",
-        &texture_manager, true);
+    // Load the models (and their textures) in parallel on the window's job system.
+    std::vector<std::unique_ptr<gfx::ModelInfo>> model_infos = gfx::ModelInfo::LoadModels(
+        {"assets/drawers/drawers.eo"}, &texture_manager, game_window.GetJobSystem(), true);
+    gfx::ModelInfo& drawers_info = *model_infos[0];
     gfx::ModelInstance* drawers_instance = new gfx::ModelInstance(&drawers_info,
         glm::vec3(0.0f, 0.0f, 0.0f));
     model_instances.push_back(drawers_instance);
 
+    gfx::HotReloader hot_reloader{&game_window, &texture_manager};
+    hot_reloader.AddModel("assets/drawers/drawers.eo", &drawers_info);
+
+    // Load the irradiance volume around the drawers for indirect diffuse lighting. It's only baked
+    // (and saved for the next run) if it's missing or was baked for a different box.
+    glm::vec3 volume_radius(drawers_instance->GetBoundsRadius());
+    glm::vec3 volume_min = drawers_instance->GetBoundsCenter() - volume_radius;
+    glm::vec3 volume_max = drawers_instance->GetBoundsCenter() + volume_radius;
+    std::unique_ptr<gfx::IrradianceVolume> drawers_volume;
+    try {
+      drawers_volume.reset(new gfx::IrradianceVolume(kVolumePath));
+    } catch (const gfx::CannotOpenIrradianceVolumeException&) {
+      std::cout << "Baking the irradiance volume for the first run." << std::endl;
+    } catch (const gfx::InvalidIrradianceVolumeException& e) {
+      std::cout << "Rebaking the irradiance volume: " << e.what() << std::endl;
+    }
+    if (drawers_volume == nullptr || drawers_volume->GetMin() != volume_min ||
+        drawers_volume->GetMax() != volume_max ||
+        drawers_volume->GetResolution() != glm::ivec3(kVolumeResolution)) {
+      drawers_volume.reset(new gfx::IrradianceVolume(volume_min, volume_max,
+          glm::ivec3(kVolumeResolution)));
+      drawers_volume->Bake(model_instances, &environment, kVolumeRaysPerProbe,
+          game_window.GetJobSystem());
+      try {
+        drawers_volume->Write(kVolumePath);
+      } catch (const gfx::CannotWriteIrradianceVolumeException& e) {
+        std::cout << "Failed to save the irradiance volume: " << e.what() << std::endl;
+      }
+    }
+    drawers_volume->Upload();
+    irradiance_volume = drawers_volume.get();
+
+    // Set up a softbox above and in front of the drawers, angled down towards them and toggled
+    // with L.
+    float drawers_radius = drawers_instance->GetBoundsRadius();
+    gfx::AreaLight drawers_light(gfx::RectangleLight, drawers_instance->GetBoundsCenter() +
+        glm::vec3(0.0f, drawers_radius, drawers_radius), glm::vec3(-0.5f * drawers_radius, 0.0f,
+        0.0f), glm::vec3(0.0f, 0.2f * drawers_radius, -0.2f * drawers_radius),
+        glm::vec3(4.0f, 4.0f, 4.0f));
+    area_light = &drawers_light;
+
+    // Set up a crowd of tentacles that each blend a sway and a curl, toggled with A.
+    std::unique_ptr<gfx::ModelInfo> tentacle_info(create_tentacle_info(&texture_manager));
+    gfx::Skeleton* tentacle_skeleton = tentacle_info->GetSkeleton();
+    std::unique_ptr<gfx::AnimationClip> sway_clip(create_tentacle_clip(tentacle_skeleton,
+        glm::vec3(0.0f, 0.0f, 1.0f), 0.25f));
+    std::unique_ptr<gfx::AnimationClip> curl_clip(create_tentacle_clip(tentacle_skeleton,
+        glm::vec3(1.0f, 0.0f, 0.0f), 0.4f));
+    gfx::Animator animator;
+    std::vector<gfx::ModelInstance*> crowd_instances;
+    for (int x = 0; x < kCrowdWidth; x++) {
+      for (int z = 0; z < kCrowdWidth; z++) {
+        gfx::ModelInstance* tentacle_instance = new gfx::ModelInstance(tentacle_info.get(),
+            kCrowdOrigin + kCrowdSpacing * glm::vec3((float)x, 0.0f, (float)z));
+        tentacle_instance->AttachAnimator(&animator, animator.AddCharacter(tentacle_skeleton));
+        crowd_instances.push_back(tentacle_instance);
+      }
+    }
+
     // gfx::ModelInfo box_info = gfx::ModelInfo("assets/primitives/box_no_maps.eo", &texture_manager, true);
     // box_info.GetMaterial()->albedo_info.value = glm::vec3(1.0, 0.0, 0.0);
     // gfx::ModelInstance* box_instance = new gfx::ModelInstance(&box_info,
@@ -178,21 +418,37 @@ int main(int /* argc */, char* /* argv */[]) {
     // }
 
     std::fill_n(keys, 1024, 0);
-    glfwSetKeyCallback(game_window.window, key_callback);
-    glfwSetMouseButtonCallback(game_window.window, mouse_button_callback);
-    glfwSetScrollCallback(game_window.window, scroll_callback);
+    if (!headless) {
+      glfwSetKeyCallback(game_window.window, key_callback);
+      glfwSetMouseButtonCallback(game_window.window, mouse_button_callback);
+      glfwSetScrollCallback(game_window.window, scroll_callback);
+    }
+    if (headless && argc == 4) {
+      game_window.StartCapture(argv[3], gfx::CapturePng);
+    }
 
     double fps_print_time = 2.5;
     double last_time = game_window.GetElapsedTime();
+    int frames_since_print = 0;
+    int frames_rendered = 0;
 
     // Main rendering loop.
     while(game_window.IsRunning()) {
       double current_time = game_window.GetElapsedTime();
       double frame_time = current_time - last_time;
       fps_print_time -= frame_time;
+      frames_since_print++;
       if (fps_print_time <= 0.0) {
-        std::cout << "FPS: " << 1.0 / frame_time << std::endl;
+        double average_frame_time = (2.5 - fps_print_time) / frames_since_print;
+        std::cout << (game_window.GetRenderMode() == gfx::Forward ? "Forward" : "Deferred") <<
+            " FPS: " << 1.0 / average_frame_time << " (" << average_frame_time * 1000.0 <<
+            " ms), pre-pass " << (game_window.IsDepthPrepassEnabled() ? "on" : "off") <<
+            ", shaded samples: " << game_window.GetShadedSampleCount() << ", GPU: " <<
+            game_window.GetGpuFrameTime() << " ms at " << game_window.GetResolutionScale() <<
+            "x resolution" << std::endl;
+        print_profile(game_window.GetProfiler());
         fps_print_time = 2.5;
+        frames_since_print = 0;
       }
       last_time = current_time;
 
@@ -206,16 +462,58 @@ int main(int /* argc */, char* /* argv */[]) {
       // game_window.UpdatePointLight(&first_point_light);
 
       game_window.PollForEvents();
-      handle_input(game_window.window);
+      handle_input(&game_window);
       update_camera();
+      for (const gfx::ReloadEvent& event : hot_reloader.Update()) {
+        if (event.succeeded) {
+          std::cout << "Reloaded " << event.path << " in " << event.reload_time << " ms (" <<
+              event.latency << " ms after the change)" << std::endl;
+        } else {
+          std::cout << "Failed to reload " << event.path << ": " << event.error << std::endl;
+        }
+      }
 
       game_window.PrepareRender();
       for (gfx::ModelInstance* instance : model_instances) {
         game_window.RenderModel(instance, &environment);
       }
+      if (crowd_enabled) {
+        // Offset each character so the crowd doesn't move in lockstep.
+        for (unsigned int i = 0; i < crowd_instances.size(); i++) {
+          float time = (float)current_time + 0.37f * (float)i;
+          animator.SetLayer(i, 0, sway_clip.get(), time, 1.0f);
+          animator.SetLayer(i, 1, curl_clip.get(), 0.7f * time,
+              0.5f + 0.5f * std::sin(0.5f * time));
+        }
+        animator.Update(game_window.GetJobSystem());
+        for (gfx::ModelInstance* instance : crowd_instances) {
+          instance->Update();
+          game_window.RenderModel(instance, &environment);
+        }
+      }
       game_window.FinishRender();
+      frames_rendered++;
+      if (headless && frames_rendered >= headless_frames) {
+        game_window.Close();
+      }
+
+      if (capturing_trace && game_window.GetProfiler()->IsCaptureComplete()) {
+        game_window.GetProfiler()->WriteChromeTrace(kTracePath);
+        std::cout << "Wrote trace to " << kTracePath << std::endl;
+        capturing_trace = false;
+      }
     }
 
+    game_window.StopCapture();
+    if (headless) {
+      std::cout << "Rendered " << frames_rendered << " frames headless in " <<
+          game_window.GetElapsedTime() << " s" << std::endl;
+      gfx::RenderGraphMemory memory = game_window.GetRenderTargetMemory();
+      std::cout << "Render targets: " << memory.aliased_bytes / 1024 << " KB in " <<
+          memory.physical_targets << " allocations (" << memory.unaliased_bytes / 1024 <<
+          " KB for " << memory.transient_targets << " targets without aliasing)" << std::endl;
+      print_profile(game_window.GetProfiler());
+    }
     glfwTerminate();
     return EXIT_SUCCESS;
   } catch (const std::exception& e) {
@@ -0,0 +1,78 @@
+// Fits the LTC tables that area lights are shaded with to the Cook-Torrance BRDF of the shaders
+// and writes them where the engine loads them from (assets/ltc/ggx.ltc) unless an output path is
+// given. The tables only need to be fitted again when the BRDF in lighting.glsl changes. No OpenGL
+// context is needed.
+//
+// Usage: fit_ltc [OUTPUT] [--size N] [--samples N]
+//
+// Brian Ho (brian@brkho.com)
+
+#include "gfx/constants.h"
+#include "gfx/job_system.h"
+#include "gfx/ltc_table.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+// The command line options.
+struct Options {
+  std::string output_path;
+  unsigned int size;
+  unsigned int samples;
+};
+
+// Parses the command line into options. Returns false if it's malformed.
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  options->output_path = gfx::ltc_table_path;
+  options->size = gfx::LTC_TABLE_SIZE;
+  options->samples = gfx::LTC_FIT_SAMPLES;
+  int first_option = 1;
+  if (argc > 1 && std::string(argv[1]).compare(0, 2, "--") != 0) {
+    options->output_path = argv[1];
+    first_option = 2;
+  }
+  for (int i = first_option; i + 1 < argc; i += 2) {
+    std::string option = argv[i];
+    if (option == "--size") {
+      options->size = std::strtoul(argv[i + 1], nullptr, 10);
+    } else if (option == "--samples") {
+      options->samples = std::strtoul(argv[i + 1], nullptr, 10);
+    } else {
+      return false;
+    }
+  }
+  return (argc - first_option) % 2 == 0 && options->size >= 2 &&
+      options->size <= gfx::LTC_MAX_TABLE_SIZE && options->samples > 0;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0] << " [OUTPUT] [--size N] [--samples N]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    gfx::JobSystem job_system(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    auto start = std::chrono::steady_clock::now();
+    gfx::LtcTable table(options.size, options.samples, &job_system);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    table.Write(options.output_path);
+    std::cout << "Fitted " << options.size * options.size << " LTCs on " <<
+        job_system.GetNumThreads() << " threads in " << elapsed.count() << " s (average error " <<
+        table.GetAverageError() << ")." << std::endl;
+    return EXIT_SUCCESS;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,417 @@
+#include "gfx/animation_clip.h"
+#include "gfx/exceptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// The largest magnitude of the three smallest components of a unit quaternion.
+const float max_smallest_component = 0.70710678f;
+
+// The largest quantized translation or scale component, and rotation component.
+const float max_quantized = 65535.0f;
+const float max_quantized_rotation = 32767.0f;
+
+// The most frames a clip can have, since the frames of the keys are stored in 16 bits.
+const size_t max_frames = 65536;
+
+// The values of one component of four joints, with the arithmetic sampling needs. This is an SSE
+// register when SSE2 is available and a plain array otherwise.
+#ifdef __SSE2__
+
+typedef __m128 Lanes;
+
+inline Lanes Load(const float* values) { return _mm_loadu_ps(values); }
+inline void Store(float* values, Lanes lanes) { _mm_storeu_ps(values, lanes); }
+inline Lanes Broadcast(float value) { return _mm_set1_ps(value); }
+inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes Subtract(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes Multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes Divide(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+inline Lanes Max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+inline Lanes Sqrt(Lanes a) { return _mm_sqrt_ps(a); }
+// Gets 1 or -1 with the sign of each lane.
+inline Lanes Sign(Lanes a) {
+  return _mm_or_ps(_mm_and_ps(a, _mm_set1_ps(-0.0f)), _mm_set1_ps(1.0f));
+}
+
+#else
+
+struct Lanes {
+  float values[4];
+};
+
+inline Lanes Load(const float* values) {
+  Lanes lanes;
+  std::memcpy(lanes.values, values, sizeof(lanes.values));
+  return lanes;
+}
+
+inline void Store(float* values, Lanes lanes) {
+  std::memcpy(values, lanes.values, sizeof(lanes.values));
+}
+
+inline Lanes Broadcast(float value) { return Lanes{{value, value, value, value}}; }
+
+#define GFX_LANES_OPERATOR(name, op) \
+  inline Lanes name(Lanes a, Lanes b) { \
+    return Lanes{{a.values[0] op b.values[0], a.values[1] op b.values[1], \
+        a.values[2] op b.values[2], a.values[3] op b.values[3]}}; \
+  }
+GFX_LANES_OPERATOR(Add, +)
+GFX_LANES_OPERATOR(Subtract, -)
+GFX_LANES_OPERATOR(Multiply, *)
+GFX_LANES_OPERATOR(Divide, /)
+#undef GFX_LANES_OPERATOR
+
+inline Lanes Max(Lanes a, Lanes b) {
+  return Lanes{{std::max(a.values[0], b.values[0]), std::max(a.values[1], b.values[1]),
+      std::max(a.values[2], b.values[2]), std::max(a.values[3], b.values[3])}};
+}
+
+inline Lanes Sqrt(Lanes a) {
+  return Lanes{{std::sqrt(a.values[0]), std::sqrt(a.values[1]), std::sqrt(a.values[2]),
+      std::sqrt(a.values[3])}};
+}
+
+inline Lanes Sign(Lanes a) {
+  return Lanes{{std::copysign(1.0f, a.values[0]), std::copysign(1.0f, a.values[1]),
+      std::copysign(1.0f, a.values[2]), std::copysign(1.0f, a.values[3])}};
+}
+
+#endif
+
+// Interpolates between two values of a track, normalizing rotations.
+glm::vec4 Interpolate(glm::vec4 first, glm::vec4 second, float alpha, bool is_rotation) {
+  glm::vec4 value = first + (second - first) * alpha;
+  return is_rotation ? glm::normalize(value) : value;
+}
+
+// Gets the largest difference between the components of two values of a track.
+float GetError(glm::vec4 a, glm::vec4 b) {
+  glm::vec4 difference = glm::abs(a - b);
+  return std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w));
+}
+
+}
+
+gfx::AnimationClip::AnimationClip(const std::vector<gfx::Pose>& frames, float frame_rate,
+    float translation_tolerance, float rotation_tolerance, float scale_tolerance) :
+    frame_rate{frame_rate}, num_frames{(uint32_t)frames.size()}, num_joints{0} {
+  if (frames.empty() || frames.size() > max_frames || !(frame_rate > 0.0f)) {
+    throw gfx::InvalidAnimationClipException();
+  }
+  num_joints = frames.front().GetNumJoints();
+  for (const gfx::Pose& frame : frames) {
+    if (frame.GetNumJoints() != num_joints) {
+      throw gfx::InvalidAnimationClipException();
+    }
+  }
+
+  std::vector<glm::vec4> values(num_frames);
+  for (unsigned int joint = 0; joint < num_joints; joint++) {
+    for (size_t i = 0; i < num_frames; i++) {
+      values[i] = glm::vec4(frames[i].GetTranslation(joint), 0.0f);
+    }
+    CompressTrack(values, 3, translation_tolerance, false);
+    for (size_t i = 0; i < num_frames; i++) {
+      glm::quat rotation = glm::normalize(frames[i].GetRotation(joint));
+      values[i] = glm::vec4(rotation.w, rotation.x, rotation.y, rotation.z);
+      // Keep every frame in the hemisphere of the last so they interpolate along the short arc.
+      if (i > 0 && glm::dot(values[i], values[i - 1]) < 0.0f) {
+        values[i] = -values[i];
+      }
+    }
+    CompressTrack(values, 4, rotation_tolerance, true);
+    for (size_t i = 0; i < num_frames; i++) {
+      values[i] = glm::vec4(frames[i].GetScale(joint), 0.0f);
+    }
+    CompressTrack(values, 3, scale_tolerance, false);
+  }
+}
+
+gfx::AnimationClip::AnimationClip(const std::vector<gfx::Pose>& frames, float frame_rate) :
+    AnimationClip(frames, frame_rate, gfx::ANIMATION_TRANSLATION_TOLERANCE,
+    gfx::ANIMATION_ROTATION_TOLERANCE, gfx::ANIMATION_SCALE_TOLERANCE) {}
+
+gfx::AnimationClip::AnimationClip(std::string path) {
+  std::ifstream input_file(path, std::ios::binary);
+  if (!input_file) {
+    throw gfx::CannotOpenAnimationFileException();
+  }
+  uint32_t num_keys = 0;
+  input_file.read((char*)(&frame_rate), sizeof(float));
+  input_file.read((char*)(&num_frames), sizeof(uint32_t));
+  input_file.read((char*)(&num_joints), sizeof(uint32_t));
+  input_file.read((char*)(&num_keys), sizeof(uint32_t));
+  if (!input_file || !(frame_rate > 0.0f) || num_frames == 0 || num_frames > max_frames ||
+      num_joints > gfx::MAX_SKIN_JOINTS || num_keys > num_frames * num_joints * 3) {
+    throw gfx::InvalidAnimationFileFormatException();
+  }
+  tracks.resize(num_joints * 3);
+  key_frames.resize(num_keys);
+  key_values.resize(num_keys * 3);
+  input_file.read((char*)(tracks.data()), sizeof(Track) * tracks.size());
+  input_file.read((char*)(key_frames.data()), sizeof(uint16_t) * key_frames.size());
+  input_file.read((char*)(key_values.data()), sizeof(uint16_t) * key_values.size());
+  if (!input_file || input_file.get() != EOF) {
+    throw gfx::InvalidAnimationFileFormatException();
+  }
+
+  // Sampling trusts the tracks, so check that each starts at the first frame and stays in order.
+  for (const Track& track : tracks) {
+    if (track.num_keys == 0 || track.first_key > num_keys ||
+        track.num_keys > num_keys - track.first_key || key_frames[track.first_key] != 0) {
+      throw gfx::InvalidAnimationFileFormatException();
+    }
+    for (uint32_t key = track.first_key + 1; key < track.first_key + track.num_keys; key++) {
+      if (key_frames[key] <= key_frames[key - 1] || key_frames[key] >= num_frames) {
+        throw gfx::InvalidAnimationFileFormatException();
+      }
+    }
+  }
+}
+
+void gfx::AnimationClip::Write(std::string path) {
+  std::ofstream output_file(path, std::ios::binary);
+  uint32_t num_keys = key_frames.size();
+  output_file.write((const char*)(&frame_rate), sizeof(float));
+  output_file.write((const char*)(&num_frames), sizeof(uint32_t));
+  output_file.write((const char*)(&num_joints), sizeof(uint32_t));
+  output_file.write((const char*)(&num_keys), sizeof(uint32_t));
+  output_file.write((const char*)(tracks.data()), sizeof(Track) * tracks.size());
+  output_file.write((const char*)(key_frames.data()), sizeof(uint16_t) * key_frames.size());
+  output_file.write((const char*)(key_values.data()), sizeof(uint16_t) * key_values.size());
+  if (!output_file) {
+    throw gfx::CannotWriteAnimationFileException();
+  }
+}
+
+void gfx::AnimationClip::Sample(float time, gfx::Pose* pose) {
+  float frame = 0.0f;
+  if (num_frames > 1) {
+    float duration = GetDuration();
+    float wrapped_time = std::fmod(time, duration);
+    wrapped_time = wrapped_time < 0.0f ? wrapped_time + duration : wrapped_time;
+    frame = std::min(wrapped_time * frame_rate, (float)(num_frames - 1));
+  }
+  uint16_t whole_frame = (uint16_t)frame;
+
+  Lanes one = Broadcast(1.0f);
+  Lanes zero = Broadcast(0.0f);
+  Lanes rotation_scale = Broadcast(2.0f * max_smallest_component / max_quantized_rotation);
+  Lanes rotation_offset = Broadcast(max_smallest_component);
+  Lanes value_scale = Broadcast(1.0f / max_quantized);
+  for (size_t block_index = 0; block_index < pose->blocks.size(); block_index++) {
+    gfx::JointBlock& block = pose->blocks[block_index];
+    float* outputs[3] = {&block.translations[0][0], &block.rotations[0][0], &block.scales[0][0]};
+    for (unsigned int kind = 0; kind < 3; kind++) {
+      // Find the keys around the frame for each joint and gather their quantized components. The
+      // lanes past the last joint decode to the identity.
+      float alphas[4];
+      float quantized[2][3][4];
+      float minimums[3][4];
+      float extents[3][4];
+      unsigned int largest[2][4];
+      for (unsigned int lane = 0; lane < 4; lane++) {
+        size_t joint = block_index * 4 + lane;
+        alphas[lane] = 0.0f;
+        if (joint >= num_joints) {
+          for (unsigned int component = 0; component < 3; component++) {
+            minimums[component][lane] = kind == 2 ? 1.0f : 0.0f;
+            extents[component][lane] = 0.0f;
+            for (unsigned int key = 0; key < 2; key++) {
+              quantized[key][component][lane] = max_quantized_rotation / 2.0f;
+            }
+          }
+          largest[0][lane] = 0;
+          largest[1][lane] = 0;
+          continue;
+        }
+        const Track& track = tracks[joint * 3 + kind];
+        const uint16_t* frames = &key_frames[track.first_key];
+        size_t next = std::upper_bound(frames, frames + track.num_keys, whole_frame) - frames;
+        size_t keys[2] = {next - 1, std::min(next, (size_t)track.num_keys - 1)};
+        if (keys[1] != keys[0]) {
+          alphas[lane] = (frame - frames[keys[0]]) / (frames[keys[1]] - frames[keys[0]]);
+        }
+        for (unsigned int key = 0; key < 2; key++) {
+          const uint16_t* values = &key_values[(track.first_key + keys[key]) * 3];
+          for (unsigned int component = 0; component < 3; component++) {
+            quantized[key][component][lane] = kind == 1 ? values[component] >> 1 :
+                values[component];
+          }
+          largest[key][lane] = (values[0] & 1) | (values[1] & 1) << 1;
+        }
+        for (unsigned int component = 0; component < 3; component++) {
+          minimums[component][lane] = track.minimum[component];
+          extents[component][lane] = track.extent[component];
+        }
+      }
+      Lanes alpha = Load(alphas);
+
+      if (kind != 1) {
+        for (unsigned int component = 0; component < 3; component++) {
+          Lanes minimum = Load(minimums[component]);
+          Lanes extent = Multiply(Load(extents[component]), value_scale);
+          Lanes first = Add(minimum, Multiply(extent, Load(quantized[0][component])));
+          Lanes second = Add(minimum, Multiply(extent, Load(quantized[1][component])));
+          Store(outputs[kind] + component * 4,
+              Add(first, Multiply(Subtract(second, first), alpha)));
+        }
+        continue;
+      }
+
+      // Dequantize the three smallest components of both rotations and rebuild the largest from
+      // the unit length, then move them into place.
+      float rotations[2][4][4];
+      for (unsigned int key = 0; key < 2; key++) {
+        float smallest[3][4];
+        Lanes sum = zero;
+        for (unsigned int component = 0; component < 3; component++) {
+          Lanes value = Subtract(Multiply(Load(quantized[key][component]), rotation_scale),
+              rotation_offset);
+          Store(smallest[component], value);
+          sum = Add(sum, Multiply(value, value));
+        }
+        float largest_values[4];
+        Store(largest_values, Sqrt(Max(Subtract(one, sum), zero)));
+        for (unsigned int lane = 0; lane < 4; lane++) {
+          unsigned int index = largest[key][lane];
+          rotations[key][index][lane] = largest_values[lane];
+          for (unsigned int component = 0; component < 3; component++) {
+            rotations[key][component + (component >= index)][lane] = smallest[component][lane];
+          }
+        }
+      }
+
+      // Interpolate along the short arc and renormalize.
+      Lanes first[4];
+      Lanes second[4];
+      Lanes dot = zero;
+      for (unsigned int component = 0; component < 4; component++) {
+        first[component] = Load(rotations[0][component]);
+        second[component] = Load(rotations[1][component]);
+        dot = Add(dot, Multiply(first[component], second[component]));
+      }
+      Lanes sign = Sign(dot);
+      Lanes rotation[4];
+      Lanes length = zero;
+      for (unsigned int component = 0; component < 4; component++) {
+        Lanes target = Multiply(second[component], sign);
+        rotation[component] = Add(first[component],
+            Multiply(Subtract(target, first[component]), alpha));
+        length = Add(length, Multiply(rotation[component], rotation[component]));
+      }
+      Lanes inverse_length = Divide(one, Sqrt(length));
+      for (unsigned int component = 0; component < 4; component++) {
+        Store(outputs[kind] + component * 4, Multiply(rotation[component], inverse_length));
+      }
+    }
+  }
+}
+
+float gfx::AnimationClip::GetDuration() {
+  return (num_frames - 1) / frame_rate;
+}
+
+size_t gfx::AnimationClip::GetNumJoints() {
+  return num_joints;
+}
+
+size_t gfx::AnimationClip::GetNumKeys() {
+  return key_frames.size();
+}
+
+size_t gfx::AnimationClip::GetCompressedSize() {
+  return tracks.size() * sizeof(Track) + key_frames.size() * sizeof(uint16_t) +
+      key_values.size() * sizeof(uint16_t);
+}
+
+void gfx::AnimationClip::CompressTrack(const std::vector<glm::vec4>& values,
+    unsigned int num_components, float tolerance, bool is_rotation) {
+  // Returns whether interpolating between two frames stays within the tolerance of the frames
+  // in between.
+  auto fits = [&values, tolerance, is_rotation](size_t first, size_t last) {
+    for (size_t i = first + 1; i < last; i++) {
+      float alpha = (float)(i - first) / (last - first);
+      if (GetError(Interpolate(values[first], values[last], alpha, is_rotation), values[i]) >
+          tolerance) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  // Keep only the first frame of constant tracks. Otherwise, greedily extend each segment from
+  // the last kept frame as far as it fits.
+  std::vector<size_t> kept_frames = {0};
+  bool is_constant = true;
+  for (size_t i = 1; i < values.size() && is_constant; i++) {
+    is_constant = GetError(values[i], values[0]) <= tolerance;
+  }
+  for (size_t first = 0; !is_constant && first + 1 < values.size(); first = kept_frames.back()) {
+    size_t last = first + 1;
+    while (last + 1 < values.size() && fits(first, last + 1)) {
+      last++;
+    }
+    kept_frames.push_back(last);
+  }
+
+  Track track;
+  track.first_key = key_frames.size();
+  track.num_keys = kept_frames.size();
+  glm::vec4 minimum = values[kept_frames[0]];
+  glm::vec4 maximum = minimum;
+  for (size_t frame : kept_frames) {
+    minimum = glm::min(minimum, values[frame]);
+    maximum = glm::max(maximum, values[frame]);
+  }
+  for (unsigned int component = 0; component < 3; component++) {
+    track.minimum[component] = is_rotation ? 0.0f : minimum[component];
+    track.extent[component] = is_rotation ? 0.0f : maximum[component] - minimum[component];
+  }
+  tracks.push_back(track);
+
+  for (size_t frame : kept_frames) {
+    key_frames.push_back((uint16_t)frame);
+    glm::vec4 value = values[frame];
+    if (!is_rotation) {
+      for (unsigned int component = 0; component < num_components; component++) {
+        float extent = track.extent[component];
+        float normalized = extent > 0.0f ? (value[component] - track.minimum[component]) / extent :
+            0.0f;
+        key_values.push_back((uint16_t)std::round(std::min(std::max(normalized, 0.0f), 1.0f) *
+            max_quantized));
+      }
+      continue;
+    }
+
+    // Drop the largest component, flipping the quaternion so it's positive and can be rebuilt
+    // from the others.
+    unsigned int largest = 0;
+    for (unsigned int component = 1; component < 4; component++) {
+      largest = std::abs(value[component]) > std::abs(value[largest]) ? component : largest;
+    }
+    value = value[largest] < 0.0f ? -value : value;
+    unsigned int component = 0;
+    for (unsigned int i = 0; i < 4; i++) {
+      if (i == largest) {
+        continue;
+      }
+      float normalized = (value[i] + max_smallest_component) / (2.0f * max_smallest_component);
+      uint16_t quantized = (uint16_t)std::round(std::min(std::max(normalized, 0.0f), 1.0f) *
+          max_quantized_rotation);
+      uint16_t index_bit = component < 2 ? (largest >> component) & 1 : 0;
+      key_values.push_back((uint16_t)(quantized << 1 | index_bit));
+      component++;
+    }
+  }
+}
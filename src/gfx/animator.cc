@@ -0,0 +1,312 @@
+#include "gfx/animator.h"
+#include "gfx/exceptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// The values of one component of four joints, with the arithmetic blending needs. This is an SSE
+// register when SSE2 is available and a plain array otherwise.
+#ifdef __SSE2__
+
+typedef __m128 Lanes;
+
+inline Lanes Load(const float* values) { return _mm_loadu_ps(values); }
+inline void Store(float* values, Lanes lanes) { _mm_storeu_ps(values, lanes); }
+inline Lanes Broadcast(float value) { return _mm_set1_ps(value); }
+inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes Subtract(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes Multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes Divide(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+inline Lanes Sqrt(Lanes a) { return _mm_sqrt_ps(a); }
+// Gets 1 or -1 with the sign of each lane.
+inline Lanes Sign(Lanes a) {
+  return _mm_or_ps(_mm_and_ps(a, _mm_set1_ps(-0.0f)), _mm_set1_ps(1.0f));
+}
+
+#else
+
+struct Lanes {
+  float values[4];
+};
+
+inline Lanes Load(const float* values) {
+  Lanes lanes;
+  std::memcpy(lanes.values, values, sizeof(lanes.values));
+  return lanes;
+}
+
+inline void Store(float* values, Lanes lanes) {
+  std::memcpy(values, lanes.values, sizeof(lanes.values));
+}
+
+inline Lanes Broadcast(float value) { return Lanes{{value, value, value, value}}; }
+
+#define GFX_LANES_OPERATOR(name, op) \
+  inline Lanes name(Lanes a, Lanes b) { \
+    return Lanes{{a.values[0] op b.values[0], a.values[1] op b.values[1], \
+        a.values[2] op b.values[2], a.values[3] op b.values[3]}}; \
+  }
+GFX_LANES_OPERATOR(Add, +)
+GFX_LANES_OPERATOR(Subtract, -)
+GFX_LANES_OPERATOR(Multiply, *)
+GFX_LANES_OPERATOR(Divide, /)
+#undef GFX_LANES_OPERATOR
+
+inline Lanes Sqrt(Lanes a) {
+  return Lanes{{std::sqrt(a.values[0]), std::sqrt(a.values[1]), std::sqrt(a.values[2]),
+      std::sqrt(a.values[3])}};
+}
+
+inline Lanes Sign(Lanes a) {
+  return Lanes{{std::copysign(1.0f, a.values[0]), std::copysign(1.0f, a.values[1]),
+      std::copysign(1.0f, a.values[2]), std::copysign(1.0f, a.values[3])}};
+}
+
+#endif
+
+// Adds a pose scaled by a weight to the blended pose. Rotations are flipped into the hemisphere of
+// the blended rotations so opposite quaternions of the same rotation don't cancel out.
+void Accumulate(const gfx::Pose& pose, float weight, gfx::Pose* blended) {
+  Lanes scale = Broadcast(weight);
+  for (size_t block_index = 0; block_index < blended->blocks.size(); block_index++) {
+    const gfx::JointBlock& block = pose.blocks[block_index];
+    gfx::JointBlock& blended_block = blended->blocks[block_index];
+    for (unsigned int component = 0; component < 3; component++) {
+      Store(blended_block.translations[component], Add(Load(blended_block.translations[component]),
+          Multiply(Load(block.translations[component]), scale)));
+      Store(blended_block.scales[component], Add(Load(blended_block.scales[component]),
+          Multiply(Load(block.scales[component]), scale)));
+    }
+    Lanes dot = Broadcast(0.0f);
+    for (unsigned int component = 0; component < 4; component++) {
+      dot = Add(dot, Multiply(Load(blended_block.rotations[component]),
+          Load(block.rotations[component])));
+    }
+    Lanes rotation_scale = Multiply(Sign(dot), scale);
+    for (unsigned int component = 0; component < 4; component++) {
+      Store(blended_block.rotations[component], Add(Load(blended_block.rotations[component]),
+          Multiply(Load(block.rotations[component]), rotation_scale)));
+    }
+  }
+}
+
+// Divides the accumulated translations and scales by the total weight and renormalizes the
+// rotations.
+void Normalize(float total_weight, gfx::Pose* blended) {
+  Lanes one = Broadcast(1.0f);
+  Lanes inverse_weight = Broadcast(1.0f / total_weight);
+  for (gfx::JointBlock& block : blended->blocks) {
+    Lanes length = Broadcast(0.0f);
+    for (unsigned int component = 0; component < 4; component++) {
+      Lanes rotation = Load(block.rotations[component]);
+      length = Add(length, Multiply(rotation, rotation));
+    }
+    Lanes inverse_length = Divide(one, Sqrt(length));
+    for (unsigned int component = 0; component < 4; component++) {
+      Store(block.rotations[component], Multiply(Load(block.rotations[component]),
+          inverse_length));
+    }
+    for (unsigned int component = 0; component < 3; component++) {
+      Store(block.translations[component], Multiply(Load(block.translations[component]),
+          inverse_weight));
+      Store(block.scales[component], Multiply(Load(block.scales[component]), inverse_weight));
+    }
+  }
+}
+
+// Builds the local transforms of a block of joints as translate * rotate * scale. Element column *
+// 3 + row of the result holds column 0-3 (the last one being the translation) of row 0-2.
+void GetLocalTransforms(const gfx::JointBlock& block, float transforms[12][4]) {
+  Lanes one = Broadcast(1.0f);
+  Lanes two = Broadcast(2.0f);
+  Lanes w = Load(block.rotations[0]);
+  Lanes x = Load(block.rotations[1]);
+  Lanes y = Load(block.rotations[2]);
+  Lanes z = Load(block.rotations[3]);
+  Lanes xx = Multiply(x, x);
+  Lanes yy = Multiply(y, y);
+  Lanes zz = Multiply(z, z);
+  Lanes xy = Multiply(x, y);
+  Lanes xz = Multiply(x, z);
+  Lanes yz = Multiply(y, z);
+  Lanes wx = Multiply(w, x);
+  Lanes wy = Multiply(w, y);
+  Lanes wz = Multiply(w, z);
+  Lanes rotation[9] = {
+      Subtract(one, Multiply(two, Add(yy, zz))), Multiply(two, Add(xy, wz)),
+      Multiply(two, Subtract(xz, wy)), Multiply(two, Subtract(xy, wz)),
+      Subtract(one, Multiply(two, Add(xx, zz))), Multiply(two, Add(yz, wx)),
+      Multiply(two, Add(xz, wy)), Multiply(two, Subtract(yz, wx)),
+      Subtract(one, Multiply(two, Add(xx, yy)))};
+  for (unsigned int column = 0; column < 3; column++) {
+    Lanes scale = Load(block.scales[column]);
+    for (unsigned int row = 0; row < 3; row++) {
+      Store(transforms[column * 3 + row], Multiply(rotation[column * 3 + row], scale));
+    }
+  }
+  for (unsigned int row = 0; row < 3; row++) {
+    Store(transforms[9 + row], Load(block.translations[row]));
+  }
+}
+
+}
+
+gfx::Animator::Animator() {}
+
+unsigned int gfx::Animator::AddCharacter(gfx::Skeleton* skeleton) {
+  Character character;
+  character.skeleton = skeleton;
+  for (Layer& layer : character.layers) {
+    layer = Layer{nullptr, 0.0f, 0.0f};
+  }
+  character.dirty = true;
+  character.moved = false;
+  character.joint_transforms.resize(skeleton->GetNumJoints());
+  character.bounds_min = glm::vec3(0.0f, 0.0f, 0.0f);
+  character.bounds_max = glm::vec3(0.0f, 0.0f, 0.0f);
+  character.revision = 0;
+
+  // Start in the bind pose, so the previous palette is valid before the first Update.
+  gfx::Pose sampled;
+  gfx::Pose blended;
+  PoseCharacter(&character, &sampled, &blended);
+  character.previous_palette = character.palette;
+  character.moved = false;
+  characters.push_back(character);
+  return characters.size() - 1;
+}
+
+void gfx::Animator::SetLayer(unsigned int character, unsigned int layer,
+    gfx::AnimationClip* clip, float time, float weight) {
+  if (layer >= gfx::ANIMATION_MAX_LAYERS) {
+    throw gfx::InvalidSkeletonException();
+  } else if (clip != nullptr &&
+      clip->GetNumJoints() != characters[character].skeleton->GetNumJoints()) {
+    throw gfx::InvalidSkeletonException();
+  }
+  characters[character].layers[layer] = Layer{clip, time, weight};
+  characters[character].dirty = true;
+}
+
+void gfx::Animator::Update(gfx::JobSystem* job_system) {
+  job_system->ParallelFor(characters.size(), gfx::ANIMATION_GRAIN_SIZE,
+      [this](size_t begin, size_t end) {
+    // Reuse the scratch poses across the characters of a chunk.
+    gfx::Pose sampled;
+    gfx::Pose blended;
+    for (size_t i = begin; i < end; i++) {
+      PoseCharacter(&characters[i], &sampled, &blended);
+    }
+  });
+}
+
+const glm::vec4* gfx::Animator::GetPalette(unsigned int character) {
+  return characters[character].palette.data();
+}
+
+const glm::vec4* gfx::Animator::GetPreviousPalette(unsigned int character) {
+  return characters[character].previous_palette.data();
+}
+
+glm::mat4 gfx::Animator::GetJointTransform(unsigned int character, unsigned int joint) {
+  return characters[character].joint_transforms[joint];
+}
+
+void gfx::Animator::GetBounds(unsigned int character, glm::vec3* bounds_min,
+    glm::vec3* bounds_max) {
+  *bounds_min = characters[character].bounds_min;
+  *bounds_max = characters[character].bounds_max;
+}
+
+gfx::Skeleton* gfx::Animator::GetSkeleton(unsigned int character) {
+  return characters[character].skeleton;
+}
+
+unsigned int gfx::Animator::GetRevision(unsigned int character) {
+  return characters[character].revision;
+}
+
+size_t gfx::Animator::GetNumCharacters() {
+  return characters.size();
+}
+
+void gfx::Animator::PoseCharacter(Character* character, gfx::Pose* sampled,
+    gfx::Pose* blended) {
+  if (!character->dirty) {
+    // The pose stood still since the last Update, so it didn't move since the previous one.
+    if (character->moved) {
+      character->previous_palette = character->palette;
+      character->moved = false;
+    }
+    return;
+  }
+  gfx::Skeleton* skeleton = character->skeleton;
+  size_t num_joints = skeleton->GetNumJoints();
+  if (sampled->GetNumJoints() != num_joints) {
+    *sampled = gfx::Pose(num_joints);
+    *blended = gfx::Pose(num_joints);
+  }
+  for (gfx::JointBlock& block : blended->blocks) {
+    std::memset(&block, 0, sizeof(block));
+  }
+
+  // Blend the layers, making up any weight they leave under 1 with the bind pose.
+  float total_weight = 0.0f;
+  for (Layer& layer : character->layers) {
+    if (layer.clip != nullptr && layer.weight > 0.0f) {
+      layer.clip->Sample(layer.time, sampled);
+      Accumulate(*sampled, layer.weight, blended);
+      total_weight += layer.weight;
+    }
+  }
+  if (total_weight < 1.0f) {
+    Accumulate(skeleton->GetBindPose(), 1.0f - total_weight, blended);
+    total_weight = 1.0f;
+  }
+  Normalize(total_weight, blended);
+
+  // Multiply the local transforms down the skeleton, then into the skinning palette and bounds.
+  // The palette being replaced becomes the previous one.
+  character->previous_palette.swap(character->palette);
+  character->palette.resize(num_joints * 3);
+  float local_transforms[12][4];
+  for (size_t joint = 0; joint < num_joints; joint++) {
+    unsigned int lane = joint % 4;
+    if (lane == 0) {
+      GetLocalTransforms(blended->blocks[joint / 4], local_transforms);
+    }
+    glm::mat4 local_transform;
+    for (unsigned int column = 0; column < 4; column++) {
+      for (unsigned int row = 0; row < 3; row++) {
+        local_transform[column][row] = local_transforms[column * 3 + row][lane];
+      }
+    }
+    unsigned int parent = skeleton->GetParent(joint);
+    glm::mat4& joint_transform = character->joint_transforms[joint];
+    joint_transform = parent == gfx::JOINT_NO_PARENT ? local_transform :
+        character->joint_transforms[parent] * local_transform;
+
+    glm::mat4 skinning_transform = joint_transform * skeleton->GetInverseBindTransform(joint);
+    for (unsigned int row = 0; row < 3; row++) {
+      character->palette[joint * 3 + row] = glm::vec4(skinning_transform[0][row],
+          skinning_transform[1][row], skinning_transform[2][row], skinning_transform[3][row]);
+    }
+    glm::vec3 position(joint_transform[3]);
+    character->bounds_min = joint == 0 ? position : glm::min(character->bounds_min, position);
+    character->bounds_max = joint == 0 ? position : glm::max(character->bounds_max, position);
+  }
+  glm::vec3 padding(skeleton->GetBoundsPadding());
+  character->bounds_min -= padding;
+  character->bounds_max += padding;
+
+  character->dirty = false;
+  character->moved = true;
+  character->revision++;
+}
@@ -0,0 +1,219 @@
+#include "gfx/ao_baker.h"
+#include "gfx/constants.h"
+#include "gfx/exceptions.h"
+#include "gfx/util.h"
+
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// A fairly granular value for Pi.
+const float pi = 3.1415926535897932384626433832795f;
+
+// The gamma the shaders raise AO to (see shade_surface in lighting.glsl).
+const float ao_gamma = 2.2f;
+
+// The fraction of the diagonal of the model's bounds used as the default maximum distance.
+const float default_distance_scale = 0.25f;
+
+// The fraction of the diagonal of the model's bounds ray origins are offset from the surface by,
+// so rays don't hit the triangle they start on.
+const float origin_bias_scale = 1e-4f;
+
+// Gets the 2D cross product of two vectors.
+float Cross(glm::vec2 a, glm::vec2 b) {
+  return a.x * b.y - a.y * b.x;
+}
+
+}
+
+gfx::AoBaker::AoBaker(gfx::ModelInfo* model_info, gfx::JobSystem* job_system) :
+    model_info{model_info}, job_system{job_system}, bvh(model_info), rays_traced{0} {}
+
+std::vector<gfx::AoBaker::Texel> gfx::AoBaker::RasterizeTexels(int width, int height) {
+  std::vector<Texel> texels(width * height, Texel{false, glm::vec3(0.0f), glm::vec3(0.0f),
+      glm::vec3(0.0f)});
+  glm::vec2 size((float)width, (float)height);
+  for (gfx::Mesh& mesh : model_info->meshes) {
+    const std::vector<gfx::Vertex>& vertices = mesh.GetVertices();
+    const std::vector<GLuint>& indices = mesh.GetIndices();
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      const gfx::Vertex* triangle[3] = {&vertices[indices[i]], &vertices[indices[i + 1]],
+          &vertices[indices[i + 2]]};
+      // Work in texel units, where texel (x, y) is centered on (x + 0.5, y + 0.5).
+      glm::vec2 uvs[3];
+      for (int j = 0; j < 3; j++) {
+        uvs[j] = triangle[j]->uv * size;
+      }
+      float area = Cross(uvs[1] - uvs[0], uvs[2] - uvs[0]);
+      if (!(std::abs(area) > 0.0f)) {
+        continue;
+      }
+      glm::vec3 face_normal = glm::cross(triangle[1]->position - triangle[0]->position,
+          triangle[2]->position - triangle[0]->position);
+      if (!(glm::length(face_normal) > 0.0f)) {
+        continue;
+      }
+      face_normal = glm::normalize(face_normal);
+
+      glm::vec2 min_uv = glm::min(glm::min(uvs[0], uvs[1]), uvs[2]);
+      glm::vec2 max_uv = glm::max(glm::max(uvs[0], uvs[1]), uvs[2]);
+      int min_x = std::max((int)std::floor(std::max(min_uv.x - 0.5f, -1.0f)), 0);
+      int min_y = std::max((int)std::floor(std::max(min_uv.y - 0.5f, -1.0f)), 0);
+      int max_x = std::min((int)std::ceil(std::min(max_uv.x - 0.5f, size.x)), width - 1);
+      int max_y = std::min((int)std::ceil(std::min(max_uv.y - 0.5f, size.y)), height - 1);
+      for (int y = min_y; y <= max_y; y++) {
+        for (int x = min_x; x <= max_x; x++) {
+          glm::vec2 point((float)x + 0.5f, (float)y + 0.5f);
+          float weights[3];
+          bool inside = true;
+          for (int j = 0; j < 3; j++) {
+            weights[j] = Cross(uvs[(j + 2) % 3] - uvs[(j + 1) % 3], point - uvs[(j + 1) % 3]) /
+                area;
+            inside = inside && weights[j] >= 0.0f;
+          }
+          if (!inside) {
+            continue;
+          }
+          Texel& texel = texels[y * width + x];
+          texel.position = glm::vec3(0.0f);
+          texel.normal = glm::vec3(0.0f);
+          for (int j = 0; j < 3; j++) {
+            texel.position += triangle[j]->position * weights[j];
+            texel.normal += triangle[j]->normal * weights[j];
+          }
+          float normal_length = glm::length(texel.normal);
+          texel.normal = normal_length > 0.0f ? texel.normal / normal_length : face_normal;
+          // Offset along the side of the triangle the normals point out of.
+          texel.face_normal = glm::dot(face_normal, texel.normal) < 0.0f ? -face_normal :
+              face_normal;
+          texel.covered = true;
+        }
+      }
+    }
+  }
+  return texels;
+}
+
+void gfx::AoBaker::Dilate(int width, int height, unsigned int passes,
+    std::vector<Texel>* texels, std::vector<float>* occlusion) {
+  std::vector<float> dilated;
+  std::vector<int> filled;
+  for (unsigned int pass = 0; pass < passes; pass++) {
+    dilated = *occlusion;
+    filled.clear();
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        if ((*texels)[y * width + x].covered) {
+          continue;
+        }
+        float sum = 0.0f;
+        int count = 0;
+        for (int neighbor_y = std::max(y - 1, 0); neighbor_y <= std::min(y + 1, height - 1);
+            neighbor_y++) {
+          for (int neighbor_x = std::max(x - 1, 0); neighbor_x <= std::min(x + 1, width - 1);
+              neighbor_x++) {
+            int neighbor = neighbor_y * width + neighbor_x;
+            if ((*texels)[neighbor].covered) {
+              sum += (*occlusion)[neighbor];
+              count++;
+            }
+          }
+        }
+        if (count > 0) {
+          dilated[y * width + x] = sum / (float)count;
+          filled.push_back(y * width + x);
+        }
+      }
+    }
+    if (filled.empty()) {
+      break;
+    }
+    for (int texel : filled) {
+      (*texels)[texel].covered = true;
+    }
+    occlusion->swap(dilated);
+  }
+}
+
+std::vector<unsigned char> gfx::AoBaker::Bake(const gfx::AoBakeSettings& settings) {
+  std::vector<Texel> texels = RasterizeTexels(settings.width, settings.height);
+  float diagonal = glm::length(bvh.GetMax() - bvh.GetMin());
+  float max_distance = settings.max_distance > 0.0f ? settings.max_distance :
+      diagonal * default_distance_scale;
+  float origin_bias = diagonal * origin_bias_scale;
+  unsigned int num_rays = std::max((settings.rays_per_texel + 3) / 4 * 4, 4u);
+  std::vector<glm::vec2> hammersley_points(num_rays);
+  for (unsigned int i = 0; i < num_rays; i++) {
+    hammersley_points[i] = gfx::util::GetHammersleyPoint(i, num_rays);
+  }
+
+  // Trace the covered texels. Every texel uses the same Hammersley points, each set rotated by a
+  // hash of the texel so the pattern doesn't show up as banding.
+  std::vector<float> occlusion(texels.size(), 1.0f);
+  job_system->ParallelFor(texels.size(), gfx::AO_BAKE_GRAIN_SIZE, [this, &texels, &occlusion,
+      &hammersley_points, max_distance, origin_bias, num_rays](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const Texel& texel = texels[i];
+      if (!texel.covered) {
+        continue;
+      }
+      uint32_t hash = gfx::util::Hash((uint32_t)i);
+      glm::vec2 rotation((float)(hash & 0xFFFF) / 65536.0f, (float)(hash >> 16) / 65536.0f);
+      glm::vec3 up = std::abs(texel.normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) :
+          glm::vec3(1.0f, 0.0f, 0.0f);
+      glm::vec3 tangent_x = glm::normalize(glm::cross(up, texel.normal));
+      glm::vec3 tangent_y = glm::cross(texel.normal, tangent_x);
+      glm::vec3 origin = texel.position + texel.face_normal * origin_bias;
+      glm::vec3 origins[4] = {origin, origin, origin, origin};
+
+      unsigned int hits = 0;
+      for (unsigned int ray = 0; ray < num_rays; ray += 4) {
+        glm::vec3 directions[4];
+        for (unsigned int j = 0; j < 4; j++) {
+          glm::vec2 point = hammersley_points[ray + j] + rotation;
+          point -= glm::floor(point);
+          float radius = std::sqrt(point.x);
+          float phi = 2.0f * pi * point.y;
+          directions[j] = tangent_x * (radius * std::cos(phi)) +
+              tangent_y * (radius * std::sin(phi)) + texel.normal * std::sqrt(1.0f - point.x);
+        }
+        unsigned int occluded = bvh.GetOccludedRays(origins, directions, max_distance);
+        hits += (occluded & 1) + (occluded >> 1 & 1) + (occluded >> 2 & 1) + (occluded >> 3);
+      }
+      occlusion[i] = 1.0f - (float)hits / (float)num_rays;
+    }
+  });
+  size_t covered_texels = std::count_if(texels.begin(), texels.end(),
+      [](const Texel& texel) { return texel.covered; });
+  rays_traced = covered_texels * num_rays;
+
+  // Empty texels that the dilation doesn't reach are left unoccluded.
+  Dilate(settings.width, settings.height, settings.dilation, &texels, &occlusion);
+  std::vector<unsigned char> image(texels.size() * 3);
+  for (size_t i = 0; i < texels.size(); i++) {
+    float encoded = std::pow(glm::clamp(occlusion[i], 0.0f, 1.0f), 1.0f / ao_gamma);
+    std::fill_n(image.begin() + i * 3, 3, (unsigned char)(encoded * 255.0f + 0.5f));
+  }
+  return image;
+}
+
+void gfx::AoBaker::BakeToFile(const gfx::AoBakeSettings& settings, std::string path) {
+  std::vector<unsigned char> image = Bake(settings);
+  if (!stbi_write_png(path.c_str(), settings.width, settings.height, 3, image.data(),
+      settings.width * 3)) {
+    throw gfx::CannotWriteImageException();
+  }
+}
+
+gfx::Bvh* gfx::AoBaker::GetBvh() {
+  return &bvh;
+}
+
+size_t gfx::AoBaker::GetRaysTraced() {
+  return rays_traced;
+}
@@ -0,0 +1,6 @@
+#include "gfx/area_light.h"
+#include "gfx/light.h"
+
+gfx::AreaLight::AreaLight(gfx::AreaLightShape shape, glm::vec3 position, glm::vec3 right,
+    glm::vec3 up, glm::vec3 radiance) : gfx::Light(radiance), shape{shape}, position{position},
+    right{right}, up{up}, two_sided{false} {}
@@ -0,0 +1,485 @@
+#include "gfx/asset_pack.h"
+#include "gfx/constants.h"
+#include "gfx/exceptions.h"
+
+#ifdef GFX_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_set>
+
+namespace {
+
+// Identifies packs, followed by the version of the format.
+const char pack_magic[4] = {'G', 'P', 'A', 'K'};
+const uint32_t pack_version = 1;
+// The flag of entries whose contents are compressed.
+const uint32_t compressed_flag = 1;
+
+// The LZ4 block format is a series of sequences of literals followed by a match. Each starts with
+// a token holding the number of literals in its high nibble and the match length minus
+// lz4_min_match in its low nibble, where 15 means more bytes of the length follow, and the match
+// is given by a 16-bit offset back from the end of the literals. The last sequence only has
+// literals. Decoders may assume the last match starts lz4_match_margin bytes before the end and
+// the last lz4_end_literals bytes are literals.
+const size_t lz4_min_match = 4;
+const size_t lz4_max_offset = 65535;
+const size_t lz4_match_margin = 12;
+const size_t lz4_end_literals = 5;
+// Bounds the size of decompressed blocks, since each byte of a block expands to at most
+// lz4_max_expansion bytes (a run of 255 length bytes each adds 255 to a match length), plus a
+// little for the shortest blocks.
+const uint64_t lz4_max_expansion = 255;
+const uint64_t lz4_max_expansion_slack = 16;
+// The number of bits of the hash table of the positions of recent 4-byte sequences.
+const unsigned int lz4_hash_bits = 16;
+
+// The header at the start of a pack. The hash table follows it, then the entries (aligned to 8
+// bytes) and their paths, and the contents start at data_offset.
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_entries;
+  uint32_t num_slots;
+  uint64_t paths_size;
+  uint64_t data_offset;
+};
+
+// The packs searched by ReadMounted, most recently mounted first.
+std::vector<gfx::AssetPack*> mounted_packs;
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t GetEntriesOffset(uint32_t num_slots) {
+  return AlignUp(sizeof(Header) + sizeof(uint32_t) * (uint64_t)num_slots, 8);
+}
+
+// Hashes a normalized path with 64-bit FNV-1a.
+uint64_t HashPath(const std::string& path) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : path) {
+    hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+  }
+  return hash;
+}
+
+uint32_t Read32(const unsigned char* bytes) {
+  uint32_t value;
+  std::memcpy(&value, bytes, sizeof(uint32_t));
+  return value;
+}
+
+// Appends the rest of a length that didn't fit in its nibble of a token.
+void WriteLength(size_t length, std::vector<unsigned char>* output) {
+  for (; length >= 255; length -= 255) {
+    output->push_back(255);
+  }
+  output->push_back((unsigned char)length);
+}
+
+// Appends a sequence of literals and the match after them, if match_length isn't 0.
+void WriteSequence(const unsigned char* literals, size_t num_literals, size_t offset,
+    size_t match_length, std::vector<unsigned char>* output) {
+  size_t match_code = match_length == 0 ? 0 : match_length - lz4_min_match;
+  output->push_back((unsigned char)((std::min(num_literals, (size_t)15) << 4) |
+      std::min(match_code, (size_t)15)));
+  if (num_literals >= 15) {
+    WriteLength(num_literals - 15, output);
+  }
+  output->insert(output->end(), literals, literals + num_literals);
+  if (match_length == 0) {
+    return;
+  }
+  output->push_back((unsigned char)(offset & 0xFF));
+  output->push_back((unsigned char)(offset >> 8));
+  if (match_code >= 15) {
+    WriteLength(match_code - 15, output);
+  }
+}
+
+// Compresses bytes into an LZ4 block, taking the longest match at the last position with the same
+// hash. Like in LZ4, the search steps further ahead the longer it goes without a match, so
+// incompressible data is skipped over quickly. The input must be smaller than 4 GB.
+std::vector<unsigned char> Compress(const unsigned char* input, size_t size) {
+  std::vector<unsigned char> output;
+  output.reserve(size + size / 255 + 16);
+  std::vector<uint32_t> table((size_t)1 << lz4_hash_bits, 0);
+  size_t anchor = 0;
+  size_t position = 0;
+  size_t misses = 0;
+  while (position + lz4_match_margin <= size) {
+    uint32_t sequence = Read32(input + position);
+    uint32_t hash = (sequence * 2654435761u) >> (32 - lz4_hash_bits);
+    size_t candidate = table[hash];
+    table[hash] = (uint32_t)position;
+    if (candidate >= position || position - candidate > lz4_max_offset ||
+        Read32(input + candidate) != sequence) {
+      position += 1 + (misses++ >> 6);
+      continue;
+    }
+    size_t match_end = position + lz4_min_match;
+    while (match_end < size - lz4_end_literals &&
+        input[match_end] == input[candidate + match_end - position]) {
+      match_end++;
+    }
+    WriteSequence(input + anchor, position - anchor, position - candidate, match_end - position,
+        &output);
+    position = match_end;
+    anchor = position;
+    misses = 0;
+  }
+  WriteSequence(input + anchor, size - anchor, 0, 0, &output);
+  return output;
+}
+
+// Reads the rest of a length that didn't fit in its nibble of a token. This returns false if the
+// input ends first.
+bool ReadLength(const unsigned char* input, size_t input_size, size_t* position, size_t* length) {
+  unsigned char byte;
+  do {
+    if (*position == input_size) {
+      return false;
+    }
+    byte = input[(*position)++];
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// Decompresses an LZ4 block into exactly output_size bytes. This returns false if the block is
+// malformed or decompresses to a different size.
+bool Decompress(const unsigned char* input, size_t input_size, unsigned char* output,
+    size_t output_size) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < input_size) {
+    unsigned char token = input[in++];
+    size_t num_literals = token >> 4;
+    if (num_literals == 15 && !ReadLength(input, input_size, &in, &num_literals)) {
+      return false;
+    }
+    if (num_literals > input_size - in || num_literals > output_size - out) {
+      return false;
+    }
+    std::memcpy(output + out, input + in, num_literals);
+    in += num_literals;
+    out += num_literals;
+    if (in == input_size) {
+      break;
+    }
+
+    if (input_size - in < 2) {
+      return false;
+    }
+    size_t offset = input[in] | ((size_t)input[in + 1] << 8);
+    in += 2;
+    size_t match_length = token & 15;
+    if (match_length == 15 && !ReadLength(input, input_size, &in, &match_length)) {
+      return false;
+    }
+    match_length += lz4_min_match;
+    if (offset == 0 || offset > out || match_length > output_size - out) {
+      return false;
+    }
+    // Matches may overlap the bytes they produce, repeating the last offset bytes.
+    if (offset >= match_length) {
+      std::memcpy(output + out, output + out - offset, match_length);
+    } else {
+      for (size_t i = 0; i < match_length; i++) {
+        output[out + i] = output[out + i - offset];
+      }
+    }
+    out += match_length;
+  }
+  return out == output_size;
+}
+
+}
+
+gfx::AssetStreamBuffer::AssetStreamBuffer(const unsigned char* data, size_t size) {
+  char* begin = (char*)data;
+  setg(begin, begin, begin + size);
+}
+
+gfx::AssetPack::AssetPack(std::string path) : data{nullptr}, size{0}, storage(),
+    is_mapped{false}, slots{nullptr}, num_slots{0}, entries{nullptr}, num_entries{0},
+    paths{nullptr} {
+#ifdef GFX_MMAP
+  int file = open(path.c_str(), O_RDONLY);
+  if (file == -1) {
+    throw gfx::CannotOpenAssetPackException();
+  }
+  struct stat file_stat;
+  if (fstat(file, &file_stat) != 0) {
+    close(file);
+    throw gfx::CannotOpenAssetPackException();
+  }
+  size = (size_t)file_stat.st_size;
+  void* mapping = size == 0 ? MAP_FAILED : mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (mapping == MAP_FAILED) {
+    throw gfx::InvalidAssetPackException();
+  }
+  // Ask for the whole pack up front, so it's read in large sequential chunks rather than a page
+  // at a time as the assets are first touched.
+  madvise(mapping, size, MADV_WILLNEED);
+  data = (const unsigned char*)mapping;
+  is_mapped = true;
+#else
+  std::ifstream input_file(path, std::ios::binary | std::ios::ate);
+  if (!input_file) {
+    throw gfx::CannotOpenAssetPackException();
+  }
+  storage.resize((size_t)input_file.tellg());
+  input_file.seekg(0);
+  input_file.read((char*)storage.data(), storage.size());
+  if (!input_file) {
+    throw gfx::CannotOpenAssetPackException();
+  }
+  data = storage.data();
+  size = storage.size();
+#endif
+
+  try {
+    Header header;
+    if (size < sizeof(Header)) {
+      throw gfx::InvalidAssetPackException();
+    }
+    std::memcpy(&header, data, sizeof(Header));
+    if (std::memcmp(header.magic, pack_magic, sizeof(pack_magic)) != 0 ||
+        header.version != pack_version || header.num_slots == 0 ||
+        (header.num_slots & (header.num_slots - 1)) != 0 ||
+        header.num_slots < header.num_entries) {
+      throw gfx::InvalidAssetPackException();
+    }
+    uint64_t entries_offset = GetEntriesOffset(header.num_slots);
+    uint64_t paths_offset = entries_offset + sizeof(Entry) * (uint64_t)header.num_entries;
+    if (header.paths_size > size || paths_offset + header.paths_size > header.data_offset ||
+        header.data_offset > size) {
+      throw gfx::InvalidAssetPackException();
+    }
+    slots = (const uint32_t*)(data + sizeof(Header));
+    num_slots = header.num_slots;
+    entries = (const Entry*)(data + entries_offset);
+    num_entries = header.num_entries;
+    paths = (const char*)(data + paths_offset);
+    Validate(header.paths_size);
+  } catch (...) {
+    Unmap();
+    throw;
+  }
+}
+
+gfx::AssetPack::~AssetPack() {
+  Unmount(this);
+  Unmap();
+}
+
+void gfx::AssetPack::Unmap() {
+#ifdef GFX_MMAP
+  if (is_mapped) {
+    munmap((void*)data, size);
+    is_mapped = false;
+  }
+#endif
+}
+
+void gfx::AssetPack::Validate(uint64_t paths_size) {
+  for (uint32_t i = 0; i < num_slots; i++) {
+    if (slots[i] > num_entries) {
+      throw gfx::InvalidAssetPackException();
+    }
+  }
+  for (uint32_t i = 0; i < num_entries; i++) {
+    const Entry& entry = entries[i];
+    bool is_compressed = (entry.flags & compressed_flag) != 0;
+    if (entry.path_offset > paths_size || entry.path_length > paths_size - entry.path_offset ||
+        entry.offset > size || entry.stored_size > size - entry.offset ||
+        (uint64_t)(size_t)entry.size != entry.size ||
+        (!is_compressed && entry.stored_size != entry.size) ||
+        (is_compressed &&
+        entry.size > entry.stored_size * lz4_max_expansion + lz4_max_expansion_slack)) {
+      throw gfx::InvalidAssetPackException();
+    }
+  }
+}
+
+const gfx::AssetPack::Entry* gfx::AssetPack::Find(const std::string& path) {
+  uint64_t hash = HashPath(path);
+  for (uint32_t i = 0; i < num_slots; i++) {
+    uint32_t slot = slots[(hash + i) & (num_slots - 1)];
+    if (slot == 0) {
+      return nullptr;
+    }
+    const Entry* entry = &entries[slot - 1];
+    if (entry->hash == hash && entry->path_length == path.size() &&
+        path.compare(0, path.size(), paths + entry->path_offset, entry->path_length) == 0) {
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+bool gfx::AssetPack::Read(std::string path, gfx::AssetData* asset) {
+  const Entry* entry = Find(NormalizePath(path));
+  if (entry == nullptr) {
+    return false;
+  }
+  const unsigned char* contents = data + entry->offset;
+  if ((entry->flags & compressed_flag) == 0) {
+    asset->storage.clear();
+    asset->data = contents;
+    asset->size = (size_t)entry->size;
+    return true;
+  }
+  asset->storage.resize((size_t)entry->size);
+  if (!Decompress(contents, (size_t)entry->stored_size, asset->storage.data(),
+      asset->storage.size())) {
+    throw gfx::InvalidAssetPackException();
+  }
+  asset->data = asset->storage.data();
+  asset->size = asset->storage.size();
+  return true;
+}
+
+size_t gfx::AssetPack::GetNumEntries() {
+  return num_entries;
+}
+
+size_t gfx::AssetPack::GetSize() {
+  return size;
+}
+
+gfx::AssetPackStats gfx::AssetPack::Write(std::string path,
+    const std::vector<std::string>& asset_paths, bool should_compress) {
+  std::vector<std::string> normalized_paths;
+  std::unordered_set<std::string> unique_paths;
+  for (const std::string& asset_path : asset_paths) {
+    std::string normalized_path = NormalizePath(asset_path);
+    if (unique_paths.insert(normalized_path).second) {
+      normalized_paths.push_back(normalized_path);
+    }
+  }
+
+  // Build the hash table with linear probing, keeping it at most half full.
+  uint32_t num_entries = (uint32_t)normalized_paths.size();
+  uint32_t num_slots = 1;
+  while (num_slots < 2 * (uint64_t)num_entries) {
+    num_slots *= 2;
+  }
+  std::vector<uint32_t> slots(num_slots, 0);
+  std::vector<Entry> entries(num_entries);
+  std::string paths;
+  for (uint32_t i = 0; i < num_entries; i++) {
+    Entry& entry = entries[i];
+    std::memset(&entry, 0, sizeof(Entry));
+    entry.hash = HashPath(normalized_paths[i]);
+    entry.path_offset = (uint32_t)paths.size();
+    entry.path_length = (uint32_t)normalized_paths[i].size();
+    paths += normalized_paths[i];
+    uint32_t slot = (uint32_t)(entry.hash & (num_slots - 1));
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (num_slots - 1);
+    }
+    slots[slot] = i + 1;
+  }
+
+  // Write the contents after room for the table of contents, which is written last once their
+  // offsets are known.
+  uint64_t entries_offset = GetEntriesOffset(num_slots);
+  uint64_t paths_offset = entries_offset + sizeof(Entry) * (uint64_t)num_entries;
+  uint64_t data_offset = AlignUp(paths_offset + paths.size(), gfx::ASSET_PACK_ALIGNMENT);
+  std::ofstream output_file(path, std::ios::binary);
+  std::string padding(data_offset, '\0');
+  output_file.write(padding.data(), padding.size());
+  gfx::AssetPackStats stats{num_entries, 0, 0, 0};
+  uint64_t offset = data_offset;
+  for (uint32_t i = 0; i < num_entries && output_file; i++) {
+    std::ifstream input_file(normalized_paths[i], std::ios::binary | std::ios::ate);
+    if (!input_file) {
+      throw gfx::CannotWriteAssetPackException();
+    }
+    std::vector<unsigned char> contents((size_t)input_file.tellg());
+    input_file.seekg(0);
+    input_file.read((char*)contents.data(), contents.size());
+    if (!input_file) {
+      throw gfx::CannotWriteAssetPackException();
+    }
+
+    std::vector<unsigned char> compressed;
+    if (should_compress && !contents.empty() &&
+        contents.size() < std::numeric_limits<uint32_t>::max()) {
+      compressed = Compress(contents.data(), contents.size());
+    }
+    bool is_compressed = !compressed.empty() &&
+        compressed.size() <= contents.size() * (1.0 - gfx::ASSET_PACK_MIN_SAVINGS);
+    const std::vector<unsigned char>& stored = is_compressed ? compressed : contents;
+    uint64_t aligned_offset = AlignUp(offset, gfx::ASSET_PACK_ALIGNMENT);
+    output_file.write(padding.data(), aligned_offset - offset);
+    output_file.write((const char*)stored.data(), stored.size());
+    entries[i].offset = aligned_offset;
+    entries[i].stored_size = stored.size();
+    entries[i].size = contents.size();
+    entries[i].flags = is_compressed ? compressed_flag : 0;
+    offset = aligned_offset + stored.size();
+    stats.num_compressed += is_compressed ? 1 : 0;
+    stats.asset_size += contents.size();
+  }
+  stats.pack_size = offset;
+
+  Header header;
+  std::memcpy(header.magic, pack_magic, sizeof(pack_magic));
+  header.version = pack_version;
+  header.num_entries = num_entries;
+  header.num_slots = num_slots;
+  header.paths_size = paths.size();
+  header.data_offset = data_offset;
+  output_file.seekp(0);
+  output_file.write((const char*)&header, sizeof(Header));
+  output_file.write((const char*)slots.data(), sizeof(uint32_t) * slots.size());
+  output_file.write(padding.data(), entries_offset - sizeof(Header) -
+      sizeof(uint32_t) * slots.size());
+  output_file.write((const char*)entries.data(), sizeof(Entry) * entries.size());
+  output_file.write(paths.data(), paths.size());
+  if (!output_file) {
+    throw gfx::CannotWriteAssetPackException();
+  }
+  return stats;
+}
+
+void gfx::AssetPack::Mount(gfx::AssetPack* pack) {
+  Unmount(pack);
+  mounted_packs.insert(mounted_packs.begin(), pack);
+}
+
+void gfx::AssetPack::Unmount(gfx::AssetPack* pack) {
+  mounted_packs.erase(std::remove(mounted_packs.begin(), mounted_packs.end(), pack),
+      mounted_packs.end());
+}
+
+bool gfx::AssetPack::ReadMounted(std::string path, gfx::AssetData* asset) {
+  for (gfx::AssetPack* pack : mounted_packs) {
+    if (pack->Read(path, asset)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string gfx::AssetPack::NormalizePath(std::string path) {
+  std::replace(path.begin(), path.end(), '\\', '/');
+  size_t start = 0;
+  while (path.compare(start, 2, "./") == 0) {
+    start += 2;
+  }
+  return path.substr(start);
+}
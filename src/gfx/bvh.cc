@@ -0,0 +1,390 @@
+#include "gfx/bvh.h"
+#include "gfx/constants.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// The deepest a BVH over 2^32 triangles can get, which bounds the traversal stack.
+const int max_depth = 64;
+
+// Direction components smaller than this are clamped to it, so their reciprocals stay finite.
+const float min_direction = 1e-20f;
+
+// Triangles whose determinant with a ray is smaller than this are treated as parallel to it.
+const float min_determinant = 1e-12f;
+
+// The values of one component of the four rays in a packet, with the arithmetic the traversal
+// needs. This is an SSE register when SSE2 is available and a plain array otherwise. Comparisons
+// return a mask with bit i set if the comparison holds for ray i.
+#ifdef __SSE2__
+
+typedef __m128 Lanes;
+
+inline Lanes Broadcast(float value) { return _mm_set1_ps(value); }
+inline Lanes Gather(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes Subtract(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes Multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes Divide(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+inline Lanes Min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+inline Lanes Max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+inline unsigned int Less(Lanes a, Lanes b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+inline unsigned int LessEqual(Lanes a, Lanes b) { return _mm_movemask_ps(_mm_cmple_ps(a, b)); }
+
+#else
+
+struct Lanes {
+  float values[4];
+};
+
+inline Lanes Broadcast(float value) { return Lanes{{value, value, value, value}}; }
+inline Lanes Gather(float a, float b, float c, float d) { return Lanes{{a, b, c, d}}; }
+
+#define GFX_LANES_OPERATOR(name, op) \
+  inline Lanes name(Lanes a, Lanes b) { \
+    return Lanes{{a.values[0] op b.values[0], a.values[1] op b.values[1], \
+        a.values[2] op b.values[2], a.values[3] op b.values[3]}}; \
+  }
+GFX_LANES_OPERATOR(Add, +)
+GFX_LANES_OPERATOR(Subtract, -)
+GFX_LANES_OPERATOR(Multiply, *)
+GFX_LANES_OPERATOR(Divide, /)
+#undef GFX_LANES_OPERATOR
+
+#define GFX_LANES_FUNCTION(name, function) \
+  inline Lanes name(Lanes a, Lanes b) { \
+    return Lanes{{function(a.values[0], b.values[0]), function(a.values[1], b.values[1]), \
+        function(a.values[2], b.values[2]), function(a.values[3], b.values[3])}}; \
+  }
+GFX_LANES_FUNCTION(Min, std::min)
+GFX_LANES_FUNCTION(Max, std::max)
+#undef GFX_LANES_FUNCTION
+
+#define GFX_LANES_COMPARISON(name, op) \
+  inline unsigned int name(Lanes a, Lanes b) { \
+    return (a.values[0] op b.values[0]) | (a.values[1] op b.values[1]) << 1 | \
+        (a.values[2] op b.values[2]) << 2 | (a.values[3] op b.values[3]) << 3; \
+  }
+GFX_LANES_COMPARISON(Less, <)
+GFX_LANES_COMPARISON(LessEqual, <=)
+#undef GFX_LANES_COMPARISON
+
+#endif
+
+// A vector of the four rays in a packet.
+struct LanesVector {
+  Lanes x;
+  Lanes y;
+  Lanes z;
+};
+
+inline LanesVector Broadcast(glm::vec3 vector) {
+  return LanesVector{Broadcast(vector.x), Broadcast(vector.y), Broadcast(vector.z)};
+}
+
+inline LanesVector Subtract(LanesVector a, LanesVector b) {
+  return LanesVector{Subtract(a.x, b.x), Subtract(a.y, b.y), Subtract(a.z, b.z)};
+}
+
+inline Lanes Dot(LanesVector a, LanesVector b) {
+  return Add(Add(Multiply(a.x, b.x), Multiply(a.y, b.y)), Multiply(a.z, b.z));
+}
+
+inline LanesVector Cross(LanesVector a, LanesVector b) {
+  return LanesVector{Subtract(Multiply(a.y, b.z), Multiply(a.z, b.y)),
+      Subtract(Multiply(a.z, b.x), Multiply(a.x, b.z)),
+      Subtract(Multiply(a.x, b.y), Multiply(a.y, b.x))};
+}
+
+// An axis aligned box with an empty box that grows to fit anything.
+struct Bounds {
+  glm::vec3 min = glm::vec3(FLT_MAX);
+  glm::vec3 max = glm::vec3(-FLT_MAX);
+
+  void Grow(glm::vec3 point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+
+  void Grow(const Bounds& bounds) {
+    min = glm::min(min, bounds.min);
+    max = glm::max(max, bounds.max);
+  }
+
+  // Gets half of the surface area, or 0 for an empty box.
+  float GetHalfArea() const {
+    glm::vec3 extent = glm::max(max - min, glm::vec3(0.0f));
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+  }
+};
+
+// A triangle being sorted into the hierarchy.
+struct BuildTriangle {
+  Bounds bounds;
+  glm::vec3 centroid;
+  unsigned int index;
+};
+
+// A bin of the centroids along an axis.
+struct Bin {
+  Bounds bounds;
+  unsigned int count = 0;
+};
+
+}
+
+gfx::Bvh::Bvh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices) :
+    nodes(), triangles() {
+  Build(positions, indices);
+}
+
+gfx::Bvh::Bvh(gfx::ModelInfo* model_info) : nodes(), triangles() {
+  std::vector<glm::vec3> positions;
+  std::vector<GLuint> indices;
+  for (gfx::Mesh& mesh : model_info->meshes) {
+    GLuint first_vertex = positions.size();
+    for (const gfx::Vertex& vertex : mesh.GetVertices()) {
+      positions.push_back(vertex.position);
+    }
+    for (GLuint index : mesh.GetIndices()) {
+      indices.push_back(first_vertex + index);
+    }
+  }
+  Build(positions, indices);
+}
+
+void gfx::Bvh::Build(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices) {
+  std::vector<BuildTriangle> build_triangles(indices.size() / 3);
+  for (size_t i = 0; i < build_triangles.size(); i++) {
+    BuildTriangle& triangle = build_triangles[i];
+    for (size_t j = 0; j < 3; j++) {
+      triangle.bounds.Grow(positions[indices[i * 3 + j]]);
+    }
+    triangle.centroid = (triangle.bounds.min + triangle.bounds.max) * 0.5f;
+    triangle.index = i;
+  }
+
+  // Split the nodes depth first, keeping the ranges of triangles left to split on a stack.
+  struct Range {
+    unsigned int node;
+    unsigned int begin;
+    unsigned int end;
+    unsigned int depth;
+  };
+  nodes.assign(1, Node());
+  std::vector<Range> ranges = {Range{0, 0, (unsigned int)build_triangles.size(), 0}};
+  while (!ranges.empty()) {
+    Range range = ranges.back();
+    ranges.pop_back();
+    Bounds bounds;
+    Bounds centroid_bounds;
+    for (unsigned int i = range.begin; i < range.end; i++) {
+      bounds.Grow(build_triangles[i].bounds);
+      centroid_bounds.Grow(build_triangles[i].centroid);
+    }
+    unsigned int count = range.end - range.begin;
+    nodes[range.node].min = bounds.min;
+    nodes[range.node].max = bounds.max;
+    nodes[range.node].offset = range.begin;
+    nodes[range.node].count = count;
+
+    // Find the bin boundary with the lowest surface area heuristic along any axis. A split is
+    // costed as one box test plus the triangle tests of each child weighted by the chance of
+    // hitting it, against the triangle tests of keeping the node as a leaf if it's small enough.
+    float best_cost = count <= gfx::BVH_MAX_LEAF_TRIANGLES ? (float)count : FLT_MAX;
+    int best_axis = -1;
+    unsigned int best_split = 0;
+    float node_area = bounds.GetHalfArea();
+    for (int axis = 0; axis < 3 && node_area > 0.0f; axis++) {
+      float axis_min = centroid_bounds.min[axis];
+      float extent = centroid_bounds.max[axis] - axis_min;
+      if (!(extent > 0.0f)) {
+        continue;
+      }
+      Bin bins[gfx::BVH_SAH_BINS];
+      float scale = (float)gfx::BVH_SAH_BINS / extent;
+      for (unsigned int i = range.begin; i < range.end; i++) {
+        unsigned int bin = std::min((unsigned int)((build_triangles[i].centroid[axis] -
+            axis_min) * scale), gfx::BVH_SAH_BINS - 1);
+        bins[bin].bounds.Grow(build_triangles[i].bounds);
+        bins[bin].count++;
+      }
+      // Sweep from the right to get the area and count right of each boundary, then from the
+      // left to cost them.
+      float right_areas[gfx::BVH_SAH_BINS];
+      unsigned int right_counts[gfx::BVH_SAH_BINS];
+      Bounds right_bounds;
+      unsigned int right_count = 0;
+      for (unsigned int i = gfx::BVH_SAH_BINS - 1; i > 0; i--) {
+        right_bounds.Grow(bins[i].bounds);
+        right_count += bins[i].count;
+        right_areas[i] = right_bounds.GetHalfArea();
+        right_counts[i] = right_count;
+      }
+      Bounds left_bounds;
+      unsigned int left_count = 0;
+      for (unsigned int i = 1; i < gfx::BVH_SAH_BINS; i++) {
+        left_bounds.Grow(bins[i - 1].bounds);
+        left_count += bins[i - 1].count;
+        if (left_count == 0 || right_counts[i] == 0) {
+          continue;
+        }
+        float cost = 1.0f + (left_bounds.GetHalfArea() * left_count +
+            right_areas[i] * right_counts[i]) / node_area;
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_split = i;
+        }
+      }
+    }
+
+    unsigned int middle;
+    if (range.depth + 1 >= (unsigned int)max_depth) {
+      // Keep the traversal stack bounded by making a leaf of whatever is left this deep.
+      continue;
+    } else if (best_axis >= 0) {
+      float axis_min = centroid_bounds.min[best_axis];
+      float scale = (float)gfx::BVH_SAH_BINS / (centroid_bounds.max[best_axis] - axis_min);
+      middle = std::partition(build_triangles.begin() + range.begin,
+          build_triangles.begin() + range.end, [best_axis, axis_min, scale, best_split](
+          const BuildTriangle& triangle) {
+        return std::min((unsigned int)((triangle.centroid[best_axis] - axis_min) * scale),
+            gfx::BVH_SAH_BINS - 1) < best_split;
+      }) - build_triangles.begin();
+    } else if (count > gfx::BVH_MAX_LEAF_TRIANGLES) {
+      // Too many triangles for a leaf but no split helps (e.g. the centroids all coincide), so
+      // halve them in their current order.
+      middle = range.begin + count / 2;
+    } else {
+      continue;
+    }
+
+    unsigned int left = nodes.size();
+    nodes[range.node].offset = left;
+    nodes[range.node].count = 0;
+    nodes.resize(nodes.size() + 2);
+    ranges.push_back(Range{left + 1, middle, range.end, range.depth + 1});
+    ranges.push_back(Range{left, range.begin, middle, range.depth + 1});
+  }
+
+  triangles.resize(build_triangles.size());
+  for (size_t i = 0; i < build_triangles.size(); i++) {
+    const GLuint* triangle_indices = &indices[build_triangles[i].index * 3];
+    glm::vec3 vertex = positions[triangle_indices[0]];
+    triangles[i] = Triangle{vertex, positions[triangle_indices[1]] - vertex,
+        positions[triangle_indices[2]] - vertex};
+  }
+}
+
+unsigned int gfx::Bvh::GetOccludedRays(const glm::vec3 origins[4],
+    const glm::vec3 directions[4], float max_distance) {
+  if (triangles.empty()) {
+    return 0;
+  }
+  LanesVector origin{Gather(origins[0].x, origins[1].x, origins[2].x, origins[3].x),
+      Gather(origins[0].y, origins[1].y, origins[2].y, origins[3].y),
+      Gather(origins[0].z, origins[1].z, origins[2].z, origins[3].z)};
+  LanesVector direction{Gather(directions[0].x, directions[1].x, directions[2].x, directions[3].x),
+      Gather(directions[0].y, directions[1].y, directions[2].y, directions[3].y),
+      Gather(directions[0].z, directions[1].z, directions[2].z, directions[3].z)};
+  glm::vec3 inverse_directions[4];
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 3; j++) {
+      float component = directions[i][j];
+      inverse_directions[i][j] = 1.0f / (std::abs(component) < min_direction ?
+          (component < 0.0f ? -min_direction : min_direction) : component);
+    }
+  }
+  LanesVector inverse_direction{Gather(inverse_directions[0].x, inverse_directions[1].x,
+      inverse_directions[2].x, inverse_directions[3].x), Gather(inverse_directions[0].y,
+      inverse_directions[1].y, inverse_directions[2].y, inverse_directions[3].y),
+      Gather(inverse_directions[0].z, inverse_directions[1].z, inverse_directions[2].z,
+      inverse_directions[3].z)};
+  Lanes zero = Broadcast(0.0f);
+  Lanes one = Broadcast(1.0f);
+  Lanes max_distances = Broadcast(max_distance);
+
+  unsigned int occluded = 0;
+  unsigned int stack[max_depth * 2];
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    const Node& node = nodes[stack[--stack_size]];
+
+    // Intersect the rays that haven't hit anything yet with the slabs of the node's box.
+    LanesVector near_planes = Subtract(Broadcast(node.min), origin);
+    LanesVector far_planes = Subtract(Broadcast(node.max), origin);
+    Lanes x_0 = Multiply(near_planes.x, inverse_direction.x);
+    Lanes x_1 = Multiply(far_planes.x, inverse_direction.x);
+    Lanes y_0 = Multiply(near_planes.y, inverse_direction.y);
+    Lanes y_1 = Multiply(far_planes.y, inverse_direction.y);
+    Lanes z_0 = Multiply(near_planes.z, inverse_direction.z);
+    Lanes z_1 = Multiply(far_planes.z, inverse_direction.z);
+    Lanes entry = Max(Max(Min(x_0, x_1), Min(y_0, y_1)), Max(Min(z_0, z_1), zero));
+    Lanes exit = Min(Min(Max(x_0, x_1), Max(y_0, y_1)), Min(Max(z_0, z_1), max_distances));
+    if ((LessEqual(entry, exit) & ~occluded) == 0) {
+      continue;
+    }
+
+    if (node.count == 0) {
+      stack[stack_size++] = node.offset + 1;
+      stack[stack_size++] = node.offset;
+      continue;
+    }
+
+    // Moller-Trumbore intersection of the packet with each triangle in the leaf.
+    for (unsigned int i = node.offset; i < node.offset + node.count; i++) {
+      const Triangle& triangle = triangles[i];
+      LanesVector edge_1 = Broadcast(triangle.edge_1);
+      LanesVector edge_2 = Broadcast(triangle.edge_2);
+      LanesVector p = Cross(direction, edge_2);
+      Lanes determinant = Dot(edge_1, p);
+      unsigned int hits = Less(determinant, Broadcast(-min_determinant)) |
+          Less(Broadcast(min_determinant), determinant);
+      Lanes inverse_determinant = Divide(one, determinant);
+      LanesVector t = Subtract(origin, Broadcast(triangle.vertex));
+      Lanes u = Multiply(Dot(t, p), inverse_determinant);
+      LanesVector q = Cross(t, edge_1);
+      Lanes v = Multiply(Dot(direction, q), inverse_determinant);
+      Lanes distance = Multiply(Dot(edge_2, q), inverse_determinant);
+      hits &= LessEqual(zero, u) & LessEqual(zero, v) & LessEqual(Add(u, v), one) &
+          Less(zero, distance) & Less(distance, max_distances);
+      occluded |= hits;
+    }
+    if (occluded == 0xF) {
+      break;
+    }
+  }
+  return occluded;
+}
+
+bool gfx::Bvh::IsOccluded(glm::vec3 origin, glm::vec3 direction, float max_distance) {
+  glm::vec3 origins[4] = {origin, origin, origin, origin};
+  glm::vec3 directions[4] = {direction, direction, direction, direction};
+  return GetOccludedRays(origins, directions, max_distance) != 0;
+}
+
+glm::vec3 gfx::Bvh::GetMin() {
+  return nodes[0].min;
+}
+
+glm::vec3 gfx::Bvh::GetMax() {
+  return nodes[0].max;
+}
+
+size_t gfx::Bvh::GetNumNodes() {
+  return nodes.size();
+}
+
+size_t gfx::Bvh::GetNumTriangles() {
+  return triangles.size();
+}
@@ -0,0 +1,216 @@
+#include "gfx/cascaded_shadow_map.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+gfx::CascadedShadowMap::CascadedShadowMap(GLuint depth_program) : shadow_map_handle{0},
+    depth_program{depth_program}, static_map_handle{0}, fbo{0}, read_fbo{0},
+    cached_light_direction{glm::vec3(0.0f, 0.0f, 0.0f)}, had_dynamic_casters{false},
+    cascades_rendered{0} {
+  for (unsigned int i = 0; i < gfx::NUM_SHADOW_CASCADES; i++) {
+    cascades[i].center = glm::vec3(0.0f, 0.0f, 0.0f);
+    cascades[i].radius = 0.0f;
+    cascades[i].valid = false;
+    cascades[i].static_signature = 0;
+  }
+}
+
+void gfx::CascadedShadowMap::Initialize() {
+  GLuint* textures[] = {&shadow_map_handle, &static_map_handle};
+  for (GLuint* texture : textures) {
+    glGenTextures(1, texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, *texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, gfx::SHADOW_MAP_SIZE,
+        gfx::SHADOW_MAP_SIZE, gfx::NUM_SHADOW_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    // Linear filtering with depth comparison gives a hardware 2x2 PCF tap.
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glGenFramebuffers(1, &fbo);
+  glGenFramebuffers(1, &read_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  glBindFramebuffer(GL_FRAMEBUFFER, read_fbo);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+}
+
+void gfx::CascadedShadowMap::ComputeSplits(float splits[gfx::NUM_SHADOW_CASCADES + 1]) {
+  // Practical split scheme: blend the logarithmic and uniform splits.
+  float near = gfx::NEAR_PLANE;
+  float far = gfx::SHADOW_DISTANCE;
+  for (unsigned int i = 0; i <= gfx::NUM_SHADOW_CASCADES; i++) {
+    float fraction = (float)i / (float)gfx::NUM_SHADOW_CASCADES;
+    float log_split = near * std::pow(far / near, fraction);
+    float uniform_split = near + (far - near) * fraction;
+    splits[i] = gfx::SHADOW_SPLIT_LAMBDA * log_split +
+        (1.0f - gfx::SHADOW_SPLIT_LAMBDA) * uniform_split;
+  }
+}
+
+bool gfx::CascadedShadowMap::Render(glm::mat4 view_transform, float fov, float aspect_ratio,
+    glm::vec3 light_direction, const std::vector<gfx::ModelInstance*>& casters) {
+  if (shadow_map_handle == 0) {
+    Initialize();
+  }
+  cascades_rendered = 0;
+  light_direction = glm::normalize(light_direction);
+  bool light_changed = light_direction != cached_light_direction;
+  cached_light_direction = light_direction;
+
+  // Hash the static casters and their revisions so we know when the static cache is stale.
+  size_t static_signature = 0;
+  bool has_dynamic_casters = false;
+  for (gfx::ModelInstance* caster : casters) {
+    if (!caster->is_static) {
+      has_dynamic_casters = true;
+      continue;
+    }
+    size_t caster_hash = std::hash<gfx::ModelInstance*>()(caster) ^
+        (std::hash<unsigned int>()(caster->GetRevision()) << 1);
+    static_signature = static_signature * 31 + caster_hash;
+  }
+
+  glm::vec3 up = std::abs(light_direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) :
+      glm::vec3(1.0f, 0.0f, 0.0f);
+  glm::mat4 light_rotation = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), light_direction, up);
+  glm::mat4 inverse_light_rotation = glm::inverse(light_rotation);
+  glm::mat4 inverse_view = glm::inverse(view_transform);
+  float tan_half_fov = std::tan(glm::radians(fov) / 2.0f);
+  float splits[gfx::NUM_SHADOW_CASCADES + 1];
+  ComputeSplits(splits);
+
+  bool transforms_changed = false;
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glViewport(0, 0, gfx::SHADOW_MAP_SIZE, gfx::SHADOW_MAP_SIZE);
+  for (unsigned int i = 0; i < gfx::NUM_SHADOW_CASCADES; i++) {
+    // Bound the frustum slice with a sphere. The radius only depends on the projection, so it is
+    // stable as the camera moves or rotates.
+    glm::vec3 corners[8];
+    glm::vec3 slice_center = glm::vec3(0.0f, 0.0f, 0.0f);
+    for (int j = 0; j < 8; j++) {
+      float distance = (j < 4) ? splits[i] : splits[i + 1];
+      float half_height = tan_half_fov * distance;
+      float half_width = half_height * aspect_ratio;
+      glm::vec4 view_corner = glm::vec4((j & 1) ? half_width : -half_width,
+          (j & 2) ? half_height : -half_height, -distance, 1.0f);
+      corners[j] = glm::vec3(inverse_view * view_corner);
+      slice_center += corners[j] / 8.0f;
+    }
+    float slice_radius = 0.0f;
+    for (int j = 0; j < 8; j++) {
+      slice_radius = std::max(slice_radius, glm::length(corners[j] - slice_center));
+    }
+    // Round up so floating point error doesn't change the projection from frame to frame.
+    slice_radius = std::ceil(slice_radius * 16.0f) / 16.0f;
+    float cascade_radius = slice_radius * gfx::SHADOW_CASCADE_PADDING;
+
+    // Only move the cascade once the slice leaves the padded region it covers. When it does,
+    // snap the new center to the texel grid in light space so static edges don't shimmer.
+    Cascade& cascade = cascades[i];
+    bool contained = cascade.valid && cascade.radius == cascade_radius &&
+        glm::length(slice_center - cascade.center) + slice_radius <= cascade_radius;
+    if (!contained || light_changed) {
+      float texel_size = 2.0f * cascade_radius / (float)gfx::SHADOW_MAP_SIZE;
+      glm::vec3 light_space_center = glm::vec3(light_rotation * glm::vec4(slice_center, 1.0f));
+      light_space_center.x = std::floor(light_space_center.x / texel_size) * texel_size;
+      light_space_center.y = std::floor(light_space_center.y / texel_size) * texel_size;
+      cascade.center = glm::vec3(inverse_light_rotation * glm::vec4(light_space_center, 1.0f));
+      cascade.radius = cascade_radius;
+      glm::mat4 light_view = glm::lookAt(cascade.center - light_direction * cascade_radius,
+          cascade.center, up);
+      glm::mat4 light_projection = glm::ortho(-cascade_radius, cascade_radius, -cascade_radius,
+          cascade_radius, 0.0f, 2.0f * cascade_radius);
+      cascade.view_projection = light_projection * light_view;
+      cascade.valid = false;
+      transforms_changed = true;
+    }
+
+    bool static_dirty = !cascade.valid || cascade.static_signature != static_signature;
+    if (static_dirty) {
+      DrawCasters(static_map_handle, i, casters, true, true);
+      cascade.valid = true;
+      cascade.static_signature = static_signature;
+      cascades_rendered++;
+    }
+    // The sampled map only needs refreshing if the cache changed or dynamic casters are (or were)
+    // drawn over it.
+    if (static_dirty || has_dynamic_casters || had_dynamic_casters) {
+      CopyStaticCache(i);
+      if (has_dynamic_casters) {
+        DrawCasters(shadow_map_handle, i, casters, false, false);
+      }
+    }
+  }
+  had_dynamic_casters = has_dynamic_casters;
+  return transforms_changed;
+}
+
+void gfx::CascadedShadowMap::DrawCasters(GLuint texture, unsigned int cascade,
+    const std::vector<gfx::ModelInstance*>& casters, bool is_static, bool clear) {
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+  if (clear) {
+    glClear(GL_DEPTH_BUFFER_BIT);
+  }
+  glUseProgram(depth_program);
+  GLint view_location = glGetUniformLocation(depth_program, "view_transform");
+  glUniformMatrix4fv(view_location, 1, GL_FALSE, glm::value_ptr(glm::mat4()));
+  GLint projection_location = glGetUniformLocation(depth_program, "projection_transform");
+  glUniformMatrix4fv(projection_location, 1, GL_FALSE,
+      glm::value_ptr(cascades[cascade].view_projection));
+
+  // Clamp casters in front of the near plane onto it instead of clipping them, and push the
+  // depths back by their slope to avoid shadow acne.
+  glEnable(GL_DEPTH_CLAMP);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.0f, 4.0f);
+  for (gfx::ModelInstance* caster : casters) {
+    if (caster->is_static == is_static) {
+      caster->DrawDepth(depth_program);
+    }
+  }
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glDisable(GL_DEPTH_CLAMP);
+}
+
+void gfx::CascadedShadowMap::CopyStaticCache(unsigned int cascade) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+  glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, static_map_handle, 0,
+      cascade);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+  glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_map_handle, 0,
+      cascade);
+  glBlitFramebuffer(0, 0, gfx::SHADOW_MAP_SIZE, gfx::SHADOW_MAP_SIZE, 0, 0, gfx::SHADOW_MAP_SIZE,
+      gfx::SHADOW_MAP_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+glm::mat4 gfx::CascadedShadowMap::GetShadowTransform(unsigned int cascade) {
+  // Map from clip space [-1, 1] into texture space [0, 1].
+  glm::mat4 bias = glm::translate(glm::mat4(), glm::vec3(0.5f, 0.5f, 0.5f));
+  bias = glm::scale(bias, glm::vec3(0.5f, 0.5f, 0.5f));
+  return bias * cascades[cascade].view_projection;
+}
+
+float gfx::CascadedShadowMap::GetTexelSize(unsigned int cascade) {
+  return 2.0f * cascades[cascade].radius / (float)gfx::SHADOW_MAP_SIZE;
+}
+
+unsigned int gfx::CascadedShadowMap::GetCascadesRendered() {
+  return cascades_rendered;
+}
+
+void gfx::CascadedShadowMap::SetDepthProgram(GLuint depth_program) {
+  this->depth_program = depth_program;
+}
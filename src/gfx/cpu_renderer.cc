@@ -0,0 +1,1156 @@
+#include "gfx/cpu_renderer.h"
+#include "gfx/exceptions.h"
+#include "gfx/game_window.h"
+#include "gfx/util.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+// A fairly granular value for Pi and the gamma for converting between linear and sRGB, as in
+// common.glsl.
+const float pi = 3.1415926535897932384626433832795f;
+const float display_gamma = 2.2f;
+
+// The positions of the samples within a pixel, in the standard 4x MSAA pattern.
+static_assert(gfx::MSAA_SAMPLES == 4, "The rasterizer covers 4 samples per pixel.");
+const double sample_x[gfx::MSAA_SAMPLES] = {0.375, 0.875, 0.125, 0.625};
+const double sample_y[gfx::MSAA_SAMPLES] = {0.125, 0.375, 0.625, 0.875};
+
+// The number of steps per pixel of the sub-pixel grid vertices are snapped to, as fine as most GPU
+// rasterizers. This keeps every edge function product exact in double precision.
+const double subpixel_steps = 256.0;
+
+// Converts a texel component to a float in the range of its format.
+float ToFloat(unsigned char value) {
+  return value / 255.0f;
+}
+
+float ToFloat(float value) {
+  return value;
+}
+
+// Averages 4 texel components for a smaller mipmap level, rounding to the texel format.
+unsigned char Average(unsigned char a, unsigned char b, unsigned char c, unsigned char d) {
+  return (unsigned char)((a + b + c + d + 2) / 4);
+}
+
+float Average(float a, float b, float c, float d) {
+  return (a + b + c + d) * 0.25f;
+}
+
+// Converts a sRGB color component into linear space.
+float SrgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+// Builds the mipmap chain of a texture from its first level by averaging 2x2 blocks of texels.
+template <typename T>
+void GenerateMipmaps(gfx::CpuTexture<T>* texture) {
+  while (texture->widths.back() > 1 || texture->heights.back() > 1) {
+    int width = texture->widths.back();
+    int height = texture->heights.back();
+    int level_width = std::max(width / 2, 1);
+    int level_height = std::max(height / 2, 1);
+    const std::vector<T>& source = texture->levels.back();
+    std::vector<T> level(level_width * level_height * 3);
+    for (int y = 0; y < level_height; y++) {
+      int y0 = std::min(y * 2, height - 1) * width;
+      int y1 = std::min(y * 2 + 1, height - 1) * width;
+      for (int x = 0; x < level_width; x++) {
+        int x0 = std::min(x * 2, width - 1);
+        int x1 = std::min(x * 2 + 1, width - 1);
+        for (int i = 0; i < 3; i++) {
+          level[(y * level_width + x) * 3 + i] = Average(source[(y0 + x0) * 3 + i],
+              source[(y0 + x1) * 3 + i], source[(y1 + x0) * 3 + i], source[(y1 + x1) * 3 + i]);
+        }
+      }
+    }
+    texture->widths.push_back(level_width);
+    texture->heights.push_back(level_height);
+    texture->levels.push_back(std::move(level));
+  }
+}
+
+// Fetches a texel of a level of a texture.
+template <typename T>
+glm::vec3 FetchTexel(const gfx::CpuTexture<T>& texture, int level, int x, int y) {
+  const T* texel = &texture.levels[level][(y * texture.widths[level] + x) * 3];
+  glm::vec3 color(ToFloat(texel[0]), ToFloat(texel[1]), ToFloat(texel[2]));
+  if (texture.convert_to_linear) {
+    color = glm::vec3(SrgbToLinear(color.x), SrgbToLinear(color.y), SrgbToLinear(color.z));
+  }
+  return color;
+}
+
+// Bilinearly samples a level of a texture. Coordinates outside [0, 1] either repeat or clamp to
+// the edge.
+template <typename T>
+glm::vec3 SampleLevel(const gfx::CpuTexture<T>& texture, int level, glm::vec2 uv, bool repeat) {
+  int width = texture.widths[level];
+  int height = texture.heights[level];
+  if (repeat) {
+    uv -= glm::floor(uv);
+  }
+  // Keep NaNs and infinities from reaching the integer conversions.
+  float x = std::isfinite(uv.x) ? glm::clamp(uv.x, -1.0f, 2.0f) * width - 0.5f : 0.0f;
+  float y = std::isfinite(uv.y) ? glm::clamp(uv.y, -1.0f, 2.0f) * height - 0.5f : 0.0f;
+  float floor_x = std::floor(x);
+  float floor_y = std::floor(y);
+  int xs[2] = {(int)floor_x, (int)floor_x + 1};
+  int ys[2] = {(int)floor_y, (int)floor_y + 1};
+  for (int i = 0; i < 2; i++) {
+    xs[i] = repeat ? (xs[i] % width + width) % width : glm::clamp(xs[i], 0, width - 1);
+    ys[i] = repeat ? (ys[i] % height + height) % height : glm::clamp(ys[i], 0, height - 1);
+  }
+  glm::vec3 bottom = glm::mix(FetchTexel(texture, level, xs[0], ys[0]),
+      FetchTexel(texture, level, xs[1], ys[0]), x - floor_x);
+  glm::vec3 top = glm::mix(FetchTexel(texture, level, xs[0], ys[1]),
+      FetchTexel(texture, level, xs[1], ys[1]), x - floor_x);
+  return glm::mix(bottom, top, y - floor_y);
+}
+
+// Samples a texture with trilinear filtering at a level of detail, magnifying the first level
+// bilinearly if the level of detail isn't positive.
+template <typename T>
+glm::vec3 SampleLod(const gfx::CpuTexture<T>& texture, glm::vec2 uv, float lod, bool repeat) {
+  int max_level = (int)texture.levels.size() - 1;
+  if (!(lod > 0.0f)) {
+    return SampleLevel(texture, 0, uv, repeat);
+  } else if (lod >= (float)max_level) {
+    return SampleLevel(texture, max_level, uv, repeat);
+  }
+  int level = (int)lod;
+  return glm::mix(SampleLevel(texture, level, uv, repeat),
+      SampleLevel(texture, level + 1, uv, repeat), lod - (float)level);
+}
+
+// Gets the equirectangular coordinates of a direction in an environment, as in lighting.glsl.
+glm::vec2 GetEnvironmentCoordinates(glm::vec3 direction) {
+  return glm::vec2((1.0f + std::atan2(direction.x, direction.z) / pi) / 2.0f,
+      std::acos(glm::clamp(direction.y, -1.0f, 1.0f)) / pi);
+}
+
+// Evaluates an edge function at the samples of the pixel at (x, y) and returns a bit per sample
+// inside the edge, which runs from (x0, y0) by (dx, dy). Samples exactly on the edge are inside
+// only for a top or left edge. Every term is exact, so the edge shared by two triangles gives
+// exactly negated results and each sample lands in exactly one of them.
+unsigned int TestEdge(double x0, double y0, double dx, double dy, bool top_left, int x, int y) {
+#if defined(__AVX__)
+  __m256d offset_x = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(x),
+      _mm256_loadu_pd(sample_x)), _mm256_set1_pd(x0));
+  __m256d offset_y = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(y),
+      _mm256_loadu_pd(sample_y)), _mm256_set1_pd(y0));
+  __m256d edge = _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(dx), offset_y),
+      _mm256_mul_pd(_mm256_set1_pd(dy), offset_x));
+  __m256d inside = top_left ? _mm256_cmp_pd(edge, _mm256_setzero_pd(), _CMP_GE_OQ) :
+      _mm256_cmp_pd(edge, _mm256_setzero_pd(), _CMP_GT_OQ);
+  return (unsigned int)_mm256_movemask_pd(inside);
+#elif defined(__SSE2__)
+  unsigned int mask = 0;
+  for (int i = 0; i < 2; i++) {
+    __m128d offset_x = _mm_sub_pd(_mm_add_pd(_mm_set1_pd(x), _mm_loadu_pd(sample_x + i * 2)),
+        _mm_set1_pd(x0));
+    __m128d offset_y = _mm_sub_pd(_mm_add_pd(_mm_set1_pd(y), _mm_loadu_pd(sample_y + i * 2)),
+        _mm_set1_pd(y0));
+    __m128d edge = _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(dx), offset_y),
+        _mm_mul_pd(_mm_set1_pd(dy), offset_x));
+    __m128d inside = top_left ? _mm_cmpge_pd(edge, _mm_setzero_pd()) :
+        _mm_cmpgt_pd(edge, _mm_setzero_pd());
+    mask |= (unsigned int)_mm_movemask_pd(inside) << (i * 2);
+  }
+  return mask;
+#else
+  unsigned int mask = 0;
+  for (unsigned int i = 0; i < gfx::MSAA_SAMPLES; i++) {
+    double edge = dx * (y + sample_y[i] - y0) - dy * (x + sample_x[i] - x0);
+    if (edge > 0.0 || (top_left && edge == 0.0)) {
+      mask |= 1 << i;
+    }
+  }
+  return mask;
+#endif
+}
+
+// Computes the depths of the samples of the pixel at (x, y) on a triangle's depth plane, which is
+// depth at (x0, y0) with the derivatives depth_dx and depth_dy. Returns a bit per sample in mask
+// whose depth is nearer than the one in the depths of the pixel and not beyond the far plane, and
+// writes the sample depths to sample_depths.
+unsigned int TestDepth(double depth, double depth_dx, double depth_dy, double x0, double y0, int x,
+    int y, unsigned int mask, const double* depths, double* sample_depths) {
+#if defined(__AVX__)
+  __m256d offset_x = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(x),
+      _mm256_loadu_pd(sample_x)), _mm256_set1_pd(x0));
+  __m256d offset_y = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(y),
+      _mm256_loadu_pd(sample_y)), _mm256_set1_pd(y0));
+  __m256d sample_depth = _mm256_add_pd(_mm256_add_pd(_mm256_set1_pd(depth),
+      _mm256_mul_pd(_mm256_set1_pd(depth_dx), offset_x)),
+      _mm256_mul_pd(_mm256_set1_pd(depth_dy), offset_y));
+  __m256d passes = _mm256_and_pd(_mm256_cmp_pd(sample_depth, _mm256_loadu_pd(depths),
+      _CMP_LT_OQ), _mm256_cmp_pd(sample_depth, _mm256_set1_pd(1.0), _CMP_LE_OQ));
+  _mm256_storeu_pd(sample_depths, sample_depth);
+  return mask & (unsigned int)_mm256_movemask_pd(passes);
+#elif defined(__SSE2__)
+  unsigned int passed = 0;
+  for (int i = 0; i < 2; i++) {
+    __m128d offset_x = _mm_sub_pd(_mm_add_pd(_mm_set1_pd(x), _mm_loadu_pd(sample_x + i * 2)),
+        _mm_set1_pd(x0));
+    __m128d offset_y = _mm_sub_pd(_mm_add_pd(_mm_set1_pd(y), _mm_loadu_pd(sample_y + i * 2)),
+        _mm_set1_pd(y0));
+    __m128d sample_depth = _mm_add_pd(_mm_add_pd(_mm_set1_pd(depth),
+        _mm_mul_pd(_mm_set1_pd(depth_dx), offset_x)),
+        _mm_mul_pd(_mm_set1_pd(depth_dy), offset_y));
+    __m128d passes = _mm_and_pd(_mm_cmplt_pd(sample_depth, _mm_loadu_pd(depths + i * 2)),
+        _mm_cmple_pd(sample_depth, _mm_set1_pd(1.0)));
+    _mm_storeu_pd(sample_depths + i * 2, sample_depth);
+    passed |= (unsigned int)_mm_movemask_pd(passes) << (i * 2);
+  }
+  return mask & passed;
+#else
+  unsigned int passed = 0;
+  for (unsigned int i = 0; i < gfx::MSAA_SAMPLES; i++) {
+    sample_depths[i] = depth + depth_dx * (x + sample_x[i] - x0) +
+        depth_dy * (y + sample_y[i] - y0);
+    if (sample_depths[i] < depths[i] && sample_depths[i] <= 1.0) {
+      passed |= 1 << i;
+    }
+  }
+  return mask & passed;
+#endif
+}
+
+// Computes the perspective correct barycentric weights of a triangle's vertices at 4 points at
+// once, given the window space positions of the vertices, twice the triangle's area, and the
+// reciprocals of the vertices' clip space w. The weights are written by vertex, then by point.
+void GetWeights(const double vertex_x[3], const double vertex_y[3], double area,
+    const float inverse_w[3], const double point_x[4], const double point_y[4],
+    float weights[3][4]) {
+#if defined(__SSE2__)
+  __m128 vertex_weights[3];
+  __m128 sum = _mm_setzero_ps();
+  for (int i = 0; i < 3; i++) {
+    int from = (i + 1) % 3;
+    int to = (i + 2) % 3;
+#if defined(__AVX__)
+    __m256d edge = _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(vertex_x[to] - vertex_x[from]),
+        _mm256_sub_pd(_mm256_loadu_pd(point_y), _mm256_set1_pd(vertex_y[from]))),
+        _mm256_mul_pd(_mm256_set1_pd(vertex_y[to] - vertex_y[from]),
+        _mm256_sub_pd(_mm256_loadu_pd(point_x), _mm256_set1_pd(vertex_x[from]))));
+    __m128 ratio = _mm256_cvtpd_ps(_mm256_div_pd(edge, _mm256_set1_pd(area)));
+#else
+    __m128 ratios[2];
+    for (int j = 0; j < 2; j++) {
+      __m128d edge = _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(vertex_x[to] - vertex_x[from]),
+          _mm_sub_pd(_mm_loadu_pd(point_y + j * 2), _mm_set1_pd(vertex_y[from]))),
+          _mm_mul_pd(_mm_set1_pd(vertex_y[to] - vertex_y[from]),
+          _mm_sub_pd(_mm_loadu_pd(point_x + j * 2), _mm_set1_pd(vertex_x[from]))));
+      ratios[j] = _mm_cvtpd_ps(_mm_div_pd(edge, _mm_set1_pd(area)));
+    }
+    __m128 ratio = _mm_movelh_ps(ratios[0], ratios[1]);
+#endif
+    vertex_weights[i] = _mm_mul_ps(ratio, _mm_set1_ps(inverse_w[i]));
+    sum = _mm_add_ps(sum, vertex_weights[i]);
+  }
+  for (int i = 0; i < 3; i++) {
+    _mm_storeu_ps(weights[i], _mm_div_ps(vertex_weights[i], sum));
+  }
+#else
+  for (int j = 0; j < 4; j++) {
+    float sum = 0.0f;
+    for (int i = 0; i < 3; i++) {
+      int from = (i + 1) % 3;
+      int to = (i + 2) % 3;
+      double edge = (vertex_x[to] - vertex_x[from]) * (point_y[j] - vertex_y[from]) -
+          (vertex_y[to] - vertex_y[from]) * (point_x[j] - vertex_x[from]);
+      weights[i][j] = (float)(edge / area) * inverse_w[i];
+      sum += weights[i][j];
+    }
+    for (int i = 0; i < 3; i++) {
+      weights[i][j] /= sum;
+    }
+  }
+#endif
+}
+
+// Interpolates a texture coordinate of a triangle's vertices at 4 points at once with the
+// weights from GetWeights, writing the u and v of each point.
+void InterpolateUv(const glm::vec2 vertex_uv[3], const float weights[3][4], float u[4],
+    float v[4]) {
+#if defined(__SSE2__)
+  __m128 sum_u = _mm_setzero_ps();
+  __m128 sum_v = _mm_setzero_ps();
+  for (int i = 0; i < 3; i++) {
+    __m128 weight = _mm_loadu_ps(weights[i]);
+    sum_u = _mm_add_ps(sum_u, _mm_mul_ps(_mm_set1_ps(vertex_uv[i].x), weight));
+    sum_v = _mm_add_ps(sum_v, _mm_mul_ps(_mm_set1_ps(vertex_uv[i].y), weight));
+  }
+  _mm_storeu_ps(u, sum_u);
+  _mm_storeu_ps(v, sum_v);
+#else
+  for (int j = 0; j < 4; j++) {
+    u[j] = 0.0f;
+    v[j] = 0.0f;
+    for (int i = 0; i < 3; i++) {
+      u[j] += vertex_uv[i].x * weights[i][j];
+      v[j] += vertex_uv[i].y * weights[i][j];
+    }
+  }
+#endif
+}
+
+// The functions below port lighting.glsl. Powers with small integer exponents are multiplied
+// out, which is what GLSL compilers do with them as well.
+
+float ClampedCosine(glm::vec3 a, glm::vec3 b) {
+  return std::min(std::max(glm::dot(a, b), 0.0f), 1.0f);
+}
+
+float NormalDistributionFunction(glm::vec3 normal, glm::vec3 halfway, float roughness) {
+  float alpha_2 = roughness * roughness * roughness * roughness;
+  float cosine = glm::dot(normal, halfway);
+  float denominator = cosine * cosine * (alpha_2 - 1.0f) + 1.0f;
+  return alpha_2 / (pi * denominator * denominator);
+}
+
+float GetGeometricAttenuation(glm::vec3 direction, glm::vec3 view, glm::vec3 normal,
+    float roughness) {
+  float k = (roughness + 1.0f) * (roughness + 1.0f) / 8.0f;
+  float g1l = glm::dot(normal, direction) / (glm::dot(normal, direction) * (1.0f - k) + k);
+  float g1v = glm::dot(normal, view) / (glm::dot(normal, view) * (1.0f - k) + k);
+  return g1l * g1v;
+}
+
+glm::vec3 GetFresnel(glm::vec3 view, glm::vec3 halfway, glm::vec3 f0) {
+  float dot_vh = glm::dot(view, halfway);
+  return f0 + (glm::vec3(1.0f) - f0) * std::exp2((-5.55473f * dot_vh - 6.98316f) * dot_vh);
+}
+
+// Gets the light reflected towards the camera from a light shining from reversed_direction. This
+// mixes the dielectric and metallic contributions of get_light_contribution, which only differ in
+// the diffuse term and Fresnel.
+glm::vec3 GetLightContribution(glm::vec3 position, glm::vec3 camera_position, glm::vec3 albedo,
+    float metallic, float roughness, glm::vec3 normal, glm::vec3 incoming_irradiance,
+    glm::vec3 reversed_direction) {
+  glm::vec3 view = glm::normalize(camera_position - position);
+  glm::vec3 halfway = glm::normalize(reversed_direction + view);
+  float d = NormalDistributionFunction(normal, halfway, roughness);
+  float g = GetGeometricAttenuation(reversed_direction, view, normal, roughness);
+  float specular = (d * g) / (glm::dot(normal, reversed_direction) * glm::dot(normal, view));
+  glm::vec3 dielectric = albedo / pi + GetFresnel(view, halfway, glm::vec3(0.04f)) * specular;
+  glm::vec3 metal = GetFresnel(view, halfway, albedo) * specular;
+  return glm::mix(dielectric, metal, metallic) * incoming_irradiance;
+}
+
+// Integrates the clamped cosine over the edge of a spherical polygon like integrate_ltc_edge.
+glm::vec3 IntegrateLtcEdge(glm::vec3 v1, glm::vec3 v2) {
+  float x = glm::dot(v1, v2);
+  float y = std::abs(x);
+  float a = 0.8543985f + (0.4965155f + 0.0145206f * y) * y;
+  float b = 3.4175940f + (4.1616724f + y) * y;
+  float v = a / b;
+  float theta_sin_theta = x > 0.0f ? v : 0.5f / std::sqrt(std::max(1.0f - x * x, 1e-7f)) - v;
+  return glm::cross(v1, v2) * theta_sin_theta;
+}
+
+// Integrates the clamped cosine over an area light after transforming it by a matrix like
+// integrate_ltc, looking the horizon clipping up in the table.
+float IntegrateLtc(gfx::LtcTable* table, const glm::mat3& transform, const gfx::AreaLight& light,
+    glm::vec3 center, bool front) {
+  if (light.shape == gfx::RectangleLight) {
+    glm::vec3 corners[4] = {center - light.right - light.up, center - light.right + light.up,
+        center + light.right + light.up, center + light.right - light.up};
+    for (glm::vec3& corner : corners) {
+      corner = glm::normalize(transform * corner);
+    }
+    glm::vec3 form_factor(0.0f);
+    for (int i = 0; i < 4; i++) {
+      form_factor += IntegrateLtcEdge(corners[i], corners[(i + 1) % 4]);
+    }
+    float length = glm::length(form_factor);
+    if (!(length > 0.0f)) {
+      return 0.0f;
+    }
+    float z = form_factor.z / length;
+    return length * table->GetHorizonScale(front ? z : -z, length);
+  }
+
+  // Find the axes of the ellipse, then the ellipse's center in the frame of its axes, scaled by
+  // its distance.
+  glm::vec3 c = transform * center;
+  glm::vec3 v1 = transform * light.right;
+  glm::vec3 v2 = transform * light.up;
+  float d11 = glm::dot(v1, v1);
+  float d22 = glm::dot(v2, v2);
+  float d12 = glm::dot(v1, v2);
+  float a, b;
+  if (std::abs(d12) > 0.0001f * std::sqrt(d11 * d22)) {
+    float trace = d11 + d22;
+    float determinant = std::sqrt(std::max(d11 * d22 - d12 * d12, 0.0f));
+    float u = 0.5f * std::sqrt(std::max(trace - 2.0f * determinant, 0.0f));
+    float v = 0.5f * std::sqrt(trace + 2.0f * determinant);
+    float e_max = (u + v) * (u + v);
+    float e_min = (u - v) * (u - v);
+    glm::vec3 axis_1, axis_2;
+    if (d11 > d22) {
+      axis_1 = v1 * d12 + v2 * (e_max - d11);
+      axis_2 = v1 * d12 + v2 * (e_min - d11);
+    } else {
+      axis_1 = v2 * d12 + v1 * (e_max - d22);
+      axis_2 = v2 * d12 + v1 * (e_min - d22);
+    }
+    a = 1.0f / e_max;
+    b = 1.0f / e_min;
+    v1 = glm::normalize(axis_1);
+    v2 = glm::normalize(axis_2);
+  } else {
+    a = 1.0f / d11;
+    b = 1.0f / d22;
+    v1 *= std::sqrt(a);
+    v2 *= std::sqrt(b);
+  }
+  glm::vec3 v3 = glm::cross(v1, v2);
+  if (glm::dot(c, v3) < 0.0f) {
+    v3 = -v3;
+  }
+  float distance = glm::dot(v3, c);
+  if (!(distance > 0.0f)) {
+    return 0.0f;
+  }
+  float x0 = glm::dot(v1, c) / distance;
+  float y0 = glm::dot(v2, c) / distance;
+  a *= distance * distance;
+  b *= distance * distance;
+
+  // Find the cone's negative eigenvalue with a safeguarded Newton method.
+  float k = 1.0f + x0 * x0 + y0 * y0;
+  float trace = a * (1.0f + x0 * x0) + b * (1.0f + y0 * y0) - 1.0f;
+  float low = -1.0f;
+  float high = -1.0f / k;
+  float e = high;
+  for (int i = 0; i < gfx::LTC_DISK_ITERATIONS; i++) {
+    float f = a * b * (1.0f + k * e) - (a + b) * e - (trace - e) * e * e;
+    float slope = a * b * k - (a + b) - (2.0f * trace - 3.0f * e) * e;
+    if (f > 0.0f) {
+      high = e;
+    } else {
+      low = e;
+    }
+    float next = e - f / slope;
+    e = next > low && next < high ? next : 0.5f * (low + high);
+  }
+  // The form factor only depends on the product and sum of the two positive eigenvalues.
+  float product = -a * b / e;
+  float sum = trace - e;
+  float form_factor = -e / std::sqrt(product - e * sum + e * e);
+  glm::vec3 direction = glm::normalize(v1 * (a * x0 / (a - e)) + v2 * (b * y0 / (b - e)) + v3);
+  return form_factor * table->GetHorizonScale(direction.z, form_factor);
+}
+
+// Gets the light reflected towards the camera from an area light like
+// get_area_light_contribution.
+glm::vec3 GetAreaLightContribution(gfx::LtcTable* table, const gfx::AreaLight& light,
+    glm::vec3 position, glm::vec3 camera_position, glm::vec3 albedo, float metallic,
+    float roughness, glm::vec3 normal) {
+  glm::vec3 center = light.position - position;
+  bool front = glm::dot(center, glm::cross(light.right, light.up)) < 0.0f;
+  if (!front && !light.two_sided) {
+    return glm::vec3(0.0f);
+  }
+
+  // Build a frame with the normal along z and the view in the xz plane.
+  glm::vec3 view = glm::normalize(camera_position - position);
+  glm::vec3 tangent = view - normal * glm::dot(view, normal);
+  if (glm::dot(tangent, tangent) < 1e-8f) {
+    glm::vec3 up = std::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) :
+        glm::vec3(1.0f, 0.0f, 0.0f);
+    tangent = glm::cross(up, normal);
+  }
+  tangent = glm::normalize(tangent);
+  glm::mat3 frame = glm::transpose(glm::mat3(tangent, glm::cross(normal, tangent), normal));
+
+  glm::mat3 inverse_transform;
+  glm::vec2 amplitudes;
+  table->Sample(roughness, glm::dot(normal, view), &inverse_transform, &amplitudes);
+  float diffuse = IntegrateLtc(table, frame, light, center, front);
+  float specular = IntegrateLtc(table, inverse_transform * frame, light, center, front);
+  glm::vec3 dielectric = albedo * diffuse +
+      glm::vec3(specular * (0.04f * amplitudes.x + 0.96f * amplitudes.y));
+  glm::vec3 metal = (albedo * amplitudes.x + (glm::vec3(1.0f) - albedo) * amplitudes.y) * specular;
+  return glm::mix(dielectric, metal, metallic) * light.irradiance;
+}
+
+glm::vec3 GetIblSampleContribution(const gfx::CpuTexture<float>& environment,
+    glm::vec3 position, glm::vec3 camera_position, glm::vec2 hammersley, float roughness,
+    glm::vec3 normal, glm::vec3 albedo, float metallic) {
+  float alpha = roughness * roughness;
+  float theta = std::atan((alpha * std::sqrt(hammersley.x)) / std::sqrt(1.0f - hammersley.x));
+  float phi = 2.0f * pi * hammersley.y;
+  glm::vec3 h_tangent(std::cos(phi) * std::sin(theta), std::sin(phi) * std::sin(theta),
+      std::cos(theta));
+
+  glm::vec3 up = std::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) :
+      glm::vec3(1.0f, 0.0f, 0.0f);
+  glm::vec3 tangent_x = glm::normalize(glm::cross(up, normal));
+  glm::vec3 tangent_y = glm::cross(normal, tangent_x);
+  glm::vec3 h = glm::normalize(tangent_x * h_tangent.x + tangent_y * h_tangent.y +
+      normal * h_tangent.z);
+
+  glm::vec3 v = glm::normalize(camera_position - position);
+  glm::vec3 l = glm::normalize(h * (2.0f * std::abs(glm::dot(h, v))) - v);
+  if (ClampedCosine(normal, l) > 0.0f) {
+    glm::vec3 sample_color = SampleLod(environment, GetEnvironmentCoordinates(l),
+        glm::mix(6.0f, 0.0f, metallic), false);
+    glm::vec3 f0 = glm::mix(glm::vec3(0.04f), albedo, metallic);
+    glm::vec3 f = GetFresnel(v, h, f0);
+    float g = GetGeometricAttenuation(l, v, normal, roughness);
+    return (f * g * sample_color * ClampedCosine(v, h)) /
+        (ClampedCosine(normal, h) * ClampedCosine(normal, v));
+  }
+  return glm::vec3(0.0f);
+}
+
+// Tone maps a HDR color with the Reinhard operator.
+glm::vec3 ReinhardMap(glm::vec3 hdr_color) {
+  return hdr_color / (hdr_color + glm::vec3(1.0f));
+}
+
+// Converts a color component to 8 bits, with NaNs turning into 0 as in OpenGL.
+unsigned char ToUnorm8(float value) {
+  return (unsigned char)(value > 0.0f ? std::min(value, 1.0f) * 255.0f + 0.5f : 0.0f);
+}
+
+}
+
+gfx::CpuRenderer::CpuRenderer(int width, int height, gfx::Camera* camera, float fov,
+    gfx::Color color, gfx::TextureManager* manager) : camera{camera}, width{width},
+    height{height}, tiles_x{(width + (int)gfx::CPU_TILE_SIZE - 1) / (int)gfx::CPU_TILE_SIZE},
+    tiles_y{(height + (int)gfx::CPU_TILE_SIZE - 1) / (int)gfx::CPU_TILE_SIZE},
+    field_of_view{fov}, clear_color{color}, manager{manager}, job_system{nullptr},
+    directional_light{nullptr}, irradiance_volume{nullptr}, skybox_environment{nullptr},
+    queued_models(), maps(), environments(), draws(), vertices(), chunks(),
+    triangles_rasterized{0}, pixels(width * height * 4, 0) {
+  std::fill_n(point_lights, gfx::MAX_POINT_LIGHTS, nullptr);
+  std::fill_n(area_lights, gfx::MAX_AREA_LIGHTS, nullptr);
+  for (unsigned int i = 0; i < gfx::NUM_IBL_SAMPLES; i++) {
+    hammersley_points[i] = gfx::util::GetHammersleyPoint(i, gfx::NUM_IBL_SAMPLES);
+  }
+  job_system = new gfx::JobSystem(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+}
+
+gfx::CpuRenderer::~CpuRenderer() {
+  delete job_system;
+}
+
+void gfx::CpuRenderer::SetDirectionalLight(gfx::DirectionalLight* directional_light) {
+  this->directional_light = directional_light;
+}
+
+void gfx::CpuRenderer::AddPointLight(gfx::PointLight* point_light) {
+  gfx::PointLight** free_slot = nullptr;
+  for (unsigned int i = 0; i < gfx::MAX_POINT_LIGHTS; i++) {
+    if (point_lights[i] == point_light) {
+      throw gfx::InvalidLightException();
+    } else if (point_lights[i] == nullptr && free_slot == nullptr) {
+      free_slot = &point_lights[i];
+    }
+  }
+  if (free_slot == nullptr) {
+    throw gfx::TooManyLightsException();
+  }
+  *free_slot = point_light;
+}
+
+void gfx::CpuRenderer::RemovePointLight(gfx::PointLight* point_light) {
+  for (unsigned int i = 0; i < gfx::MAX_POINT_LIGHTS; i++) {
+    if (point_lights[i] == point_light) {
+      point_lights[i] = nullptr;
+      return;
+    }
+  }
+  throw gfx::InvalidLightException();
+}
+
+void gfx::CpuRenderer::AddAreaLight(gfx::AreaLight* area_light) {
+  gfx::AreaLight** free_slot = nullptr;
+  for (unsigned int i = 0; i < gfx::MAX_AREA_LIGHTS; i++) {
+    if (area_lights[i] == area_light) {
+      throw gfx::InvalidLightException();
+    } else if (area_lights[i] == nullptr && free_slot == nullptr) {
+      free_slot = &area_lights[i];
+    }
+  }
+  if (free_slot == nullptr) {
+    throw gfx::TooManyLightsException();
+  }
+  if (ltc_table == nullptr) {
+    ltc_table.reset(new gfx::LtcTable(gfx::ltc_table_path));
+  }
+  *free_slot = area_light;
+}
+
+void gfx::CpuRenderer::RemoveAreaLight(gfx::AreaLight* area_light) {
+  for (unsigned int i = 0; i < gfx::MAX_AREA_LIGHTS; i++) {
+    if (area_lights[i] == area_light) {
+      area_lights[i] = nullptr;
+      return;
+    }
+  }
+  throw gfx::InvalidLightException();
+}
+
+void gfx::CpuRenderer::SetIrradianceVolume(gfx::IrradianceVolume* irradiance_volume) {
+  this->irradiance_volume = irradiance_volume;
+}
+
+void gfx::CpuRenderer::PrepareRender(gfx::Environment* environment) {
+  skybox_environment = environment;
+  queued_models.clear();
+}
+
+void gfx::CpuRenderer::RenderModel(gfx::ModelInstance* model_instance,
+    gfx::Environment* environment) {
+  queued_models.push_back(std::make_pair(model_instance, environment));
+}
+
+const gfx::CpuTexture<unsigned char>* gfx::CpuRenderer::GetMap(GLuint handle) {
+  if (handle == 0) {
+    return nullptr;
+  }
+  auto map_it = maps.find(handle);
+  if (map_it != maps.end()) {
+    return map_it->second.get();
+  }
+
+  std::string path;
+  bool convert_to_linear;
+  if (!manager->GetTextureSource(handle, &path, &convert_to_linear)) {
+    throw gfx::CannotLoadTextureException();
+  }
+  int image_width, image_height, num_components;
+  unsigned char* image_data = gfx::TextureManager::DecodeImage(path, &image_width, &image_height,
+      &num_components);
+  if (image_data == nullptr) {
+    throw gfx::CannotLoadTextureException();
+  }
+  std::unique_ptr<gfx::CpuTexture<unsigned char>> texture(new gfx::CpuTexture<unsigned char>());
+  std::vector<unsigned char> level(image_width * image_height * 3);
+  for (int i = 0; i < image_width * image_height; i++) {
+    std::copy_n(image_data + i * num_components, 3, level.begin() + i * 3);
+  }
+  gfx::TextureManager::FreeImage(image_data);
+  texture->widths.push_back(image_width);
+  texture->heights.push_back(image_height);
+  texture->levels.push_back(std::move(level));
+  texture->convert_to_linear = convert_to_linear;
+  GenerateMipmaps(texture.get());
+  return (maps[handle] = std::move(texture)).get();
+}
+
+const gfx::CpuTexture<float>* gfx::CpuRenderer::GetEnvironment(gfx::Environment* environment) {
+  if (environment == nullptr) {
+    return nullptr;
+  }
+  auto environment_it = environments.find(environment->path);
+  if (environment_it != environments.end()) {
+    return environment_it->second.get();
+  }
+
+  int image_width, image_height, num_components;
+  float* image_data = gfx::Environment::DecodeImage(environment->path, &image_width,
+      &image_height, &num_components);
+  if (image_data == nullptr) {
+    throw gfx::CannotLoadTextureException();
+  }
+  std::unique_ptr<gfx::CpuTexture<float>> texture(new gfx::CpuTexture<float>());
+  std::vector<float> level(image_width * image_height * 3);
+  for (int i = 0; i < image_width * image_height; i++) {
+    std::copy_n(image_data + i * num_components, 3, level.begin() + i * 3);
+  }
+  gfx::Environment::FreeImage(image_data);
+  texture->widths.push_back(image_width);
+  texture->heights.push_back(image_height);
+  texture->levels.push_back(std::move(level));
+  texture->convert_to_linear = false;
+  GenerateMipmaps(texture.get());
+  return (environments[environment->path] = std::move(texture)).get();
+}
+
+void gfx::CpuRenderer::CreateDraws() {
+  draws.clear();
+  size_t num_vertices = 0;
+  size_t num_triangles = 0;
+  for (auto& queued_model : queued_models) {
+    gfx::ModelInstance* instance = queued_model.first;
+    for (gfx::Mesh& mesh : instance->GetModelInfo()->meshes) {
+      Draw draw;
+      draw.mesh = &mesh;
+      draw.model_transform = instance->GetModelTransform();
+      draw.normal_transform = instance->GetNormalTransform();
+      draw.skinning_palette = mesh.IsSkinned() ? instance->GetSkinningPalette() : nullptr;
+      const gfx::MapInfo* map_infos[5] = {&mesh.material->albedo_info,
+          &mesh.material->metallic_info, &mesh.material->roughness_info,
+          &mesh.material->normal_info, &mesh.material->ao_info};
+      for (int i = 0; i < 5; i++) {
+        draw.maps[i] = GetMap(map_infos[i]->handle);
+        draw.map_values[i] = map_infos[i]->value;
+      }
+      draw.environment = GetEnvironment(queued_model.second);
+      draw.first_vertex = num_vertices;
+      draw.first_triangle = num_triangles;
+      num_vertices += mesh.GetVertices().size();
+      num_triangles += mesh.GetIndices().size() / 3;
+      draws.push_back(draw);
+    }
+  }
+  vertices.resize(num_vertices);
+}
+
+void gfx::CpuRenderer::ShadeVertices(const glm::mat4& view_projection) {
+  job_system->ParallelFor(vertices.size(), gfx::CPU_GRAIN_SIZE,
+      [this, &view_projection](size_t begin, size_t end) {
+    // Find the draw of the first vertex, then walk through the draws in order.
+    auto draw_it = std::upper_bound(draws.begin(), draws.end(), begin,
+        [](size_t vertex, const Draw& draw) { return vertex < draw.first_vertex; }) - 1;
+    for (size_t i = begin; i < end; i++) {
+      while (i >= draw_it->first_vertex + draw_it->mesh->GetVertices().size()) {
+        ++draw_it;
+      }
+      gfx::Vertex vertex = draw_it->mesh->GetVertices()[i - draw_it->first_vertex];
+      if (draw_it->skinning_palette != nullptr) {
+        // Skin the vertex like skinning.glsl.
+        const gfx::SkinVertex& skin = draw_it->mesh->GetSkin()[i - draw_it->first_vertex];
+        glm::vec4 rows[3] = {glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f)};
+        for (unsigned int influence = 0; influence < 4; influence++) {
+          float weight = (float)skin.weights[influence] / 255.0f;
+          for (unsigned int row = 0; row < 3; row++) {
+            rows[row] += weight * draw_it->skinning_palette[skin.joints[influence] * 3 + row];
+          }
+        }
+        glm::vec4 position(vertex.position, 1.0f);
+        glm::vec4 normal(vertex.normal, 0.0f);
+        glm::vec4 tangent(vertex.tangent, 0.0f);
+        for (unsigned int row = 0; row < 3; row++) {
+          vertex.position[row] = glm::dot(rows[row], position);
+          vertex.normal[row] = glm::dot(rows[row], normal);
+          vertex.tangent[row] = glm::dot(rows[row], tangent);
+        }
+      }
+      glm::mat3 normal_transform(draw_it->normal_transform);
+      glm::vec4 world_position = draw_it->model_transform * glm::vec4(vertex.position, 1.0f);
+      ShadedVertex& shaded = vertices[i];
+      shaded.position = view_projection * world_position;
+      shaded.world_position = glm::vec3(world_position);
+      shaded.tangent = glm::normalize(normal_transform * vertex.tangent);
+      shaded.normal = glm::normalize(normal_transform * vertex.normal);
+      shaded.bitangent = glm::normalize(glm::cross(shaded.tangent, shaded.normal));
+      shaded.uv = vertex.uv;
+    }
+  });
+}
+
+void gfx::CpuRenderer::SetUpTriangles() {
+  size_t num_triangles = draws.empty() ? 0 :
+      draws.back().first_triangle + draws.back().mesh->GetIndices().size() / 3;
+  size_t num_tiles = tiles_x * tiles_y;
+  chunks.resize((num_triangles + gfx::CPU_GRAIN_SIZE - 1) / gfx::CPU_GRAIN_SIZE);
+  job_system->ParallelFor(chunks.size(), 1, [this, num_triangles, num_tiles](size_t begin,
+      size_t end) {
+    for (size_t chunk_index = begin; chunk_index < end; chunk_index++) {
+      TriangleChunk& chunk = chunks[chunk_index];
+      chunk.triangles.clear();
+      chunk.bins.resize(num_tiles);
+      for (std::vector<unsigned int>& bin : chunk.bins) {
+        bin.clear();
+      }
+
+      size_t first = chunk_index * gfx::CPU_GRAIN_SIZE;
+      size_t last = std::min(first + gfx::CPU_GRAIN_SIZE, num_triangles);
+      auto draw_it = std::upper_bound(draws.begin(), draws.end(), first,
+          [](size_t triangle, const Draw& draw) { return triangle < draw.first_triangle; }) - 1;
+      for (size_t i = first; i < last; i++) {
+        while (i >= draw_it->first_triangle + draw_it->mesh->GetIndices().size() / 3) {
+          ++draw_it;
+        }
+        const std::vector<GLuint>& indices = draw_it->mesh->GetIndices();
+        size_t index = (i - draw_it->first_triangle) * 3;
+        const ShadedVertex* triangle_vertices[3];
+        for (int j = 0; j < 3; j++) {
+          triangle_vertices[j] = &vertices[draw_it->first_vertex + indices[index + j]];
+        }
+        ClipTriangle(&*draw_it, triangle_vertices, &chunk);
+      }
+    }
+  });
+}
+
+void gfx::CpuRenderer::ClipTriangle(const Draw* draw, const ShadedVertex* triangle_vertices[3],
+    TriangleChunk* chunk) {
+  // The signed distance of each vertex to the near plane (z = -w in clip space).
+  float distances[3];
+  bool inside = true;
+  for (int i = 0; i < 3; i++) {
+    distances[i] = triangle_vertices[i]->position.z + triangle_vertices[i]->position.w;
+    inside = inside && distances[i] >= 0.0f;
+  }
+  if (inside) {
+    AddTriangle(draw, *triangle_vertices[0], *triangle_vertices[1], *triangle_vertices[2], chunk);
+    return;
+  }
+
+  // Clip the polygon against the plane, which leaves at most 4 vertices, and fan it out.
+  ShadedVertex clipped[4];
+  int num_clipped = 0;
+  for (int i = 0; i < 3; i++) {
+    int next = (i + 1) % 3;
+    if (distances[i] >= 0.0f) {
+      clipped[num_clipped++] = *triangle_vertices[i];
+    }
+    if ((distances[i] >= 0.0f) != (distances[next] >= 0.0f)) {
+      float t = distances[i] / (distances[i] - distances[next]);
+      const ShadedVertex& a = *triangle_vertices[i];
+      const ShadedVertex& b = *triangle_vertices[next];
+      ShadedVertex& vertex = clipped[num_clipped++];
+      vertex.position = glm::mix(a.position, b.position, t);
+      vertex.world_position = glm::mix(a.world_position, b.world_position, t);
+      vertex.tangent = glm::mix(a.tangent, b.tangent, t);
+      vertex.bitangent = glm::mix(a.bitangent, b.bitangent, t);
+      vertex.normal = glm::mix(a.normal, b.normal, t);
+      vertex.uv = glm::mix(a.uv, b.uv, t);
+    }
+  }
+  for (int i = 2; i < num_clipped; i++) {
+    AddTriangle(draw, clipped[0], clipped[i - 1], clipped[i], chunk);
+  }
+}
+
+void gfx::CpuRenderer::AddTriangle(const Draw* draw, const ShadedVertex& a,
+    const ShadedVertex& b, const ShadedVertex& c, TriangleChunk* chunk) {
+  Triangle triangle;
+  triangle.draw = draw;
+  triangle.vertices[0] = a;
+  triangle.vertices[1] = b;
+  triangle.vertices[2] = c;
+  double depths[3];
+  for (int i = 0; i < 3; i++) {
+    const glm::vec4& position = triangle.vertices[i].position;
+    triangle.inverse_w[i] = 1.0f / position.w;
+    glm::vec3 ndc = glm::vec3(position) * triangle.inverse_w[i];
+    // Clamp far off-screen vertices so the conversions below stay in range.
+    double x = glm::clamp((ndc.x * 0.5 + 0.5) * width, -1e6, 1e6);
+    double y = glm::clamp((ndc.y * 0.5 + 0.5) * height, -1e6, 1e6);
+    triangle.x[i] = std::round(x * subpixel_steps) / subpixel_steps;
+    triangle.y[i] = std::round(y * subpixel_steps) / subpixel_steps;
+    depths[i] = ndc.z * 0.5 + 0.5;
+  }
+
+  // Make the winding counter-clockwise so the edge functions are positive inside.
+  double area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+      (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+  if (!(area != 0.0)) {
+    return;
+  } else if (area < 0.0) {
+    std::swap(triangle.x[1], triangle.x[2]);
+    std::swap(triangle.y[1], triangle.y[2]);
+    std::swap(triangle.inverse_w[1], triangle.inverse_w[2]);
+    std::swap(depths[1], depths[2]);
+    std::swap(triangle.vertices[1], triangle.vertices[2]);
+    area = -area;
+  }
+  triangle.area = area;
+
+  double min_x = std::min(std::min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+  double max_x = std::max(std::max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+  double min_y = std::min(std::min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+  double max_y = std::max(std::max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+  triangle.min_x = std::max((int)std::floor(min_x), 0);
+  triangle.max_x = std::min((int)std::floor(max_x), width - 1);
+  triangle.min_y = std::max((int)std::floor(min_y), 0);
+  triangle.max_y = std::min((int)std::floor(max_y), height - 1);
+  if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y) {
+    return;
+  }
+
+  // Depth is affine in window space, so it's interpolated with a plane equation.
+  double dx1 = triangle.x[1] - triangle.x[0];
+  double dy1 = triangle.y[1] - triangle.y[0];
+  double dx2 = triangle.x[2] - triangle.x[0];
+  double dy2 = triangle.y[2] - triangle.y[0];
+  triangle.depth = depths[0];
+  triangle.depth_dx = ((depths[1] - depths[0]) * dy2 - (depths[2] - depths[0]) * dy1) / area;
+  triangle.depth_dy = ((depths[2] - depths[0]) * dx1 - (depths[1] - depths[0]) * dx2) / area;
+
+  // The interior is to the left of each counter-clockwise edge, so with y pointing up, left edges
+  // run downwards and top edges run in -x.
+  for (int i = 0; i < 3; i++) {
+    int from = (i + 1) % 3;
+    int to = (i + 2) % 3;
+    double dx = triangle.x[to] - triangle.x[from];
+    double dy = triangle.y[to] - triangle.y[from];
+    triangle.top_left[i] = dy < 0.0 || (dy == 0.0 && dx < 0.0);
+  }
+
+  unsigned int index = chunk->triangles.size();
+  chunk->triangles.push_back(triangle);
+  int tile_size = gfx::CPU_TILE_SIZE;
+  for (int tile_y = triangle.min_y / tile_size; tile_y <= triangle.max_y / tile_size; tile_y++) {
+    for (int tile_x = triangle.min_x / tile_size; tile_x <= triangle.max_x / tile_size;
+        tile_x++) {
+      chunk->bins[tile_y * tiles_x + tile_x].push_back(index);
+    }
+  }
+}
+
+glm::vec3 gfx::CpuRenderer::ShadePixel(const Triangle& triangle, int x, int y) {
+  // Interpolate at the pixel center and, since texture derivatives are taken across each 2x2 quad
+  // of pixels like on a GPU, at three pixel centers of its quad.
+  int quad_x = x & ~1;
+  int quad_y = y & ~1;
+  const double point_x[4] = {x + 0.5, quad_x + 0.5, quad_x + 1.5, quad_x + 0.5};
+  const double point_y[4] = {y + 0.5, quad_y + 0.5, quad_y + 0.5, quad_y + 1.5};
+  float weights[3][4];
+  GetWeights(triangle.x, triangle.y, triangle.area, triangle.inverse_w, point_x, point_y,
+      weights);
+  glm::vec2 vertex_uv[3];
+  glm::vec3 position(0.0f), tangent(0.0f), bitangent(0.0f), vertex_normal(0.0f);
+  for (int i = 0; i < 3; i++) {
+    const ShadedVertex& vertex = triangle.vertices[i];
+    position += vertex.world_position * weights[i][0];
+    tangent += vertex.tangent * weights[i][0];
+    bitangent += vertex.bitangent * weights[i][0];
+    vertex_normal += vertex.normal * weights[i][0];
+    vertex_uv[i] = vertex.uv;
+  }
+  float u[4];
+  float v[4];
+  InterpolateUv(vertex_uv, weights, u, v);
+  glm::vec2 uv(u[0], v[0]);
+  glm::vec2 uv_dx(u[2] - u[1], v[2] - v[1]);
+  glm::vec2 uv_dy(u[3] - u[1], v[3] - v[1]);
+
+  // Sample the material as in material.glsl.
+  const Draw& draw = *triangle.draw;
+  glm::vec3 values[5];
+  for (int i = 0; i < 5; i++) {
+    const gfx::CpuTexture<unsigned char>* map = draw.maps[i];
+    if (map == nullptr) {
+      values[i] = draw.map_values[i];
+      continue;
+    }
+    glm::vec2 size((float)map->widths[0], (float)map->heights[0]);
+    float rho = std::max(glm::length(uv_dx * size), glm::length(uv_dy * size));
+    values[i] = SampleLod(*map, uv, std::log2(rho), true);
+  }
+  glm::vec3 albedo = values[0];
+  float metallic = values[1].x;
+  float roughness = values[2].x;
+  glm::vec3 tangent_space_normal = glm::normalize(values[3] * 2.0f - glm::vec3(1.0f)) *
+      glm::vec3(1.0f, -1.0f, 1.0f);
+  glm::vec3 normal = glm::normalize(tangent * tangent_space_normal.x +
+      bitangent * tangent_space_normal.y + vertex_normal * tangent_space_normal.z);
+  glm::vec3 ao = values[4];
+
+  // Shade the surface as in shade_surface.
+  glm::vec3 camera_position = camera->camera_position;
+  glm::vec3 total_color(0.0f);
+  if (draw.environment != nullptr) {
+    for (unsigned int i = 0; i < gfx::NUM_IBL_SAMPLES; i++) {
+      total_color += GetIblSampleContribution(*draw.environment, position, camera_position,
+          hammersley_points[i], roughness, normal, albedo, metallic);
+    }
+    total_color /= (float)gfx::NUM_IBL_SAMPLES;
+  } else if (irradiance_volume == nullptr) {
+    total_color = glm::mix(albedo * 0.05f, glm::vec3(0.0f), metallic);
+  }
+  if (irradiance_volume != nullptr) {
+    total_color += glm::mix(albedo / pi * irradiance_volume->GetIrradiance(position, normal),
+        glm::vec3(0.0f), metallic);
+  }
+
+  if (directional_light != nullptr) {
+    glm::vec3 reversed_direction = -directional_light->direction;
+    glm::vec3 incoming_irradiance = directional_light->irradiance *
+        ClampedCosine(normal, reversed_direction);
+    total_color += GetLightContribution(position, camera_position, albedo, metallic, roughness,
+        normal, incoming_irradiance, reversed_direction);
+  }
+  for (unsigned int i = 0; i < gfx::MAX_POINT_LIGHTS; i++) {
+    gfx::PointLight* light = point_lights[i];
+    if (light == nullptr) {
+      continue;
+    }
+    glm::vec3 reversed_direction = glm::normalize(light->position - position);
+    float distance = glm::distance(position, light->position);
+    float ratio = distance / light->radius;
+    float window = glm::clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+    float falloff = window * window / (distance * distance + 1.0f);
+    glm::vec3 incoming_irradiance = (light->irradiance * falloff) *
+        ClampedCosine(normal, reversed_direction);
+    total_color += GetLightContribution(position, camera_position, albedo, metallic, roughness,
+        normal, incoming_irradiance, reversed_direction);
+  }
+  for (unsigned int i = 0; i < gfx::MAX_AREA_LIGHTS; i++) {
+    if (area_lights[i] != nullptr) {
+      total_color += GetAreaLightContribution(ltc_table.get(), *area_lights[i], position,
+          camera_position, albedo, metallic, roughness, normal);
+    }
+  }
+
+  // Bias AO because it will eventually be gamma corrected.
+  return total_color * glm::vec3(std::pow(ao.x, display_gamma), std::pow(ao.y, display_gamma),
+      std::pow(ao.z, display_gamma));
+}
+
+void gfx::CpuRenderer::RenderTile(int tile_x, int tile_y,
+    const glm::mat4& inverse_sky_transform) {
+  const int tile_size = gfx::CPU_TILE_SIZE;
+  const int samples = gfx::MSAA_SAMPLES;
+  int begin_x = tile_x * tile_size;
+  int begin_y = tile_y * tile_size;
+  int end_x = std::min(begin_x + tile_size, width);
+  int end_y = std::min(begin_y + tile_size, height);
+
+  // Rasterize the binned triangles in submission order into the tile's visibility buffer, which
+  // holds the depth and triangle of each sample.
+  double depths[tile_size * tile_size * samples];
+  const Triangle* visible[tile_size * tile_size * samples];
+  std::fill_n(depths, tile_size * tile_size * samples, 1.0);
+  std::fill_n(visible, tile_size * tile_size * samples, nullptr);
+  size_t tile = tile_y * tiles_x + tile_x;
+  for (const TriangleChunk& chunk : chunks) {
+    for (unsigned int index : chunk.bins[tile]) {
+      const Triangle& triangle = chunk.triangles[index];
+      int min_x = std::max(triangle.min_x, begin_x);
+      int max_x = std::min(triangle.max_x, end_x - 1);
+      int min_y = std::max(triangle.min_y, begin_y);
+      int max_y = std::min(triangle.max_y, end_y - 1);
+      for (int y = min_y; y <= max_y; y++) {
+        for (int x = min_x; x <= max_x; x++) {
+          unsigned int mask = 0xF;
+          for (int i = 0; i < 3 && mask != 0; i++) {
+            int from = (i + 1) % 3;
+            int to = (i + 2) % 3;
+            mask &= TestEdge(triangle.x[from], triangle.y[from],
+                triangle.x[to] - triangle.x[from], triangle.y[to] - triangle.y[from],
+                triangle.top_left[i], x, y);
+          }
+          if (mask == 0) {
+            continue;
+          }
+          size_t pixel = ((y - begin_y) * tile_size + (x - begin_x)) * samples;
+          double sample_depths[samples];
+          mask = TestDepth(triangle.depth, triangle.depth_dx, triangle.depth_dy, triangle.x[0],
+              triangle.y[0], x, y, mask, depths + pixel, sample_depths);
+          for (int i = 0; mask != 0; i++, mask >>= 1) {
+            if ((mask & 1) != 0) {
+              depths[pixel + i] = sample_depths[i];
+              visible[pixel + i] = &triangle;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Shade each triangle visible in a pixel once, then tone map and resolve the samples.
+  const gfx::CpuTexture<float>* sky = GetEnvironment(skybox_environment);
+  for (int y = begin_y; y < end_y; y++) {
+    for (int x = begin_x; x < end_x; x++) {
+      size_t pixel = ((y - begin_y) * tile_size + (x - begin_x)) * samples;
+      const Triangle* shaded[samples];
+      glm::vec3 colors[samples];
+      int num_shaded = 0;
+      bool has_background = false;
+      glm::vec3 background;
+      glm::vec3 resolved(0.0f);
+      for (int i = 0; i < samples; i++) {
+        const Triangle* triangle = visible[pixel + i];
+        glm::vec3 color;
+        if (triangle == nullptr) {
+          if (!has_background && sky != nullptr) {
+            glm::vec4 point = inverse_sky_transform * glm::vec4((x + 0.5f) / width * 2.0f - 1.0f,
+                (y + 0.5f) / height * 2.0f - 1.0f, 1.0f, 1.0f);
+            glm::vec3 direction = glm::normalize(glm::vec3(point) / point.w);
+            background = SampleLod(*sky, GetEnvironmentCoordinates(direction),
+                skybox_environment->skybox_blur, false);
+          } else if (!has_background) {
+            background = glm::vec3(clear_color.r, clear_color.g, clear_color.b);
+          }
+          has_background = true;
+          color = background;
+        } else {
+          int shaded_index = std::find(shaded, shaded + num_shaded, triangle) - shaded;
+          if (shaded_index == num_shaded) {
+            shaded[num_shaded] = triangle;
+            colors[num_shaded++] = ShadePixel(*triangle, x, y);
+          }
+          color = colors[shaded_index];
+        }
+        resolved += ReinhardMap(color);
+      }
+      resolved /= (float)samples;
+
+      // Gamma correct and dither as in hdr.frag.
+      float dither = (float)gfx::bayer_matrix[(y % 8) * 8 + x % 8] / 32.0f / 255.0f +
+          1.0f / 255.0f;
+      unsigned char* output = &pixels[(y * width + x) * 4];
+      for (int i = 0; i < 3; i++) {
+        output[i] = ToUnorm8(std::pow(resolved[i], 1.0f / display_gamma) + dither);
+      }
+      output[3] = 255;
+    }
+  }
+}
+
+void gfx::CpuRenderer::FinishRender() {
+  CreateDraws();
+  GetEnvironment(skybox_environment);
+  glm::mat4 view_transform = camera->GetViewTransform();
+  glm::mat4 projection = glm::perspective(glm::radians(field_of_view),
+      (float)width / (float)height, gfx::NEAR_PLANE, gfx::FAR_PLANE);
+  ShadeVertices(projection * view_transform);
+  SetUpTriangles();
+
+  glm::mat4 inverse_sky_transform = glm::inverse(projection *
+      glm::mat4(glm::mat3(view_transform)));
+  job_system->ParallelFor(tiles_x * tiles_y, 1,
+      [this, &inverse_sky_transform](size_t begin, size_t end) {
+    for (size_t tile = begin; tile < end; tile++) {
+      RenderTile(tile % tiles_x, tile / tiles_x, inverse_sky_transform);
+    }
+  });
+
+  triangles_rasterized = 0;
+  for (const TriangleChunk& chunk : chunks) {
+    triangles_rasterized += chunk.triangles.size();
+  }
+}
+
+const std::vector<unsigned char>& gfx::CpuRenderer::GetPixels() {
+  return pixels;
+}
+
+int gfx::CpuRenderer::GetWidth() {
+  return width;
+}
+
+int gfx::CpuRenderer::GetHeight() {
+  return height;
+}
+
+size_t gfx::CpuRenderer::GetTrianglesRasterized() {
+  return triangles_rasterized;
+}
+
+gfx::JobSystem* gfx::CpuRenderer::GetJobSystem() {
+  return job_system;
+}
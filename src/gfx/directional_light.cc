@@ -2,4 +2,4 @@
 #include "gfx/light.h"
 
 gfx::DirectionalLight::DirectionalLight(glm::vec3 direction, glm::vec3 irradiance) :
-    gfx::Light(irradiance), direction{direction} {}
+    gfx::Light(irradiance), direction{direction}, casts_shadows{true} {}
@@ -0,0 +1,9 @@
+#include "gfx/draw_list.h"
+
+gfx::Frustum::Frustum(glm::mat4 view_projection) {
+  glm::mat4 rows = glm::transpose(view_projection);
+  for (int i = 0; i < 6; i++) {
+    planes[i] = rows[3] + ((i % 2 == 0) ? 1.0f : -1.0f) * rows[i / 2];
+    planes[i] /= glm::length(glm::vec3(planes[i]));
+  }
+}
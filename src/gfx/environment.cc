@@ -1,15 +1,23 @@
+#include "gfx/asset_pack.h"
 #include "gfx/environment.h"
 #include "gfx/exceptions.h"
 
 #include <iostream>
 #include <stb_image.h>
 
-gfx::Environment::Environment(std::string skybox_path, float skybox_blur) : environment_handle{0},
-    skybox_blur{skybox_blur} {
+gfx::Environment::Environment(std::string skybox_path, float skybox_blur) :
+    Environment(skybox_path, skybox_blur, true) {}
+
+gfx::Environment::Environment(std::string skybox_path, float skybox_blur, bool should_upload) :
+    environment_handle{0}, path{skybox_path}, skybox_blur{skybox_blur} {
+  if (!should_upload) {
+    return;
+  }
+
   // Load the image.
   int width, height, num_components;
-  float* image_data = stbi_loadf(skybox_path.c_str(), &width, &height, &num_components, 0);
-  if (image_data == nullptr || (num_components != 3 && num_components != 4)) {
+  float* image_data = DecodeImage(skybox_path, &width, &height, &num_components);
+  if (image_data == nullptr) {
     throw gfx::CannotLoadTextureException();
   }
   GLenum image_format = num_components == 4 ? GL_RGBA : GL_RGB;
@@ -24,6 +32,29 @@ gfx::Environment::Environment(std::string skybox_path, float skybox_blur) : envi
 
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, image_format, GL_FLOAT, image_data);
   glGenerateMipmap(GL_TEXTURE_2D);
-  stbi_image_free(image_data);
+  FreeImage(image_data);
   glBindTexture(GL_TEXTURE_2D, 0);
 }
+
+float* gfx::Environment::DecodeImage(std::string path, int* width, int* height,
+    int* num_components) {
+  // Decode the image out of a mounted pack if one has it, and from the loose file otherwise.
+  gfx::AssetData asset;
+  float* image_data;
+  try {
+    image_data = gfx::AssetPack::ReadMounted(path, &asset) ?
+        stbi_loadf_from_memory(asset.data, (int)asset.size, width, height, num_components, 0) :
+        stbi_loadf(path.c_str(), width, height, num_components, 0);
+  } catch (const gfx::InvalidAssetPackException&) {
+    return nullptr;
+  }
+  if (image_data != nullptr && *num_components != 3 && *num_components != 4) {
+    stbi_image_free(image_data);
+    return nullptr;
+  }
+  return image_data;
+}
+
+void gfx::Environment::FreeImage(float* image_data) {
+  stbi_image_free(image_data);
+}
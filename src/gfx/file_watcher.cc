@@ -0,0 +1,118 @@
+#include "gfx/exceptions.h"
+#include "gfx/file_watcher.h"
+
+#ifdef GFX_INOTIFY
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <unordered_set>
+
+#ifdef GFX_INOTIFY
+
+gfx::FileWatcher::FileWatcher() : inotify_fd{-1}, watch_paths() {
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0) {
+    throw gfx::CannotWatchFilesException();
+  }
+}
+
+gfx::FileWatcher::~FileWatcher() {
+  // Closing the descriptor removes all of its watches.
+  close(inotify_fd);
+}
+
+void gfx::FileWatcher::WatchDirectory(std::string path) {
+  while (path.size() > 1 && path.back() == '/') {
+    path.pop_back();
+  }
+  AddWatch(path);
+}
+
+void gfx::FileWatcher::AddWatch(const std::string& path) {
+  int watch = inotify_add_watch(inotify_fd, path.c_str(),
+      IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+  if (watch < 0) {
+    throw gfx::CannotWatchFilesException();
+  }
+  watch_paths[watch] = path;
+
+  // Close the directory before recursing so a subdirectory that can't be watched doesn't leak it.
+  DIR* directory = opendir(path.c_str());
+  if (directory == nullptr) {
+    return;
+  }
+  std::vector<std::string> subdirectory_paths;
+  while (dirent* entry = readdir(directory)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    std::string entry_path = path + "/" + name;
+    struct stat entry_stat;
+    if (stat(entry_path.c_str(), &entry_stat) == 0 && S_ISDIR(entry_stat.st_mode)) {
+      subdirectory_paths.push_back(entry_path);
+    }
+  }
+  closedir(directory);
+  for (const std::string& subdirectory_path : subdirectory_paths) {
+    AddWatch(subdirectory_path);
+  }
+}
+
+std::vector<std::string> gfx::FileWatcher::Poll() {
+  std::vector<std::string> changed_paths;
+  std::unordered_set<std::string> seen_paths;
+  // The buffer must be aligned for inotify_event.
+  alignas(inotify_event) char buffer[4096];
+  while (true) {
+    ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      // EAGAIN means every pending event was read.
+      break;
+    }
+    for (char* cursor = buffer; cursor < buffer + length;) {
+      const inotify_event* event = reinterpret_cast<const inotify_event*>(cursor);
+      cursor += sizeof(inotify_event) + event->len;
+      auto watch_it = watch_paths.find(event->wd);
+      if (watch_it == watch_paths.end() || event->len == 0) {
+        continue;
+      }
+      std::string path = watch_it->second + "/" + event->name;
+      if (event->mask & IN_ISDIR) {
+        // Watch new subdirectories. Files written into them before the watch is added are missed.
+        // A subdirectory that can't be watched (e.g. it was already removed, or the watch limit
+        // was reached) is skipped so the changes read so far are still returned.
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+          try {
+            AddWatch(path);
+          } catch (const gfx::CannotWatchFilesException&) {
+            continue;
+          }
+        }
+      } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) &&
+          seen_paths.insert(path).second) {
+        changed_paths.push_back(path);
+      }
+    }
+  }
+  return changed_paths;
+}
+
+#else
+
+gfx::FileWatcher::FileWatcher() : inotify_fd{-1}, watch_paths() {}
+
+gfx::FileWatcher::~FileWatcher() {}
+
+void gfx::FileWatcher::WatchDirectory(std::string /* path */) {}
+
+void gfx::FileWatcher::AddWatch(const std::string& /* path */) {}
+
+std::vector<std::string> gfx::FileWatcher::Poll() {
+  return std::vector<std::string>();
+}
+
+#endif
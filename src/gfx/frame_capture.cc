@@ -0,0 +1,224 @@
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+
+#include "gfx/frame_capture.h"
+
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// Gets the bytes per pixel of the RGBA pixels read back for a format.
+size_t GetPixelSize(gfx::CaptureFormat format) {
+  return format == gfx::CapturePng ? 4 : 4 * sizeof(float);
+}
+
+}
+
+gfx::FrameCapture::FrameCapture(std::string path_prefix, gfx::CaptureFormat format) :
+    path_prefix{path_prefix}, format{format}, next_readback{0}, frames_captured{0},
+    wait_time{0.0}, stopping{false} {
+  for (unsigned int i = 0; i < gfx::CAPTURE_READBACK_FRAMES; i++) {
+    Readback& readback = readbacks[i];
+    glGenBuffers(1, &readback.buffer);
+    readback.buffer_size = 0;
+    readback.fence = nullptr;
+    readback.frame = 0;
+    readback.width = 0;
+    readback.height = 0;
+    readback.tone_mapped = false;
+  }
+  encoder = std::thread(&gfx::FrameCapture::EncodeFrames, this);
+}
+
+gfx::FrameCapture::~FrameCapture() {
+  for (unsigned int i = 0; i < gfx::CAPTURE_READBACK_FRAMES; i++) {
+    Readback& readback = readbacks[(next_readback + i) % gfx::CAPTURE_READBACK_FRAMES];
+    if (readback.fence != nullptr) {
+      Retrieve(&readback, true);
+    }
+    glDeleteBuffers(1, &readback.buffer);
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    stopping = true;
+  }
+  job_queued.notify_one();
+  encoder.join();
+}
+
+void gfx::FrameCapture::Capture(GLuint framebuffer, GLuint width, GLuint height,
+    bool tone_mapped) {
+  auto start = std::chrono::steady_clock::now();
+  // Hand the finished readbacks to the encoder oldest first. Usually only the oldest one is
+  // finished, since the GPU is a frame or two behind.
+  for (unsigned int i = 0; i < gfx::CAPTURE_READBACK_FRAMES; i++) {
+    Readback& readback = readbacks[(next_readback + i) % gfx::CAPTURE_READBACK_FRAMES];
+    if (readback.fence != nullptr && !Retrieve(&readback, false)) {
+      break;
+    }
+  }
+  // If the ring is full, block on the oldest readback so it can be reused.
+  Readback& readback = readbacks[next_readback];
+  if (readback.fence != nullptr) {
+    Retrieve(&readback, true);
+  }
+
+  // Reading into a bound pixel pack buffer makes glReadPixels return without waiting for the GPU.
+  size_t size = (size_t)width * height * GetPixelSize(format);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  if (readback.buffer_size != size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    readback.buffer_size = size;
+  }
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, format == gfx::CapturePng ? GL_UNSIGNED_BYTE :
+      GL_FLOAT, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback.frame = frames_captured++;
+  readback.width = width;
+  readback.height = height;
+  readback.tone_mapped = tone_mapped;
+  next_readback = (next_readback + 1) % gfx::CAPTURE_READBACK_FRAMES;
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  wait_time = elapsed.count();
+}
+
+gfx::CaptureFormat gfx::FrameCapture::GetFormat() {
+  return format;
+}
+
+unsigned int gfx::FrameCapture::GetFramesCaptured() {
+  return frames_captured;
+}
+
+double gfx::FrameCapture::GetWaitTime() {
+  return wait_time;
+}
+
+bool gfx::FrameCapture::Retrieve(Readback* readback, bool wait) {
+  if (glClientWaitSync(readback->fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+    if (!wait) {
+      return false;
+    }
+    while (glClientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+        gfx::CAPTURE_WAIT_TIMEOUT) == GL_TIMEOUT_EXPIRED) {}
+  }
+  glDeleteSync(readback->fence);
+  readback->fence = nullptr;
+
+  // Copy the pixels out so the buffer can be unmapped and reused right away. The encoder does all
+  // of the per-pixel work.
+  EncodeJob job;
+  job.frame = readback->frame;
+  job.width = readback->width;
+  job.height = readback->height;
+  job.tone_mapped = readback->tone_mapped;
+  job.pixels.resize(readback->buffer_size);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+  void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback->buffer_size,
+      GL_MAP_READ_BIT);
+  if (mapped != nullptr) {
+    std::memcpy(job.pixels.data(), mapped, readback->buffer_size);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (mapped == nullptr) {
+    std::cout << "Failed to map captured frame " << job.frame << "." << std::endl;
+    return true;
+  }
+  Enqueue(std::move(job));
+  return true;
+}
+
+void gfx::FrameCapture::Enqueue(EncodeJob job) {
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (encode_queue.size() >= gfx::CAPTURE_MAX_QUEUED_FRAMES) {
+      job_taken.wait(lock);
+    }
+    encode_queue.push_back(std::move(job));
+  }
+  job_queued.notify_one();
+}
+
+void gfx::FrameCapture::EncodeFrames() {
+  while (true) {
+    EncodeJob job;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      while (encode_queue.empty() && !stopping) {
+        job_queued.wait(lock);
+      }
+      if (encode_queue.empty()) {
+        return;
+      }
+      job = std::move(encode_queue.front());
+      encode_queue.pop_front();
+    }
+    job_taken.notify_one();
+    Encode(job);
+  }
+}
+
+void gfx::FrameCapture::Encode(const EncodeJob& job) {
+  std::ostringstream path;
+  path << path_prefix << std::setw(gfx::CAPTURE_FRAME_DIGITS) << std::setfill('0') << job.frame <<
+      (format == gfx::CapturePng ? ".png" : ".pfm");
+  size_t num_pixels = (size_t)job.width * job.height;
+
+  if (format == gfx::CapturePng) {
+    // Drop the alpha, which the default framebuffer may not store, and flip the rows top to
+    // bottom.
+    std::vector<unsigned char> rgb(num_pixels * 3);
+    for (GLuint y = 0; y < job.height; y++) {
+      const unsigned char* source = &job.pixels[(size_t)(job.height - 1 - y) * job.width * 4];
+      unsigned char* destination = &rgb[(size_t)y * job.width * 3];
+      for (GLuint x = 0; x < job.width; x++) {
+        destination[x * 3] = source[x * 4];
+        destination[x * 3 + 1] = source[x * 4 + 1];
+        destination[x * 3 + 2] = source[x * 4 + 2];
+      }
+    }
+    if (!stbi_write_png(path.str().c_str(), job.width, job.height, 3, rgb.data(),
+        job.width * 3)) {
+      std::cout << "Failed to write captured frame \'" << path.str() << "\'." << std::endl;
+    }
+    return;
+  }
+
+  // Portable Float Maps store the rows bottom to top like OpenGL, and a negative scale marks
+  // little endian floats.
+  std::vector<float> rgb(num_pixels * 3);
+  const float* source = (const float*)job.pixels.data();
+  for (size_t i = 0; i < num_pixels * 3; i++) {
+    float value = source[i / 3 * 4 + i % 3];
+    if (job.tone_mapped) {
+      // Invert the Reinhard tone mapping. Values at 1 would be infinite, so they're clamped to
+      // the largest value a half float history can tell apart from 1.
+      value = std::min(std::max(value, 0.0f), 0.9995f);
+      value = value / (1.0f - value);
+    }
+    rgb[i] = value;
+  }
+  uint16_t endian_probe = 1;
+  bool little_endian = *(unsigned char*)&endian_probe == 1;
+  std::ofstream ofs(path.str(), std::ios::binary);
+  ofs << "PF\n" << job.width << " " << job.height << "\n" << (little_endian ? "-1.0" : "1.0") <<
+      "\n";
+  ofs.write((const char*)rgb.data(), rgb.size() * sizeof(float));
+  if (!ofs) {
+    std::cout << "Failed to write captured frame \'" << path.str() << "\'." << std::endl;
+  }
+}
@@ -1,43 +1,231 @@
+#include "gfx/draw_list.h"
 #include "gfx/exceptions.h"
 #include "gfx/game_window.h"
+#include "gfx/util.h"
 
 #include <glad/glad.h>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
+
+namespace {
+
+// The names of the render targets and passes of each level of the downsample and upsample chains.
+const char* const downsample_names[] = {"Downsample 1", "Downsample 2", "Downsample 3",
+    "Downsample 4", "Downsample 5", "Downsample 6"};
+const char* const upsample_names[] = {"Upsample 1", "Upsample 2", "Upsample 3", "Upsample 4",
+    "Upsample 5", "Upsample 6"};
+static_assert(sizeof(downsample_names) / sizeof(downsample_names[0]) == gfx::DOWNSAMPLE_LEVELS &&
+    sizeof(upsample_names) / sizeof(upsample_names[0]) == gfx::DOWNSAMPLE_LEVELS,
+    "There must be a name for each level of the downsample chain.");
+
+// Copies the value of a uniform of one program to a uniform of the same type in the currently
+// bound program.
+void CopyUniform(GLuint source, GLint source_location, GLint destination_location, GLenum type) {
+  GLfloat floats[16];
+  GLint ints[4];
+  GLuint uints[4];
+  switch (type) {
+    case GL_FLOAT:
+    case GL_FLOAT_VEC2:
+    case GL_FLOAT_VEC3:
+    case GL_FLOAT_VEC4:
+    case GL_FLOAT_MAT3:
+    case GL_FLOAT_MAT4:
+      glGetUniformfv(source, source_location, floats);
+      break;
+    case GL_UNSIGNED_INT:
+    case GL_UNSIGNED_INT_VEC2:
+    case GL_UNSIGNED_INT_VEC3:
+    case GL_UNSIGNED_INT_VEC4:
+      glGetUniformuiv(source, source_location, uints);
+      break;
+    default:
+      // Ints, bools, and samplers.
+      glGetUniformiv(source, source_location, ints);
+      break;
+  }
+  switch (type) {
+    case GL_FLOAT: glUniform1fv(destination_location, 1, floats); break;
+    case GL_FLOAT_VEC2: glUniform2fv(destination_location, 1, floats); break;
+    case GL_FLOAT_VEC3: glUniform3fv(destination_location, 1, floats); break;
+    case GL_FLOAT_VEC4: glUniform4fv(destination_location, 1, floats); break;
+    case GL_FLOAT_MAT3: glUniformMatrix3fv(destination_location, 1, GL_FALSE, floats); break;
+    case GL_FLOAT_MAT4: glUniformMatrix4fv(destination_location, 1, GL_FALSE, floats); break;
+    case GL_UNSIGNED_INT: glUniform1uiv(destination_location, 1, uints); break;
+    case GL_UNSIGNED_INT_VEC2: glUniform2uiv(destination_location, 1, uints); break;
+    case GL_UNSIGNED_INT_VEC3: glUniform3uiv(destination_location, 1, uints); break;
+    case GL_UNSIGNED_INT_VEC4: glUniform4uiv(destination_location, 1, uints); break;
+    case GL_INT_VEC2: case GL_BOOL_VEC2: glUniform2iv(destination_location, 1, ints); break;
+    case GL_INT_VEC3: case GL_BOOL_VEC3: glUniform3iv(destination_location, 1, ints); break;
+    case GL_INT_VEC4: case GL_BOOL_VEC4: glUniform4iv(destination_location, 1, ints); break;
+    default: glUniform1iv(destination_location, 1, ints); break;
+  }
+}
+
+// Copies the uniform values and uniform block bindings of a program to a relinked version of it,
+// leaving the relinked program bound. Uniforms that only one of them has are skipped.
+void CopyProgramState(GLuint source, GLuint destination) {
+  glUseProgram(destination);
+  GLint num_uniforms = 0;
+  glGetProgramiv(source, GL_ACTIVE_UNIFORMS, &num_uniforms);
+  for (GLuint i = 0; i < (GLuint)num_uniforms; i++) {
+    GLchar name_buffer[256];
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(source, i, sizeof(name_buffer), nullptr, &size, &type, name_buffer);
+    // Arrays are listed once, as their first element.
+    std::string name = name_buffer;
+    if (size > 1 && name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+      name.resize(name.size() - 3);
+    }
+    for (GLint element = 0; element < size; element++) {
+      std::string element_name = size > 1 ? name + "[" + std::to_string(element) + "]" : name;
+      // Uniforms in blocks have no location.
+      GLint source_location = glGetUniformLocation(source, element_name.c_str());
+      GLint destination_location = glGetUniformLocation(destination, element_name.c_str());
+      if (source_location >= 0 && destination_location >= 0) {
+        CopyUniform(source, source_location, destination_location, type);
+      }
+    }
+  }
+
+  GLint num_blocks = 0;
+  glGetProgramiv(source, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+  for (GLuint i = 0; i < (GLuint)num_blocks; i++) {
+    GLchar name[256];
+    GLint binding = 0;
+    glGetActiveUniformBlockName(source, i, sizeof(name), nullptr, name);
+    glGetActiveUniformBlockiv(source, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+    GLuint index = glGetUniformBlockIndex(destination, name);
+    if (index != GL_INVALID_INDEX) {
+      glUniformBlockBinding(destination, index, binding);
+    }
+  }
+}
+
+}
 
 gfx::GameWindow::GameWindow(int width, int height, std::string main_vertex_path,
     std::string main_fragment_path, std::string hdr_vertex_path, std::string hdr_fragment_path,
     std::string skybox_vertex_path, std::string skybox_fragment_path, gfx::Camera* camera,
-    float fov, gfx::Color color) : camera{camera}, window{nullptr}, field_of_view{fov}, program{0},
-    vp_width{0}, vp_height{0}, hdr_program{0}, skybox_program{0}, multisampled_hdr_fbo{0},
-    multisampled_hdr_color_buffer{0}, matrix_handle{0}, draw_quad{nullptr}, quad_vertices{nullptr},
-    quad_elements{nullptr}, skybox_mesh{nullptr}, skybox_vertices{nullptr},
-    skybox_elements{nullptr}, directional_light{nullptr} {
+    float fov, gfx::Color color, gfx::AntiAliasingMode anti_aliasing_mode,
+    gfx::ContextMode context_mode) : camera{camera}, window{nullptr}, field_of_view{fov},
+    program{0}, clear_color{color}, vp_width{0}, vp_height{0}, hdr_program{0}, skybox_program{0},
+    render_mode{gfx::Forward}, anti_aliasing_mode{anti_aliasing_mode},
+    context_mode{context_mode}, headless_context{nullptr}, headless_closed{false},
+    num_samples{anti_aliasing_mode == gfx::TAA ? 1 : gfx::MSAA_SAMPLES}, gbuffer_program{0},
+    deferred_program{0}, deferred_edges_program{0}, skybox_environment{nullptr}, depth_program{0},
+    depth_prepass_enabled{false}, shadow_map{nullptr}, point_shadow_atlas{nullptr},
+    irradiance_volume{nullptr}, ltc_table{nullptr}, current_query{0}, shaded_sample_count{0},
+    deferred_environment{nullptr}, render_graph{nullptr}, hdr_color_target{0}, motion_target{0},
+    hdr_pass{0}, taa_program{0}, taa_history_index{0},
+    taa_history_valid{false}, frame_index{0}, dynamic_resolution_enabled{false},
+    target_frame_time{0.0}, resolution_scale{1.0f}, render_width{0}, render_height{0},
+    auto_exposure_enabled{false}, bloom_enabled{false}, downsample_resolve_program{0},
+    downsample_program{0}, upsample_program{0}, exposure_program{0}, exposure_index{0},
+    exposure_valid{false}, previous_frame_time{0.0}, profiler{nullptr}, stream_buffer{nullptr},
+    job_system{nullptr}, frame_capture{nullptr},
+    capture_pass{0}, matrix_handle{0},
+    draw_quad{nullptr}, quad_vertices{nullptr}, quad_elements{nullptr}, skybox_mesh{nullptr},
+    skybox_vertices{nullptr}, skybox_elements{nullptr}, directional_light{nullptr} {
   for (unsigned int i = 0; i < gfx::MAX_POINT_LIGHTS; i++) {
     point_lights[i] = nullptr;
   }
+  for (unsigned int i = 0; i < gfx::MAX_AREA_LIGHTS; i++) {
+    area_lights[i] = nullptr;
+  }
+  for (unsigned int i = 0; i < 2; i++) {
+    taa_history_buffers[i] = 0;
+    taa_history_fbos[i] = 0;
+    exposure_buffers[i] = 0;
+    exposure_fbos[i] = 0;
+  }
+  for (unsigned int i = 0; i < 4; i++) {
+    gbuffer_targets[i] = 0;
+  }
+  for (unsigned int i = 0; i < gfx::DOWNSAMPLE_LEVELS; i++) {
+    downsample_targets[i] = 0;
+    upsample_targets[i] = 0;
+  }
   gfx::GameWindow::InitializeGameWindow(width, height, color);
   program = gfx::GameWindow::LinkProgram(main_vertex_path, main_fragment_path);
   hdr_program = gfx::GameWindow::LinkProgram(hdr_vertex_path, hdr_fragment_path);
   skybox_program = gfx::GameWindow::LinkProgram(skybox_vertex_path, skybox_fragment_path);
-  if (program == 0 || hdr_program == 0 || skybox_program == 0) {
+  gbuffer_program = gfx::GameWindow::LinkProgram(main_vertex_path,
+      gfx::shaders_path + "/gbuffer.frag");
+  deferred_program = gfx::GameWindow::LinkProgram(hdr_vertex_path,
+      gfx::shaders_path + "/deferred.frag");
+  deferred_edges_program = gfx::GameWindow::LinkProgram(hdr_vertex_path,
+      gfx::shaders_path + "/deferred_edges.frag");
+  depth_program = gfx::GameWindow::LinkProgram(gfx::shaders_path + "/depth.vert",
+      gfx::shaders_path + "/depth.frag");
+  if (program == 0 || hdr_program == 0 || skybox_program == 0 || gbuffer_program == 0 ||
+      deferred_program == 0 || deferred_edges_program == 0 || depth_program == 0) {
     throw gfx::GameWindowCannotBeInitializedException();
   }
+  AddShaderProgram(&program, main_vertex_path, main_fragment_path);
+  AddShaderProgram(&hdr_program, hdr_vertex_path, hdr_fragment_path);
+  AddShaderProgram(&skybox_program, skybox_vertex_path, skybox_fragment_path);
+  AddShaderProgram(&gbuffer_program, main_vertex_path, gfx::shaders_path + "/gbuffer.frag");
+  AddShaderProgram(&deferred_program, hdr_vertex_path, gfx::shaders_path + "/deferred.frag");
+  AddShaderProgram(&deferred_edges_program, hdr_vertex_path,
+      gfx::shaders_path + "/deferred_edges.frag");
+  AddShaderProgram(&depth_program, gfx::shaders_path + "/depth.vert",
+      gfx::shaders_path + "/depth.frag");
+  GLuint geometry_programs[] = {program, gbuffer_program};
+  for (GLuint geometry_program : geometry_programs) {
+    glUniformBlockBinding(geometry_program,
+        glGetUniformBlockIndex(geometry_program, "FrameConstants"), gfx::FRAME_CONSTANTS_BINDING);
+    glUniformBlockBinding(geometry_program,
+        glGetUniformBlockIndex(geometry_program, "InstanceConstants"),
+        gfx::INSTANCE_CONSTANTS_BINDING);
+  }
+  GLuint skinned_programs[] = {program, gbuffer_program, depth_program};
+  for (GLuint skinned_program : skinned_programs) {
+    glUniformBlockBinding(skinned_program,
+        glGetUniformBlockIndex(skinned_program, "SkinningPalette"), gfx::SKINNING_PALETTE_BINDING);
+  }
+  stream_buffer = new gfx::StreamBuffer(GL_UNIFORM_BUFFER, gfx::STREAM_BUFFER_REGION_SIZE);
+  // The calling thread runs jobs too, so leave it one of the cores.
+  job_system = new gfx::JobSystem(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+  shadow_map = new gfx::CascadedShadowMap(depth_program);
+  point_shadow_atlas = new gfx::PointShadowAtlas(depth_program);
+  for (GLuint lit_program : GetLitPrograms()) {
+    glUseProgram(lit_program);
+    glUniform1i(glGetUniformLocation(lit_program, "shadow_map"), 6);
+    glUniform1i(glGetUniformLocation(lit_program, "point_shadow_atlas"), 7);
+    glUniform1i(glGetUniformLocation(lit_program, "irradiance_volume.coefficients"),
+        gfx::IRRADIANCE_VOLUME_TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(lit_program, "ltc_matrices"), gfx::LTC_MATRIX_TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(lit_program, "ltc_amplitudes"),
+        gfx::LTC_AMPLITUDE_TEXTURE_UNIT);
+  }
 
   // TODO(brkho): Implement resizing.
   GLint dimensions[4];
   glGetIntegerv(GL_VIEWPORT, dimensions);
   vp_width = dimensions[2];
   vp_height = dimensions[3];
-  glUseProgram(program);
+  render_width = vp_width;
+  render_height = vp_height;
   InitializeHammersleyPoints();
 
   InitializeHdrProgram();
   InitializeSkyboxProgram();
+  InitializeDeferredProgram();
+  if (anti_aliasing_mode == gfx::TAA) {
+    InitializeTemporalAntiAliasing(hdr_vertex_path);
+  }
+  InitializePostProcessing(hdr_vertex_path);
+  previous_view_transform = camera->GetViewTransform();
 
   // Set up the dithering texture to combat banding in low lighting conditions.
   glGenTextures(1, &matrix_handle);
@@ -47,13 +235,41 @@ gfx::GameWindow::GameWindow(int width, int height, std::string main_vertex_path,
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 8, 8, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, bayer_matrix);
+  glUseProgram(hdr_program);
   glUniform1i(glGetUniformLocation(hdr_program, "hdrBuffer"), 0);
   glUniform2ui(glGetUniformLocation(hdr_program, "dimensions"), vp_width, vp_height);
   glUniform1i(glGetUniformLocation(hdr_program, "bayer_matrix"), 1);
+  glUniform1i(glGetUniformLocation(hdr_program, "taa_history"), 2);
+  glUniform1i(glGetUniformLocation(hdr_program, "taa_enabled"), anti_aliasing_mode == gfx::TAA);
+  glUniform2ui(glGetUniformLocation(hdr_program, "render_dimensions"), render_width,
+      render_height);
+  glUniform1i(glGetUniformLocation(hdr_program, "bloom_buffer"), 3);
+  glUniform1f(glGetUniformLocation(hdr_program, "bloom_strength"), gfx::BLOOM_STRENGTH);
+  glUniform1i(glGetUniformLocation(hdr_program, "exposure_buffer"), 4);
+
+  glGenQueries(2, shaded_samples_queries);
+  profiler = new gfx::Profiler();
+  render_graph = new gfx::RenderGraph();
+  BuildRenderGraph();
 
   glUseProgram(program);
 }
 
+gfx::GameWindow::GameWindow(int width, int height, std::string main_vertex_path,
+    std::string main_fragment_path, std::string hdr_vertex_path, std::string hdr_fragment_path,
+    std::string skybox_vertex_path, std::string skybox_fragment_path, gfx::Camera* camera,
+    float fov, gfx::Color color, gfx::AntiAliasingMode anti_aliasing_mode) :
+    GameWindow(width, height, main_vertex_path, main_fragment_path, hdr_vertex_path,
+    hdr_fragment_path, skybox_vertex_path, skybox_fragment_path, camera, fov, color,
+    anti_aliasing_mode, gfx::Windowed) {}
+
+gfx::GameWindow::GameWindow(int width, int height, std::string main_vertex_path,
+    std::string main_fragment_path, std::string hdr_vertex_path, std::string hdr_fragment_path,
+    std::string skybox_vertex_path, std::string skybox_fragment_path, gfx::Camera* camera,
+    float fov, gfx::Color color) : GameWindow(width, height, main_vertex_path, main_fragment_path,
+    hdr_vertex_path, hdr_fragment_path, skybox_vertex_path, skybox_fragment_path, camera, fov,
+    color, gfx::MSAA) {}
+
 gfx::GameWindow::GameWindow(int width, int height, std::string main_vertex_path,
     std::string main_fragment_path, std::string hdr_vertex_path, std::string hdr_fragment_path,
     std::string skybox_vertex_path, std::string skybox_fragment_path, gfx::Camera* camera) :
@@ -62,26 +278,6 @@ gfx::GameWindow::GameWindow(int width, int height, std::string main_vertex_path,
     gfx::Color(0.0f, 0.0f, 0.0f)) {}
 
 void gfx::GameWindow::InitializeHdrProgram() {
-  // TODO(brkho): Actually save the handle to the multisampled HDR color buffer and the depth render
-  // buffer object so we can clean them up on GameWindow destruction.
-  // Generate the intermediate framebuffer which stores the HDR output.
-  glGenFramebuffers(1, &multisampled_hdr_fbo);
-  glBindFramebuffer(GL_FRAMEBUFFER, multisampled_hdr_fbo);
-  // GLuint multisampled_hdr_color_buffer;
-  glGenTextures(1, &multisampled_hdr_color_buffer);
-  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, multisampled_hdr_color_buffer);
-  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, gfx::MSAA_SAMPLES, GL_RGBA16F, vp_width,
-      vp_height, GL_TRUE);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE,
-      multisampled_hdr_color_buffer, 0);
-  GLuint depth_rbo;
-  glGenRenderbuffers(1, &depth_rbo);
-  glBindRenderbuffer(GL_RENDERBUFFER, depth_rbo);
-  glRenderbufferStorageMultisample(GL_RENDERBUFFER, gfx::MSAA_SAMPLES, GL_DEPTH_COMPONENT,
-      vp_width, vp_height);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rbo);
-
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
   // Set up quad used for rendering the output texture.
   glUseProgram(hdr_program);
   quad_vertices = new std::vector<gfx::Vertex>();
@@ -107,6 +303,119 @@ void gfx::GameWindow::InitializeSkyboxProgram() {
   skybox_mesh = new gfx::Mesh(skybox_vertices, skybox_elements, nullptr, true);
 }
 
+void gfx::GameWindow::InitializeDeferredProgram() {
+  // The G-buffer bindings never change, so set up the samplers once.
+  GLuint gbuffer_programs[] = {deferred_program, deferred_edges_program};
+  for (GLuint gbuffer_reader : gbuffer_programs) {
+    glUseProgram(gbuffer_reader);
+    glUniform1i(glGetUniformLocation(gbuffer_reader, "albedo_metallic_buffer"), 0);
+    glUniform1i(glGetUniformLocation(gbuffer_reader, "normal_roughness_buffer"), 1);
+    glUniform1i(glGetUniformLocation(gbuffer_reader, "ao_environment_buffer"), 2);
+    glUniform1i(glGetUniformLocation(gbuffer_reader, "depth_buffer"), 3);
+    glUniform1i(glGetUniformLocation(gbuffer_reader, "num_samples"), num_samples);
+    glUniform2ui(glGetUniformLocation(gbuffer_reader, "dimensions"), render_width,
+        render_height);
+  }
+  glUseProgram(deferred_program);
+  glUniform1i(glGetUniformLocation(deferred_program, "environment_map.map"), 4);
+  glUseProgram(program);
+}
+
+void gfx::GameWindow::InitializeTemporalAntiAliasing(std::string hdr_vertex_path) {
+  taa_program = gfx::GameWindow::LinkProgram(hdr_vertex_path, gfx::shaders_path + "/taa.frag");
+  if (taa_program == 0) {
+    throw gfx::GameWindowCannotBeInitializedException();
+  }
+  AddShaderProgram(&taa_program, hdr_vertex_path, gfx::shaders_path + "/taa.frag");
+
+  // The history is filtered when it is reprojected, so it is a regular texture.
+  glGenTextures(2, taa_history_buffers);
+  glGenFramebuffers(2, taa_history_fbos);
+  for (int i = 0; i < 2; i++) {
+    glBindTexture(GL_TEXTURE_2D, taa_history_buffers[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, vp_width, vp_height, 0, GL_RGBA, GL_FLOAT,
+        nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindFramebuffer(GL_FRAMEBUFFER, taa_history_fbos[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+        taa_history_buffers[i], 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      throw gfx::GameWindowCannotBeInitializedException();
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  glUseProgram(taa_program);
+  glUniform1i(glGetUniformLocation(taa_program, "current_buffer"), 0);
+  glUniform1i(glGetUniformLocation(taa_program, "motion_buffer"), 1);
+  glUniform1i(glGetUniformLocation(taa_program, "history_buffer"), 2);
+  glUniform2ui(glGetUniformLocation(taa_program, "dimensions"), vp_width, vp_height);
+  glUniform2ui(glGetUniformLocation(taa_program, "render_dimensions"), render_width,
+      render_height);
+  glUniform1f(glGetUniformLocation(taa_program, "history_weight"), gfx::TAA_HISTORY_WEIGHT);
+  glUseProgram(program);
+}
+
+void gfx::GameWindow::InitializePostProcessing(std::string hdr_vertex_path) {
+  downsample_resolve_program = gfx::GameWindow::LinkProgram(hdr_vertex_path,
+      gfx::shaders_path + "/downsample_resolve.frag");
+  downsample_program = gfx::GameWindow::LinkProgram(hdr_vertex_path,
+      gfx::shaders_path + "/downsample.frag");
+  upsample_program = gfx::GameWindow::LinkProgram(hdr_vertex_path,
+      gfx::shaders_path + "/upsample.frag");
+  exposure_program = gfx::GameWindow::LinkProgram(hdr_vertex_path,
+      gfx::shaders_path + "/exposure.frag");
+  if (downsample_resolve_program == 0 || downsample_program == 0 || upsample_program == 0 ||
+      exposure_program == 0) {
+    throw gfx::GameWindowCannotBeInitializedException();
+  }
+  AddShaderProgram(&downsample_resolve_program, hdr_vertex_path,
+      gfx::shaders_path + "/downsample_resolve.frag");
+  AddShaderProgram(&downsample_program, hdr_vertex_path, gfx::shaders_path + "/downsample.frag");
+  AddShaderProgram(&upsample_program, hdr_vertex_path, gfx::shaders_path + "/upsample.frag");
+  AddShaderProgram(&exposure_program, hdr_vertex_path, gfx::shaders_path + "/exposure.frag");
+
+  // The exposure is read with texelFetch, so it doesn't need filtering.
+  glGenTextures(2, exposure_buffers);
+  glGenFramebuffers(2, exposure_fbos);
+  for (int i = 0; i < 2; i++) {
+    glBindTexture(GL_TEXTURE_2D, exposure_buffers[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, exposure_fbos[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+        exposure_buffers[i], 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      throw gfx::GameWindowCannotBeInitializedException();
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  glUseProgram(downsample_resolve_program);
+  glUniform1i(glGetUniformLocation(downsample_resolve_program, "hdr_buffer"), 0);
+  glUniform1i(glGetUniformLocation(downsample_resolve_program, "taa_history"), 1);
+  glUniform1i(glGetUniformLocation(downsample_resolve_program, "num_samples"), num_samples);
+  glUniform1i(glGetUniformLocation(downsample_resolve_program, "taa_enabled"),
+      anti_aliasing_mode == gfx::TAA);
+  glUseProgram(downsample_program);
+  glUniform1i(glGetUniformLocation(downsample_program, "source"), 0);
+  glUseProgram(upsample_program);
+  glUniform1i(glGetUniformLocation(upsample_program, "source"), 0);
+  glUseProgram(exposure_program);
+  glUniform1i(glGetUniformLocation(exposure_program, "luminance_buffer"), 0);
+  glUniform1i(glGetUniformLocation(exposure_program, "previous_exposure"), 1);
+  glUniform1f(glGetUniformLocation(exposure_program, "key"), gfx::EXPOSURE_KEY);
+  glUniform1f(glGetUniformLocation(exposure_program, "min_exposure"), gfx::MIN_EXPOSURE);
+  glUniform1f(glGetUniformLocation(exposure_program, "max_exposure"), gfx::MAX_EXPOSURE);
+  glUseProgram(program);
+}
+
 gfx::Vertex gfx::GameWindow::PositionToVertex(glm::vec3 position) {
   return gfx::Vertex{position, glm::vec3{0.0f, 0.0f, 0.0f}, glm::vec3{0.0f, 0.0f, 0.0f},
       glm::vec2{0.0f, 0.0f}};
@@ -114,30 +423,54 @@ gfx::Vertex gfx::GameWindow::PositionToVertex(glm::vec3 position) {
 
 void gfx::GameWindow::InitializeHammersleyPoints() {
   for (unsigned int i = 0; i < gfx::NUM_IBL_SAMPLES; i++) {
-    // Hammersley calculation adapted from:
-    // http://www.math.uiuc.edu/~gfrancis/illimath/windows/aszgard_mini/pylibs/cgkit/hammersley.py
-    float u = 0.0f;
-    float p = 0.5f;
-    unsigned int k = i;
-    while (k > 0) {
-      if (k & 1) {
-        u += p;
-      }
-      p *= 0.5;
-      k = k >> 1;
+    glm::vec2 point = gfx::util::GetHammersleyPoint(i, gfx::NUM_IBL_SAMPLES);
+    for (GLuint lit_program : GetLitPrograms()) {
+      glUseProgram(lit_program);
+      GLint location = glGetUniformLocation(lit_program,
+          ("hammersley_points[" + std::to_string(i) + "]").c_str());
+      glUniform2f(location, point.x, point.y);
     }
-    float v = ((float)i + 0.5f) / (float)gfx::NUM_IBL_SAMPLES;
-    GLint location = glGetUniformLocation(program,
-        ("hammersley_points[" + std::to_string(i) + "]").c_str());
-    glUniform2f(location, u, v);
   }
+  glUseProgram(program);
 }
 
 bool gfx::GameWindow::IsRunning() {
+  if (headless_context != nullptr) {
+    return !headless_closed;
+  }
   return !glfwWindowShouldClose(window);
 }
 
+void gfx::GameWindow::Close() {
+  if (headless_context != nullptr) {
+    headless_closed = true;
+  } else {
+    glfwSetWindowShouldClose(window, GL_TRUE);
+  }
+}
+
+gfx::ContextMode gfx::GameWindow::GetContextMode() {
+  return context_mode;
+}
+
+void gfx::GameWindow::GetFramebufferSize(int* width, int* height) {
+  if (headless_context != nullptr) {
+    *width = headless_context->GetWidth();
+    *height = headless_context->GetHeight();
+  } else {
+    glfwGetFramebufferSize(window, width, height);
+  }
+}
+
 void gfx::GameWindow::InitializeGameWindow(int width, int height, gfx::Color color) {
+  if (context_mode == gfx::Headless) {
+    // Headless contexts don't touch GLFW at all since it can't initialize without a display.
+    headless_context = new gfx::HeadlessContext(width, height);
+    gladLoadGLLoader((GLADloadproc)gfx::HeadlessContext::GetProcAddress);
+    InitializeContextState(width, height, color);
+    return;
+  }
+
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -155,7 +488,13 @@ void gfx::GameWindow::InitializeGameWindow(int width, int height, gfx::Color col
   }
   glfwMakeContextCurrent(window);
   gladLoadGL();
+  InitializeContextState(width, height, color);
+}
 
+void gfx::GameWindow::InitializeContextState(int width, int height, gfx::Color color) {
+#ifdef GFX_GL_STATS
+  gfx::gl_stats::Install();
+#endif
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_MULTISAMPLE);
   // glEnable(GL_SAMPLE_SHADING);
@@ -165,9 +504,34 @@ void gfx::GameWindow::InitializeGameWindow(int width, int height, gfx::Color col
   gfx::GameWindow::UpdateDimensions(width, height);
 }
 
-GLuint gfx::GameWindow::CompileShader(std::string path, GLenum shader_type) {
+std::string gfx::GameWindow::ReadShaderSource(std::string path,
+    std::vector<std::string>* source_paths) {
+  if (source_paths != nullptr) {
+    source_paths->push_back(path);
+  }
   std::ifstream ifs(path);
-  std::string content((std::istreambuf_iterator<char>(ifs)), (std::istreambuf_iterator<char>()));
+  std::string directory = path.substr(0, path.find_last_of('/') + 1);
+  std::string content;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.compare(0, 10, "#include \"") == 0) {
+      size_t path_end = line.find('"', 10);
+      std::string included = ReadShaderSource(directory + line.substr(10, path_end - 10),
+          source_paths);
+      if (included.size() == 0) {
+        std::cout << "Cannot include \'" << line << "\' in \'" << path << "\'." << std::endl;
+        return "";
+      }
+      content += included;
+    } else {
+      content += line + "\n";
+    }
+  }
+  return content;
+}
+
+GLuint gfx::GameWindow::CompileShader(std::string path, GLenum shader_type) {
+  std::string content = ReadShaderSource(path, nullptr);
   if (content.size() == 0) {
     return 0;
   }
@@ -185,6 +549,7 @@ GLuint gfx::GameWindow::CompileShader(std::string path, GLenum shader_type) {
   if(!success) {
     glGetShaderInfoLog(shader, 512, NULL, info_log);
     std::cout << "Shader compilation of \'" << path << "\' failed:\n" << info_log << std::endl;
+    glDeleteShader(shader);
     return 0;
   }
   return shader;
@@ -194,6 +559,8 @@ GLuint gfx::GameWindow::LinkProgram(std::string vertex_path, std::string fragmen
   GLuint vertex_shader = CompileShader(vertex_path, GL_VERTEX_SHADER);
   GLuint frag_shader = CompileShader(fragment_path, GL_FRAGMENT_SHADER);
   if (vertex_shader == 0 || frag_shader == 0) {
+    glDeleteShader(vertex_shader);
+    glDeleteShader(frag_shader);
     return 0;
   }
   GLuint linked_program = glCreateProgram();
@@ -210,6 +577,7 @@ GLuint gfx::GameWindow::LinkProgram(std::string vertex_path, std::string fragmen
   if(!success) {
     glGetProgramInfoLog(linked_program, 512, NULL, info_log);
     std::cout << "Failed to link shader program:\n" << info_log << std::endl;
+    glDeleteProgram(linked_program);
     return 0;
   }
 
@@ -221,34 +589,103 @@ GLuint gfx::GameWindow::LinkProgram(std::string vertex_path, std::string fragmen
   return linked_program;
 }
 
+void gfx::GameWindow::AddShaderProgram(GLuint* program, std::string vertex_path,
+    std::string fragment_path) {
+  shader_programs.push_back(ShaderProgram{program, vertex_path, fragment_path});
+}
+
+bool gfx::GameWindow::ReloadShader(std::string path) {
+  bool used = false;
+  bool failed = false;
+  for (ShaderProgram& shader_program : shader_programs) {
+    // Read the sources again, since the change may have added or removed an #include.
+    std::vector<std::string> source_paths;
+    ReadShaderSource(shader_program.vertex_path, &source_paths);
+    ReadShaderSource(shader_program.fragment_path, &source_paths);
+    if (std::find(source_paths.begin(), source_paths.end(), path) == source_paths.end()) {
+      continue;
+    }
+    used = true;
+    GLuint relinked = LinkProgram(shader_program.vertex_path, shader_program.fragment_path);
+    if (relinked == 0) {
+      failed = true;
+      continue;
+    }
+    CopyProgramState(*shader_program.program, relinked);
+    glDeleteProgram(*shader_program.program);
+    *shader_program.program = relinked;
+    if (shader_program.program == &depth_program) {
+      shadow_map->SetDepthProgram(depth_program);
+      point_shadow_atlas->SetDepthProgram(depth_program);
+    }
+  }
+  glUseProgram(program);
+  if (failed) {
+    throw gfx::CannotReloadShaderException();
+  }
+  return used;
+}
+
 void gfx::GameWindow::SetBufferClearColor(gfx::Color color) {
+  clear_color = color;
   glClearColor(color.r, color.g, color.b, color.a);
 }
 
 void gfx::GameWindow::SetDirectionalLight(gfx::DirectionalLight* di) {
   directional_light = di;
   if (directional_light == nullptr) {
-    GLint di_enabled_location = glGetUniformLocation(program, "directional_light.enabled");
-    glUniform1i(di_enabled_location, false);
+    for (GLuint lit_program : GetLitPrograms()) {
+      glUseProgram(lit_program);
+      GLint di_enabled_location = glGetUniformLocation(lit_program, "directional_light.enabled");
+      glUniform1i(di_enabled_location, false);
+    }
+    glUseProgram(program);
     return;
   }
   UpdateDirectionalLight();
 }
 
 void gfx::GameWindow::UpdateDirectionalLight() {
-  GLint di_enabled_location = glGetUniformLocation(program, "directional_light.enabled");
-  glUniform1i(di_enabled_location, true);
-  GLint di_direction_location = glGetUniformLocation(program, "directional_light.direction");
   glm::vec3 normalized_direction = glm::normalize(directional_light->direction);
-  glUniform3fv(di_direction_location, 1, glm::value_ptr(normalized_direction));
-  GLint di_irradiance_location = glGetUniformLocation(program, "directional_light.irradiance");
-  glUniform3fv(di_irradiance_location, 1, glm::value_ptr(directional_light->irradiance));
+  for (GLuint lit_program : GetLitPrograms()) {
+    glUseProgram(lit_program);
+    GLint di_enabled_location = glGetUniformLocation(lit_program, "directional_light.enabled");
+    glUniform1i(di_enabled_location, true);
+    GLint di_shadows_location = glGetUniformLocation(lit_program,
+        "directional_light.casts_shadows");
+    glUniform1i(di_shadows_location, directional_light->casts_shadows);
+    GLint di_direction_location = glGetUniformLocation(lit_program,
+        "directional_light.direction");
+    glUniform3fv(di_direction_location, 1, glm::value_ptr(normalized_direction));
+    GLint di_irradiance_location = glGetUniformLocation(lit_program,
+        "directional_light.irradiance");
+    glUniform3fv(di_irradiance_location, 1, glm::value_ptr(directional_light->irradiance));
+  }
+  glUseProgram(program);
 }
 
 void gfx::GameWindow::UnsetDirectionalLight() {
   SetDirectionalLight(nullptr);
 }
 
+void gfx::GameWindow::SetIrradianceVolume(gfx::IrradianceVolume* volume) {
+  irradiance_volume = volume;
+  for (GLuint lit_program : GetLitPrograms()) {
+    glUseProgram(lit_program);
+    glUniform1i(glGetUniformLocation(lit_program, "irradiance_volume.enabled"), volume != nullptr);
+    if (volume == nullptr) {
+      continue;
+    }
+    glUniform3fv(glGetUniformLocation(lit_program, "irradiance_volume.min_position"), 1,
+        glm::value_ptr(volume->GetMin()));
+    glUniform3fv(glGetUniformLocation(lit_program, "irradiance_volume.cell_size"), 1,
+        glm::value_ptr(volume->GetCellSize()));
+    glUniform3iv(glGetUniformLocation(lit_program, "irradiance_volume.resolution"), 1,
+        glm::value_ptr(volume->GetResolution()));
+  }
+  glUseProgram(program);
+}
+
 unsigned int gfx::GameWindow::GetAndValidatePointLightIndex(gfx::PointLight* point_light) {
   auto reverse_it = point_lights_reverse.find(point_light);
   if (reverse_it == point_lights_reverse.end()) {
@@ -282,8 +719,12 @@ void gfx::GameWindow::AddPointLight(gfx::PointLight* point_light) {
 void gfx::GameWindow::RemovePointLight(gfx::PointLight* point_light) {
   unsigned int index = GetAndValidatePointLightIndex(point_light);
   std::string light_base = "point_lights[" + std::to_string(index) + "].";
-  GLint enabled_location = glGetUniformLocation(program, (light_base + "enabled").c_str());
-  glUniform1i(enabled_location, false);
+  for (GLuint lit_program : GetLitPrograms()) {
+    glUseProgram(lit_program);
+    GLint enabled_location = glGetUniformLocation(lit_program, (light_base + "enabled").c_str());
+    glUniform1i(enabled_location, false);
+  }
+  glUseProgram(program);
   point_lights_reverse.erase(point_light);
   point_lights[index] = nullptr;
 }
@@ -291,24 +732,123 @@ void gfx::GameWindow::RemovePointLight(gfx::PointLight* point_light) {
 void gfx::GameWindow::UpdatePointLight(gfx::PointLight* point_light) {
   unsigned int index = GetAndValidatePointLightIndex(point_light);
   std::string light_base = "point_lights[" + std::to_string(index) + "].";
-  GLint enabled_location = glGetUniformLocation(program, (light_base + "enabled").c_str());
-  glUniform1i(enabled_location, true);
-  GLint position_location = glGetUniformLocation(program, (light_base + "position").c_str());
-  glUniform3fv(position_location, 1, glm::value_ptr(point_lights[index]->position));
-  GLint irradiance_location = glGetUniformLocation(program, (light_base + "irradiance").c_str());
-  glUniform3fv(irradiance_location, 1, glm::value_ptr(point_lights[index]->irradiance));
-  GLint const_atten_location = glGetUniformLocation(program, (light_base + "const_atten").c_str());
-  glUniform1f(const_atten_location, point_lights[index]->const_atten);
-  GLint lin_atten_location = glGetUniformLocation(program, (light_base + "linear_atten").c_str());
-  glUniform1f(lin_atten_location, point_lights[index]->linear_atten);
-  GLint quad_atten_location = glGetUniformLocation(program, (light_base + "quad_atten").c_str());
-  glUniform1f(quad_atten_location, point_lights[index]->quad_atten);
+  for (GLuint lit_program : GetLitPrograms()) {
+    glUseProgram(lit_program);
+    GLint enabled_location = glGetUniformLocation(lit_program, (light_base + "enabled").c_str());
+    glUniform1i(enabled_location, true);
+    GLint position_location = glGetUniformLocation(lit_program, (light_base + "position").c_str());
+    glUniform3fv(position_location, 1, glm::value_ptr(point_lights[index]->position));
+    GLint irradiance_location = glGetUniformLocation(lit_program,
+        (light_base + "irradiance").c_str());
+    glUniform3fv(irradiance_location, 1, glm::value_ptr(point_lights[index]->irradiance));
+    GLint const_atten_location = glGetUniformLocation(lit_program,
+        (light_base + "const_atten").c_str());
+    glUniform1f(const_atten_location, point_lights[index]->const_atten);
+    GLint lin_atten_location = glGetUniformLocation(lit_program,
+        (light_base + "linear_atten").c_str());
+    glUniform1f(lin_atten_location, point_lights[index]->linear_atten);
+    GLint quad_atten_location = glGetUniformLocation(lit_program,
+        (light_base + "quad_atten").c_str());
+    glUniform1f(quad_atten_location, point_lights[index]->quad_atten);
+    GLint radius_location = glGetUniformLocation(lit_program, (light_base + "radius").c_str());
+    glUniform1f(radius_location, point_lights[index]->radius);
+  }
+  glUseProgram(program);
+}
+
+unsigned int gfx::GameWindow::GetAndValidateAreaLightIndex(gfx::AreaLight* area_light) {
+  auto reverse_it = area_lights_reverse.find(area_light);
+  if (reverse_it == area_lights_reverse.end()) {
+    throw gfx::InvalidLightException();
+  }
+  return reverse_it->second;
+}
+
+void gfx::GameWindow::AddAreaLight(gfx::AreaLight* area_light) {
+  // Trying to add the same area light twice.
+  auto reverse_it = area_lights_reverse.find(area_light);
+  if (reverse_it != area_lights_reverse.end()) {
+    throw gfx::InvalidLightException();
+  }
+
+  int free_index = -1;
+  for (unsigned int i = 0; i < gfx::MAX_AREA_LIGHTS; i++) {
+    if (area_lights[i] == nullptr) {
+      free_index = i;
+      break;
+    }
+  }
+  if (free_index == -1) {
+    throw gfx::TooManyLightsException();
+  }
+  if (ltc_table == nullptr) {
+    ltc_table = new gfx::LtcTable(gfx::ltc_table_path);
+    ltc_table->Upload();
+  }
+  area_lights_reverse[area_light] = free_index;
+  area_lights[free_index] = area_light;
+  UpdateAreaLight(area_light);
+}
+
+void gfx::GameWindow::RemoveAreaLight(gfx::AreaLight* area_light) {
+  unsigned int index = GetAndValidateAreaLightIndex(area_light);
+  std::string light_base = "area_lights[" + std::to_string(index) + "].";
+  for (GLuint lit_program : GetLitPrograms()) {
+    glUseProgram(lit_program);
+    GLint enabled_location = glGetUniformLocation(lit_program, (light_base + "enabled").c_str());
+    glUniform1i(enabled_location, false);
+  }
+  glUseProgram(program);
+  area_lights_reverse.erase(area_light);
+  area_lights[index] = nullptr;
+}
+
+void gfx::GameWindow::UpdateAreaLight(gfx::AreaLight* area_light) {
+  unsigned int index = GetAndValidateAreaLightIndex(area_light);
+  std::string light_base = "area_lights[" + std::to_string(index) + "].";
+  for (GLuint lit_program : GetLitPrograms()) {
+    glUseProgram(lit_program);
+    GLint enabled_location = glGetUniformLocation(lit_program, (light_base + "enabled").c_str());
+    glUniform1i(enabled_location, true);
+    GLint is_disk_location = glGetUniformLocation(lit_program, (light_base + "is_disk").c_str());
+    glUniform1i(is_disk_location, area_light->shape == gfx::DiskLight);
+    GLint two_sided_location = glGetUniformLocation(lit_program,
+        (light_base + "two_sided").c_str());
+    glUniform1i(two_sided_location, area_light->two_sided);
+    GLint position_location = glGetUniformLocation(lit_program, (light_base + "position").c_str());
+    glUniform3fv(position_location, 1, glm::value_ptr(area_light->position));
+    GLint right_location = glGetUniformLocation(lit_program, (light_base + "right").c_str());
+    glUniform3fv(right_location, 1, glm::value_ptr(area_light->right));
+    GLint up_location = glGetUniformLocation(lit_program, (light_base + "up").c_str());
+    glUniform3fv(up_location, 1, glm::value_ptr(area_light->up));
+    GLint radiance_location = glGetUniformLocation(lit_program, (light_base + "radiance").c_str());
+    glUniform3fv(radiance_location, 1, glm::value_ptr(area_light->irradiance));
+  }
+  glUseProgram(program);
+}
+
+std::vector<GLuint> gfx::GameWindow::GetLitPrograms() {
+  return std::vector<GLuint>{program, deferred_program};
+}
+
+void gfx::GameWindow::SetRenderMode(gfx::RenderMode mode) {
+  if (mode != render_mode) {
+    render_mode = mode;
+    BuildRenderGraph();
+  }
+}
+
+gfx::RenderMode gfx::GameWindow::GetRenderMode() {
+  return render_mode;
 }
 
 void gfx::GameWindow::UpdateDimensions(int width, int height) {
-  glfwSetWindowSize(window, width, height);
+  // The pbuffer of a headless context has a fixed size.
+  if (window != nullptr) {
+    glfwSetWindowSize(window, width, height);
+  }
   int real_width, real_height;
-  glfwGetFramebufferSize(window, &real_width, &real_height);
+  GetFramebufferSize(&real_width, &real_height);
   glViewport(0, 0, real_width, real_height);
   gfx::GameWindow::UpdatePerspectiveProjection(real_width, real_height);
 }
@@ -316,33 +856,227 @@ void gfx::GameWindow::UpdateDimensions(int width, int height) {
 void gfx::GameWindow::UpdateFieldOfView(float fov) {
   field_of_view = fov;
   int real_width, real_height;
-  glfwGetFramebufferSize(window, &real_width, &real_height);
+  GetFramebufferSize(&real_width, &real_height);
   gfx::GameWindow::UpdatePerspectiveProjection(real_width, real_height);
 }
 
 void gfx::GameWindow::PollForEvents() {
-  glfwPollEvents();
+  if (window != nullptr) {
+    glfwPollEvents();
+  }
+  job_system->RunMainThreadJobs();
 }
 
 double gfx::GameWindow::GetElapsedTime() {
+  if (headless_context != nullptr) {
+    return headless_context->GetElapsedTime();
+  }
   return glfwGetTime();
 }
 
+void gfx::GameWindow::SetDepthPrepass(bool enabled) {
+  depth_prepass_enabled = enabled;
+}
+
+bool gfx::GameWindow::IsDepthPrepassEnabled() {
+  return depth_prepass_enabled;
+}
+
+GLuint64 gfx::GameWindow::GetShadedSampleCount() {
+  return shaded_sample_count;
+}
+
+unsigned int gfx::GameWindow::GetShadowCascadesRendered() {
+  return shadow_map->GetCascadesRendered();
+}
+
+unsigned int gfx::GameWindow::GetPointShadowFacesRendered() {
+  return point_shadow_atlas->GetFacesRendered();
+}
+
+void gfx::GameWindow::SetDynamicResolution(bool enabled, double target_frame_time) {
+  // A target that isn't positive would make the ideal scale zero or NaN in UpdateResolutionScale.
+  if (enabled && !(target_frame_time > 0.0)) {
+    throw gfx::InvalidTargetFrameTimeException();
+  }
+  dynamic_resolution_enabled = enabled;
+  this->target_frame_time = target_frame_time;
+  if (!enabled) {
+    resolution_scale = 1.0f;
+    SetRenderDimensions(vp_width, vp_height);
+  }
+}
+
+bool gfx::GameWindow::IsDynamicResolutionEnabled() {
+  return dynamic_resolution_enabled;
+}
+
+float gfx::GameWindow::GetResolutionScale() {
+  return resolution_scale;
+}
+
+void gfx::GameWindow::SetAutoExposure(bool enabled) {
+  if (enabled != auto_exposure_enabled) {
+    auto_exposure_enabled = enabled;
+    // Start over from the first frame's exposure rather than a stale one.
+    exposure_valid = false;
+    BuildRenderGraph();
+  }
+}
+
+bool gfx::GameWindow::IsAutoExposureEnabled() {
+  return auto_exposure_enabled;
+}
+
+void gfx::GameWindow::SetBloom(bool enabled) {
+  if (enabled != bloom_enabled) {
+    bloom_enabled = enabled;
+    BuildRenderGraph();
+  }
+}
+
+bool gfx::GameWindow::IsBloomEnabled() {
+  return bloom_enabled;
+}
+
+double gfx::GameWindow::GetGpuFrameTime() {
+  return profiler->GetGpuFrameTime();
+}
+
+gfx::Profiler* gfx::GameWindow::GetProfiler() {
+  return profiler;
+}
+
+gfx::RenderGraphMemory gfx::GameWindow::GetRenderTargetMemory() {
+  return render_graph->GetMemory();
+}
+
+const gfx::FrameGlStats& gfx::GameWindow::GetGlStats() {
+  return profiler->GetGlStats();
+}
+
+gfx::JobSystem* gfx::GameWindow::GetJobSystem() {
+  return job_system;
+}
+
+void gfx::GameWindow::StartCapture(std::string path_prefix, gfx::CaptureFormat format) {
+  delete frame_capture;
+  frame_capture = new gfx::FrameCapture(path_prefix, format);
+  BuildRenderGraph();
+}
+
+void gfx::GameWindow::StopCapture() {
+  if (frame_capture != nullptr) {
+    delete frame_capture;
+    frame_capture = nullptr;
+    BuildRenderGraph();
+  }
+}
+
+bool gfx::GameWindow::IsCapturing() {
+  return frame_capture != nullptr;
+}
+
+void gfx::GameWindow::CaptureFrame() {
+  if (frame_capture->GetFormat() == gfx::CapturePng) {
+    frame_capture->Capture(0, vp_width, vp_height, false);
+  } else if (anti_aliasing_mode == gfx::TAA) {
+    frame_capture->Capture(taa_history_fbos[taa_history_index], vp_width, vp_height, true);
+  } else {
+    // Resolving averages the linear samples rather than the tone mapped ones like hdr.frag.
+    GLuint resolve_fbo = render_graph->GetFramebuffer(capture_pass);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, render_graph->GetFramebuffer(hdr_pass));
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_fbo);
+    glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, render_width, render_height,
+        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    frame_capture->Capture(resolve_fbo, render_width, render_height, false);
+  }
+}
+
+GLuint gfx::GameWindow::GetGeometryProgram() {
+  return render_mode == gfx::Deferred ? gbuffer_program : program;
+}
+
+void gfx::GameWindow::BeginShadedSamplesQuery() {
+  // The query was last issued two frames ago, so its result is almost certainly available.
+  GLuint query = shaded_samples_queries[current_query];
+  if (glIsQuery(query)) {
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &shaded_sample_count);
+    }
+  }
+  glBeginQuery(GL_SAMPLES_PASSED, query);
+}
+
+void gfx::GameWindow::UpdateResolutionScale() {
+  double gpu_frame_time = profiler->GetGpuFrameTime();
+  if (gpu_frame_time > 0.0) {
+    // GPU time scales roughly with the number of pixels shaded, so the scale that would hit the
+    // target goes with the square root of the time ratio. Move only part of the way there each
+    // frame so a single slow frame doesn't make the resolution jump.
+    float ideal_scale = resolution_scale * (float)std::sqrt(target_frame_time / gpu_frame_time);
+    ideal_scale = std::min(std::max(ideal_scale, gfx::MIN_RESOLUTION_SCALE),
+        gfx::MAX_RESOLUTION_SCALE);
+    resolution_scale += gfx::RESOLUTION_SCALE_SMOOTHING * (ideal_scale - resolution_scale);
+    SetRenderDimensions(std::max(1u, (GLuint)std::lround(vp_width * resolution_scale)),
+        std::max(1u, (GLuint)std::lround(vp_height * resolution_scale)));
+  }
+}
+
+void gfx::GameWindow::SetRenderDimensions(GLuint width, GLuint height) {
+  if (width == render_width && height == render_height) {
+    return;
+  }
+  render_width = width;
+  render_height = height;
+  std::vector<GLuint> readers{hdr_program, deferred_program, deferred_edges_program};
+  if (taa_program != 0) {
+    readers.push_back(taa_program);
+  }
+  // The deferred programs reconstruct positions from the fragment coordinates, so their
+  // dimensions are the rendered region rather than the full buffer.
+  for (GLuint reader : readers) {
+    glUseProgram(reader);
+    const char* name = (reader == hdr_program || reader == taa_program) ? "render_dimensions" :
+        "dimensions";
+    glUniform2ui(glGetUniformLocation(reader, name), render_width, render_height);
+  }
+  glUseProgram(program);
+}
+
 void gfx::GameWindow::PrepareRender(gfx::Environment* environment) {
-  glBindFramebuffer(GL_FRAMEBUFFER, multisampled_hdr_fbo);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  if (profiler->BeginFrame() && dynamic_resolution_enabled) {
+    UpdateResolutionScale();
+  }
+  skybox_environment = environment;
+  deferred_environment = nullptr;
+  queued_models.clear();
+}
 
+void gfx::GameWindow::RenderSkybox(gfx::Environment* environment) {
   glActiveTexture(GL_TEXTURE0);
   // Draw skybox if enabled.
   if (environment != nullptr) {
-    // Setup the program and uniforms.
+    // Setup the program and uniforms. The skybox is projected onto the far plane, so it passes an
+    // inclusive depth test only where nothing else was drawn.
     glUseProgram(skybox_program);
     glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
+    glm::mat4 rotation = glm::mat4(glm::mat3(camera->GetViewTransform()));
     GLint view_location = glGetUniformLocation(skybox_program, "view_transform");
-    glUniformMatrix4fv(view_location, 1, GL_FALSE,
-        glm::value_ptr(glm::mat4(glm::mat3(camera->GetViewTransform()))));
+    glUniformMatrix4fv(view_location, 1, GL_FALSE, glm::value_ptr(rotation));
     GLint projection_location = glGetUniformLocation(skybox_program, "projection_transform");
-    glUniformMatrix4fv(projection_location, 1, GL_FALSE, glm::value_ptr(perspective_projection));
+    glUniformMatrix4fv(projection_location, 1, GL_FALSE, glm::value_ptr(jittered_projection));
+    GLint current_location = glGetUniformLocation(skybox_program, "unjittered_view_projection");
+    glUniformMatrix4fv(current_location, 1, GL_FALSE,
+        glm::value_ptr(perspective_projection * rotation));
+    GLint previous_location = glGetUniformLocation(skybox_program, "previous_view_projection");
+    glUniformMatrix4fv(previous_location, 1, GL_FALSE,
+        glm::value_ptr(perspective_projection * glm::mat4(glm::mat3(previous_view_transform))));
     GLint blur_location = glGetUniformLocation(skybox_program, "skybox_blur");
     glUniform1f(blur_location, environment->skybox_blur);
 
@@ -355,40 +1089,412 @@ void gfx::GameWindow::PrepareRender(gfx::Environment* environment) {
     glBindVertexArray(skybox_mesh->vao);
     glDrawElements(GL_TRIANGLES, skybox_mesh->GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
+    glDepthFunc(GL_LESS);
     glDepthMask(GL_TRUE);
   } else {
     glBindTexture(GL_TEXTURE_2D, 0);
   }
-
-  // Begin normal rendering.
-  glUseProgram(program);
-  GLint view_location = glGetUniformLocation(program, "view_transform");
-  glUniformMatrix4fv(view_location, 1, GL_FALSE, glm::value_ptr(camera->GetViewTransform()));
-  GLint projection_location = glGetUniformLocation(program, "projection_transform");
-  glUniformMatrix4fv(projection_location, 1, GL_FALSE, glm::value_ptr(perspective_projection));
-  GLint camera_location = glGetUniformLocation(program, "camera_position");
-  glUniform3fv(camera_location, 1, glm::value_ptr(camera->camera_position));
 }
 
 void gfx::GameWindow::RenderModel(gfx::ModelInstance* model_instance,
     gfx::Environment* environment) {
-  GLint enabled_location = glGetUniformLocation(program, "environment_map.enabled");
+  queued_models.push_back(std::make_pair(model_instance, environment));
+}
+
+void gfx::GameWindow::DrawModel(gfx::ModelInstance* model_instance,
+    gfx::Environment* environment) {
+  GLuint geometry_program = GetGeometryProgram();
+  GLint enabled_location = glGetUniformLocation(geometry_program, "environment_map.enabled");
   glUniform1i(enabled_location, environment != nullptr);
-  if (environment != nullptr) {
+  if (environment != nullptr && render_mode == gfx::Deferred) {
+    deferred_environment = environment;
+  } else if (environment != nullptr) {
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, environment->environment_handle);
     GLint environment_location = glGetUniformLocation(program, "environment_map.map");
     glUniform1i(environment_location, 0);
   }
-  model_instance->Draw(program);
+  model_instance->Draw(geometry_program);
 }
 
-void gfx::GameWindow::FinishRender() {
+void gfx::GameWindow::RenderShadows() {
+  std::vector<gfx::ModelInstance*> casters;
+  for (auto &queued_model : queued_models) {
+    casters.push_back(queued_model.first);
+  }
+
+  if (directional_light != nullptr && directional_light->casts_shadows) {
+    bool transforms_changed = shadow_map->Render(camera->GetViewTransform(), field_of_view,
+        (GLfloat)vp_width / (GLfloat)vp_height, directional_light->direction, casters);
+    if (transforms_changed) {
+      for (GLuint lit_program : GetLitPrograms()) {
+        glUseProgram(lit_program);
+        for (unsigned int i = 0; i < gfx::NUM_SHADOW_CASCADES; i++) {
+          std::string index = "[" + std::to_string(i) + "]";
+          GLint transform_location = glGetUniformLocation(lit_program,
+              ("shadow_transforms" + index).c_str());
+          glUniformMatrix4fv(transform_location, 1, GL_FALSE,
+              glm::value_ptr(shadow_map->GetShadowTransform(i)));
+          GLint texel_location = glGetUniformLocation(lit_program,
+              ("shadow_texel_sizes" + index).c_str());
+          glUniform1f(texel_location, shadow_map->GetTexelSize(i));
+        }
+      }
+    }
+  }
+
+  bool point_shadows_changed = point_shadow_atlas->Render(point_lights, camera->camera_position,
+      field_of_view, casters);
+  if (point_shadows_changed) {
+    for (GLuint lit_program : GetLitPrograms()) {
+      glUseProgram(lit_program);
+      for (unsigned int i = 0; i < gfx::MAX_POINT_LIGHTS; i++) {
+        std::string index = "[" + std::to_string(i) + "]";
+        bool has_shadow = point_shadow_atlas->HasShadow(i);
+        GLint shadows_location = glGetUniformLocation(lit_program,
+            ("point_lights" + index + ".casts_shadows").c_str());
+        glUniform1i(shadows_location, has_shadow);
+        if (!has_shadow) {
+          continue;
+        }
+        for (unsigned int face = 0; face < gfx::NUM_CUBE_FACES; face++) {
+          std::string face_index = "[" + std::to_string(i * gfx::NUM_CUBE_FACES + face) + "]";
+          GLint transform_location = glGetUniformLocation(lit_program,
+              ("point_shadow_transforms" + face_index).c_str());
+          glUniformMatrix4fv(transform_location, 1, GL_FALSE,
+              glm::value_ptr(point_shadow_atlas->GetFaceTransform(i, face)));
+        }
+        GLint texel_location = glGetUniformLocation(lit_program,
+            ("point_shadow_texel_scales" + index).c_str());
+        glUniform1f(texel_location, point_shadow_atlas->GetTexelScale(i));
+      }
+    }
+  }
+}
+
+void gfx::GameWindow::BuildDrawList() {
+  {
+    gfx::ProfileScope scope(profiler, "Stream wait");
+    stream_buffer->BeginFrame();
+  }
+  gfx::ProfileScope scope(profiler, "Build draw list");
+  glm::mat4 view_transform = camera->GetViewTransform();
+  gfx::FrameConstants frame_constants{view_transform, jittered_projection,
+      perspective_projection * view_transform, perspective_projection * previous_view_transform};
+  size_t frame_offset = stream_buffer->Write(&frame_constants, sizeof(frame_constants));
+
+  // Pack the instance constants back to back in one allocation so each ModelInstance can write
+  // its own slot without synchronizing with the others.
+  size_t count = queued_models.size();
+  size_t alignment = stream_buffer->GetAlignment();
+  size_t stride = (sizeof(gfx::InstanceConstants) + alignment - 1) / alignment * alignment;
+  size_t instances_offset = count > 0 ? stream_buffer->Allocate(count * stride) : 0;
+  char* instances = count > 0 ? (char*)stream_buffer->GetPointer(instances_offset) : nullptr;
+
+  // Give each animated ModelInstance a slot for its skinning palettes the same way.
+  std::vector<size_t> palette_slots(count);
+  size_t num_palettes = 0;
+  for (size_t i = 0; i < count; i++) {
+    palette_slots[i] = num_palettes;
+    num_palettes += queued_models[i].first->GetSkinningPalette() != nullptr ? 1 : 0;
+  }
+  size_t palette_stride = (sizeof(gfx::SkinningPalette) + alignment - 1) / alignment * alignment;
+  size_t palettes_offset = num_palettes > 0 ?
+      stream_buffer->Allocate(num_palettes * palette_stride) : 0;
+  char* palettes = num_palettes > 0 ?
+      (char*)stream_buffer->GetPointer(palettes_offset) : nullptr;
+
+  gfx::Frustum frustum(perspective_projection * view_transform);
+
+  draw_commands.resize(count);
+  job_system->ParallelFor(count, gfx::DRAW_LIST_GRAIN_SIZE, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      gfx::ModelInstance* model_instance = queued_models[i].first;
+      // Culled ModelInstances write their constants as well so their previous transforms stay
+      // current for motion vectors.
+      model_instance->WriteInstanceConstants((gfx::InstanceConstants*)(instances + i * stride));
+      if (model_instance->GetSkinningPalette() != nullptr) {
+        size_t palette_offset = palette_slots[i] * palette_stride;
+        model_instance->WriteSkinningPalette((gfx::SkinningPalette*)(palettes + palette_offset),
+            stream_buffer->buffer_handle, palettes_offset + palette_offset);
+      }
+      glm::vec3 center = model_instance->GetBoundsCenter();
+      bool visible = frustum.IntersectsSphere(center, model_instance->GetBoundsRadius());
+      // The pre-pass already rejects hidden samples, so only group the models then.
+      uint64_t sort_key = gfx::ComputeDrawSortKey(view_transform, center,
+          model_instance->GetModelInfo(), !depth_prepass_enabled);
+      draw_commands[i] = DrawCommand{sort_key, model_instance, queued_models[i].second,
+          instances_offset + i * stride, visible};
+    }
+  });
+  stream_buffer->Unmap();
+  glBindBufferRange(GL_UNIFORM_BUFFER, gfx::FRAME_CONSTANTS_BINDING, stream_buffer->buffer_handle,
+      frame_offset, sizeof(frame_constants));
+
+  draw_list.clear();
+  for (DrawCommand& command : draw_commands) {
+    if (command.visible) {
+      draw_list.push_back(command);
+    }
+  }
+  std::stable_sort(draw_list.begin(), draw_list.end(),
+      [](const DrawCommand& a, const DrawCommand& b) { return a.sort_key < b.sort_key; });
+}
+
+void gfx::GameWindow::RenderQueuedModels() {
+  glViewport(0, 0, render_width, render_height);
+  // The render graph has bound the G-buffer (or the HDR buffer in forward mode).
+  if (render_mode == gfx::Deferred) {
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glClearColor(clear_color.r, clear_color.g, clear_color.b, clear_color.a);
+  } else {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (anti_aliasing_mode == gfx::TAA) {
+      const GLfloat no_motion[] = {0.0f, 0.0f, 0.0f, 0.0f};
+      glClearBufferfv(GL_COLOR, 1, no_motion);
+    }
+  }
+  glActiveTexture(GL_TEXTURE6);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_map->shadow_map_handle);
+  glActiveTexture(GL_TEXTURE7);
+  glBindTexture(GL_TEXTURE_2D, point_shadow_atlas->atlas_handle);
+  glActiveTexture(GL_TEXTURE0 + gfx::IRRADIANCE_VOLUME_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_3D,
+      irradiance_volume != nullptr ? irradiance_volume->volume_handle : 0);
+  glActiveTexture(GL_TEXTURE0 + gfx::LTC_MATRIX_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_2D, ltc_table != nullptr ? ltc_table->matrix_handle : 0);
+  glActiveTexture(GL_TEXTURE0 + gfx::LTC_AMPLITUDE_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_2D, ltc_table != nullptr ? ltc_table->amplitude_handle : 0);
+
+  // The geometry program reads its transforms from the streamed frame constants, but the depth
+  // program is shared with the shadow passes and takes them as uniforms.
+  glUseProgram(depth_program);
+  GLint view_location = glGetUniformLocation(depth_program, "view_transform");
+  glUniformMatrix4fv(view_location, 1, GL_FALSE, glm::value_ptr(camera->GetViewTransform()));
+  GLint projection_location = glGetUniformLocation(depth_program, "projection_transform");
+  glUniformMatrix4fv(projection_location, 1, GL_FALSE, glm::value_ptr(jittered_projection));
+  GLuint geometry_program = GetGeometryProgram();
+  glUseProgram(geometry_program);
+  GLint camera_location = glGetUniformLocation(geometry_program, "camera_position");
+  glUniform3fv(camera_location, 1, glm::value_ptr(camera->camera_position));
+
+  if (depth_prepass_enabled) {
+    // Lay down depth only, fetching from the tightly packed position streams.
+    glUseProgram(depth_program);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    for (DrawCommand& command : draw_list) {
+      command.model_instance->DrawDepth(depth_program);
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // Shade only the samples that ended up visible.
+    glUseProgram(geometry_program);
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+  }
+
+  BeginShadedSamplesQuery();
+  for (DrawCommand& command : draw_list) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, gfx::INSTANCE_CONSTANTS_BINDING,
+        stream_buffer->buffer_handle, command.instance_offset, sizeof(gfx::InstanceConstants));
+    DrawModel(command.model_instance, command.environment);
+  }
+  glEndQuery(GL_SAMPLES_PASSED);
+  current_query = 1 - current_query;
+  glDepthMask(GL_TRUE);
+  glDepthFunc(GL_LESS);
+  queued_models.clear();
+}
+
+void gfx::GameWindow::RenderDeferredLighting() {
+  // The render graph has bound the HDR buffer with the G-buffer's depth and stencil (and the
+  // motion buffer with TAA).
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  glClear(GL_COLOR_BUFFER_BIT);
+  // With TAA, the skybox also writes its motion where the G-buffer pass left none.
+  if (anti_aliasing_mode == gfx::TAA) {
+    const GLenum draw_buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, draw_buffers);
+  }
+  // The skybox is depth tested against the G-buffer's depth like in the forward path, so it only
+  // shades the pixels no geometry covers. The fullscreen passes below cover every pixel.
+  RenderSkybox(skybox_environment);
+  glDisable(GL_DEPTH_TEST);
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+  // Bind the G-buffer for both the edge classification and the lighting passes.
+  for (int i = 0; i < 4; i++) {
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, render_graph->GetHandle(gbuffer_targets[i]));
+  }
+  glActiveTexture(GL_TEXTURE4);
+  glBindTexture(GL_TEXTURE_2D,
+      deferred_environment != nullptr ? deferred_environment->environment_handle : 0);
+  glBindVertexArray(draw_quad->vao);
+
+  // Flag the pixels whose samples disagree with a stencil value of 1. Single-sampled buffers have
+  // no edges to flag.
+  glEnable(GL_STENCIL_TEST);
+  if (num_samples > 1) {
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glUseProgram(deferred_edges_program);
+    glDrawElements(GL_TRIANGLES, draw_quad->GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+  }
+
+  // Shade the interior pixels once using their first sample. The result is written to every
+  // covered sample, so the custom resolve in FinishRender works unchanged.
+  glUseProgram(deferred_program);
+  glm::mat4 view_projection = jittered_projection * camera->GetViewTransform();
+  glUniformMatrix4fv(glGetUniformLocation(deferred_program, "inverse_view_projection"), 1,
+      GL_FALSE, glm::value_ptr(glm::inverse(view_projection)));
+  glUniform3fv(glGetUniformLocation(deferred_program, "camera_position"), 1,
+      glm::value_ptr(camera->camera_position));
+  glUniform1i(glGetUniformLocation(deferred_program, "environment_map.enabled"),
+      deferred_environment != nullptr);
+  GLint sample_location = glGetUniformLocation(deferred_program, "sample_index");
+  glUniform1i(sample_location, 0);
+  glStencilFunc(GL_EQUAL, 0, 0xFF);
+  glDrawElements(GL_TRIANGLES, draw_quad->GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
+
+  // Shade the edge pixels once per sample, restricting each draw to a single sample.
+  if (num_samples > 1) {
+    glStencilFunc(GL_EQUAL, 1, 0xFF);
+    glEnable(GL_SAMPLE_MASK);
+    for (unsigned int i = 0; i < num_samples; i++) {
+      glSampleMaski(0, 1u << i);
+      glUniform1i(sample_location, i);
+      glDrawElements(GL_TRIANGLES, draw_quad->GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
+    }
+    glSampleMaski(0, ~0u);
+    glDisable(GL_SAMPLE_MASK);
+  }
+  glDisable(GL_STENCIL_TEST);
+  glEnable(GL_DEPTH_TEST);
+  glBindVertexArray(0);
+}
+
+void gfx::GameWindow::RenderTemporalResolve() {
+  glBindFramebuffer(GL_FRAMEBUFFER, taa_history_fbos[taa_history_index]);
+  glDisable(GL_DEPTH_TEST);
+  glUseProgram(taa_program);
+  glUniform1i(glGetUniformLocation(taa_program, "history_valid"), taa_history_valid);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, render_graph->GetHandle(hdr_color_target));
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, render_graph->GetHandle(motion_target));
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, taa_history_buffers[1 - taa_history_index]);
+  glBindVertexArray(draw_quad->vao);
+  glDrawElements(GL_TRIANGLES, draw_quad->GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
+  glBindVertexArray(0);
+  glEnable(GL_DEPTH_TEST);
+  taa_history_valid = true;
+}
+
+void gfx::GameWindow::GetDownsampleSize(unsigned int level, GLuint* width, GLuint* height) {
+  *width = std::max(1u, vp_width >> (level + 1));
+  *height = std::max(1u, vp_height >> (level + 1));
+}
+
+void gfx::GameWindow::RenderDownsample(unsigned int level) {
+  GLuint width, height;
+  GetDownsampleSize(level, &width, &height);
+  glViewport(0, 0, width, height);
+  glDisable(GL_DEPTH_TEST);
+  if (level == 0) {
+    // The TAA history covers the whole viewport, but the HDR buffer only covers the rendered
+    // region.
+    bool taa = anti_aliasing_mode == gfx::TAA;
+    glUseProgram(downsample_resolve_program);
+    glUniform2ui(glGetUniformLocation(downsample_resolve_program, "source_dimensions"),
+        taa ? vp_width : render_width, taa ? vp_height : render_height);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, render_graph->GetHandle(hdr_color_target));
+    if (taa) {
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, taa_history_buffers[taa_history_index]);
+    }
+  } else {
+    GLuint source_width, source_height;
+    GetDownsampleSize(level - 1, &source_width, &source_height);
+    glUseProgram(downsample_program);
+    glUniform2f(glGetUniformLocation(downsample_program, "texel_size"), 1.0f / source_width,
+        1.0f / source_height);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, render_graph->GetHandle(downsample_targets[level - 1]));
+  }
+  glBindVertexArray(draw_quad->vao);
+  glDrawElements(GL_TRIANGLES, draw_quad->GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
+  glBindVertexArray(0);
+  glEnable(GL_DEPTH_TEST);
+}
+
+void gfx::GameWindow::RenderUpsample(unsigned int level) {
+  GLuint width, height, source_width, source_height;
+  GetDownsampleSize(level, &width, &height);
+  GetDownsampleSize(level + 1, &source_width, &source_height);
+  // The bloom starts from the last level of the downsample chain.
+  unsigned int source = level + 1 == gfx::DOWNSAMPLE_LEVELS - 1 ? downsample_targets[level + 1] :
+      upsample_targets[level + 1];
+  glViewport(0, 0, width, height);
+  glDisable(GL_DEPTH_TEST);
+  glUseProgram(upsample_program);
+  glUniform2f(glGetUniformLocation(upsample_program, "half_texel_size"), 0.5f / source_width,
+      0.5f / source_height);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, render_graph->GetHandle(source));
+  glBindVertexArray(draw_quad->vao);
+  glDrawElements(GL_TRIANGLES, draw_quad->GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
+  glBindVertexArray(0);
+  glEnable(GL_DEPTH_TEST);
+}
+
+void gfx::GameWindow::RenderExposure() {
+  // Adapt by the time since the last frame, so the speed doesn't depend on the frame rate.
+  double current_time = GetElapsedTime();
+  float adaptation = 1.0f - (float)std::exp(-(current_time - previous_frame_time) *
+      gfx::EXPOSURE_ADAPTATION_RATE);
+  previous_frame_time = current_time;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, exposure_fbos[exposure_index]);
+  glViewport(0, 0, 1, 1);
+  glDisable(GL_DEPTH_TEST);
+  glUseProgram(exposure_program);
+  glUniform1i(glGetUniformLocation(exposure_program, "history_valid"), exposure_valid);
+  glUniform1f(glGetUniformLocation(exposure_program, "adaptation"), adaptation);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D,
+      render_graph->GetHandle(downsample_targets[gfx::DOWNSAMPLE_LEVELS - 1]));
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, exposure_buffers[1 - exposure_index]);
+  glBindVertexArray(draw_quad->vao);
+  glDrawElements(GL_TRIANGLES, draw_quad->GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
+  glBindVertexArray(0);
+  glEnable(GL_DEPTH_TEST);
+  exposure_valid = true;
+}
+
+void gfx::GameWindow::RenderTonemap() {
   glUseProgram(hdr_program);
+  glUniform1i(glGetUniformLocation(hdr_program, "bloom_enabled"), bloom_enabled);
+  glUniform1i(glGetUniformLocation(hdr_program, "auto_exposure_enabled"), auto_exposure_enabled);
   glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, multisampled_hdr_color_buffer);
+  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, render_graph->GetHandle(hdr_color_target));
   glActiveTexture(GL_TEXTURE1);
   glBindTexture(GL_TEXTURE_2D, matrix_handle);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, taa_history_buffers[taa_history_index]);
+  if (bloom_enabled) {
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, render_graph->GetHandle(upsample_targets[0]));
+  }
+  glActiveTexture(GL_TEXTURE4);
+  glBindTexture(GL_TEXTURE_2D, exposure_buffers[exposure_index]);
 
   // Bind the default frame buffer, so we can actually render to the screen.
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -399,10 +1505,205 @@ void gfx::GameWindow::FinishRender() {
   glBindVertexArray(draw_quad->vao);
   glDrawElements(GL_TRIANGLES, draw_quad->GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
   glBindVertexArray(0);
-  glfwSwapBuffers(window);
+}
+
+void gfx::GameWindow::BuildRenderGraph() {
+  render_graph->Reset();
+  bool taa = anti_aliasing_mode == gfx::TAA;
+  gfx::RenderTargetDescription hdr_color_description{GL_TEXTURE_2D_MULTISAMPLE, GL_RGBA16F,
+      vp_width, vp_height, num_samples};
+  hdr_color_target = render_graph->CreateRenderTarget("HDR color", hdr_color_description);
+  if (taa) {
+    motion_target = render_graph->CreateRenderTarget("Motion", gfx::RenderTargetDescription{
+        GL_TEXTURE_2D_MULTISAMPLE, GL_RG16F, vp_width, vp_height, num_samples});
+  }
+  // The TAA history is ping-ponged across frames, so it lives outside the graph.
+  unsigned int taa_history = render_graph->ImportRenderTarget("TAA history");
+
+  // The shadow maps are owned by the shadow casters rather than the graph.
+  unsigned int shadows = render_graph->AddPass("Shadows", [this]() { RenderShadows(); });
+  render_graph->SetSideEffects(shadows);
+
+  unsigned int geometry = render_graph->AddPass("Geometry", [this]() { RenderQueuedModels(); });
+  if (render_mode == gfx::Deferred) {
+    // Keep the G-buffer thin: 8 bits are plenty for albedo, metallic, and AO, but normals need
+    // half floats to avoid banding in the specular highlights.
+    const char* names[] = {"G-buffer albedo metallic", "G-buffer normal roughness",
+        "G-buffer AO environment", "G-buffer depth stencil"};
+    const GLenum formats[] = {GL_RGBA8, GL_RGBA16F, GL_RGBA8, GL_DEPTH24_STENCIL8};
+    for (int i = 0; i < 4; i++) {
+      gbuffer_targets[i] = render_graph->CreateRenderTarget(names[i], gfx::RenderTargetDescription{
+          GL_TEXTURE_2D_MULTISAMPLE, formats[i], vp_width, vp_height, num_samples});
+      render_graph->Write(geometry, gbuffer_targets[i],
+          i < 3 ? GL_COLOR_ATTACHMENT0 + i : GL_DEPTH_STENCIL_ATTACHMENT);
+    }
+    // With TAA, the motion buffer is written alongside the G-buffer.
+    if (taa) {
+      render_graph->Write(geometry, motion_target, GL_COLOR_ATTACHMENT3);
+    }
+
+    // The lighting pass writes into the same HDR color buffer as the forward renderer, but uses
+    // the G-buffer's depth and stencil so edge pixels can be flagged.
+    hdr_pass = render_graph->AddPass("Deferred lighting", [this]() { RenderDeferredLighting(); });
+    for (int i = 0; i < 4; i++) {
+      render_graph->Read(hdr_pass, gbuffer_targets[i]);
+    }
+    render_graph->Write(hdr_pass, hdr_color_target, GL_COLOR_ATTACHMENT0);
+    render_graph->Write(hdr_pass, gbuffer_targets[3], GL_DEPTH_STENCIL_ATTACHMENT);
+    if (taa) {
+      render_graph->Read(hdr_pass, motion_target);
+      render_graph->Write(hdr_pass, motion_target, GL_COLOR_ATTACHMENT1);
+    }
+  } else {
+    unsigned int depth = render_graph->CreateRenderTarget("Depth", gfx::RenderTargetDescription{
+        GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, vp_width, vp_height, num_samples});
+    render_graph->Write(geometry, hdr_color_target, GL_COLOR_ATTACHMENT0);
+    render_graph->Write(geometry, depth, GL_DEPTH_ATTACHMENT);
+    // Motion is written by the geometry and skybox passes as a second output of the HDR buffer.
+    if (taa) {
+      render_graph->Write(geometry, motion_target, GL_COLOR_ATTACHMENT1);
+    }
+    hdr_pass = geometry;
+
+    // The skybox is depth tested against the geometry, so it shares its framebuffer.
+    unsigned int skybox = render_graph->AddPass("Skybox",
+        [this]() { RenderSkybox(skybox_environment); });
+    render_graph->Read(skybox, hdr_color_target);
+    render_graph->Read(skybox, depth);
+    render_graph->Write(skybox, hdr_color_target, GL_COLOR_ATTACHMENT0);
+    render_graph->Write(skybox, depth, GL_DEPTH_ATTACHMENT);
+    if (taa) {
+      render_graph->Read(skybox, motion_target);
+      render_graph->Write(skybox, motion_target, GL_COLOR_ATTACHMENT1);
+    }
+  }
+
+  // The resolves cover the whole viewport and upscale the rendered region.
+  if (taa) {
+    unsigned int resolve = render_graph->AddPass("TAA resolve", [this]() {
+      glViewport(0, 0, vp_width, vp_height);
+      RenderTemporalResolve();
+    });
+    render_graph->Read(resolve, hdr_color_target);
+    render_graph->Read(resolve, motion_target);
+    render_graph->Read(resolve, taa_history);
+    render_graph->Write(resolve, taa_history, GL_NONE);
+  }
+
+  // Auto exposure and bloom share the downsample chain. Each level is only read by the next, so
+  // the upsample chain aliases the downsample levels of the same size.
+  unsigned int exposure = render_graph->ImportRenderTarget("Exposure");
+  if (auto_exposure_enabled || bloom_enabled) {
+    for (unsigned int level = 0; level < gfx::DOWNSAMPLE_LEVELS; level++) {
+      gfx::RenderTargetDescription description{GL_TEXTURE_2D, GL_RGBA16F, 0, 0, 1};
+      GetDownsampleSize(level, &description.width, &description.height);
+      downsample_targets[level] = render_graph->CreateRenderTarget(downsample_names[level],
+          description);
+      unsigned int downsample = render_graph->AddPass(downsample_names[level],
+          [this, level]() { RenderDownsample(level); });
+      if (level == 0) {
+        render_graph->Read(downsample, taa ? taa_history : hdr_color_target);
+      } else {
+        render_graph->Read(downsample, downsample_targets[level - 1]);
+      }
+      render_graph->Write(downsample, downsample_targets[level], GL_COLOR_ATTACHMENT0);
+    }
+  }
+  if (auto_exposure_enabled) {
+    // The exposure is ping-ponged across frames, so it lives outside the graph.
+    unsigned int reduce = render_graph->AddPass("Exposure", [this]() { RenderExposure(); });
+    render_graph->Read(reduce, downsample_targets[gfx::DOWNSAMPLE_LEVELS - 1]);
+    render_graph->Read(reduce, exposure);
+    render_graph->Write(reduce, exposure, GL_NONE);
+  }
+  if (bloom_enabled) {
+    for (unsigned int level = gfx::DOWNSAMPLE_LEVELS - 1; level-- > 0;) {
+      gfx::RenderTargetDescription description{GL_TEXTURE_2D, GL_RGBA16F, 0, 0, 1};
+      GetDownsampleSize(level, &description.width, &description.height);
+      upsample_targets[level] = render_graph->CreateRenderTarget(upsample_names[level],
+          description);
+      unsigned int upsample = render_graph->AddPass(upsample_names[level],
+          [this, level]() { RenderUpsample(level); });
+      render_graph->Read(upsample, level + 1 == gfx::DOWNSAMPLE_LEVELS - 1 ?
+          downsample_targets[level + 1] : upsample_targets[level + 1]);
+      render_graph->Write(upsample, upsample_targets[level], GL_COLOR_ATTACHMENT0);
+    }
+  }
+
+  unsigned int tonemap = render_graph->AddPass("Tonemap", [this]() {
+    glViewport(0, 0, vp_width, vp_height);
+    RenderTonemap();
+  });
+  render_graph->Read(tonemap, taa ? taa_history : hdr_color_target);
+  if (auto_exposure_enabled) {
+    render_graph->Read(tonemap, exposure);
+  }
+  if (bloom_enabled) {
+    render_graph->Read(tonemap, upsample_targets[0]);
+  }
+  render_graph->SetSideEffects(tonemap);
+
+  if (frame_capture != nullptr) {
+    capture_pass = render_graph->AddPass("Capture", [this]() { CaptureFrame(); });
+    render_graph->SetSideEffects(capture_pass);
+    if (frame_capture->GetFormat() == gfx::CapturePfm && !taa) {
+      gfx::RenderTargetDescription resolve_description{GL_TEXTURE_2D, GL_RGBA16F, vp_width,
+          vp_height, 1};
+      unsigned int resolve = render_graph->CreateRenderTarget("Capture resolve",
+          resolve_description);
+      render_graph->Read(capture_pass, hdr_color_target);
+      render_graph->Write(capture_pass, resolve, GL_COLOR_ATTACHMENT0);
+    }
+  }
+  render_graph->Compile();
+}
+
+void gfx::GameWindow::FinishRender() {
+  if (anti_aliasing_mode == gfx::TAA) {
+    frame_index++;
+    UpdatePerspectiveProjection(vp_width, vp_height);
+  }
+  // The shadow passes draw the skinned ModelInstances too, so the palettes are streamed before
+  // any of the passes run.
+  BuildDrawList();
+  render_graph->Execute(profiler);
+  stream_buffer->EndFrame();
+  {
+    gfx::ProfileScope scope(profiler, "Swap");
+    if (headless_context != nullptr) {
+      headless_context->SwapBuffers();
+    } else {
+      glfwSwapBuffers(window);
+    }
+  }
+
+  taa_history_index = 1 - taa_history_index;
+  exposure_index = 1 - exposure_index;
+  previous_view_transform = camera->GetViewTransform();
+  profiler->EndFrame();
 }
 
 void gfx::GameWindow::UpdatePerspectiveProjection(int width, int height) {
   perspective_projection = glm::perspective(glm::radians(field_of_view),
-      (GLfloat)width / (GLfloat)height, 0.1f, 1000.0f);
+      (GLfloat)width / (GLfloat)height, gfx::NEAR_PLANE, gfx::FAR_PLANE);
+  jittered_projection = perspective_projection;
+  if (anti_aliasing_mode != gfx::TAA || render_width == 0 || render_height == 0) {
+    return;
+  }
+  // Offset by a pixel-sized Halton (2, 3) point so successive frames sample different positions
+  // within each pixel.
+  unsigned int bases[] = {2, 3};
+  float jitter[2];
+  for (int axis = 0; axis < 2; axis++) {
+    float fraction = 1.0f;
+    jitter[axis] = 0.0f;
+    for (unsigned int i = frame_index % gfx::TAA_JITTER_PHASES + 1; i > 0; i /= bases[axis]) {
+      fraction /= (float)bases[axis];
+      jitter[axis] += fraction * (float)(i % bases[axis]);
+    }
+    jitter[axis] -= 0.5f;
+  }
+  jittered_projection = glm::translate(glm::mat4(), glm::vec3(
+      2.0f * jitter[0] / (float)render_width, 2.0f * jitter[1] / (float)render_height, 0.0f)) *
+      perspective_projection;
 }
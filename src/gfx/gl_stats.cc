@@ -0,0 +1,195 @@
+#include "gfx/gl_stats.h"
+
+#include <glad/glad.h>
+
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// Appends a count to a summary, abbreviating large counts (e.g. 12.3k).
+void AppendCount(std::ostringstream& out, unsigned long count, const char* unit) {
+  if (count >= 1000000) {
+    out << std::setprecision(3) << count / 1000000.0 << "M";
+  } else if (count >= 10000) {
+    out << std::setprecision(3) << count / 1000.0 << "k";
+  } else {
+    out << count;
+  }
+  out << " " << unit;
+}
+
+// Appends a line summarizing the stats of a frame or pass.
+void AppendStats(std::ostringstream& out, const std::string& name, unsigned int depth,
+    const gfx::GlStats& stats) {
+  out << std::string(2 * depth, ' ') << name << ": ";
+  AppendCount(out, stats.draw_calls, "draws, ");
+  AppendCount(out, stats.triangles, "tris, ");
+  AppendCount(out, stats.program_switches, "programs, ");
+  AppendCount(out, stats.texture_binds, "textures, ");
+  AppendCount(out, stats.uniform_uploads, "uniforms, ");
+  AppendCount(out, stats.buffer_uploads, "uploads (");
+  out << std::setprecision(3) << stats.buffer_upload_bytes / 1024.0 << " KB)\n";
+}
+
+#ifdef GFX_GL_STATS
+// The counts of the commands issued since the program started.
+gfx::GlStats counters = gfx::GlStats();
+
+// The program bound by the last glUseProgram call, to only count the calls that change it.
+GLuint current_program = 0;
+
+// Gets the number of triangles drawn by a draw of count vertices.
+unsigned long CountTriangles(GLenum mode, GLsizei count) {
+  switch (mode) {
+    case GL_TRIANGLES:
+      return count / 3;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN:
+      return count > 2 ? count - 2 : 0;
+    default:
+      return 0;
+  }
+}
+
+// Defines original_<name>, which holds the function glad loaded, and Count<name>, which counts a
+// call to it with the given statement before forwarding it.
+#define GFX_WRAP_GL(name, params, args, count) \
+  decltype(glad_gl##name) original_##name = nullptr; \
+  void APIENTRY Count##name params { \
+    count; \
+    original_##name args; \
+  }
+
+#define GFX_WRAP_UNIFORM(name, params, args) \
+  GFX_WRAP_GL(name, params, args, counters.uniform_uploads++)
+
+GFX_WRAP_GL(DrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count),
+    counters.draw_calls++; counters.triangles += CountTriangles(mode, count))
+GFX_WRAP_GL(DrawElements, (GLenum mode, GLsizei count, GLenum type, const void* indices),
+    (mode, count, type, indices),
+    counters.draw_calls++; counters.triangles += CountTriangles(mode, count))
+GFX_WRAP_GL(DrawArraysInstanced,
+    (GLenum mode, GLint first, GLsizei count, GLsizei instances),
+    (mode, first, count, instances),
+    counters.draw_calls++; counters.triangles += CountTriangles(mode, count) * instances)
+GFX_WRAP_GL(DrawElementsInstanced,
+    (GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances),
+    (mode, count, type, indices, instances),
+    counters.draw_calls++; counters.triangles += CountTriangles(mode, count) * instances)
+
+GFX_WRAP_GL(UseProgram, (GLuint program), (program),
+    counters.program_switches += program != current_program; current_program = program)
+GFX_WRAP_GL(BindTexture, (GLenum target, GLuint texture), (target, texture),
+    counters.texture_binds++)
+
+GFX_WRAP_UNIFORM(Uniform1i, (GLint location, GLint v0), (location, v0))
+GFX_WRAP_UNIFORM(Uniform1f, (GLint location, GLfloat v0), (location, v0))
+GFX_WRAP_UNIFORM(Uniform2f, (GLint location, GLfloat v0, GLfloat v1), (location, v0, v1))
+GFX_WRAP_UNIFORM(Uniform3f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2),
+    (location, v0, v1, v2))
+GFX_WRAP_UNIFORM(Uniform4f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3),
+    (location, v0, v1, v2, v3))
+GFX_WRAP_UNIFORM(Uniform2ui, (GLint location, GLuint v0, GLuint v1), (location, v0, v1))
+GFX_WRAP_UNIFORM(Uniform1iv, (GLint location, GLsizei count, const GLint* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform2iv, (GLint location, GLsizei count, const GLint* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform3iv, (GLint location, GLsizei count, const GLint* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform4iv, (GLint location, GLsizei count, const GLint* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform1uiv, (GLint location, GLsizei count, const GLuint* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform2uiv, (GLint location, GLsizei count, const GLuint* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform3uiv, (GLint location, GLsizei count, const GLuint* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform4uiv, (GLint location, GLsizei count, const GLuint* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform1fv, (GLint location, GLsizei count, const GLfloat* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform2fv, (GLint location, GLsizei count, const GLfloat* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform3fv, (GLint location, GLsizei count, const GLfloat* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(Uniform4fv, (GLint location, GLsizei count, const GLfloat* value),
+    (location, count, value))
+GFX_WRAP_UNIFORM(UniformMatrix3fv,
+    (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value),
+    (location, count, transpose, value))
+GFX_WRAP_UNIFORM(UniformMatrix4fv,
+    (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value),
+    (location, count, transpose, value))
+
+// Buffers allocated without data aren't uploads.
+GFX_WRAP_GL(BufferData, (GLenum target, GLsizeiptr size, const void* data, GLenum usage),
+    (target, size, data, usage),
+    if (data != nullptr) { counters.buffer_uploads++; counters.buffer_upload_bytes += size; })
+GFX_WRAP_GL(BufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void* data),
+    (target, offset, size, data),
+    counters.buffer_uploads++; counters.buffer_upload_bytes += size)
+GFX_WRAP_GL(FlushMappedBufferRange, (GLenum target, GLintptr offset, GLsizeiptr length),
+    (target, offset, length),
+    counters.buffer_uploads++; counters.buffer_upload_bytes += length)
+
+#undef GFX_WRAP_UNIFORM
+#undef GFX_WRAP_GL
+#endif
+
+}
+
+#ifdef GFX_GL_STATS
+void gfx::gl_stats::Install() {
+  // Functions the context doesn't have stay null, and wrapped functions aren't wrapped again.
+#define GFX_INSTALL_GL(name) \
+  if (glad_gl##name != nullptr && glad_gl##name != Count##name) { \
+    original_##name = glad_gl##name; \
+    glad_gl##name = Count##name; \
+  }
+  GFX_INSTALL_GL(DrawArrays)
+  GFX_INSTALL_GL(DrawElements)
+  GFX_INSTALL_GL(DrawArraysInstanced)
+  GFX_INSTALL_GL(DrawElementsInstanced)
+  GFX_INSTALL_GL(UseProgram)
+  GFX_INSTALL_GL(BindTexture)
+  GFX_INSTALL_GL(Uniform1i)
+  GFX_INSTALL_GL(Uniform1f)
+  GFX_INSTALL_GL(Uniform2f)
+  GFX_INSTALL_GL(Uniform3f)
+  GFX_INSTALL_GL(Uniform4f)
+  GFX_INSTALL_GL(Uniform2ui)
+  GFX_INSTALL_GL(Uniform1iv)
+  GFX_INSTALL_GL(Uniform2iv)
+  GFX_INSTALL_GL(Uniform3iv)
+  GFX_INSTALL_GL(Uniform4iv)
+  GFX_INSTALL_GL(Uniform1uiv)
+  GFX_INSTALL_GL(Uniform2uiv)
+  GFX_INSTALL_GL(Uniform3uiv)
+  GFX_INSTALL_GL(Uniform4uiv)
+  GFX_INSTALL_GL(Uniform1fv)
+  GFX_INSTALL_GL(Uniform2fv)
+  GFX_INSTALL_GL(Uniform3fv)
+  GFX_INSTALL_GL(Uniform4fv)
+  GFX_INSTALL_GL(UniformMatrix3fv)
+  GFX_INSTALL_GL(UniformMatrix4fv)
+  GFX_INSTALL_GL(BufferData)
+  GFX_INSTALL_GL(BufferSubData)
+  GFX_INSTALL_GL(FlushMappedBufferRange)
+#undef GFX_INSTALL_GL
+  current_program = 0;
+}
+
+gfx::GlStats gfx::gl_stats::GetCounters() {
+  return counters;
+}
+#endif
+
+std::string gfx::gl_stats::Format(const gfx::FrameGlStats& stats) {
+  std::ostringstream out;
+  AppendStats(out, "Frame", 0, stats.total);
+  for (const gfx::GlPassStats& pass : stats.passes) {
+    AppendStats(out, pass.name, pass.depth, pass.stats);
+  }
+  return out.str();
+}
@@ -0,0 +1,118 @@
+#include "gfx/exceptions.h"
+#include "gfx/headless_context.h"
+
+#ifdef GFX_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstring>
+#include <iostream>
+
+#ifdef GFX_HEADLESS_EGL
+
+namespace {
+
+// Gets Mesa's surfaceless display if the EGL implementation supports it, and the default display
+// otherwise.
+EGLDisplay GetHeadlessDisplay() {
+  const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (extensions != nullptr && std::strstr(extensions, "EGL_MESA_platform_surfaceless") &&
+      std::strstr(extensions, "EGL_EXT_platform_base")) {
+    auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+        "eglGetPlatformDisplayEXT");
+    if (get_platform_display != nullptr) {
+      EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+          EGL_DEFAULT_DISPLAY, nullptr);
+      if (display != EGL_NO_DISPLAY) {
+        return display;
+      }
+    }
+  }
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+}
+
+gfx::HeadlessContext::HeadlessContext(int width, int height) : display{EGL_NO_DISPLAY},
+    surface{EGL_NO_SURFACE}, context{EGL_NO_CONTEXT}, width{width}, height{height},
+    start_time{std::chrono::steady_clock::now()} {
+  display = GetHeadlessDisplay();
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr) ||
+      !eglBindAPI(EGL_OPENGL_API)) {
+    std::cout << "Failed to initialize EGL." << std::endl;
+    throw gfx::CannotCreateHeadlessContextException();
+  }
+
+  EGLint config_attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE,
+      EGL_OPENGL_BIT, EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+      EGL_DEPTH_SIZE, 24, EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display, config_attributes, &config, 1, &num_configs) ||
+      num_configs == 0) {
+    std::cout << "Failed to find an EGL config with pbuffer support." << std::endl;
+    eglTerminate(display);
+    throw gfx::CannotCreateHeadlessContextException();
+  }
+
+  EGLint surface_attributes[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+  surface = eglCreatePbufferSurface(display, config, surface_attributes);
+  EGLint context_attributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+  if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+      !eglMakeCurrent(display, surface, surface, context)) {
+    std::cout << "Failed to create a headless OpenGL context." << std::endl;
+    eglTerminate(display);
+    throw gfx::CannotCreateHeadlessContextException();
+  }
+}
+
+gfx::HeadlessContext::~HeadlessContext() {
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(display, context);
+  eglDestroySurface(display, surface);
+  eglTerminate(display);
+}
+
+void gfx::HeadlessContext::SwapBuffers() {
+  eglSwapBuffers(display, surface);
+}
+
+void* gfx::HeadlessContext::GetProcAddress(const char* name) {
+  return (void*)eglGetProcAddress(name);
+}
+
+#else
+
+gfx::HeadlessContext::HeadlessContext(int width, int height) : display{nullptr},
+    surface{nullptr}, context{nullptr}, width{width}, height{height},
+    start_time{std::chrono::steady_clock::now()} {
+  std::cout << "The engine was built without EGL, so headless contexts are unavailable." <<
+      std::endl;
+  throw gfx::CannotCreateHeadlessContextException();
+}
+
+gfx::HeadlessContext::~HeadlessContext() {}
+
+void gfx::HeadlessContext::SwapBuffers() {}
+
+void* gfx::HeadlessContext::GetProcAddress(const char* /* name */) {
+  return nullptr;
+}
+
+#endif
+
+int gfx::HeadlessContext::GetWidth() {
+  return width;
+}
+
+int gfx::HeadlessContext::GetHeight() {
+  return height;
+}
+
+double gfx::HeadlessContext::GetElapsedTime() {
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+  return elapsed.count();
+}
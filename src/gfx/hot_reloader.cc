@@ -0,0 +1,86 @@
+#include "gfx/hot_reloader.h"
+
+#ifdef GFX_INOTIFY
+#include <sys/stat.h>
+#include <time.h>
+#endif
+
+#include <chrono>
+#include <exception>
+
+gfx::HotReloader::HotReloader(gfx::GameWindow* window, gfx::TextureManager* manager) :
+    window{window}, manager{manager}, watcher(), models() {
+  watcher.WatchDirectory(gfx::shaders_path);
+  watcher.WatchDirectory(gfx::assets_path);
+}
+
+void gfx::HotReloader::AddModel(std::string model_path, gfx::ModelInfo* model_info) {
+  models[model_path] = model_info;
+}
+
+gfx::ReloadKind gfx::HotReloader::GetKind(const std::string& path) {
+  std::string extension = path.substr(path.find_last_of('.') + 1);
+  if (extension == "vert" || extension == "frag" || extension == "glsl" || extension == "geom" ||
+      extension == "comp") {
+    return gfx::ShaderReload;
+  } else if (extension == "eo") {
+    return gfx::ModelReload;
+  }
+  return gfx::TextureReload;
+}
+
+double gfx::HotReloader::GetTimeSinceModified(const std::string& path) {
+#ifdef GFX_INOTIFY
+  // The modification time is on the realtime clock, so compare it against that clock.
+  struct stat file_stat;
+  timespec now;
+  if (stat(path.c_str(), &file_stat) != 0 || clock_gettime(CLOCK_REALTIME, &now) != 0) {
+    return 0.0;
+  }
+  return (now.tv_sec - file_stat.st_mtim.tv_sec) * 1000.0 +
+      (now.tv_nsec - file_stat.st_mtim.tv_nsec) / 1000000.0;
+#else
+  (void)path;
+  return 0.0;
+#endif
+}
+
+bool gfx::HotReloader::Reload(const std::string& path, gfx::ReloadKind kind) {
+  switch (kind) {
+    case gfx::ShaderReload:
+      return window->ReloadShader(path);
+    case gfx::ModelReload: {
+      auto model_it = models.find(path);
+      if (model_it == models.end()) {
+        return false;
+      }
+      model_it->second->Reload(path, manager);
+      return true;
+    }
+    default:
+      return manager->ReloadTexture(path);
+  }
+}
+
+std::vector<gfx::ReloadEvent> gfx::HotReloader::Update() {
+  std::vector<gfx::ReloadEvent> events;
+  for (const std::string& path : watcher.Poll()) {
+    gfx::ReloadKind kind = GetKind(path);
+    auto start = std::chrono::steady_clock::now();
+    bool reloaded = true;
+    std::string error;
+    try {
+      reloaded = Reload(path, kind);
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
+    if (!reloaded) {
+      continue;
+    }
+    std::chrono::duration<double, std::milli> reload_time =
+        std::chrono::steady_clock::now() - start;
+    events.push_back(gfx::ReloadEvent{path, kind, error.empty(), error, reload_time.count(),
+        GetTimeSinceModified(path)});
+  }
+  return events;
+}
@@ -0,0 +1,307 @@
+#include "gfx/bvh.h"
+#include "gfx/exceptions.h"
+#include "gfx/irradiance_volume.h"
+#include "gfx/util.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+
+namespace {
+
+// A fairly granular value for Pi.
+const float pi = 3.1415926535897932384626433832795f;
+
+// The smallest distance between probes, which keeps a flat box from dividing by zero.
+const float min_cell_size = 1e-6f;
+
+// An environment box filtered down for sampling by the bake, with the first row at a v coordinate
+// of 0 like an OpenGL texture.
+struct Sky {
+  int width;
+  int height;
+  std::vector<glm::vec3> texels;
+};
+
+// Decodes the image of an environment and box filters it down to at most
+// IRRADIANCE_ENVIRONMENT_WIDTH texels wide, keeping its aspect ratio.
+Sky LoadSky(gfx::Environment* environment) {
+  int image_width, image_height, num_components;
+  float* image_data = gfx::Environment::DecodeImage(environment->path, &image_width,
+      &image_height, &num_components);
+  if (image_data == nullptr) {
+    throw gfx::CannotLoadTextureException();
+  }
+  Sky sky;
+  sky.width = std::min(image_width, gfx::IRRADIANCE_ENVIRONMENT_WIDTH);
+  sky.height = std::max(image_height * sky.width / image_width, 1);
+  sky.texels.resize(sky.width * sky.height);
+  for (int y = 0; y < sky.height; y++) {
+    int begin_y = y * image_height / sky.height;
+    int end_y = std::max((y + 1) * image_height / sky.height, begin_y + 1);
+    for (int x = 0; x < sky.width; x++) {
+      int begin_x = x * image_width / sky.width;
+      int end_x = std::max((x + 1) * image_width / sky.width, begin_x + 1);
+      glm::vec3 sum(0.0f);
+      for (int image_y = begin_y; image_y < end_y; image_y++) {
+        for (int image_x = begin_x; image_x < end_x; image_x++) {
+          const float* texel = image_data + (image_y * image_width + image_x) * num_components;
+          sum += glm::vec3(texel[0], texel[1], texel[2]);
+        }
+      }
+      sky.texels[y * sky.width + x] = sum / (float)((end_x - begin_x) * (end_y - begin_y));
+    }
+  }
+  gfx::Environment::FreeImage(image_data);
+  return sky;
+}
+
+// Samples the radiance of the sky in a direction with bilinear filtering, using the
+// equirectangular coordinates of lighting.glsl.
+glm::vec3 SampleSky(const Sky& sky, glm::vec3 direction) {
+  glm::vec2 uv((1.0f + std::atan2(direction.x, direction.z) / pi) / 2.0f,
+      std::acos(glm::clamp(direction.y, -1.0f, 1.0f)) / pi);
+  glm::vec2 texel = uv * glm::vec2((float)sky.width, (float)sky.height) - 0.5f;
+  glm::vec2 base = glm::floor(texel);
+  glm::vec2 weight = texel - base;
+  int x0 = glm::clamp((int)base.x, 0, sky.width - 1);
+  int y0 = glm::clamp((int)base.y, 0, sky.height - 1);
+  int x1 = glm::clamp((int)base.x + 1, 0, sky.width - 1);
+  int y1 = glm::clamp((int)base.y + 1, 0, sky.height - 1);
+  glm::vec3 top = glm::mix(sky.texels[y0 * sky.width + x0], sky.texels[y0 * sky.width + x1],
+      weight.x);
+  glm::vec3 bottom = glm::mix(sky.texels[y1 * sky.width + x0], sky.texels[y1 * sky.width + x1],
+      weight.x);
+  return glm::mix(top, bottom, weight.y);
+}
+
+// Evaluates the 9 real L2 spherical harmonics basis functions in a (normalized) direction. This
+// must match get_sh_basis in lighting.glsl.
+void GetShBasis(glm::vec3 direction, float basis[gfx::IRRADIANCE_SH_COEFFICIENTS]) {
+  basis[0] = 0.282095f;
+  basis[1] = 0.488603f * direction.y;
+  basis[2] = 0.488603f * direction.z;
+  basis[3] = 0.488603f * direction.x;
+  basis[4] = 1.092548f * direction.x * direction.y;
+  basis[5] = 1.092548f * direction.y * direction.z;
+  basis[6] = 0.315392f * (3.0f * direction.z * direction.z - 1.0f);
+  basis[7] = 1.092548f * direction.x * direction.z;
+  basis[8] = 0.546274f * (direction.x * direction.x - direction.y * direction.y);
+}
+
+// The factors that convolve the radiance coefficients of each band with a clamped cosine, turning
+// them into irradiance coefficients.
+const float cosine_lobe[gfx::IRRADIANCE_SH_COEFFICIENTS] = {pi, 2.0f * pi / 3.0f,
+    2.0f * pi / 3.0f, 2.0f * pi / 3.0f, pi / 4.0f, pi / 4.0f, pi / 4.0f, pi / 4.0f, pi / 4.0f};
+
+}
+
+gfx::IrradianceVolume::IrradianceVolume(glm::vec3 min, glm::vec3 max, glm::ivec3 resolution) :
+    volume_handle{0}, min{min}, max{max}, resolution{glm::max(resolution, glm::ivec3(1))},
+    coefficients(), rays_traced{0} {
+  coefficients.assign((size_t)this->resolution.x * this->resolution.y * this->resolution.z *
+      gfx::IRRADIANCE_SH_COEFFICIENTS, glm::vec3(0.0f));
+}
+
+gfx::IrradianceVolume::IrradianceVolume(std::string path) : volume_handle{0}, min(), max(),
+    resolution(), coefficients(), rays_traced{0} {
+  std::ifstream input_file(path, std::ios::binary);
+  if (!input_file) {
+    throw gfx::CannotOpenIrradianceVolumeException();
+  }
+  int32_t file_resolution[3];
+  input_file.read((char*)(&min), sizeof(glm::vec3));
+  input_file.read((char*)(&max), sizeof(glm::vec3));
+  input_file.read((char*)(file_resolution), sizeof(file_resolution));
+  if (!input_file) {
+    throw gfx::InvalidIrradianceVolumeException();
+  }
+
+  // Check the number of probes against the rest of the file before allocating them.
+  std::streamoff header_size = input_file.tellg();
+  input_file.seekg(0, std::ios::end);
+  std::streamoff num_remaining_probes = (input_file.tellg() - header_size) /
+      (std::streamoff)(sizeof(glm::vec3) * gfx::IRRADIANCE_SH_COEFFICIENTS);
+  input_file.seekg(header_size);
+  std::streamoff num_probes = 1;
+  for (int i = 0; i < 3; i++) {
+    if (file_resolution[i] < 1 || file_resolution[i] > num_remaining_probes / num_probes) {
+      throw gfx::InvalidIrradianceVolumeException();
+    }
+    num_probes *= file_resolution[i];
+    resolution[i] = file_resolution[i];
+  }
+  coefficients.resize((size_t)num_probes * gfx::IRRADIANCE_SH_COEFFICIENTS);
+  input_file.read((char*)(coefficients.data()), sizeof(glm::vec3) * coefficients.size());
+  if (!input_file || input_file.get() != EOF) {
+    throw gfx::InvalidIrradianceVolumeException();
+  }
+}
+
+gfx::IrradianceVolume::~IrradianceVolume() {
+  if (volume_handle != 0) {
+    glDeleteTextures(1, &volume_handle);
+  }
+}
+
+void gfx::IrradianceVolume::Bake(const std::vector<gfx::ModelInstance*>& instances,
+    gfx::Environment* environment, unsigned int rays_per_probe, gfx::JobSystem* job_system) {
+  Sky sky = LoadSky(environment);
+
+  // Trace against the triangles of every instance in world space.
+  std::vector<glm::vec3> positions;
+  std::vector<GLuint> indices;
+  for (gfx::ModelInstance* instance : instances) {
+    glm::mat4 model_transform = instance->GetModelTransform();
+    for (gfx::Mesh& mesh : instance->GetModelInfo()->meshes) {
+      GLuint first_vertex = (GLuint)positions.size();
+      for (const gfx::Vertex& vertex : mesh.GetVertices()) {
+        positions.push_back(glm::vec3(model_transform * glm::vec4(vertex.position, 1.0f)));
+      }
+      for (GLuint index : mesh.GetIndices()) {
+        indices.push_back(first_vertex + index);
+      }
+    }
+  }
+  gfx::Bvh bvh(positions, indices);
+
+  unsigned int num_rays = std::max((rays_per_probe + 3) / 4 * 4, 4u);
+  std::vector<glm::vec2> hammersley_points(num_rays);
+  for (unsigned int i = 0; i < num_rays; i++) {
+    hammersley_points[i] = gfx::util::GetHammersleyPoint(i, num_rays);
+  }
+
+  // Project the radiance arriving at each probe onto the basis, using uniformly distributed
+  // directions rotated by a hash of the probe so neighboring probes don't alias the same way.
+  size_t num_probes = (size_t)resolution.x * resolution.y * resolution.z;
+  glm::vec3 cell_size = GetCellSize();
+  job_system->ParallelFor(num_probes, gfx::IRRADIANCE_BAKE_GRAIN_SIZE, [this, &sky, &bvh,
+      &hammersley_points, num_rays, num_probes, cell_size](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      glm::ivec3 probe((int)(i % resolution.x), (int)(i / resolution.x % resolution.y),
+          (int)(i / ((size_t)resolution.x * resolution.y)));
+      glm::vec3 origin = min + glm::vec3(probe) * cell_size;
+      glm::vec3 origins[4] = {origin, origin, origin, origin};
+      uint32_t hash = gfx::util::Hash((uint32_t)i);
+      glm::vec2 rotation((float)(hash & 0xFFFF) / 65536.0f, (float)(hash >> 16) / 65536.0f);
+
+      glm::vec3 radiance[gfx::IRRADIANCE_SH_COEFFICIENTS] = {};
+      for (unsigned int ray = 0; ray < num_rays; ray += 4) {
+        glm::vec3 directions[4];
+        for (unsigned int j = 0; j < 4; j++) {
+          glm::vec2 point = hammersley_points[ray + j] + rotation;
+          point -= glm::floor(point);
+          float z = 1.0f - 2.0f * point.x;
+          float radius = std::sqrt(std::max(1.0f - z * z, 0.0f));
+          float phi = 2.0f * pi * point.y;
+          directions[j] = glm::vec3(radius * std::cos(phi), radius * std::sin(phi), z);
+        }
+        unsigned int occluded = bvh.GetOccludedRays(origins, directions, FLT_MAX);
+        for (unsigned int j = 0; j < 4; j++) {
+          if (occluded & (1u << j)) {
+            continue;
+          }
+          glm::vec3 sample = SampleSky(sky, directions[j]);
+          float basis[gfx::IRRADIANCE_SH_COEFFICIENTS];
+          GetShBasis(directions[j], basis);
+          for (unsigned int k = 0; k < gfx::IRRADIANCE_SH_COEFFICIENTS; k++) {
+            radiance[k] += sample * basis[k];
+          }
+        }
+      }
+      // Each direction covers an equal share of the sphere's solid angle.
+      float weight = 4.0f * pi / (float)num_rays;
+      for (unsigned int k = 0; k < gfx::IRRADIANCE_SH_COEFFICIENTS; k++) {
+        coefficients[k * num_probes + i] = radiance[k] * (weight * cosine_lobe[k]);
+      }
+    }
+  });
+  rays_traced = num_probes * num_rays;
+}
+
+void gfx::IrradianceVolume::Write(std::string path) {
+  std::ofstream output_file(path, std::ios::binary);
+  int32_t file_resolution[3] = {resolution.x, resolution.y, resolution.z};
+  output_file.write((const char*)(&min), sizeof(glm::vec3));
+  output_file.write((const char*)(&max), sizeof(glm::vec3));
+  output_file.write((const char*)(file_resolution), sizeof(file_resolution));
+  output_file.write((const char*)(coefficients.data()), sizeof(glm::vec3) * coefficients.size());
+  if (!output_file) {
+    throw gfx::CannotWriteIrradianceVolumeException();
+  }
+}
+
+void gfx::IrradianceVolume::Upload() {
+  if (volume_handle == 0) {
+    glGenTextures(1, &volume_handle);
+    glBindTexture(GL_TEXTURE_3D, volume_handle);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(GL_TEXTURE_3D, volume_handle);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, resolution.x, resolution.y,
+      resolution.z * gfx::IRRADIANCE_SH_COEFFICIENTS, 0, GL_RGB, GL_FLOAT, coefficients.data());
+  glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+glm::vec3 gfx::IrradianceVolume::GetIrradiance(glm::vec3 position, glm::vec3 normal) {
+  // Offset along the normal by half a cell so the surface doesn't pick up the probes behind it.
+  glm::vec3 cell_size = GetCellSize();
+  glm::vec3 offset_position = position + normal * (0.5f * std::min(std::min(cell_size.x,
+      cell_size.y), cell_size.z));
+  glm::vec3 grid = glm::clamp((offset_position - min) / cell_size, glm::vec3(0.0f),
+      glm::vec3(resolution - 1));
+  glm::ivec3 corner = glm::min(glm::ivec3(grid), resolution - 1);
+  glm::ivec3 next_corner = glm::min(corner + 1, resolution - 1);
+  glm::vec3 weight = grid - glm::vec3(corner);
+
+  size_t num_probes = (size_t)resolution.x * resolution.y * resolution.z;
+  float basis[gfx::IRRADIANCE_SH_COEFFICIENTS];
+  GetShBasis(normal, basis);
+  glm::vec3 irradiance(0.0f);
+  for (unsigned int k = 0; k < gfx::IRRADIANCE_SH_COEFFICIENTS; k++) {
+    const glm::vec3* block = coefficients.data() + k * num_probes;
+    auto get = [this, block](int x, int y, int z) {
+      return block[((size_t)z * resolution.y + y) * resolution.x + x];
+    };
+    glm::vec3 front = glm::mix(
+        glm::mix(get(corner.x, corner.y, corner.z), get(next_corner.x, corner.y, corner.z),
+        weight.x),
+        glm::mix(get(corner.x, next_corner.y, corner.z),
+        get(next_corner.x, next_corner.y, corner.z), weight.x), weight.y);
+    glm::vec3 back = glm::mix(
+        glm::mix(get(corner.x, corner.y, next_corner.z),
+        get(next_corner.x, corner.y, next_corner.z), weight.x),
+        glm::mix(get(corner.x, next_corner.y, next_corner.z),
+        get(next_corner.x, next_corner.y, next_corner.z), weight.x), weight.y);
+    irradiance += glm::mix(front, back, weight.z) * basis[k];
+  }
+  // L2 irradiance can ring below zero opposite bright lights.
+  return glm::max(irradiance, glm::vec3(0.0f));
+}
+
+glm::vec3 gfx::IrradianceVolume::GetMin() {
+  return min;
+}
+
+glm::vec3 gfx::IrradianceVolume::GetMax() {
+  return max;
+}
+
+glm::ivec3 gfx::IrradianceVolume::GetResolution() {
+  return resolution;
+}
+
+size_t gfx::IrradianceVolume::GetRaysTraced() {
+  return rays_traced;
+}
+
+glm::vec3 gfx::IrradianceVolume::GetCellSize() {
+  return glm::max((max - min) / glm::vec3(glm::max(resolution - 1, glm::ivec3(1))),
+      glm::vec3(min_cell_size));
+}
@@ -0,0 +1,240 @@
+#include "gfx/job_system.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace {
+
+// The job system the calling thread is a worker of, and the index of its queue.
+thread_local const gfx::JobSystem* current_job_system = nullptr;
+thread_local unsigned int current_queue_index = 0;
+
+}
+
+gfx::JobCounter::JobCounter() : count{0}, error{nullptr} {}
+
+bool gfx::JobCounter::IsDone() {
+  if (count.load() != 0) {
+    return false;
+  }
+  // Lock the mutex so a waiter can't return (and destroy the counter) while the thread that
+  // finished the last job is still scheduling the continuations.
+  std::lock_guard<std::mutex> lock(mutex);
+  return count.load() == 0;
+}
+
+gfx::JobSystem::JobSystem(unsigned int num_workers) : main_thread_id{std::this_thread::get_id()},
+    queued_jobs{0}, sleeping_workers{0}, stopping{false} {
+  for (unsigned int i = 0; i < num_workers + 1; i++) {
+    queues.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+  }
+  for (unsigned int i = 0; i < num_workers; i++) {
+    workers.push_back(std::thread(&gfx::JobSystem::RunWorker, this, i + 1));
+  }
+}
+
+gfx::JobSystem::~JobSystem() {
+  stopping = true;
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+  }
+  wake_up.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+void gfx::JobSystem::Run(std::function<void()> job, gfx::JobCounter* counter) {
+  if (counter != nullptr) {
+    counter->count++;
+  }
+  Push(Job{std::move(job), counter});
+}
+
+void gfx::JobSystem::Run(std::function<void()> job, gfx::JobCounter* counter,
+    gfx::JobCounter* dependency) {
+  if (counter != nullptr) {
+    counter->count++;
+  }
+  {
+    std::lock_guard<std::mutex> lock(dependency->mutex);
+    if (dependency->count.load() != 0) {
+      dependency->continuations.push_back(std::make_pair(std::move(job), counter));
+      return;
+    }
+  }
+  Push(Job{std::move(job), counter});
+}
+
+void gfx::JobSystem::RunOnMainThread(std::function<void()> job, gfx::JobCounter* counter) {
+  if (counter != nullptr) {
+    counter->count++;
+  }
+  std::lock_guard<std::mutex> lock(main_thread_jobs.mutex);
+  main_thread_jobs.jobs.push_back(Job{std::move(job), counter});
+}
+
+void gfx::JobSystem::RunMainThreadJobs() {
+  // Only run the jobs that are already queued so a job that posts another can't starve the frame.
+  std::deque<Job> jobs;
+  {
+    std::lock_guard<std::mutex> lock(main_thread_jobs.mutex);
+    jobs.swap(main_thread_jobs.jobs);
+  }
+  for (Job& job : jobs) {
+    Execute(job);
+  }
+}
+
+void gfx::JobSystem::Wait(gfx::JobCounter* counter) {
+  unsigned int queue_index = GetQueueIndex();
+  bool is_main_thread = std::this_thread::get_id() == main_thread_id;
+  while (!counter->IsDone()) {
+    if (is_main_thread) {
+      RunMainThreadJobs();
+    }
+    Job job;
+    if (TryTakeJob(queue_index, &job)) {
+      Execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  std::exception_ptr error = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(counter->mutex);
+    std::swap(error, counter->error);
+  }
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
+
+void gfx::JobSystem::ParallelFor(size_t count, size_t grain_size,
+    const std::function<void(size_t, size_t)>& body) {
+  if (count == 0) {
+    return;
+  }
+  grain_size = std::max(grain_size, (size_t)1);
+  // Don't schedule jobs for loops that fit in a single chunk.
+  if (workers.empty() || count <= grain_size) {
+    body(0, count);
+    return;
+  }
+  gfx::JobCounter counter;
+  for (size_t begin = grain_size; begin < count; begin += grain_size) {
+    size_t end = std::min(begin + grain_size, count);
+    Run([&body, begin, end]() { body(begin, end); }, &counter);
+  }
+  // Work on the first chunk here while the workers steal the others. The jobs refer to the body
+  // and the counter, so wait for them before letting an exception leave this frame.
+  try {
+    body(0, grain_size);
+  } catch (...) {
+    try {
+      Wait(&counter);
+    } catch (...) {
+    }
+    throw;
+  }
+  Wait(&counter);
+}
+
+unsigned int gfx::JobSystem::GetNumThreads() {
+  return workers.size() + 1;
+}
+
+unsigned int gfx::JobSystem::GetQueueIndex() {
+  return current_job_system == this ? current_queue_index : 0;
+}
+
+void gfx::JobSystem::Push(Job job) {
+  JobQueue& queue = *queues[GetQueueIndex()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(std::move(job));
+  }
+  queued_jobs++;
+  // Workers increment sleeping_workers before checking queued_jobs, so either they see the new job
+  // or this sees them asleep and wakes one.
+  if (sleeping_workers.load() > 0) {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake_up.notify_one();
+  }
+}
+
+bool gfx::JobSystem::TryTakeJob(unsigned int queue_index, Job* job) {
+  if (queued_jobs.load() == 0) {
+    return false;
+  }
+  {
+    JobQueue& queue = *queues[queue_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      *job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+      queued_jobs--;
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues.size(); i++) {
+    JobQueue& queue = *queues[(queue_index + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      *job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+      queued_jobs--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void gfx::JobSystem::Execute(Job& job) {
+  try {
+    job.function();
+  } catch (...) {
+    if (job.counter == nullptr) {
+      std::terminate();
+    }
+    std::lock_guard<std::mutex> lock(job.counter->mutex);
+    if (job.counter->error == nullptr) {
+      job.counter->error = std::current_exception();
+    }
+  }
+  Finish(job.counter);
+}
+
+void gfx::JobSystem::Finish(gfx::JobCounter* counter) {
+  if (counter == nullptr) {
+    return;
+  }
+  std::vector<std::pair<std::function<void()>, gfx::JobCounter*>> ready;
+  {
+    std::lock_guard<std::mutex> lock(counter->mutex);
+    if (--counter->count == 0) {
+      ready.swap(counter->continuations);
+    }
+  }
+  for (auto& continuation : ready) {
+    Push(Job{std::move(continuation.first), continuation.second});
+  }
+}
+
+void gfx::JobSystem::RunWorker(unsigned int queue_index) {
+  current_job_system = this;
+  current_queue_index = queue_index;
+  while (!stopping) {
+    Job job;
+    if (TryTakeJob(queue_index, &job)) {
+      Execute(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    sleeping_workers++;
+    wake_up.wait(lock, [this]() { return stopping || queued_jobs.load() > 0; });
+    sleeping_workers--;
+  }
+}
@@ -0,0 +1,461 @@
+#include "gfx/exceptions.h"
+#include "gfx/ltc_table.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+
+namespace {
+
+// A fairly granular value for Pi.
+const float pi = 3.1415926535897932384626433832795f;
+
+// The smallest alpha fitted, since the lobe of a perfectly smooth surface is a Dirac delta.
+const float min_alpha = 0.001f;
+
+// The largest view angle fitted, since the lobe is undefined at grazing angles.
+const float max_theta = 1.57f;
+
+// The size of the starting simplex of each fit, the relative difference between its best and
+// worst points that the fit stops at, and the most iterations it takes.
+const float fit_step = 0.05f;
+const float fit_tolerance = 1e-5f;
+const int fit_max_iterations = 100;
+
+// The number of steps the form factor of a clipped sphere is integrated over.
+const int sphere_steps = 1024;
+
+// A clamped cosine distribution transformed by M = basis * [m11 0 m13; 0 m22 0; 0 0 1], where
+// the basis rotates z to the average direction of the lobe.
+struct Ltc {
+  float m11;
+  float m22;
+  float m13;
+  glm::mat3 basis;
+  // The integral of the lobe, which scales the distribution.
+  float amplitude;
+  glm::mat3 transform;
+  glm::mat3 inverse_transform;
+  float determinant;
+
+  // Recomputes the transform and its inverse after the parameters change.
+  void Update() {
+    transform = basis * glm::mat3(glm::vec3(m11, 0.0f, 0.0f), glm::vec3(0.0f, m22, 0.0f),
+        glm::vec3(m13, 0.0f, 1.0f));
+    inverse_transform = glm::inverse(transform);
+    determinant = std::abs(glm::determinant(transform));
+  }
+
+  // Evaluates the normalized distribution in a direction.
+  float Evaluate(glm::vec3 direction) const {
+    glm::vec3 original = glm::normalize(inverse_transform * direction);
+    float length = glm::length(transform * original);
+    float jacobian = determinant / (length * length * length);
+    return std::max(original.z, 0.0f) / pi / jacobian;
+  }
+
+  // Samples a direction from the distribution given two uniform random numbers.
+  glm::vec3 Sample(float u1, float u2) const {
+    float theta = std::acos(std::sqrt(u1));
+    float phi = 2.0f * pi * u2;
+    return glm::normalize(transform * glm::vec3(std::sin(theta) * std::cos(phi),
+        std::sin(theta) * std::sin(phi), std::cos(theta)));
+  }
+};
+
+// Gets the Fresnel factor of lighting.glsl, which Fresnel scales by (1 - f0) on top of f0.
+float GetFresnelFactor(float dot_vh) {
+  return std::exp2((-5.55473f * dot_vh - 6.98316f) * dot_vh);
+}
+
+// Evaluates the Cook-Torrance lobe of lighting.glsl times the cosine of the light direction,
+// without Fresnel, and the probability of sampling the light direction with SampleLobe.
+float EvaluateLobe(glm::vec3 view, glm::vec3 light, float roughness, float* pdf) {
+  if (light.z <= 0.0f) {
+    *pdf = 0.0f;
+    return 0.0f;
+  }
+  glm::vec3 halfway = glm::normalize(view + light);
+  float alpha = std::max(roughness * roughness, min_alpha);
+  float alpha_2 = alpha * alpha;
+  // This is cos^2 * (alpha^2 - 1) + 1 rearranged to keep its precision for small alphas.
+  float denominator = halfway.x * halfway.x + halfway.y * halfway.y +
+      halfway.z * halfway.z * alpha_2;
+  float d = alpha_2 / (pi * denominator * denominator);
+  float k = (roughness + 1.0f) * (roughness + 1.0f) / 8.0f;
+  float g1l = light.z / (light.z * (1.0f - k) + k);
+  float g1v = view.z / (view.z * (1.0f - k) + k);
+  *pdf = d * halfway.z / (4.0f * glm::dot(view, halfway));
+  return d * g1l * g1v / view.z;
+}
+
+// Samples a light direction by sampling the GGX distribution of halfway vectors, as the IBL in
+// lighting.glsl does.
+glm::vec3 SampleLobe(glm::vec3 view, float roughness, float u1, float u2) {
+  float alpha = std::max(roughness * roughness, min_alpha);
+  float theta = std::atan(alpha * std::sqrt(u1 / (1.0f - u1)));
+  float phi = 2.0f * pi * u2;
+  glm::vec3 halfway(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi),
+      std::cos(theta));
+  return glm::normalize(halfway * (2.0f * glm::dot(view, halfway)) - view);
+}
+
+// Integrates the lobe and the lobe times the Fresnel factor over the sphere, and averages the
+// directions of the lobe.
+void IntegrateLobe(glm::vec3 view, float roughness, unsigned int samples, float* norm,
+    float* fresnel, glm::vec3* average_direction) {
+  double norm_sum = 0.0;
+  double fresnel_sum = 0.0;
+  glm::dvec3 direction_sum(0.0);
+  for (unsigned int j = 0; j < samples; j++) {
+    for (unsigned int i = 0; i < samples; i++) {
+      float u1 = (i + 0.5f) / samples;
+      float u2 = (j + 0.5f) / samples;
+      glm::vec3 light = SampleLobe(view, roughness, u1, u2);
+      float pdf;
+      float value = EvaluateLobe(view, light, roughness, &pdf);
+      if (pdf > 0.0f) {
+        double weight = value / pdf;
+        glm::vec3 halfway = glm::normalize(view + light);
+        norm_sum += weight;
+        fresnel_sum += weight * GetFresnelFactor(std::max(glm::dot(view, halfway), 0.0f));
+        direction_sum += glm::dvec3(light) * weight;
+      }
+    }
+  }
+  *norm = (float)(norm_sum / (samples * samples));
+  *fresnel = (float)(fresnel_sum / (samples * samples));
+  // The lobe is symmetric about the xz plane.
+  *average_direction = glm::normalize(glm::vec3((float)direction_sum.x, 0.0f,
+      (float)direction_sum.z));
+}
+
+// Measures how far an LTC strays from the lobe, sampling both with multiple importance sampling
+// and cubing the differences so the fit favors the peak.
+double ComputeError(const Ltc& ltc, glm::vec3 view, float roughness, unsigned int samples) {
+  double error = 0.0;
+  for (unsigned int j = 0; j < samples; j++) {
+    for (unsigned int i = 0; i < samples; i++) {
+      float u1 = (i + 0.5f) / samples;
+      float u2 = (j + 0.5f) / samples;
+      glm::vec3 lights[2] = {ltc.Sample(u1, u2), SampleLobe(view, roughness, u1, u2)};
+      for (glm::vec3 light : lights) {
+        float lobe_pdf;
+        float lobe = EvaluateLobe(view, light, roughness, &lobe_pdf);
+        float ltc_pdf = ltc.Evaluate(light);
+        double difference = std::abs(lobe - ltc_pdf * ltc.amplitude);
+        if (lobe_pdf + ltc_pdf > 0.0f) {
+          error += difference * difference * difference / (lobe_pdf + ltc_pdf);
+        }
+      }
+    }
+  }
+  return error / (2.0 * samples * samples);
+}
+
+// Minimizes a function of 3 parameters with the Nelder-Mead simplex method, starting from a point
+// and stepping by fit_step along each axis. The best point is written back to the start.
+template <typename Function>
+double Minimize(float point[3], const Function& function) {
+  float simplex[4][3];
+  double values[4];
+  for (int i = 0; i < 4; i++) {
+    std::copy(point, point + 3, simplex[i]);
+    if (i > 0) {
+      simplex[i][i - 1] += fit_step;
+    }
+    values[i] = function(simplex[i]);
+  }
+  int best = 0;
+  for (int iteration = 0; iteration < fit_max_iterations; iteration++) {
+    // Find the best, worst, and second worst points.
+    best = 0;
+    int worst = 0;
+    for (int i = 1; i < 4; i++) {
+      best = values[i] < values[best] ? i : best;
+      worst = values[i] > values[worst] ? i : worst;
+    }
+    int second_worst = best;
+    for (int i = 0; i < 4; i++) {
+      if (i != worst && values[i] > values[second_worst]) {
+        second_worst = i;
+      }
+    }
+    double low = std::abs(values[best]);
+    double high = std::abs(values[worst]);
+    if (2.0 * std::abs(high - low) <= (high + low) * fit_tolerance) {
+      break;
+    }
+
+    // Reflect the worst point through the centroid of the others, expanding if that's the best
+    // so far and contracting if it's still the worst. If nothing helps, shrink towards the best.
+    float centroid[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 4; i++) {
+      if (i == worst) {
+        continue;
+      }
+      for (int k = 0; k < 3; k++) {
+        centroid[k] += simplex[i][k] / 3.0f;
+      }
+    }
+    auto extend = [&centroid, &simplex, worst](float factor, float* result) {
+      for (int k = 0; k < 3; k++) {
+        result[k] = centroid[k] + factor * (centroid[k] - simplex[worst][k]);
+      }
+    };
+    float reflected[3];
+    extend(1.0f, reflected);
+    double reflected_value = function(reflected);
+    if (reflected_value < values[second_worst]) {
+      float expanded[3];
+      extend(2.0f, expanded);
+      double expanded_value = reflected_value < values[best] ? function(expanded) :
+          reflected_value;
+      bool use_expanded = expanded_value < reflected_value;
+      std::copy(use_expanded ? expanded : reflected, (use_expanded ? expanded : reflected) + 3,
+          simplex[worst]);
+      values[worst] = std::min(expanded_value, reflected_value);
+      continue;
+    }
+    float contracted[3];
+    extend(-0.5f, contracted);
+    double contracted_value = function(contracted);
+    if (contracted_value < values[worst]) {
+      std::copy(contracted, contracted + 3, simplex[worst]);
+      values[worst] = contracted_value;
+      continue;
+    }
+    for (int i = 0; i < 4; i++) {
+      if (i == best) {
+        continue;
+      }
+      for (int k = 0; k < 3; k++) {
+        simplex[i][k] = simplex[best][k] + 0.5f * (simplex[i][k] - simplex[best][k]);
+      }
+      values[i] = function(simplex[i]);
+    }
+  }
+  std::copy(simplex[best], simplex[best] + 3, point);
+  return values[best];
+}
+
+// Fits the parameters of an LTC (starting from its current ones) to the lobe. An isotropic fit
+// only varies m11, using it for m22 as well with no skew.
+double Fit(Ltc* ltc, glm::vec3 view, float roughness, unsigned int samples, bool isotropic) {
+  auto set_parameters = [ltc, isotropic](const float parameters[3]) {
+    ltc->m11 = std::max(parameters[0], 1e-7f);
+    ltc->m22 = isotropic ? ltc->m11 : std::max(parameters[1], 1e-7f);
+    ltc->m13 = isotropic ? 0.0f : parameters[2];
+    ltc->Update();
+  };
+  float parameters[3] = {ltc->m11, ltc->m22, ltc->m13};
+  double error = Minimize(parameters, [ltc, &set_parameters, view, roughness,
+      samples](const float candidate[3]) {
+    set_parameters(candidate);
+    return ComputeError(*ltc, view, roughness, samples);
+  });
+  set_parameters(parameters);
+  return error;
+}
+
+// Gets the view direction of an entry of the tables.
+glm::vec3 GetView(unsigned int entry, unsigned int size) {
+  float x = (float)entry / (float)(size - 1);
+  float theta = std::min(std::acos(1.0f - x * x), max_theta);
+  return glm::vec3(std::sin(theta), 0.0f, std::cos(theta));
+}
+
+// Integrates the clamped cosine over a sphere seen at an elevation with a cosine of z and a form
+// factor (the squared sine of its angular radius) over Pi, as the horizon clips it. The azimuth is
+// integrated analytically over each ring of directions around the center of the sphere.
+double GetClippedSphereFormFactor(double z, double form_factor) {
+  double cos_radius = std::sqrt(std::max(1.0 - form_factor, 0.0));
+  double sin_elevation = std::sqrt(std::max(1.0 - z * z, 0.0));
+  double sum = 0.0;
+  for (int step = 0; step < sphere_steps; step++) {
+    // The cosine of the angle between a ring and the center of the sphere.
+    double u = cos_radius + (1.0 - cos_radius) * (step + 0.5) / sphere_steps;
+    double a = u * z;
+    double b = std::sqrt(std::max(1.0 - u * u, 0.0)) * sin_elevation;
+    if (a >= b) {
+      sum += 2.0 * pi * a;
+    } else if (a > -b) {
+      double azimuth = std::acos(a / b);
+      sum += (2.0 * pi - 2.0 * azimuth) * a + 2.0 * b * std::sin(azimuth);
+    }
+  }
+  return sum * (1.0 - cos_radius) / sphere_steps / pi;
+}
+
+}
+
+gfx::LtcTable::LtcTable(unsigned int size, unsigned int samples, gfx::JobSystem* job_system) :
+    matrix_handle{0}, amplitude_handle{0}, size{size}, matrices(size * size),
+    amplitudes(size * size), average_error{0.0} {
+  if (size < 2 || size > gfx::LTC_MAX_TABLE_SIZE || samples == 0) {
+    throw gfx::InvalidLtcTableException();
+  }
+
+  // Each fit starts from the last one. Straight on views are fitted first, isotropically and
+  // from the roughest down. Every roughness then fits its other view angles in parallel,
+  // starting with the isotropic fit and rotating the LTC to the lobe's average direction.
+  std::vector<Ltc> fits(size * size);
+  std::vector<double> errors(size * size);
+  auto fit_entry = [this, &fits, &errors, size, samples](unsigned int roughness_index,
+      unsigned int view_index, const Ltc& start) {
+    float roughness = (float)roughness_index / (float)(size - 1);
+    glm::vec3 view = GetView(view_index, size);
+    float norm, fresnel;
+    glm::vec3 average_direction;
+    IntegrateLobe(view, roughness, samples, &norm, &fresnel, &average_direction);
+    Ltc ltc = start;
+    ltc.amplitude = norm;
+    bool isotropic = view_index == 0;
+    if (isotropic) {
+      ltc.basis = glm::mat3(1.0f);
+      ltc.m13 = 0.0f;
+    } else {
+      ltc.basis = glm::mat3(glm::vec3(average_direction.z, 0.0f, -average_direction.x),
+          glm::vec3(0.0f, 1.0f, 0.0f), average_direction);
+    }
+    ltc.Update();
+    unsigned int entry = view_index * size + roughness_index;
+    errors[entry] = Fit(&ltc, view, roughness, samples, isotropic);
+    fits[entry] = ltc;
+
+    // Store the inverse transform scaled so its middle entry is 1, which leaves the direction of
+    // every transformed vector the same.
+    glm::mat3 inverse = ltc.inverse_transform;
+    float scale = 1.0f / inverse[1][1];
+    matrices[entry] = glm::vec4(inverse[0][0], inverse[0][2], inverse[2][0], inverse[2][2]) *
+        scale;
+    amplitudes[entry] = glm::vec3(norm, fresnel, 0.0f);
+  };
+
+  Ltc start;
+  start.m11 = start.m22 = 1.0f;
+  start.m13 = 0.0f;
+  for (unsigned int roughness_index = size; roughness_index-- > 0; ) {
+    fit_entry(roughness_index, 0, start);
+    start = fits[roughness_index];
+  }
+  job_system->ParallelFor(size, 1, [&fits, &fit_entry, size](size_t begin, size_t end) {
+    for (size_t roughness_index = begin; roughness_index < end; roughness_index++) {
+      for (unsigned int view_index = 1; view_index < size; view_index++) {
+        fit_entry(roughness_index, view_index, fits[(view_index - 1) * size + roughness_index]);
+      }
+    }
+  });
+  for (double error : errors) {
+    average_error += error / errors.size();
+  }
+
+  // Tabulate the horizon clipping of spheres.
+  for (unsigned int y = 0; y < size; y++) {
+    for (unsigned int x = 0; x < size; x++) {
+      double z = 2.0 * x / (size - 1) - 1.0;
+      double form_factor = (double)y / (size - 1);
+      amplitudes[y * size + x].z = form_factor == 0.0 ? (float)std::max(z, 0.0) :
+          (float)(GetClippedSphereFormFactor(z, form_factor) / form_factor);
+    }
+  }
+}
+
+gfx::LtcTable::LtcTable(std::string path) : matrix_handle{0}, amplitude_handle{0}, size{0},
+    matrices(), amplitudes(), average_error{0.0} {
+  std::ifstream input_file(path, std::ios::binary);
+  if (!input_file) {
+    throw gfx::CannotOpenLtcTableException();
+  }
+  uint32_t file_size = 0;
+  input_file.read((char*)(&file_size), sizeof(uint32_t));
+  if (!input_file || file_size < 2 || file_size > gfx::LTC_MAX_TABLE_SIZE) {
+    throw gfx::InvalidLtcTableException();
+  }
+  size = file_size;
+  matrices.resize(size * size);
+  amplitudes.resize(size * size);
+  input_file.read((char*)(matrices.data()), sizeof(glm::vec4) * matrices.size());
+  input_file.read((char*)(amplitudes.data()), sizeof(glm::vec3) * amplitudes.size());
+  if (!input_file || input_file.get() != EOF) {
+    throw gfx::InvalidLtcTableException();
+  }
+}
+
+gfx::LtcTable::~LtcTable() {
+  if (matrix_handle != 0) {
+    glDeleteTextures(1, &matrix_handle);
+    glDeleteTextures(1, &amplitude_handle);
+  }
+}
+
+void gfx::LtcTable::Write(std::string path) {
+  std::ofstream output_file(path, std::ios::binary);
+  uint32_t file_size = size;
+  output_file.write((const char*)(&file_size), sizeof(uint32_t));
+  output_file.write((const char*)(matrices.data()), sizeof(glm::vec4) * matrices.size());
+  output_file.write((const char*)(amplitudes.data()), sizeof(glm::vec3) * amplitudes.size());
+  if (!output_file) {
+    throw gfx::CannotWriteLtcTableException();
+  }
+}
+
+void gfx::LtcTable::Upload() {
+  if (matrix_handle == 0) {
+    GLuint handles[2];
+    glGenTextures(2, handles);
+    matrix_handle = handles[0];
+    amplitude_handle = handles[1];
+    for (GLuint handle : handles) {
+      glBindTexture(GL_TEXTURE_2D, handle);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, matrix_handle);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size, size, 0, GL_RGBA, GL_FLOAT, matrices.data());
+  glBindTexture(GL_TEXTURE_2D, amplitude_handle);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, size, size, 0, GL_RGB, GL_FLOAT,
+      amplitudes.data());
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+template <typename T>
+T gfx::LtcTable::Filter(const std::vector<T>& table, glm::vec2 coordinates) {
+  float x = glm::clamp(std::isfinite(coordinates.x) ? coordinates.x : 0.0f, 0.0f, 1.0f) *
+      (size - 1);
+  float y = glm::clamp(std::isfinite(coordinates.y) ? coordinates.y : 0.0f, 0.0f, 1.0f) *
+      (size - 1);
+  unsigned int x0 = std::min((unsigned int)x, size - 2);
+  unsigned int y0 = std::min((unsigned int)y, size - 2);
+  float fraction_x = x - x0;
+  float fraction_y = y - y0;
+  T bottom = glm::mix(table[y0 * size + x0], table[y0 * size + x0 + 1], fraction_x);
+  T top = glm::mix(table[(y0 + 1) * size + x0], table[(y0 + 1) * size + x0 + 1], fraction_x);
+  return glm::mix(bottom, top, fraction_y);
+}
+
+void gfx::LtcTable::Sample(float roughness, float cos_theta, glm::mat3* inverse_transform,
+    glm::vec2* amplitudes) {
+  glm::vec2 coordinates(roughness, std::sqrt(1.0f - glm::clamp(cos_theta, 0.0f, 1.0f)));
+  glm::vec4 matrix = Filter(matrices, coordinates);
+  *inverse_transform = glm::mat3(glm::vec3(matrix.x, 0.0f, matrix.y),
+      glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(matrix.z, 0.0f, matrix.w));
+  glm::vec3 amplitude = Filter(this->amplitudes, coordinates);
+  *amplitudes = glm::vec2(amplitude.x, amplitude.y);
+}
+
+float gfx::LtcTable::GetHorizonScale(float cos_elevation, float form_factor) {
+  return Filter(amplitudes, glm::vec2(cos_elevation * 0.5f + 0.5f, form_factor)).z;
+}
+
+unsigned int gfx::LtcTable::GetSize() {
+  return size;
+}
+
+double gfx::LtcTable::GetAverageError() {
+  return average_error;
+}
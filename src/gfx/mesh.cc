@@ -5,8 +5,15 @@
 #include <iostream>
 
 gfx::Mesh::Mesh(std::vector<gfx::Vertex>* vertices, std::vector<GLuint>* indices,
-    std::shared_ptr<gfx::Material> material, bool should_map) : vao{0}, vbo{0}, ebo{0},
-    material{material}, vertices{vertices}, indices{indices} {
+    std::shared_ptr<gfx::Material> material, bool should_map) :
+    Mesh(vertices, indices, nullptr, material, should_map) {}
+
+gfx::Mesh::Mesh(std::vector<gfx::Vertex>* vertices, std::vector<GLuint>* indices,
+    std::vector<gfx::SkinVertex>* skin, std::shared_ptr<gfx::Material> material, bool should_map) :
+    vao{0}, vbo{0}, ebo{0}, position_vao{0}, position_vbo{0}, skin_vbo{0}, material{material},
+    bounds_min{glm::vec3(0.0f, 0.0f, 0.0f)}, bounds_max{glm::vec3(0.0f, 0.0f, 0.0f)},
+    vertices{vertices}, indices{indices}, skin{skin} {
+  gfx::Mesh::UpdateBounds();
   if (should_map) {
     gfx::Mesh::Map();
   }
@@ -21,7 +28,8 @@ gfx::Mesh::~Mesh() {
 }
 
 bool gfx::Mesh::IsMapped() {
-  return (vao != 0 || vbo != 0 || ebo != 0);
+  return (vao != 0 || vbo != 0 || ebo != 0 || position_vao != 0 || position_vbo != 0 ||
+      skin_vbo != 0);
 }
 
 void gfx::Mesh::Map() {
@@ -57,6 +65,42 @@ void gfx::Mesh::Map() {
       (GLvoid*) offsetof(Vertex, uv));
   glEnableVertexAttribArray(3);
 
+  // Set up a second VAO with only tightly packed positions so depth-only passes fetch 12 bytes per
+  // vertex instead of the full interleaved vertex.
+  std::vector<glm::vec3> positions;
+  positions.reserve(vertices->size());
+  for (auto &vertex : *vertices) {
+    positions.push_back(vertex.position);
+  }
+  glGenVertexArrays(1, &position_vao);
+  glBindVertexArray(position_vao);
+  glGenBuffers(1, &position_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, position_vbo);
+  glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions.front(),
+      GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*) 0);
+  glEnableVertexAttribArray(0);
+
+  // Both VAOs source the joints and weights of skinned meshes from a third VBO, so depth-only
+  // passes can skin the positions too.
+  if (skin != nullptr) {
+    glGenBuffers(1, &skin_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, skin_vbo);
+    glBufferData(GL_ARRAY_BUFFER, skin->size() * sizeof(SkinVertex), &skin->front(),
+        GL_STATIC_DRAW);
+    GLuint skinned_vaos[] = {vao, position_vao};
+    for (GLuint skinned_vao : skinned_vaos) {
+      glBindVertexArray(skinned_vao);
+      glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, sizeof(SkinVertex),
+          (GLvoid*) offsetof(SkinVertex, joints));
+      glEnableVertexAttribArray(4);
+      glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SkinVertex),
+          (GLvoid*) offsetof(SkinVertex, weights));
+      glEnableVertexAttribArray(5);
+    }
+  }
+
   glBindVertexArray(0);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -66,12 +110,20 @@ void gfx::Mesh::Unmap() {
   if (!gfx::Mesh::IsMapped()) {
     throw gfx::BuffersNotYetMappedException();
   }
-  glDeleteBuffers(1, &vao);
+  glDeleteVertexArrays(1, &vao);
   glDeleteBuffers(1, &vbo);
   glDeleteBuffers(1, &ebo);
+  glDeleteVertexArrays(1, &position_vao);
+  glDeleteBuffers(1, &position_vbo);
+  if (skin_vbo != 0) {
+    glDeleteBuffers(1, &skin_vbo);
+  }
   vao = 0;
   vbo = 0;
   ebo = 0;
+  position_vao = 0;
+  position_vbo = 0;
+  skin_vbo = 0;
 }
 
 void gfx::Mesh::Remap() {
@@ -82,3 +134,45 @@ void gfx::Mesh::Remap() {
 GLuint gfx::Mesh::GetNumberOfIndices() {
   return indices->size();
 }
+
+const std::vector<gfx::Vertex>& gfx::Mesh::GetVertices() {
+  return *vertices;
+}
+
+const std::vector<GLuint>& gfx::Mesh::GetIndices() {
+  return *indices;
+}
+
+bool gfx::Mesh::IsSkinned() {
+  return skin != nullptr;
+}
+
+const std::vector<gfx::SkinVertex>& gfx::Mesh::GetSkin() {
+  return *skin;
+}
+
+void gfx::Mesh::SwapGeometry(std::vector<gfx::Vertex>* new_vertices,
+    std::vector<GLuint>* new_indices, std::vector<gfx::SkinVertex>* new_skin) {
+  vertices->swap(*new_vertices);
+  indices->swap(*new_indices);
+  if (skin != nullptr) {
+    skin->swap(*new_skin);
+  }
+  gfx::Mesh::UpdateBounds();
+  if (gfx::Mesh::IsMapped()) {
+    gfx::Mesh::Remap();
+  }
+}
+
+void gfx::Mesh::UpdateBounds() {
+  bounds_min = glm::vec3(0.0f, 0.0f, 0.0f);
+  bounds_max = glm::vec3(0.0f, 0.0f, 0.0f);
+  if (!vertices->empty()) {
+    bounds_min = vertices->front().position;
+    bounds_max = vertices->front().position;
+    for (auto &vertex : *vertices) {
+      bounds_min = glm::min(bounds_min, vertex.position);
+      bounds_max = glm::max(bounds_max, vertex.position);
+    }
+  }
+}
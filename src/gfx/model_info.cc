@@ -1,42 +1,118 @@
+#include "gfx/asset_pack.h"
 #include "gfx/exceptions.h"
 #include "gfx/model_info.h"
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <exception>
+#include <fstream>
 #include <iostream>
 #include <memory>
 
 gfx::ModelInfo::ModelInfo(std::string model_path, gfx::TextureManager* manager, bool should_map) :
-    meshes{std::vector<gfx::Mesh>()} {
+    ModelInfo(ReadEOFile(model_path), manager, should_map) {}
 
-  std::ifstream input_file {model_path};
-  if (!input_file) {
+gfx::ModelInfo::ModelInfo(const EOFileData& data, gfx::TextureManager* manager, bool should_map) :
+    meshes{std::vector<gfx::Mesh>()}, skeleton{data.skeleton}, geometry_revision{0} {
+  // Get the material info with defaults.
+  // MAYBE SWITCH THIS TO LINEAR TO GET QUIXEL TO WORK WITH IT.
+  GLuint map_handles[5];
+  for (size_t i = 0; i < 5; i++) {
+    map_handles[i] = data.map_paths[i].empty() ? 0 :
+        manager->GetTextureHandle(data.map_paths[i], false);
+  }
+  gfx::MapInfo albedo_info = gfx::MapInfo{map_handles[0], glm::vec3(1.0, 1.0, 1.0)};
+  gfx::MapInfo metallic_info = gfx::MapInfo{map_handles[1], glm::vec3(0.0, 0.0, 0.0)};
+  gfx::MapInfo roughness_info = gfx::MapInfo{map_handles[2], glm::vec3(0.5, 0.5, 0.5)};
+  gfx::MapInfo normal_info = gfx::MapInfo{map_handles[3], glm::vec3(0.5, 0.5, 1.0)};
+  gfx::MapInfo ao_info = gfx::MapInfo{map_handles[4], glm::vec3(1.0, 1.0, 1.0)};
+  std::shared_ptr<gfx::Material> material(new gfx::Material(data.shader_type, albedo_info,
+    metallic_info, roughness_info, normal_info, ao_info, 0.05));
+
+  // TODO(brkho): One day support multiple meshes in one model.
+  meshes.push_back(gfx::Mesh(data.vertices, data.indices, data.skin, material, should_map));
+}
+
+std::vector<std::unique_ptr<gfx::ModelInfo>> gfx::ModelInfo::LoadModels(
+    const std::vector<std::string>& model_paths, gfx::TextureManager* manager,
+    gfx::JobSystem* job_system, bool should_map) {
+  // Read the files in parallel, keeping every model's error so all of their data can be freed.
+  std::vector<EOFileData> file_data(model_paths.size());
+  std::vector<std::exception_ptr> errors(model_paths.size());
+  gfx::JobCounter counter;
+  for (size_t i = 0; i < model_paths.size(); i++) {
+    job_system->Run([&model_paths, &file_data, &errors, i]() {
+      try {
+        file_data[i] = ReadEOFile(model_paths[i]);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }, &counter);
+  }
+  job_system->Wait(&counter);
+
+  std::exception_ptr error = nullptr;
+  std::vector<std::pair<std::string, bool>> textures;
+  for (size_t i = 0; i < model_paths.size(); i++) {
+    if (errors[i] != nullptr) {
+      error = error == nullptr ? errors[i] : error;
+      continue;
+    }
+    for (const std::string& map_path : file_data[i].map_paths) {
+      if (!map_path.empty()) {
+        textures.push_back(std::make_pair(map_path, false));
+      }
+    }
+  }
+  if (error != nullptr) {
+    for (size_t i = 0; i < model_paths.size(); i++) {
+      delete file_data[i].vertices;
+      delete file_data[i].indices;
+      delete file_data[i].skin;
+    }
+    std::rethrow_exception(error);
+  }
+
+  // Decode the textures in parallel so the ModelInfos below find them in the TextureManager's
+  // cache, then create the meshes on this thread since mapping them needs the OpenGL context.
+  manager->LoadTextures(textures, job_system);
+  std::vector<std::unique_ptr<gfx::ModelInfo>> model_infos;
+  for (size_t i = 0; i < model_paths.size(); i++) {
+    model_infos.push_back(std::unique_ptr<gfx::ModelInfo>(
+        new gfx::ModelInfo(file_data[i], manager, should_map)));
+  }
+  return model_infos;
+}
+
+gfx::ModelInfo::EOFileData gfx::ModelInfo::ReadEOFile(std::string model_path) {
+  // Read the model in place out of a mounted pack if one has it, and from the loose file
+  // otherwise.
+  gfx::AssetData asset;
+  bool is_packed = gfx::AssetPack::ReadMounted(model_path, &asset);
+  gfx::AssetStreamBuffer asset_buffer(asset.data, asset.size);
+  std::filebuf file_buffer;
+  if (!is_packed && file_buffer.open(model_path, std::ios::in | std::ios::binary) == nullptr) {
     throw gfx::CannotOpenEOFileException();
   }
+  std::istream input_file(is_packed ? (std::streambuf*)&asset_buffer : &file_buffer);
 
   // Read the shader type.
+  EOFileData data;
   char shader_type_value;
   input_file.read(&shader_type_value, 1);
   if ((size_t)shader_type_value >= gfx::shader_map.size()) {
     throw gfx::InvalidShaderTypeException();
   }
-  gfx::ShaderType shader_type = gfx::shader_map[(size_t)shader_type_value];
+  data.shader_type = gfx::shader_map[(size_t)shader_type_value];
 
-  // Get the material info with defaults.
-  // MAYBE SWITCH THIS TO LINEAR TO GET QUIXEL TO WORK WITH IT.
-  gfx::MapInfo albedo_info = gfx::MapInfo{LoadMap(&input_file, manager, false),
-      glm::vec3(1.0, 1.0, 1.0)};
-  gfx::MapInfo metallic_info = gfx::MapInfo{LoadMap(&input_file, manager, false),
-      glm::vec3(0.0, 0.0, 0.0)};
-  gfx::MapInfo roughness_info = gfx::MapInfo{LoadMap(&input_file, manager, false),
-      glm::vec3(0.5, 0.5, 0.5)};
-  gfx::MapInfo normal_info = gfx::MapInfo{LoadMap(&input_file, manager, false),
-      glm::vec3(0.5, 0.5, 1.0)};
-  gfx::MapInfo ao_info = gfx::MapInfo{LoadMap(&input_file, manager, false),
-      glm::vec3(1.0, 1.0, 1.0)};
-  std::shared_ptr<gfx::Material> material(new gfx::Material(shader_type, albedo_info,
-    metallic_info, roughness_info, normal_info, ao_info, 0.05));
+  // Read the albedo, metallic, roughness, normal, and AO map paths.
+  for (size_t i = 0; i < 5; i++) {
+    data.map_paths[i] = ReadMapPath(&input_file);
+  }
 
   // Copy the vertices directly into memory.
   size_t num_vertices;
@@ -56,13 +132,124 @@ gfx::ModelInfo::ModelInfo(std::string model_path, gfx::TextureManager* manager,
   indices->resize(num_indices);
   input_file.read((char*)(indices->data()), sizeof(GLuint) * num_indices);
   // Error checking.
-  if ((size_t)input_file.gcount() != sizeof(GLuint) * num_indices || input_file.get() != EOF) {
+  if ((size_t)input_file.gcount() != sizeof(GLuint) * num_indices) {
+    delete vertices;
+    delete indices;
     throw gfx::InvalidEOFileFormatException();
   }
 
-  // TODO(brkho): One day support multiple meshes in one model.
-  meshes.push_back(gfx::Mesh(vertices, indices, material, should_map));
-  input_file.close();
+  // Skinned models have a skin block after the indices.
+  if (input_file.peek() != EOF) {
+    try {
+      ReadSkin(&input_file, num_vertices, &data);
+    } catch (...) {
+      delete vertices;
+      delete indices;
+      throw;
+    }
+    data.skeleton->FitBoundsPadding(*vertices, *data.skin);
+  }
+  if (input_file.get() != EOF) {
+    delete vertices;
+    delete indices;
+    delete data.skin;
+    throw gfx::InvalidEOFileFormatException();
+  }
+  data.vertices = vertices;
+  data.indices = indices;
+  return data;
+}
+
+void gfx::ModelInfo::ReadSkin(std::istream* input_file, size_t num_vertices, EOFileData* data) {
+  // Read the skeleton's parent indices and bind pose.
+  size_t num_joints;
+  input_file->read((char*)(&num_joints), sizeof(size_t));
+  if (!*input_file || num_joints == 0 || num_joints > gfx::MAX_SKIN_JOINTS) {
+    throw gfx::InvalidEOFileFormatException();
+  }
+  std::vector<unsigned int> parents;
+  gfx::Pose bind_pose {num_joints};
+  for (unsigned int joint = 0; joint < num_joints; joint++) {
+    uint32_t parent;
+    float values[10];
+    input_file->read((char*)(&parent), sizeof(uint32_t));
+    input_file->read((char*)(values), sizeof(values));
+    if ((size_t)input_file->gcount() != sizeof(values)) {
+      throw gfx::InvalidEOFileFormatException();
+    }
+    parents.push_back(parent);
+    bind_pose.SetJoint(joint, glm::vec3(values[0], values[1], values[2]),
+        glm::quat(values[3], values[4], values[5], values[6]),
+        glm::vec3(values[7], values[8], values[9]));
+  }
+  try {
+    data->skeleton = std::make_shared<gfx::Skeleton>(parents, bind_pose);
+  } catch (gfx::InvalidSkeletonException&) {
+    throw gfx::InvalidEOFileFormatException();
+  }
+
+  // Copy the joints influencing each vertex directly into memory.
+  std::vector<gfx::SkinVertex>* skin = new std::vector<gfx::SkinVertex>(num_vertices);
+  input_file->read((char*)(skin->data()), sizeof(gfx::SkinVertex) * num_vertices);
+  bool is_valid = (size_t)input_file->gcount() == sizeof(gfx::SkinVertex) * num_vertices;
+  for (size_t i = 0; i < num_vertices && is_valid; i++) {
+    for (unsigned int influence = 0; influence < 4; influence++) {
+      is_valid = is_valid && (*skin)[i].joints[influence] < num_joints;
+    }
+  }
+  if (!is_valid) {
+    delete skin;
+    throw gfx::InvalidEOFileFormatException();
+  }
+  data->skin = skin;
+}
+
+void gfx::ModelInfo::WriteEOFile(std::string model_path, const EOFileData& data) {
+  auto shader_it = std::find(gfx::shader_map.begin(), gfx::shader_map.end(), data.shader_type);
+  if (shader_it == gfx::shader_map.end()) {
+    throw gfx::InvalidShaderTypeException();
+  }
+  // The length of each map path (with its null terminator) is stored in a single signed char.
+  for (const std::string& map_path : data.map_paths) {
+    if (map_path.size() + 1 > 127) {
+      throw gfx::InvalidEOFileFormatException();
+    }
+  }
+
+  std::ofstream output_file(model_path, std::ios::binary);
+  char shader_type_value = (char)(shader_it - gfx::shader_map.begin());
+  output_file.write(&shader_type_value, 1);
+  for (const std::string& map_path : data.map_paths) {
+    char num_chars = map_path.empty() ? 0 : (char)(map_path.size() + 1);
+    output_file.write(&num_chars, 1);
+    output_file.write(map_path.c_str(), num_chars);
+  }
+  size_t num_vertices = data.vertices->size();
+  output_file.write((const char*)(&num_vertices), sizeof(size_t));
+  output_file.write((const char*)(data.vertices->data()), sizeof(gfx::Vertex) * num_vertices);
+  size_t num_indices = data.indices->size();
+  output_file.write((const char*)(&num_indices), sizeof(size_t));
+  output_file.write((const char*)(data.indices->data()), sizeof(GLuint) * num_indices);
+  if (data.skin != nullptr && data.skeleton != nullptr) {
+    size_t num_joints = data.skeleton->GetNumJoints();
+    output_file.write((const char*)(&num_joints), sizeof(size_t));
+    const gfx::Pose& bind_pose = data.skeleton->GetBindPose();
+    for (unsigned int joint = 0; joint < num_joints; joint++) {
+      uint32_t parent = data.skeleton->GetParent(joint);
+      glm::vec3 translation = bind_pose.GetTranslation(joint);
+      glm::quat rotation = bind_pose.GetRotation(joint);
+      glm::vec3 scale = bind_pose.GetScale(joint);
+      float values[10] = {translation.x, translation.y, translation.z, rotation.w, rotation.x,
+          rotation.y, rotation.z, scale.x, scale.y, scale.z};
+      output_file.write((const char*)(&parent), sizeof(uint32_t));
+      output_file.write((const char*)(values), sizeof(values));
+    }
+    output_file.write((const char*)(data.skin->data()),
+        sizeof(gfx::SkinVertex) * data.skin->size());
+  }
+  if (!output_file) {
+    throw gfx::CannotWriteEOFileException();
+  }
 }
 
 gfx::ModelInfo::~ModelInfo() {
@@ -95,19 +282,61 @@ void gfx::ModelInfo::Remap() {
   gfx::ModelInfo::Map();
 }
 
+void gfx::ModelInfo::Reload(std::string model_path, gfx::TextureManager* manager) {
+  EOFileData data = ReadEOFile(model_path);
+  std::shared_ptr<gfx::Material> material = meshes[0].material;
+  gfx::MapInfo* map_infos[] = {&material->albedo_info, &material->metallic_info,
+      &material->roughness_info, &material->normal_info, &material->ao_info};
+  try {
+    // Animators and ModelInstances point at the skeleton, so it's updated in place and can't
+    // change its number of joints.
+    if ((skeleton == nullptr) != (data.skeleton == nullptr) || (skeleton != nullptr &&
+        skeleton->GetNumJoints() != data.skeleton->GetNumJoints())) {
+      throw gfx::InvalidSkeletonException();
+    }
+    GLuint map_handles[5];
+    for (size_t i = 0; i < 5; i++) {
+      map_handles[i] = data.map_paths[i].empty() ? 0 :
+          manager->GetTextureHandle(data.map_paths[i], false);
+    }
+    for (size_t i = 0; i < 5; i++) {
+      map_infos[i]->handle = map_handles[i];
+    }
+  } catch (...) {
+    delete data.vertices;
+    delete data.indices;
+    delete data.skin;
+    throw;
+  }
+
+  // TODO(brkho): One day support multiple meshes in one model.
+  if (skeleton != nullptr) {
+    *skeleton = *data.skeleton;
+  }
+  meshes[0].SwapGeometry(data.vertices, data.indices, data.skin);
+  delete data.vertices;
+  delete data.indices;
+  delete data.skin;
+  geometry_revision++;
+}
+
+unsigned int gfx::ModelInfo::GetGeometryRevision() {
+  return geometry_revision;
+}
+
 std::shared_ptr<gfx::Material> gfx::ModelInfo::GetMaterial() {
   return meshes[0].material;
 }
 
-GLuint gfx::ModelInfo::LoadMap(std::ifstream* input_file, gfx::TextureManager* manager,
-    bool convert_to_linear) {
-  char num_chars;
-  input_file->read(&num_chars, 1);
-  if (num_chars == 0) {
-    return 0;
-  }
+gfx::Skeleton* gfx::ModelInfo::GetSkeleton() {
+  return skeleton.get();
+}
 
-  char path[256];
-  input_file->read(path, num_chars);
-  return manager->GetTextureHandle(std::string {path}, convert_to_linear);
+std::string gfx::ModelInfo::ReadMapPath(std::istream* input_file) {
+  char num_chars = 0;
+  input_file->read(&num_chars, 1);
+  // The length counts the path's null terminator, so drop it.
+  std::string path((unsigned char)num_chars, '\0');
+  input_file->read(&path[0], path.size());
+  return std::string(path.c_str());
 }
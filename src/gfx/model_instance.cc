@@ -4,12 +4,17 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <iostream>
 
 gfx::ModelInstance::ModelInstance(gfx::ModelInfo* model_info, glm::vec3 position, glm::vec3 scale,
     glm::quat rotation, gfx::Color color) : position{position}, scale{scale}, rotation{rotation},
-    color{color}, model_info{model_info} {
+    color{color}, is_static{true}, model_info{model_info}, revision{0},
+    bounds_center{glm::vec3(0.0f, 0.0f, 0.0f)}, bounds_radius{0.0f}, hierarchy{nullptr},
+    transform{0}, transform_revision{0}, animator{nullptr}, character{0}, character_revision{0},
+    geometry_revision{model_info->GetGeometryRevision()}, palette_buffer{0}, palette_offset{0} {
   gfx::ModelInstance::Update();
+  drawn_model_transform = model_transform;
 }
 
 gfx::ModelInstance::ModelInstance(gfx::ModelInfo* model_info) :
@@ -19,18 +24,66 @@ gfx::ModelInstance::ModelInstance(gfx::ModelInfo* model_info, glm::vec3 position
     ModelInstance(model_info, position, glm::vec3{1.0f, 1.0f, 1.0f},
     glm::quat{1.0, 0.0f, 0.0f, 0.0f}, gfx::Color{1.0f, 1.0f, 1.0f}) {}
 
+unsigned int gfx::ModelInstance::GetRevision() {
+  return revision;
+}
+
+glm::vec3 gfx::ModelInstance::GetBoundsCenter() {
+  return bounds_center;
+}
+
+float gfx::ModelInstance::GetBoundsRadius() {
+  return bounds_radius;
+}
+
+gfx::ModelInfo* gfx::ModelInstance::GetModelInfo() {
+  return model_info;
+}
+
+glm::mat4 gfx::ModelInstance::GetModelTransform() {
+  return model_transform;
+}
+
+glm::mat4 gfx::ModelInstance::GetNormalTransform() {
+  return normal_transform;
+}
+
+void gfx::ModelInstance::WriteInstanceConstants(gfx::InstanceConstants* constants) {
+  constants->model_transform = model_transform;
+  constants->normal_transform = normal_transform;
+  constants->previous_model_transform = drawn_model_transform;
+  drawn_model_transform = model_transform;
+}
+
+void gfx::ModelInstance::WriteSkinningPalette(gfx::SkinningPalette* palette, GLuint buffer,
+    size_t offset) {
+  size_t num_rows = 3 * animator->GetSkeleton(character)->GetNumJoints();
+  std::copy(animator->GetPalette(character), animator->GetPalette(character) + num_rows,
+      palette->rows);
+  std::copy(animator->GetPreviousPalette(character),
+      animator->GetPreviousPalette(character) + num_rows, palette->previous_rows);
+  palette_buffer = buffer;
+  palette_offset = offset;
+}
+
+void gfx::ModelInstance::BindSkinningPalette(GLuint program, gfx::Mesh* mesh) {
+  bool is_skinned = animator != nullptr && palette_buffer != 0 && mesh->IsSkinned();
+  glUniform1i(glGetUniformLocation(program, "skinned"), is_skinned);
+  if (is_skinned) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, gfx::SKINNING_PALETTE_BINDING, palette_buffer,
+        palette_offset, sizeof(gfx::SkinningPalette));
+  }
+}
+
 void gfx::ModelInstance::Draw(GLuint program) {
   if (!model_info->IsMapped()) {
     throw gfx::BuffersNotYetMappedException();
   }
-  GLint model_location = glGetUniformLocation(program, "model_transform");
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, glm::value_ptr(model_transform));
-  GLint normal_location = glGetUniformLocation(program, "normal_transform");
-  glUniformMatrix4fv(normal_location, 1, GL_FALSE, glm::value_ptr(normal_transform));
   GLint color_location = glGetUniformLocation(program, "base_color");
   glUniform4f(color_location, color.r, color.g, color.b, color.a);
   // Draw all meshes.
   for (auto &mesh : model_info->meshes) {
+    BindSkinningPalette(program, &mesh);
     glBindVertexArray(mesh.vao);
     mesh.material->UseMaterial(program);
     glDrawElements(GL_TRIANGLES, mesh.GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
@@ -38,10 +91,93 @@ void gfx::ModelInstance::Draw(GLuint program) {
   }
 }
 
+void gfx::ModelInstance::DrawDepth(GLuint program) {
+  if (!model_info->IsMapped()) {
+    throw gfx::BuffersNotYetMappedException();
+  }
+  GLint model_location = glGetUniformLocation(program, "model_transform");
+  glUniformMatrix4fv(model_location, 1, GL_FALSE, glm::value_ptr(model_transform));
+  for (auto &mesh : model_info->meshes) {
+    BindSkinningPalette(program, &mesh);
+    glBindVertexArray(mesh.position_vao);
+    glDrawElements(GL_TRIANGLES, mesh.GetNumberOfIndices(), GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+  }
+}
+
 void gfx::ModelInstance::Update() {
-  model_transform = glm::mat4();
-  model_transform = glm::translate(model_transform, position);
-  model_transform = glm::scale(model_transform, scale);
-  model_transform = glm::mat4_cast(rotation) * model_transform;
-  normal_transform = glm::transpose(glm::inverse(model_transform));
+  // The bounds follow the pose of the attached character and the geometry of the ModelInfo.
+  bool is_posed = false;
+  if (animator != nullptr && animator->GetRevision(character) != character_revision) {
+    character_revision = animator->GetRevision(character);
+    is_posed = true;
+  }
+  bool is_reloaded = model_info->GetGeometryRevision() != geometry_revision;
+  geometry_revision = model_info->GetGeometryRevision();
+  if (hierarchy != nullptr) {
+    // Only count the ModelInstance as moved if the hierarchy changed its transform.
+    unsigned int hierarchy_revision = hierarchy->GetRevision(transform);
+    if (hierarchy_revision != transform_revision || is_posed || is_reloaded) {
+      transform_revision = hierarchy_revision;
+      SetTransforms(hierarchy->GetWorldTransform(transform),
+          hierarchy->GetNormalTransform(transform));
+    }
+    return;
+  }
+  glm::mat4 transform_matrix = glm::mat4();
+  transform_matrix = glm::translate(transform_matrix, position);
+  transform_matrix = glm::scale(transform_matrix, scale);
+  transform_matrix = glm::mat4_cast(rotation) * transform_matrix;
+  SetTransforms(transform_matrix, glm::transpose(glm::inverse(transform_matrix)));
+}
+
+void gfx::ModelInstance::AttachTransform(gfx::TransformHierarchy* hierarchy,
+    unsigned int transform) {
+  this->hierarchy = hierarchy;
+  this->transform = transform;
+  transform_revision = hierarchy->GetRevision(transform);
+  SetTransforms(hierarchy->GetWorldTransform(transform),
+      hierarchy->GetNormalTransform(transform));
+}
+
+void gfx::ModelInstance::AttachAnimator(gfx::Animator* animator, unsigned int character) {
+  gfx::Skeleton* skeleton = model_info->GetSkeleton();
+  if (skeleton == nullptr ||
+      animator->GetSkeleton(character)->GetNumJoints() != skeleton->GetNumJoints()) {
+    throw gfx::InvalidSkeletonException();
+  }
+  this->animator = animator;
+  this->character = character;
+  character_revision = animator->GetRevision(character);
+  is_static = false;
+  SetTransforms(model_transform, normal_transform);
+}
+
+const glm::vec4* gfx::ModelInstance::GetSkinningPalette() {
+  return animator == nullptr ? nullptr : animator->GetPalette(character);
+}
+
+void gfx::ModelInstance::SetTransforms(glm::mat4 model_transform, glm::mat4 normal_transform) {
+  this->model_transform = model_transform;
+  this->normal_transform = normal_transform;
+  revision++;
+
+  // Bound the object space boxes of the meshes with a sphere and move it into world space.
+  // Rotation preserves lengths, so only the longest scaled axis grows the radius.
+  glm::vec3 bounds_min = model_info->meshes.empty() ? glm::vec3(0.0f, 0.0f, 0.0f) :
+      model_info->meshes.front().bounds_min;
+  glm::vec3 bounds_max = bounds_min;
+  for (auto &mesh : model_info->meshes) {
+    bounds_min = glm::min(bounds_min, mesh.bounds_min);
+    bounds_max = glm::max(bounds_max, mesh.bounds_max);
+  }
+  if (animator != nullptr) {
+    animator->GetBounds(character, &bounds_min, &bounds_max);
+  }
+  float max_scale = 0.0f;
+  for (unsigned int i = 0; i < 3; i++) {
+    max_scale = std::max(max_scale, glm::length(glm::vec3(model_transform[i])));
+  }
+  bounds_center = glm::vec3(model_transform * glm::vec4((bounds_min + bounds_max) / 2.0f, 1.0f));
+  bounds_radius = glm::length(bounds_max - bounds_min) / 2.0f * max_scale;
 }
@@ -0,0 +1,287 @@
+#include "gfx/point_shadow_atlas.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+gfx::PointShadowAtlas::PointShadowAtlas(GLuint depth_program) : atlas_handle{0},
+    depth_program{depth_program}, fbo{0}, faces_rendered{0} {
+  for (unsigned int i = 0; i < gfx::MAX_POINT_LIGHTS; i++) {
+    slots[i].light = nullptr;
+    slots[i].valid = false;
+    slots[i].position = glm::vec3(0.0f, 0.0f, 0.0f);
+    slots[i].range = 0.0f;
+    slots[i].face_size = 0;
+    for (unsigned int face = 0; face < gfx::NUM_CUBE_FACES; face++) {
+      slots[i].face_signatures[face] = 0;
+    }
+    slots[i].frames_waiting = 0;
+  }
+}
+
+void gfx::PointShadowAtlas::Initialize() {
+  // Each slot is a 3x2 grid of faces at the largest face size, with the slots stacked vertically.
+  glGenTextures(1, &atlas_handle);
+  glBindTexture(GL_TEXTURE_2D, atlas_handle);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, 3 * gfx::MAX_POINT_SHADOW_SIZE,
+      2 * gfx::MAX_POINT_SHADOW_SIZE * gfx::MAX_POINT_LIGHTS, 0, GL_DEPTH_COMPONENT, GL_FLOAT,
+      nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, atlas_handle, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+}
+
+float gfx::PointShadowAtlas::GetShadowRange(gfx::PointLight* light) {
+  // Solve irradiance / (d^2 + 1) = cutoff for the brightest channel, matching the falloff in
+  // lighting.glsl.
+  float brightest = std::max(light->irradiance.x, std::max(light->irradiance.y,
+      light->irradiance.z));
+  float range = std::sqrt(std::max(brightest / gfx::POINT_SHADOW_IRRADIANCE_CUTOFF - 1.0f, 1.0f));
+  return std::min(range, (float)light->radius);
+}
+
+unsigned int gfx::PointShadowAtlas::ChooseFaceSize(glm::vec3 position, float range,
+    glm::vec3 camera_position, float fov, unsigned int previous_size) {
+  float distance = glm::length(position - camera_position);
+  float coverage = (distance <= range) ? 1.0f :
+      range / (distance * std::tan(glm::radians(fov) / 2.0f));
+  unsigned int face_size = gfx::MAX_POINT_SHADOW_SIZE;
+  while (face_size > gfx::MIN_POINT_SHADOW_SIZE) {
+    float threshold = (float)face_size / (float)(2 * gfx::MAX_POINT_SHADOW_SIZE);
+    if (face_size == previous_size) {
+      threshold *= 0.8f;
+    }
+    if (coverage >= threshold) {
+      break;
+    }
+    face_size /= 2;
+  }
+  return face_size;
+}
+
+bool gfx::PointShadowAtlas::CasterOverlapsFace(glm::vec3 position, float range,
+    unsigned int face_size, unsigned int face, gfx::ModelInstance* caster) {
+  glm::vec3 offset = caster->GetBoundsCenter() - position;
+  float radius = caster->GetBoundsRadius();
+  if (glm::length(offset) - radius > range) {
+    return false;
+  }
+  // The face's frustum is bounded by four planes through the light. Reject the caster if its
+  // bounding sphere is entirely behind any of them.
+  float tan_half_fov = (float)face_size / (float)(face_size - 2);
+  float slack = radius * std::sqrt(tan_half_fov * tan_half_fov + 1.0f);
+  unsigned int axis = face / 2;
+  float along = (face % 2 == 0) ? offset[axis] : -offset[axis];
+  for (unsigned int other = 0; other < 3; other++) {
+    if (other == axis) {
+      continue;
+    }
+    if (along * tan_half_fov - offset[other] < -slack ||
+        along * tan_half_fov + offset[other] < -slack) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t gfx::PointShadowAtlas::ComputeFaceSignature(glm::vec3 position, float range,
+    unsigned int face_size, unsigned int face, const std::vector<gfx::ModelInstance*>& casters) {
+  size_t signature = 0;
+  for (gfx::ModelInstance* caster : casters) {
+    if (!CasterOverlapsFace(position, range, face_size, face, caster)) {
+      continue;
+    }
+    size_t caster_hash = std::hash<gfx::ModelInstance*>()(caster) ^
+        (std::hash<unsigned int>()(caster->GetRevision()) << 1);
+    signature = signature * 31 + caster_hash;
+  }
+  return signature;
+}
+
+glm::mat4 gfx::PointShadowAtlas::GetFaceViewProjection(glm::vec3 position, float range,
+    unsigned int face_size, unsigned int face) {
+  // The usual cube map face orientations.
+  const glm::vec3 directions[gfx::NUM_CUBE_FACES] = {glm::vec3(1.0f, 0.0f, 0.0f),
+      glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+      glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)};
+  const glm::vec3 ups[gfx::NUM_CUBE_FACES] = {glm::vec3(0.0f, -1.0f, 0.0f),
+      glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+      glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)};
+  glm::mat4 view = glm::lookAt(position, position + directions[face], ups[face]);
+
+  // Widen the frustum so the inner texels cover exactly 90 degrees and a one texel border of the
+  // face's own depths surrounds them. Filtered lookups at the face edges then never read a
+  // neighboring tile.
+  float fov = 2.0f * std::atan((float)face_size / (float)(face_size - 2));
+  glm::mat4 projection = glm::perspective(fov, 1.0f, gfx::POINT_SHADOW_NEAR_PLANE, range);
+  return projection * view;
+}
+
+glm::ivec4 gfx::PointShadowAtlas::GetFaceRect(unsigned int light, unsigned int face_size,
+    unsigned int face) {
+  int slot_y = light * 2 * gfx::MAX_POINT_SHADOW_SIZE;
+  return glm::ivec4((face % 3) * face_size, slot_y + (face / 3) * face_size, face_size,
+      face_size);
+}
+
+bool gfx::PointShadowAtlas::Render(gfx::PointLight* const lights[gfx::MAX_POINT_LIGHTS],
+    glm::vec3 camera_position, float fov, const std::vector<gfx::ModelInstance*>& casters) {
+  if (atlas_handle == 0) {
+    Initialize();
+  }
+  faces_rendered = 0;
+  bool shadows_changed = false;
+
+  // Work out which faces of each slot are out of date.
+  float ranges[gfx::MAX_POINT_LIGHTS];
+  unsigned int face_sizes[gfx::MAX_POINT_LIGHTS];
+  bool needs_full_update[gfx::MAX_POINT_LIGHTS];
+  size_t signatures[gfx::MAX_POINT_LIGHTS][gfx::NUM_CUBE_FACES];
+  bool dirty_faces[gfx::MAX_POINT_LIGHTS][gfx::NUM_CUBE_FACES];
+  std::vector<unsigned int> dirty_lights;
+  for (unsigned int i = 0; i < gfx::MAX_POINT_LIGHTS; i++) {
+    Slot& slot = slots[i];
+    gfx::PointLight* light = (lights[i] != nullptr && lights[i]->casts_shadows) ? lights[i] :
+        nullptr;
+    if (slot.light != light) {
+      shadows_changed = shadows_changed || slot.valid;
+      slot.light = light;
+      slot.valid = false;
+      slot.face_size = 0;
+      slot.frames_waiting = 0;
+    }
+    if (light == nullptr) {
+      continue;
+    }
+    ranges[i] = GetShadowRange(light);
+    face_sizes[i] = ChooseFaceSize(light->position, ranges[i], camera_position, fov,
+        slot.face_size);
+    needs_full_update[i] = !slot.valid || slot.position != light->position ||
+        slot.range != ranges[i] || slot.face_size != face_sizes[i];
+    bool is_dirty = false;
+    for (unsigned int face = 0; face < gfx::NUM_CUBE_FACES; face++) {
+      signatures[i][face] = ComputeFaceSignature(light->position, ranges[i], face_sizes[i], face,
+          casters);
+      dirty_faces[i][face] = needs_full_update[i] ||
+          signatures[i][face] != slot.face_signatures[face];
+      is_dirty = is_dirty || dirty_faces[i][face];
+    }
+    if (is_dirty) {
+      dirty_lights.push_back(i);
+    } else {
+      slot.frames_waiting = 0;
+    }
+  }
+
+  // Serve the largest lights first, but let lights that have waited on the budget catch up.
+  std::sort(dirty_lights.begin(), dirty_lights.end(), [this, &face_sizes](unsigned int a,
+      unsigned int b) {
+    return face_sizes[a] * (slots[a].frames_waiting + 1) >
+        face_sizes[b] * (slots[b].frames_waiting + 1);
+  });
+  for (unsigned int i : dirty_lights) {
+    Slot& slot = slots[i];
+    // At least one update always goes through so a frame can't stall every light.
+    if (needs_full_update[i]) {
+      // Moving or resizing a light changes all of its transforms, so its faces are rendered
+      // together. Until then the old faces stay consistent with the old transforms.
+      if (faces_rendered != 0 &&
+          faces_rendered + gfx::NUM_CUBE_FACES > gfx::POINT_SHADOW_FACE_BUDGET) {
+        slot.frames_waiting++;
+        continue;
+      }
+      slot.valid = true;
+      slot.position = slot.light->position;
+      slot.range = ranges[i];
+      slot.face_size = face_sizes[i];
+      shadows_changed = true;
+    }
+    bool all_rendered = true;
+    for (unsigned int face = 0; face < gfx::NUM_CUBE_FACES; face++) {
+      if (!dirty_faces[i][face]) {
+        continue;
+      }
+      if (faces_rendered != 0 && faces_rendered >= gfx::POINT_SHADOW_FACE_BUDGET &&
+          !needs_full_update[i]) {
+        all_rendered = false;
+        break;
+      }
+      DrawFace(i, face, casters);
+      slot.face_signatures[face] = signatures[i][face];
+      faces_rendered++;
+    }
+    slot.frames_waiting = all_rendered ? 0 : slot.frames_waiting + 1;
+  }
+  return shadows_changed;
+}
+
+void gfx::PointShadowAtlas::DrawFace(unsigned int light, unsigned int face,
+    const std::vector<gfx::ModelInstance*>& casters) {
+  Slot& slot = slots[light];
+  glm::ivec4 rect = GetFaceRect(light, slot.face_size, face);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glViewport(rect.x, rect.y, rect.z, rect.w);
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(rect.x, rect.y, rect.z, rect.w);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  glDisable(GL_SCISSOR_TEST);
+
+  glUseProgram(depth_program);
+  GLint view_location = glGetUniformLocation(depth_program, "view_transform");
+  glUniformMatrix4fv(view_location, 1, GL_FALSE, glm::value_ptr(glm::mat4()));
+  GLint projection_location = glGetUniformLocation(depth_program, "projection_transform");
+  glUniformMatrix4fv(projection_location, 1, GL_FALSE, glm::value_ptr(
+      GetFaceViewProjection(slot.position, slot.range, slot.face_size, face)));
+
+  // Push the depths back by their slope to avoid shadow acne.
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.0f, 4.0f);
+  for (gfx::ModelInstance* caster : casters) {
+    if (CasterOverlapsFace(slot.position, slot.range, slot.face_size, face, caster)) {
+      caster->DrawDepth(depth_program);
+    }
+  }
+  glDisable(GL_POLYGON_OFFSET_FILL);
+}
+
+bool gfx::PointShadowAtlas::HasShadow(unsigned int light) {
+  return slots[light].valid;
+}
+
+glm::mat4 gfx::PointShadowAtlas::GetFaceTransform(unsigned int light, unsigned int face) {
+  // Map from clip space [-1, 1] into the face's rectangle of the [0, 1] atlas space.
+  Slot& slot = slots[light];
+  glm::ivec4 rect = GetFaceRect(light, slot.face_size, face);
+  glm::vec2 atlas_size = glm::vec2(3 * gfx::MAX_POINT_SHADOW_SIZE,
+      2 * gfx::MAX_POINT_SHADOW_SIZE * gfx::MAX_POINT_LIGHTS);
+  glm::vec2 half_extent = glm::vec2(rect.z, rect.w) / (2.0f * atlas_size);
+  glm::vec2 center = glm::vec2(rect.x, rect.y) / atlas_size + half_extent;
+  glm::mat4 bias = glm::translate(glm::mat4(), glm::vec3(center, 0.5f));
+  bias = glm::scale(bias, glm::vec3(half_extent, 0.5f));
+  return bias * GetFaceViewProjection(slot.position, slot.range, slot.face_size, face);
+}
+
+float gfx::PointShadowAtlas::GetTexelScale(unsigned int light) {
+  unsigned int face_size = slots[light].face_size;
+  return (face_size == 0) ? 0.0f : 2.0f / (float)(face_size - 2);
+}
+
+unsigned int gfx::PointShadowAtlas::GetFacesRendered() {
+  return faces_rendered;
+}
+
+void gfx::PointShadowAtlas::SetDepthProgram(GLuint depth_program) {
+  this->depth_program = depth_program;
+}
@@ -0,0 +1,270 @@
+#include "gfx/exceptions.h"
+#include "gfx/profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+gfx::Profiler::Profiler() : epoch{std::chrono::steady_clock::now()}, gpu_frame_index{0},
+    gpu_depth{0}, gpu_scope_timed{false}, frame_start{0.0}, gpu_frame_time{0.0},
+    frames_to_capture{0}, capturing_frame{false}, gl_stats{gfx::GlStats(), {}} {
+  for (GpuFrame& frame : gpu_frames) {
+    glGenQueries(gfx::PROFILER_MAX_GPU_SCOPES, frame.queries);
+    frame.pending = false;
+    frame.captured = false;
+  }
+}
+
+double gfx::Profiler::GetTime() {
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - epoch;
+  return elapsed.count();
+}
+
+bool gfx::Profiler::BeginFrame() {
+  frame_start = GetTime();
+  // The query set of this slot was last used PROFILER_QUERY_LATENCY frames ago.
+  gpu_frame_index = (gpu_frame_index + 1) % gfx::PROFILER_QUERY_LATENCY;
+  GpuFrame& frame = gpu_frames[gpu_frame_index];
+  bool read = frame.pending && ReadGpuFrame(frame);
+  frame.scopes.clear();
+  frame.pending = false;
+  capturing_frame = frames_to_capture > 0;
+  frame.captured = capturing_frame;
+#ifdef GFX_GL_STATS
+  // Scopes started before the frame aren't part of its passes.
+  current_gl_stats.passes.clear();
+  std::fill(open_gl_passes.begin(), open_gl_passes.end(), (size_t)-1);
+  frame_gl_start = gfx::gl_stats::GetCounters();
+#endif
+  return read;
+}
+
+void gfx::Profiler::EndFrame() {
+  GpuFrame& frame = gpu_frames[gpu_frame_index];
+  frame.pending = !frame.scopes.empty();
+  double duration = GetTime() - frame_start;
+  Record(cpu_histories, cpu_scope_names, "Frame", duration / 1000.0);
+  if (capturing_frame) {
+    captured_cpu_events.push_back(Event{"Frame", frame_start, duration, 0});
+    frames_to_capture--;
+    capturing_frame = false;
+  }
+#ifdef GFX_GL_STATS
+  current_gl_stats.total = gfx::gl_stats::GetCounters() - frame_gl_start;
+  std::swap(gl_stats, current_gl_stats);
+#endif
+}
+
+void gfx::Profiler::BeginCpuScope(const char* name) {
+  open_cpu_scopes.push_back(Event{name, GetTime(), 0.0, (unsigned int)open_cpu_scopes.size() + 1});
+#ifdef GFX_GL_STATS
+  open_gl_passes.push_back(current_gl_stats.passes.size());
+  current_gl_stats.passes.push_back(
+      gfx::GlPassStats{name, open_cpu_scopes.back().depth, gfx::GlStats()});
+  open_gl_scopes.push_back(gfx::gl_stats::GetCounters());
+#endif
+}
+
+void gfx::Profiler::EndCpuScope() {
+  Event scope = open_cpu_scopes.back();
+  open_cpu_scopes.pop_back();
+  scope.duration = GetTime() - scope.start;
+  Record(cpu_histories, cpu_scope_names, scope.name, scope.duration / 1000.0);
+  if (capturing_frame) {
+    captured_cpu_events.push_back(scope);
+  }
+#ifdef GFX_GL_STATS
+  if (open_gl_passes.back() != (size_t)-1) {
+    current_gl_stats.passes[open_gl_passes.back()].stats =
+        gfx::gl_stats::GetCounters() - open_gl_scopes.back();
+  }
+  open_gl_passes.pop_back();
+  open_gl_scopes.pop_back();
+#endif
+}
+
+void gfx::Profiler::BeginGpuScope(const char* name) {
+  if (gpu_depth++ > 0) {
+    return;
+  }
+  GpuFrame& frame = gpu_frames[gpu_frame_index];
+  gpu_scope_timed = frame.scopes.size() < gfx::PROFILER_MAX_GPU_SCOPES;
+  if (gpu_scope_timed) {
+    glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.scopes.size()]);
+    frame.scopes.push_back(Event{name, GetTime(), 0.0, 1});
+  }
+}
+
+void gfx::Profiler::EndGpuScope() {
+  if (--gpu_depth > 0) {
+    return;
+  }
+  if (gpu_scope_timed) {
+    glEndQuery(GL_TIME_ELAPSED);
+    gpu_scope_timed = false;
+  }
+}
+
+bool gfx::Profiler::ReadGpuFrame(GpuFrame& frame) {
+  // Queries complete in order, so the frame is ready once its last query is.
+  GLint available = 0;
+  glGetQueryObjectiv(frame.queries[frame.scopes.size() - 1], GL_QUERY_RESULT_AVAILABLE,
+      &available);
+  if (!available) {
+    return false;
+  }
+  double total = 0.0;
+  double cursor = 0.0;
+  for (unsigned int i = 0; i < frame.scopes.size(); i++) {
+    Event& scope = frame.scopes[i];
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &elapsed);
+    scope.duration = (double)elapsed / 1000.0;
+    total += scope.duration;
+    Record(gpu_histories, gpu_scope_names, scope.name, scope.duration / 1000.0);
+    if (frame.captured) {
+      // The GPU can't start a scope before it was issued or before the previous one finished.
+      scope.start = std::max(scope.start, cursor);
+      cursor = scope.start + scope.duration;
+      captured_gpu_events.push_back(scope);
+    }
+  }
+  gpu_frame_time = total / 1000.0;
+  Record(gpu_histories, gpu_scope_names, "Frame", gpu_frame_time);
+  return true;
+}
+
+void gfx::Profiler::Record(std::unordered_map<std::string, History>& histories,
+    std::vector<std::string>& names, std::string name, double time) {
+  auto iterator = histories.find(name);
+  if (iterator == histories.end()) {
+    iterator = histories.insert(std::make_pair(name, History{{}, 0})).first;
+    iterator->second.times.reserve(gfx::PROFILER_HISTORY_FRAMES);
+    names.push_back(name);
+  }
+  History& history = iterator->second;
+  if (history.times.size() < gfx::PROFILER_HISTORY_FRAMES) {
+    history.times.push_back(time);
+  } else {
+    history.times[history.next] = time;
+    history.next = (history.next + 1) % gfx::PROFILER_HISTORY_FRAMES;
+  }
+}
+
+gfx::ProfilerStatistics gfx::Profiler::ComputeStatistics(
+    std::unordered_map<std::string, History>& histories, std::string name) {
+  auto iterator = histories.find(name);
+  if (iterator == histories.end() || iterator->second.times.empty()) {
+    return gfx::ProfilerStatistics{0.0, 0.0, 0.0, 0};
+  }
+  std::vector<double> times = iterator->second.times;
+  std::sort(times.begin(), times.end());
+  double sum = 0.0;
+  for (double time : times) {
+    sum += time;
+  }
+  size_t p99_index = (size_t)std::ceil(0.99 * (double)times.size()) - 1;
+  return gfx::ProfilerStatistics{times.front(), sum / (double)times.size(), times[p99_index],
+      (unsigned int)times.size()};
+}
+
+void gfx::Profiler::ResetStatistics() {
+  for (GpuFrame& frame : gpu_frames) {
+    frame.pending = false;
+  }
+  for (auto& entry : cpu_histories) {
+    entry.second.times.clear();
+    entry.second.next = 0;
+  }
+  for (auto& entry : gpu_histories) {
+    entry.second.times.clear();
+    entry.second.next = 0;
+  }
+}
+
+gfx::ProfilerStatistics gfx::Profiler::GetCpuStatistics(std::string name) {
+  return ComputeStatistics(cpu_histories, name);
+}
+
+gfx::ProfilerStatistics gfx::Profiler::GetGpuStatistics(std::string name) {
+  return ComputeStatistics(gpu_histories, name);
+}
+
+std::vector<std::string> gfx::Profiler::GetCpuScopeNames() {
+  return cpu_scope_names;
+}
+
+std::vector<std::string> gfx::Profiler::GetGpuScopeNames() {
+  return gpu_scope_names;
+}
+
+double gfx::Profiler::GetGpuFrameTime() {
+  return gpu_frame_time;
+}
+
+const gfx::FrameGlStats& gfx::Profiler::GetGlStats() {
+  return gl_stats;
+}
+
+void gfx::Profiler::CaptureFrames(unsigned int frame_count) {
+  captured_cpu_events.clear();
+  captured_gpu_events.clear();
+  for (GpuFrame& frame : gpu_frames) {
+    frame.captured = false;
+  }
+  frames_to_capture = frame_count;
+}
+
+bool gfx::Profiler::IsCaptureComplete() {
+  if (frames_to_capture > 0 || capturing_frame) {
+    return false;
+  }
+  for (GpuFrame& frame : gpu_frames) {
+    if (frame.pending && frame.captured) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void gfx::Profiler::WriteChromeTrace(std::string path) {
+  std::ofstream file(path);
+  if (!file) {
+    throw gfx::CannotWriteTraceException();
+  }
+  // Complete ("X") events on the same thread nest by time, so CPU scopes show up under their
+  // frames without recording the hierarchy.
+  file << "{\"traceEvents\":[" << std::endl;
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},"
+      << std::endl;
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+  const std::vector<Event>* tracks[] = {&captured_cpu_events, &captured_gpu_events};
+  file.setf(std::ios::fixed);
+  file.precision(3);
+  for (int tid = 0; tid < 2; tid++) {
+    for (const Event& event : *tracks[tid]) {
+      file << "," << std::endl << "{\"name\":\"" << event.name << "\",\"cat\":\"" <<
+          (tid == 0 ? "cpu" : "gpu") << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid <<
+          ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+    }
+  }
+  file << std::endl << "]}" << std::endl;
+  if (!file) {
+    throw gfx::CannotWriteTraceException();
+  }
+}
+
+gfx::ProfileScope::ProfileScope(gfx::Profiler* profiler, const char* name, bool is_gpu) :
+    profiler{profiler}, is_gpu{is_gpu} {
+  profiler->BeginCpuScope(name);
+  if (is_gpu) {
+    profiler->BeginGpuScope(name);
+  }
+}
+
+gfx::ProfileScope::~ProfileScope() {
+  if (is_gpu) {
+    profiler->EndGpuScope();
+  }
+  profiler->EndCpuScope();
+}
@@ -0,0 +1,353 @@
+#include "gfx/exceptions.h"
+#include "gfx/render_graph.h"
+
+#include <algorithm>
+
+gfx::RenderGraph::RenderGraph() : memory{0, 0, 0, 0} {}
+
+gfx::RenderGraph::~RenderGraph() {
+  for (auto& framebuffer : framebuffers) {
+    glDeleteFramebuffers(1, &framebuffer.second);
+  }
+  for (PhysicalTarget& physical_target : physical_targets) {
+    Free(physical_target.description, physical_target.handle);
+  }
+}
+
+void gfx::RenderGraph::Reset() {
+  render_targets.clear();
+  passes.clear();
+}
+
+unsigned int gfx::RenderGraph::CreateRenderTarget(const char* name,
+    gfx::RenderTargetDescription description) {
+  if (description.target == GL_TEXTURE_2D) {
+    description.samples = 1;
+  }
+  render_targets.push_back(RenderTarget{name, description, false, 0, 1, 0});
+  return render_targets.size() - 1;
+}
+
+unsigned int gfx::RenderGraph::ImportRenderTarget(const char* name) {
+  render_targets.push_back(RenderTarget{name, gfx::RenderTargetDescription{GL_NONE, GL_NONE, 0, 0,
+      0}, true, 0, 1, 0});
+  return render_targets.size() - 1;
+}
+
+unsigned int gfx::RenderGraph::AddPass(const char* name, std::function<void()> execute) {
+  passes.push_back(Pass{name, execute, {}, {}, false, false, 0, {}});
+  return passes.size() - 1;
+}
+
+void gfx::RenderGraph::Read(unsigned int pass, unsigned int render_target) {
+  if (pass >= passes.size() || render_target >= render_targets.size()) {
+    throw gfx::InvalidRenderGraphException();
+  }
+  passes[pass].reads.push_back(render_target);
+}
+
+void gfx::RenderGraph::Write(unsigned int pass, unsigned int render_target, GLenum attachment) {
+  if (pass >= passes.size() || render_target >= render_targets.size() ||
+      (render_targets[render_target].imported && attachment != GL_NONE)) {
+    throw gfx::InvalidRenderGraphException();
+  }
+  passes[pass].writes.push_back(std::make_pair(attachment, render_target));
+}
+
+void gfx::RenderGraph::SetSideEffects(unsigned int pass) {
+  if (pass >= passes.size()) {
+    throw gfx::InvalidRenderGraphException();
+  }
+  passes[pass].side_effects = true;
+}
+
+void gfx::RenderGraph::Compile() {
+  CullPasses();
+  AssignPhysicalTargets();
+  CreateFramebuffers();
+}
+
+void gfx::RenderGraph::CullPasses() {
+  // Walk the passes backwards, keeping a pass if a later live pass reads what it writes.
+  std::vector<bool> read_later(render_targets.size(), false);
+  for (unsigned int i = passes.size(); i-- > 0;) {
+    Pass& pass = passes[i];
+    pass.culled = !pass.side_effects;
+    for (auto& write : pass.writes) {
+      if (read_later[write.second] || render_targets[write.second].imported) {
+        pass.culled = false;
+      }
+    }
+    if (!pass.culled) {
+      for (unsigned int render_target : pass.reads) {
+        read_later[render_target] = true;
+      }
+    }
+  }
+
+  for (RenderTarget& render_target : render_targets) {
+    render_target.first_pass = 1;
+    render_target.last_pass = 0;
+  }
+  for (unsigned int i = 0; i < passes.size(); i++) {
+    if (passes[i].culled) {
+      continue;
+    }
+    std::vector<unsigned int> used = passes[i].reads;
+    for (auto& write : passes[i].writes) {
+      used.push_back(write.second);
+    }
+    for (unsigned int index : used) {
+      RenderTarget& render_target = render_targets[index];
+      if (render_target.first_pass > render_target.last_pass) {
+        render_target.first_pass = i;
+      }
+      render_target.last_pass = i;
+    }
+  }
+}
+
+void gfx::RenderGraph::AssignPhysicalTargets() {
+  for (PhysicalTarget& physical_target : physical_targets) {
+    physical_target.assigned = false;
+  }
+  memory = gfx::RenderGraphMemory{0, 0, 0, 0};
+
+  // Render targets are assigned in the order they are first used, each to the first matching
+  // physical target whose last pass is before its first. Physical targets from the previous
+  // compile are reused before new ones are allocated.
+  std::vector<unsigned int> order;
+  for (unsigned int i = 0; i < render_targets.size(); i++) {
+    const RenderTarget& render_target = render_targets[i];
+    if (!render_target.imported && render_target.first_pass <= render_target.last_pass) {
+      order.push_back(i);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+    return render_targets[a].first_pass < render_targets[b].first_pass;
+  });
+  for (unsigned int index : order) {
+    RenderTarget& render_target = render_targets[index];
+    unsigned int chosen = physical_targets.size();
+    for (unsigned int i = 0; i < physical_targets.size(); i++) {
+      PhysicalTarget& physical_target = physical_targets[i];
+      if (IsAliasable(physical_target.description, render_target.description) &&
+          (!physical_target.assigned || physical_target.last_pass < render_target.first_pass)) {
+        chosen = i;
+        break;
+      }
+    }
+    if (chosen == physical_targets.size()) {
+      physical_targets.push_back(PhysicalTarget{render_target.description,
+          Allocate(render_target.description), false, 0});
+    }
+    physical_targets[chosen].assigned = true;
+    physical_targets[chosen].last_pass = render_target.last_pass;
+    render_target.physical_target = chosen;
+    memory.unaliased_bytes += GetSize(render_target.description);
+    memory.transient_targets++;
+  }
+
+  // Free the physical targets nothing was assigned to, remapping the indices of the rest.
+  std::vector<unsigned int> remapped(physical_targets.size());
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < physical_targets.size(); i++) {
+    if (physical_targets[i].assigned) {
+      remapped[i] = kept;
+      physical_targets[kept++] = physical_targets[i];
+    } else {
+      Free(physical_targets[i].description, physical_targets[i].handle);
+    }
+  }
+  physical_targets.resize(kept);
+  for (unsigned int index : order) {
+    render_targets[index].physical_target = remapped[render_targets[index].physical_target];
+  }
+  for (PhysicalTarget& physical_target : physical_targets) {
+    memory.aliased_bytes += GetSize(physical_target.description);
+    memory.physical_targets++;
+  }
+}
+
+void gfx::RenderGraph::CreateFramebuffers() {
+  // The physical targets may have changed, so start over.
+  for (auto& framebuffer : framebuffers) {
+    glDeleteFramebuffers(1, &framebuffer.second);
+  }
+  framebuffers.clear();
+
+  for (Pass& pass : passes) {
+    pass.framebuffer = 0;
+    pass.draw_buffers.clear();
+    std::vector<std::pair<GLenum, GLuint>> attachments;
+    for (auto& write : pass.writes) {
+      if (write.first != GL_NONE) {
+        attachments.push_back(std::make_pair(write.first, write.second));
+      }
+    }
+    if (pass.culled || attachments.empty()) {
+      continue;
+    }
+    std::sort(attachments.begin(), attachments.end());
+    for (auto& attachment : attachments) {
+      // Each fragment output i is written to GL_COLOR_ATTACHMENTi, even if there are gaps.
+      if (attachment.first >= GL_COLOR_ATTACHMENT0 && attachment.first <= GL_COLOR_ATTACHMENT15) {
+        pass.draw_buffers.resize(attachment.first - GL_COLOR_ATTACHMENT0 + 1, GL_NONE);
+        pass.draw_buffers.back() = attachment.first;
+      }
+      attachment.second = physical_targets[render_targets[attachment.second].physical_target]
+          .handle;
+    }
+
+    auto it = framebuffers.find(attachments);
+    if (it != framebuffers.end()) {
+      pass.framebuffer = it->second;
+      continue;
+    }
+    glGenFramebuffers(1, &pass.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+    for (auto& write : pass.writes) {
+      if (write.first == GL_NONE) {
+        continue;
+      }
+      const RenderTarget& render_target = render_targets[write.second];
+      GLuint handle = physical_targets[render_target.physical_target].handle;
+      if (render_target.description.target == GL_RENDERBUFFER) {
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, write.first, GL_RENDERBUFFER, handle);
+      } else {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, write.first, render_target.description.target,
+            handle, 0);
+      }
+    }
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    framebuffers[attachments] = pass.framebuffer;
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      throw gfx::InvalidRenderGraphException();
+    }
+  }
+}
+
+void gfx::RenderGraph::Execute(gfx::Profiler* profiler) {
+  for (Pass& pass : passes) {
+    if (pass.culled) {
+      continue;
+    }
+    gfx::ProfileScope scope(profiler, pass.name, true);
+    if (pass.framebuffer != 0) {
+      glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+      if (pass.draw_buffers.empty()) {
+        glDrawBuffer(GL_NONE);
+      } else {
+        glDrawBuffers(pass.draw_buffers.size(), pass.draw_buffers.data());
+      }
+    }
+    pass.execute();
+  }
+}
+
+GLuint gfx::RenderGraph::GetHandle(unsigned int render_target) {
+  const RenderTarget& target = render_targets.at(render_target);
+  if (target.imported || target.first_pass > target.last_pass) {
+    return 0;
+  }
+  return physical_targets[target.physical_target].handle;
+}
+
+GLuint gfx::RenderGraph::GetFramebuffer(unsigned int pass) {
+  return passes.at(pass).framebuffer;
+}
+
+bool gfx::RenderGraph::IsPassCulled(unsigned int pass) {
+  return passes.at(pass).culled;
+}
+
+gfx::RenderGraphMemory gfx::RenderGraph::GetMemory() {
+  return memory;
+}
+
+size_t gfx::RenderGraph::GetSize(const gfx::RenderTargetDescription& description) {
+  size_t bytes_per_sample;
+  switch (description.internal_format) {
+    case GL_R8:
+      bytes_per_sample = 1;
+      break;
+    case GL_RG8:
+    case GL_R16F:
+    case GL_DEPTH_COMPONENT16:
+      bytes_per_sample = 2;
+      break;
+    case GL_RGBA16F:
+    case GL_RG32F:
+    case GL_DEPTH32F_STENCIL8:
+      bytes_per_sample = 8;
+      break;
+    case GL_RGBA32F:
+      bytes_per_sample = 16;
+      break;
+    default:
+      // GL_RGBA8, GL_RG16F, GL_R32F, GL_R11F_G11F_B10F, GL_DEPTH_COMPONENT24,
+      // GL_DEPTH24_STENCIL8, and the like.
+      bytes_per_sample = 4;
+      break;
+  }
+  return bytes_per_sample * description.width * description.height *
+      std::max(description.samples, 1u);
+}
+
+bool gfx::RenderGraph::IsAliasable(const gfx::RenderTargetDescription& a,
+    const gfx::RenderTargetDescription& b) {
+  return a.target == b.target && a.internal_format == b.internal_format && a.width == b.width &&
+      a.height == b.height && a.samples == b.samples;
+}
+
+GLuint gfx::RenderGraph::Allocate(const gfx::RenderTargetDescription& description) {
+  GLuint handle;
+  if (description.target == GL_RENDERBUFFER) {
+    glGenRenderbuffers(1, &handle);
+    glBindRenderbuffer(GL_RENDERBUFFER, handle);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, description.samples,
+        description.internal_format, description.width, description.height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    return handle;
+  }
+
+  glGenTextures(1, &handle);
+  glBindTexture(description.target, handle);
+  if (description.target == GL_TEXTURE_2D_MULTISAMPLE) {
+    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, description.samples,
+        description.internal_format, description.width, description.height, GL_TRUE);
+  } else {
+    // The format and type only describe the (absent) data, but must still match the internal
+    // format's kind.
+    GLenum format = GL_RGBA;
+    GLenum type = GL_FLOAT;
+    if (description.internal_format == GL_DEPTH24_STENCIL8) {
+      format = GL_DEPTH_STENCIL;
+      type = GL_UNSIGNED_INT_24_8;
+    } else if (description.internal_format == GL_DEPTH32F_STENCIL8) {
+      format = GL_DEPTH_STENCIL;
+      type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+    } else if (description.internal_format == GL_DEPTH_COMPONENT16 ||
+        description.internal_format == GL_DEPTH_COMPONENT24 ||
+        description.internal_format == GL_DEPTH_COMPONENT32F) {
+      format = GL_DEPTH_COMPONENT;
+    }
+    glTexImage2D(GL_TEXTURE_2D, 0, description.internal_format, description.width,
+        description.height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(description.target, 0);
+  return handle;
+}
+
+void gfx::RenderGraph::Free(const gfx::RenderTargetDescription& description, GLuint handle) {
+  if (description.target == GL_RENDERBUFFER) {
+    glDeleteRenderbuffers(1, &handle);
+  } else {
+    glDeleteTextures(1, &handle);
+  }
+}
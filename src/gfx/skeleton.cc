@@ -0,0 +1,120 @@
+#include "gfx/exceptions.h"
+#include "gfx/skeleton.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+gfx::Pose::Pose() : num_joints{0} {}
+
+gfx::Pose::Pose(size_t num_joints) : num_joints{num_joints} {
+  JointBlock identity;
+  std::memset(&identity, 0, sizeof(identity));
+  for (unsigned int lane = 0; lane < 4; lane++) {
+    identity.rotations[0][lane] = 1.0f;
+    for (unsigned int i = 0; i < 3; i++) {
+      identity.scales[i][lane] = 1.0f;
+    }
+  }
+  blocks.resize((num_joints + 3) / 4, identity);
+}
+
+size_t gfx::Pose::GetNumJoints() const {
+  return num_joints;
+}
+
+void gfx::Pose::SetJoint(unsigned int joint, glm::vec3 translation, glm::quat rotation,
+    glm::vec3 scale) {
+  JointBlock& block = blocks[joint / 4];
+  unsigned int lane = joint % 4;
+  for (unsigned int i = 0; i < 3; i++) {
+    block.translations[i][lane] = translation[i];
+    block.scales[i][lane] = scale[i];
+  }
+  block.rotations[0][lane] = rotation.w;
+  block.rotations[1][lane] = rotation.x;
+  block.rotations[2][lane] = rotation.y;
+  block.rotations[3][lane] = rotation.z;
+}
+
+glm::vec3 gfx::Pose::GetTranslation(unsigned int joint) const {
+  const JointBlock& block = blocks[joint / 4];
+  unsigned int lane = joint % 4;
+  return glm::vec3(block.translations[0][lane], block.translations[1][lane],
+      block.translations[2][lane]);
+}
+
+glm::quat gfx::Pose::GetRotation(unsigned int joint) const {
+  const JointBlock& block = blocks[joint / 4];
+  unsigned int lane = joint % 4;
+  return glm::quat(block.rotations[0][lane], block.rotations[1][lane], block.rotations[2][lane],
+      block.rotations[3][lane]);
+}
+
+glm::vec3 gfx::Pose::GetScale(unsigned int joint) const {
+  const JointBlock& block = blocks[joint / 4];
+  unsigned int lane = joint % 4;
+  return glm::vec3(block.scales[0][lane], block.scales[1][lane], block.scales[2][lane]);
+}
+
+gfx::Skeleton::Skeleton(std::vector<unsigned int> parents, gfx::Pose bind_pose) :
+    parents{parents}, bind_pose{bind_pose}, bounds_padding{0.0f} {
+  if (parents.size() > gfx::MAX_SKIN_JOINTS || bind_pose.GetNumJoints() != parents.size()) {
+    throw gfx::InvalidSkeletonException();
+  }
+  std::vector<glm::mat4> bind_transforms;
+  for (unsigned int joint = 0; joint < parents.size(); joint++) {
+    unsigned int parent = parents[joint];
+    if (parent != gfx::JOINT_NO_PARENT && parent >= joint) {
+      throw gfx::InvalidSkeletonException();
+    }
+    glm::mat4 local_transform = glm::translate(glm::mat4(), bind_pose.GetTranslation(joint)) *
+        glm::mat4_cast(bind_pose.GetRotation(joint)) *
+        glm::scale(glm::mat4(), bind_pose.GetScale(joint));
+    bind_transforms.push_back(parent == gfx::JOINT_NO_PARENT ? local_transform :
+        bind_transforms[parent] * local_transform);
+    inverse_bind_transforms.push_back(glm::inverse(bind_transforms.back()));
+  }
+}
+
+size_t gfx::Skeleton::GetNumJoints() {
+  return parents.size();
+}
+
+unsigned int gfx::Skeleton::GetParent(unsigned int joint) {
+  return parents[joint];
+}
+
+const gfx::Pose& gfx::Skeleton::GetBindPose() {
+  return bind_pose;
+}
+
+glm::mat4 gfx::Skeleton::GetInverseBindTransform(unsigned int joint) {
+  return inverse_bind_transforms[joint];
+}
+
+void gfx::Skeleton::FitBoundsPadding(const std::vector<gfx::Vertex>& vertices,
+    const std::vector<gfx::SkinVertex>& skin) {
+  std::vector<glm::vec3> joint_positions;
+  for (glm::mat4& inverse_bind_transform : inverse_bind_transforms) {
+    joint_positions.push_back(glm::vec3(glm::inverse(inverse_bind_transform)[3]));
+  }
+  float padding = 0.0f;
+  for (size_t i = 0; i < std::min(vertices.size(), skin.size()); i++) {
+    for (unsigned int influence = 0; influence < 4; influence++) {
+      unsigned int joint = skin[i].joints[influence];
+      if (skin[i].weights[influence] == 0) {
+        continue;
+      } else if (joint >= parents.size()) {
+        throw gfx::InvalidSkeletonException();
+      }
+      padding = std::max(padding, glm::length(vertices[i].position - joint_positions[joint]));
+    }
+  }
+  bounds_padding = padding;
+}
+
+float gfx::Skeleton::GetBoundsPadding() {
+  return bounds_padding;
+}
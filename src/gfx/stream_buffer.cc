@@ -0,0 +1,96 @@
+#include "gfx/exceptions.h"
+#include "gfx/stream_buffer.h"
+
+#include <chrono>
+#include <cstring>
+
+gfx::StreamBuffer::StreamBuffer(GLenum target, size_t region_size) : buffer_handle{0},
+    target{target}, region_size{region_size}, alignment{1}, region{0}, mapped{nullptr},
+    written{0}, wait_time{0.0} {
+  for (unsigned int i = 0; i < gfx::STREAM_BUFFER_FRAMES; i++) {
+    fences[i] = nullptr;
+  }
+  if (target == GL_UNIFORM_BUFFER) {
+    GLint offset_alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+    alignment = offset_alignment;
+  }
+  glGenBuffers(1, &buffer_handle);
+  glBindBuffer(target, buffer_handle);
+  glBufferData(target, region_size * gfx::STREAM_BUFFER_FRAMES, nullptr, GL_STREAM_DRAW);
+  glBindBuffer(target, 0);
+}
+
+void gfx::StreamBuffer::BeginFrame() {
+  region = (region + 1) % gfx::STREAM_BUFFER_FRAMES;
+  wait_time = 0.0;
+  GLsync fence = fences[region];
+  if (fence != nullptr) {
+    // Usually the GPU finished with the region a couple of frames ago, so check without waiting
+    // before flushing and blocking.
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      auto start = std::chrono::steady_clock::now();
+      while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, gfx::STREAM_BUFFER_WAIT_TIMEOUT) ==
+          GL_TIMEOUT_EXPIRED) {}
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      wait_time = elapsed.count();
+    }
+    glDeleteSync(fence);
+    fences[region] = nullptr;
+  }
+
+  // The fence guarantees the GPU is done with the region, so the driver doesn't need to
+  // synchronize or preserve its contents.
+  glBindBuffer(target, buffer_handle);
+  mapped = (char*)glMapBufferRange(target, region * region_size, region_size, GL_MAP_WRITE_BIT |
+      GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+  glBindBuffer(target, 0);
+  written = 0;
+}
+
+size_t gfx::StreamBuffer::Allocate(size_t size) {
+  if (mapped == nullptr) {
+    throw gfx::BuffersNotYetMappedException();
+  }
+  size_t offset = (written + alignment - 1) / alignment * alignment;
+  if (offset + size > region_size) {
+    throw gfx::StreamBufferFullException();
+  }
+  written = offset + size;
+  return region * region_size + offset;
+}
+
+void* gfx::StreamBuffer::GetPointer(size_t offset) {
+  return mapped + (offset - region * region_size);
+}
+
+size_t gfx::StreamBuffer::Write(const void* data, size_t size) {
+  size_t offset = Allocate(size);
+  std::memcpy(GetPointer(offset), data, size);
+  return offset;
+}
+
+size_t gfx::StreamBuffer::GetAlignment() {
+  return alignment;
+}
+
+void gfx::StreamBuffer::Unmap() {
+  if (mapped == nullptr) {
+    throw gfx::BuffersNotYetMappedException();
+  }
+  glBindBuffer(target, buffer_handle);
+  if (written > 0) {
+    glFlushMappedBufferRange(target, 0, written);
+  }
+  glUnmapBuffer(target);
+  glBindBuffer(target, 0);
+  mapped = nullptr;
+}
+
+void gfx::StreamBuffer::EndFrame() {
+  fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+double gfx::StreamBuffer::GetWaitTime() {
+  return wait_time;
+}
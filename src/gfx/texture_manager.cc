@@ -1,5 +1,6 @@
 #define STB_IMAGE_IMPLEMENTATION
 
+#include "gfx/asset_pack.h"
 #include "gfx/exceptions.h"
 #include "gfx/texture_manager.h"
 
@@ -7,7 +8,10 @@
 
 #include <iostream>
 
-gfx::TextureManager::TextureManager() : path_to_id_map() {}
+gfx::TextureManager::TextureManager() : TextureManager(true) {}
+
+gfx::TextureManager::TextureManager(bool should_upload) : path_to_id_map(), path_to_linear_map(),
+    should_upload{should_upload}, next_handle{1} {}
 
 GLuint gfx::TextureManager::GetTextureHandle(std::string path, bool convert_to_linear) {
   // If we have already loaded this texture, simply return the cached ID.
@@ -18,11 +22,92 @@ GLuint gfx::TextureManager::GetTextureHandle(std::string path, bool convert_to_l
 
   // Load the image.
   int width, height, num_components;
-  unsigned char* image_data = stbi_load(path.c_str(), &width, &height, &num_components, 0);
-  if (image_data == nullptr || (num_components != 3 && num_components != 4)) {
+  unsigned char* image_data = DecodeImage(path, &width, &height, &num_components);
+  if (image_data == nullptr) {
     throw gfx::CannotLoadTextureException();
   }
-  GLenum image_format = num_components == 4 ? GL_RGBA : GL_RGB;
+  return UploadTexture(path, image_data, width, height, num_components, convert_to_linear);
+}
+
+void gfx::TextureManager::LoadTextures(const std::vector<std::pair<std::string, bool>>& textures,
+    gfx::JobSystem* job_system) {
+  struct Image {
+    unsigned char* data;
+    int width;
+    int height;
+    int num_components;
+  };
+  std::vector<Image> images(textures.size(), Image{nullptr, 0, 0, 0});
+  std::unordered_set<std::string> pending_paths;
+  gfx::JobCounter counter;
+  for (size_t i = 0; i < textures.size(); i++) {
+    const std::string& path = textures[i].first;
+    if (path_to_id_map.count(path) != 0 || !pending_paths.insert(path).second) {
+      continue;
+    }
+    job_system->Run([this, &textures, &images, &counter, job_system, i]() {
+      Image& image = images[i];
+      image.data = DecodeImage(textures[i].first, &image.width, &image.height,
+          &image.num_components);
+      if (image.data == nullptr) {
+        return;
+      }
+      // Post the upload before this job finishes so the counter can't reach zero in between.
+      job_system->RunOnMainThread([this, &textures, &images, i]() {
+        Image& image = images[i];
+        UploadTexture(textures[i].first, image.data, image.width, image.height,
+            image.num_components, textures[i].second);
+        image.data = nullptr;
+      }, &counter);
+    }, &counter);
+  }
+  job_system->Wait(&counter);
+
+  // Only the images that failed to load are left.
+  bool failed = false;
+  for (size_t i = 0; i < textures.size(); i++) {
+    const std::string& path = textures[i].first;
+    if (pending_paths.count(path) != 0 && path_to_id_map.count(path) == 0) {
+      FreeImage(images[i].data);
+      failed = true;
+    }
+  }
+  if (failed) {
+    throw gfx::CannotLoadTextureException();
+  }
+}
+
+unsigned char* gfx::TextureManager::DecodeImage(std::string path, int* width, int* height,
+    int* num_components) {
+  // Decode the image out of a mounted pack if one has it, and from the loose file otherwise.
+  gfx::AssetData asset;
+  unsigned char* image_data;
+  try {
+    image_data = gfx::AssetPack::ReadMounted(path, &asset) ?
+        stbi_load_from_memory(asset.data, (int)asset.size, width, height, num_components, 0) :
+        stbi_load(path.c_str(), width, height, num_components, 0);
+  } catch (const gfx::InvalidAssetPackException&) {
+    return nullptr;
+  }
+  if (image_data != nullptr && *num_components != 3 && *num_components != 4) {
+    stbi_image_free(image_data);
+    return nullptr;
+  }
+  return image_data;
+}
+
+void gfx::TextureManager::FreeImage(unsigned char* image_data) {
+  stbi_image_free(image_data);
+}
+
+GLuint gfx::TextureManager::UploadTexture(std::string path, unsigned char* image_data, int width,
+    int height, int num_components, bool convert_to_linear) {
+  if (!should_upload) {
+    FreeImage(image_data);
+    path_to_id_map[path] = next_handle;
+    path_to_linear_map[path] = convert_to_linear;
+    return next_handle++;
+  }
 
   // Transfer the texture to OpenGL.
   GLuint texture;
@@ -32,23 +117,64 @@ GLuint gfx::TextureManager::GetTextureHandle(std::string path, bool convert_to_l
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  TransferImage(image_data, width, height, num_components, convert_to_linear);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  path_to_id_map[path] = texture;
+  path_to_linear_map[path] = convert_to_linear;
+  return texture;
+}
 
+void gfx::TextureManager::TransferImage(unsigned char* image_data, int width, int height,
+    int num_components, bool convert_to_linear) {
+  GLenum image_format = num_components == 4 ? GL_RGBA : GL_RGB;
   GLenum engine_format = convert_to_linear ? GL_SRGB : GL_RGB;
   glTexImage2D(GL_TEXTURE_2D, 0, engine_format, width, height, 0, image_format, GL_UNSIGNED_BYTE,
       image_data);
   glGenerateMipmap(GL_TEXTURE_2D);
-  stbi_image_free(image_data);
+  FreeImage(image_data);
+}
+
+bool gfx::TextureManager::ReloadTexture(std::string path) {
+  auto path_it = path_to_id_map.find(path);
+  if (path_it == path_to_id_map.end()) {
+    return false;
+  }
+  int width, height, num_components;
+  unsigned char* image_data = DecodeImage(path, &width, &height, &num_components);
+  if (image_data == nullptr) {
+    throw gfx::CannotLoadTextureException();
+  }
+  if (!should_upload) {
+    FreeImage(image_data);
+    return true;
+  }
+  // Respecifying the image keeps the handle, and with it every Material's reference to it.
+  glBindTexture(GL_TEXTURE_2D, path_it->second);
+  TransferImage(image_data, width, height, num_components, path_to_linear_map[path]);
   glBindTexture(GL_TEXTURE_2D, 0);
-  path_to_id_map[path] = texture;
-  return texture;
+  return true;
+}
+
+bool gfx::TextureManager::GetTextureSource(GLuint id, std::string* path, bool* convert_to_linear) {
+  for (auto it = path_to_id_map.begin(); it != path_to_id_map.end(); ++it) {
+    if (it->second == id) {
+      *path = it->first;
+      *convert_to_linear = path_to_linear_map[it->first];
+      return true;
+    }
+  }
+  return false;
 }
 
 void gfx::TextureManager::FreeTexture(GLuint id) {
   for (auto it = path_to_id_map.begin(); it != path_to_id_map.end(); ++it) {
     if (it->second == id) {
+      path_to_linear_map.erase(it->first);
       path_to_id_map.erase(it);
       break;
     }
   }
-  glDeleteTextures(1, &id);
+  if (should_upload) {
+    glDeleteTextures(1, &id);
+  }
 }
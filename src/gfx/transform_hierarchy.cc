@@ -0,0 +1,384 @@
+#include "gfx/exceptions.h"
+#include "gfx/transform_hierarchy.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// The transform of a slot that is only padding to the start of the next depth's block.
+const unsigned int EMPTY_SLOT = 0xFFFFFFFF;
+
+// The world transform roots are parented to, laid out like TransformBlock::world_transforms.
+const float IDENTITY_TRANSFORM[12][4] = {
+    {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f},
+    {0.0f, 0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f},
+    {0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f},
+    {0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}};
+
+// The values of one component of the four transforms in a block, with the arithmetic Update
+// needs. This is an SSE register when SSE2 is available and a plain array otherwise.
+#ifdef __SSE2__
+
+typedef __m128 Lanes;
+
+inline Lanes Load(const float* values) { return _mm_loadu_ps(values); }
+inline void Store(float* values, Lanes lanes) { _mm_storeu_ps(values, lanes); }
+inline Lanes Broadcast(float value) { return _mm_set1_ps(value); }
+inline Lanes Gather(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes Subtract(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes Multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes Divide(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+
+#else
+
+struct Lanes {
+  float values[4];
+};
+
+inline Lanes Load(const float* values) {
+  Lanes lanes;
+  std::memcpy(lanes.values, values, sizeof(lanes.values));
+  return lanes;
+}
+
+inline void Store(float* values, Lanes lanes) {
+  std::memcpy(values, lanes.values, sizeof(lanes.values));
+}
+
+inline Lanes Broadcast(float value) { return Lanes{{value, value, value, value}}; }
+inline Lanes Gather(float a, float b, float c, float d) { return Lanes{{a, b, c, d}}; }
+
+#define GFX_LANES_OPERATOR(name, op) \
+  inline Lanes name(Lanes a, Lanes b) { \
+    return Lanes{{a.values[0] op b.values[0], a.values[1] op b.values[1], \
+        a.values[2] op b.values[2], a.values[3] op b.values[3]}}; \
+  }
+GFX_LANES_OPERATOR(Add, +)
+GFX_LANES_OPERATOR(Subtract, -)
+GFX_LANES_OPERATOR(Multiply, *)
+GFX_LANES_OPERATOR(Divide, /)
+#undef GFX_LANES_OPERATOR
+
+#endif
+
+}
+
+gfx::TransformHierarchy::TransformHierarchy() : is_sorted{true} {}
+
+unsigned int gfx::TransformHierarchy::AddTransform(unsigned int parent) {
+  unsigned int transform = parents.size();
+  if (parent != gfx::TRANSFORM_NO_PARENT && parent >= transform) {
+    throw gfx::InvalidTransformParentException();
+  }
+  // Append the transform after the sorted ones. The next Update moves it to its depth.
+  unsigned int slot = slot_transforms.size();
+  if (slot % 4 == 0) {
+    blocks.push_back(CreateIdentityBlock());
+  }
+  slot_transforms.push_back(transform);
+  slots.push_back(slot);
+  parents.push_back(parent);
+  dirty.push_back(1);
+  revisions.push_back(0);
+  is_sorted = false;
+  return transform;
+}
+
+void gfx::TransformHierarchy::SetParent(unsigned int transform, unsigned int parent) {
+  if (parent != gfx::TRANSFORM_NO_PARENT && parent >= transform) {
+    throw gfx::InvalidTransformParentException();
+  }
+  parents[transform] = parent;
+  dirty[transform] = 1;
+  is_sorted = false;
+}
+
+unsigned int gfx::TransformHierarchy::GetParent(unsigned int transform) {
+  return parents[transform];
+}
+
+void gfx::TransformHierarchy::SetPosition(unsigned int transform, glm::vec3 position) {
+  TransformBlock& block = blocks[slots[transform] / 4];
+  unsigned int lane = slots[transform] % 4;
+  for (unsigned int i = 0; i < 3; i++) {
+    block.positions[i][lane] = position[i];
+  }
+  dirty[transform] = 1;
+}
+
+void gfx::TransformHierarchy::SetRotation(unsigned int transform, glm::quat rotation) {
+  TransformBlock& block = blocks[slots[transform] / 4];
+  unsigned int lane = slots[transform] % 4;
+  block.rotations[0][lane] = rotation.w;
+  block.rotations[1][lane] = rotation.x;
+  block.rotations[2][lane] = rotation.y;
+  block.rotations[3][lane] = rotation.z;
+  dirty[transform] = 1;
+}
+
+void gfx::TransformHierarchy::SetScale(unsigned int transform, glm::vec3 scale) {
+  TransformBlock& block = blocks[slots[transform] / 4];
+  unsigned int lane = slots[transform] % 4;
+  for (unsigned int i = 0; i < 3; i++) {
+    block.scales[i][lane] = scale[i];
+  }
+  dirty[transform] = 1;
+}
+
+glm::vec3 gfx::TransformHierarchy::GetPosition(unsigned int transform) {
+  TransformBlock& block = blocks[slots[transform] / 4];
+  unsigned int lane = slots[transform] % 4;
+  return glm::vec3(block.positions[0][lane], block.positions[1][lane], block.positions[2][lane]);
+}
+
+glm::quat gfx::TransformHierarchy::GetRotation(unsigned int transform) {
+  TransformBlock& block = blocks[slots[transform] / 4];
+  unsigned int lane = slots[transform] % 4;
+  return glm::quat(block.rotations[0][lane], block.rotations[1][lane], block.rotations[2][lane],
+      block.rotations[3][lane]);
+}
+
+glm::vec3 gfx::TransformHierarchy::GetScale(unsigned int transform) {
+  TransformBlock& block = blocks[slots[transform] / 4];
+  unsigned int lane = slots[transform] % 4;
+  return glm::vec3(block.scales[0][lane], block.scales[1][lane], block.scales[2][lane]);
+}
+
+void gfx::TransformHierarchy::Update() {
+  if (!is_sorted) {
+    SortByDepth();
+  }
+  // Parents are added first, so their dirty flags are final by the time their children are reached.
+  size_t size = parents.size();
+  for (size_t i = 0; i < size; i++) {
+    if (parents[i] != gfx::TRANSFORM_NO_PARENT) {
+      dirty[i] |= dirty[parents[i]];
+    }
+  }
+  // The blocks of each depth come after those of the depth above, so every parent is finished by
+  // the time its children's block is updated.
+  for (size_t block = 0; block < blocks.size(); block++) {
+    size_t begin = block * 4;
+    size_t end = std::min(begin + 4, slot_transforms.size());
+    bool any_dirty = false;
+    for (size_t slot = begin; slot < end; slot++) {
+      unsigned int transform = slot_transforms[slot];
+      any_dirty = any_dirty || (transform != EMPTY_SLOT && dirty[transform]);
+    }
+    if (any_dirty) {
+      UpdateBlock(block);
+    }
+  }
+  if (size > 0) {
+    std::memset(dirty.data(), 0, size);
+  }
+}
+
+glm::mat4 gfx::TransformHierarchy::GetWorldTransform(unsigned int transform) {
+  TransformBlock& block = blocks[slots[transform] / 4];
+  unsigned int lane = slots[transform] % 4;
+  glm::mat4 world_transform;
+  for (unsigned int column = 0; column < 4; column++) {
+    for (unsigned int row = 0; row < 3; row++) {
+      world_transform[column][row] = block.world_transforms[column * 3 + row][lane];
+    }
+  }
+  return world_transform;
+}
+
+glm::mat4 gfx::TransformHierarchy::GetNormalTransform(unsigned int transform) {
+  TransformBlock& block = blocks[slots[transform] / 4];
+  unsigned int lane = slots[transform] % 4;
+  glm::mat4 normal_transform;
+  for (unsigned int column = 0; column < 3; column++) {
+    for (unsigned int row = 0; row < 3; row++) {
+      normal_transform[column][row] = block.normal_transforms[column * 3 + row][lane];
+    }
+  }
+  return normal_transform;
+}
+
+unsigned int gfx::TransformHierarchy::GetRevision(unsigned int transform) {
+  return revisions[transform];
+}
+
+size_t gfx::TransformHierarchy::GetSize() {
+  return parents.size();
+}
+
+gfx::TransformHierarchy::TransformBlock gfx::TransformHierarchy::CreateIdentityBlock() {
+  TransformBlock block;
+  std::memset(&block, 0, sizeof(block));
+  for (unsigned int lane = 0; lane < 4; lane++) {
+    block.rotations[0][lane] = 1.0f;
+    for (unsigned int i = 0; i < 3; i++) {
+      block.scales[i][lane] = 1.0f;
+    }
+  }
+  return block;
+}
+
+void gfx::TransformHierarchy::SortByDepth() {
+  // Parents are added first, so their depths are known by the time their children are reached.
+  size_t size = parents.size();
+  std::vector<unsigned int> depths(size);
+  unsigned int max_depth = 0;
+  for (size_t i = 0; i < size; i++) {
+    depths[i] = parents[i] == gfx::TRANSFORM_NO_PARENT ? 0 : depths[parents[i]] + 1;
+    max_depth = std::max(max_depth, depths[i]);
+  }
+
+  // Start each depth at a new block, so no block holds both a transform and its parent.
+  std::vector<size_t> next_slots(max_depth + 1, 0);
+  for (size_t i = 0; i < size; i++) {
+    next_slots[depths[i]]++;
+  }
+  size_t num_slots = 0;
+  for (unsigned int depth = 0; depth <= max_depth; depth++) {
+    size_t num_depth_slots = (next_slots[depth] + 3) / 4 * 4;
+    next_slots[depth] = num_slots;
+    num_slots += num_depth_slots;
+  }
+
+  // Move every transform into its slot, keeping the order they were added in within a depth.
+  // Each member of a block is a run of rows of four lanes, so a lane is copied row by row.
+  const size_t num_rows = sizeof(TransformBlock) / sizeof(float[4]);
+  std::vector<TransformBlock> sorted_blocks(num_slots / 4, CreateIdentityBlock());
+  std::vector<unsigned int> sorted_transforms(num_slots, EMPTY_SLOT);
+  for (size_t i = 0; i < size; i++) {
+    size_t slot = next_slots[depths[i]]++;
+    const float (*source)[4] = reinterpret_cast<const float (*)[4]>(&blocks[slots[i] / 4]);
+    float (*destination)[4] = reinterpret_cast<float (*)[4]>(&sorted_blocks[slot / 4]);
+    for (size_t row = 0; row < num_rows; row++) {
+      destination[row][slot % 4] = source[row][slots[i] % 4];
+    }
+    sorted_transforms[slot] = i;
+    slots[i] = slot;
+  }
+  blocks.swap(sorted_blocks);
+  slot_transforms.swap(sorted_transforms);
+  is_sorted = true;
+}
+
+void gfx::TransformHierarchy::UpdateBlock(size_t block_index) {
+  TransformBlock& block = blocks[block_index];
+  size_t begin = block_index * 4;
+  size_t end = std::min(begin + 4, slot_transforms.size());
+  unsigned int block_parents[4] = {gfx::TRANSFORM_NO_PARENT, gfx::TRANSFORM_NO_PARENT,
+      gfx::TRANSFORM_NO_PARENT, gfx::TRANSFORM_NO_PARENT};
+  for (size_t slot = begin; slot < end; slot++) {
+    if (slot_transforms[slot] != EMPTY_SLOT) {
+      block_parents[slot - begin] = parents[slot_transforms[slot]];
+    }
+  }
+
+  // Build the local rotation times scale from the quaternions, then add the translation.
+  Lanes one = Broadcast(1.0f);
+  Lanes two = Broadcast(2.0f);
+  Lanes w = Load(block.rotations[0]);
+  Lanes x = Load(block.rotations[1]);
+  Lanes y = Load(block.rotations[2]);
+  Lanes z = Load(block.rotations[3]);
+  Lanes xx = Multiply(x, x);
+  Lanes yy = Multiply(y, y);
+  Lanes zz = Multiply(z, z);
+  Lanes xy = Multiply(x, y);
+  Lanes xz = Multiply(x, z);
+  Lanes yz = Multiply(y, z);
+  Lanes wx = Multiply(w, x);
+  Lanes wy = Multiply(w, y);
+  Lanes wz = Multiply(w, z);
+  Lanes rotation[9] = {
+      Subtract(one, Multiply(two, Add(yy, zz))), Multiply(two, Add(xy, wz)),
+      Multiply(two, Subtract(xz, wy)), Multiply(two, Subtract(xy, wz)),
+      Subtract(one, Multiply(two, Add(xx, zz))), Multiply(two, Add(yz, wx)),
+      Multiply(two, Add(xz, wy)), Multiply(two, Subtract(yz, wx)),
+      Subtract(one, Multiply(two, Add(xx, yy)))};
+  Lanes scale[3];
+  Lanes local[12];
+  for (unsigned int column = 0; column < 3; column++) {
+    scale[column] = Load(block.scales[column]);
+    for (unsigned int row = 0; row < 3; row++) {
+      local[column * 3 + row] = Multiply(rotation[column * 3 + row], scale[column]);
+    }
+  }
+  for (unsigned int row = 0; row < 3; row++) {
+    local[9 + row] = Load(block.positions[row]);
+  }
+
+  // A block holds transforms of a single depth, so either all of them are roots or none are.
+  if (block_parents[0] == gfx::TRANSFORM_NO_PARENT) {
+    // The inverse transpose of a rotation times a scale is the rotation times the inverse scale.
+    for (unsigned int i = 0; i < 12; i++) {
+      Store(block.world_transforms[i], local[i]);
+    }
+    for (unsigned int column = 0; column < 3; column++) {
+      Lanes inverse_scale = Divide(one, scale[column]);
+      for (unsigned int row = 0; row < 3; row++) {
+        Store(block.normal_transforms[column * 3 + row],
+            Multiply(rotation[column * 3 + row], inverse_scale));
+      }
+    }
+  } else {
+    // Gather the parents' world transforms from the blocks of the depth above, using the identity
+    // for the padding lanes.
+    const float* parent_transforms[4];
+    unsigned int parent_lanes[4];
+    for (unsigned int lane = 0; lane < 4; lane++) {
+      unsigned int parent = block_parents[lane];
+      parent_transforms[lane] = parent != gfx::TRANSFORM_NO_PARENT ?
+          &blocks[slots[parent] / 4].world_transforms[0][0] : &IDENTITY_TRANSFORM[0][0];
+      parent_lanes[lane] = parent != gfx::TRANSFORM_NO_PARENT ? slots[parent] % 4 : 0;
+    }
+    Lanes parent[12];
+    for (unsigned int i = 0; i < 12; i++) {
+      parent[i] = Gather(parent_transforms[0][i * 4 + parent_lanes[0]],
+          parent_transforms[1][i * 4 + parent_lanes[1]],
+          parent_transforms[2][i * 4 + parent_lanes[2]],
+          parent_transforms[3][i * 4 + parent_lanes[3]]);
+    }
+
+    Lanes world[12];
+    for (unsigned int column = 0; column < 4; column++) {
+      for (unsigned int row = 0; row < 3; row++) {
+        Lanes value = column == 3 ? parent[9 + row] : Broadcast(0.0f);
+        for (unsigned int i = 0; i < 3; i++) {
+          value = Add(value, Multiply(parent[i * 3 + row], local[column * 3 + i]));
+        }
+        world[column * 3 + row] = value;
+        Store(block.world_transforms[column * 3 + row], value);
+      }
+    }
+
+    // Parents can shear their children, so use the cofactor matrix divided by the determinant.
+    // Its columns are the cross products of the other two columns of the world transform.
+    Lanes normal[9];
+    for (unsigned int column = 0; column < 3; column++) {
+      const Lanes* a = &world[((column + 1) % 3) * 3];
+      const Lanes* b = &world[((column + 2) % 3) * 3];
+      normal[column * 3 + 0] = Subtract(Multiply(a[1], b[2]), Multiply(a[2], b[1]));
+      normal[column * 3 + 1] = Subtract(Multiply(a[2], b[0]), Multiply(a[0], b[2]));
+      normal[column * 3 + 2] = Subtract(Multiply(a[0], b[1]), Multiply(a[1], b[0]));
+    }
+    Lanes inverse_determinant = Divide(one, Add(Add(Multiply(world[0], normal[0]),
+        Multiply(world[1], normal[1])), Multiply(world[2], normal[2])));
+    for (unsigned int i = 0; i < 9; i++) {
+      Store(block.normal_transforms[i], Multiply(normal[i], inverse_determinant));
+    }
+  }
+
+  // The transforms that weren't dirty were recomputed from unchanged inputs, so only count the
+  // dirty ones as changed.
+  for (size_t slot = begin; slot < end; slot++) {
+    unsigned int transform = slot_transforms[slot];
+    if (transform != EMPTY_SLOT) {
+      revisions[transform] += dirty[transform];
+    }
+  }
+}
@@ -51,3 +51,29 @@ void gfx::util::_CheckGlError(const char *file, int line) {
     error_enum = glGetError();
   }
 }
+
+glm::vec2 gfx::util::GetHammersleyPoint(unsigned int i, unsigned int count) {
+  // Hammersley calculation adapted from:
+  // http://www.math.uiuc.edu/~gfrancis/illimath/windows/aszgard_mini/pylibs/cgkit/hammersley.py
+  float u = 0.0f;
+  float p = 0.5f;
+  unsigned int k = i;
+  while (k > 0) {
+    if (k & 1) {
+      u += p;
+    }
+    p *= 0.5;
+    k = k >> 1;
+  }
+  float v = ((float)i + 0.5f) / (float)count;
+  return glm::vec2(u, v);
+}
+
+uint32_t gfx::util::Hash(uint32_t value) {
+  value ^= value >> 16;
+  value *= 0x7FEB352Du;
+  value ^= value >> 15;
+  value *= 0x846CA68Bu;
+  value ^= value >> 16;
+  return value;
+}